@@ -0,0 +1,320 @@
+// -----------------------------------------------------------------------------
+// UART rate negotiation (UCP_BAUD_SET) between the bridge and the firmware
+//
+// A pty stands in for the UART. On the master side a simulated firmware
+// answers UCP_HELLO, keep-alives and BAUD_SET, sends a report every 20 ms and falls
+// back to 115200 on its own after fallback_ms without a valid frame, like
+// uart_mutex.c. A pty carries bytes at any speed, so the simulation reads the
+// head's rate off the slave's termios and garbles every byte, both ways,
+// while the two rates differ. Cases:
+//   switch   : 921600 is accepted; time until the new rate is confirmed
+//   clamped  : 2000000 is asked for; the firmware's UCP_HELLO answer says
+//              921600 at most, which is proposed and accepted straight away
+//   refused  : firmware that predates UCP_HELLO is proposed 2000000 after
+//              the queries go unanswered and refuses; the link stays at 115200
+//   lost ack : the firmware switches but its answer is lost; the head keeps
+//              proposing until the firmware falls back, then switches
+//   broken   : the link stops working at 921600 some time after switching;
+//              both sides fall back and telemetry resumes at 115200
+// Each case prints PASS or FAIL; the exit status is 1 if any failed.
+// Usage: bench_baud_negotiation
+// -----------------------------------------------------------------------------
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bridge_rig.hpp"
+#include "ucp_hello.hpp"
+
+static const unsigned kSimMaxBaud = 921600;
+static const uint64_t kReportPeriodNs = 20 * 1000000ull;
+
+static unsigned speed_to_baud(speed_t speed) {
+  switch (speed) {
+    case B115200: return 115200;
+    case B230400: return 230400;
+    case B460800: return 460800;
+    case B921600: return 921600;
+    case B2000000: return 2000000;
+    default: return 0;
+  }
+}
+
+class SimFirmware {
+ public:
+  // `slave` is the head's side of the pty, opened again to read its rate.
+  // Without `hello` the firmware predates UCP_HELLO and skips it.
+  SimFirmware(int master, const char* slave, bool hello = true) : fd_(master), hello_(hello) {
+    probe_fd_ = open(slave, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    thread_ = std::thread([this] { run(); });
+  }
+  ~SimFirmware() {
+    done_ = true;
+    thread_.join();
+    if (probe_fd_ >= 0) close(probe_fd_);
+  }
+
+  std::atomic<int> lose_acks{0};           // Switch, but garble this many answers
+  std::atomic<bool> fast_broken{false};    // Nothing gets through above 115200
+  std::atomic<uint64_t> fallbacks{0};
+
+ private:
+  unsigned head_baud() {
+    struct termios tty;
+    if (tcgetattr(probe_fd_, &tty) != 0) return 0;
+    return speed_to_baud(cfgetospeed(&tty));
+  }
+
+  bool garbled() {
+    return head_baud() != baud_ || (baud_ > bridge::kDefaultBaud && fast_broken.load());
+  }
+
+  template <typename T>
+  void send(const T& msg, bool lose = false) {
+    uint8_t buf[ucp::Frame<T>::size()];
+    size_t n = encoder_.encode(msg, buf, sizeof(buf));
+    if (lose || garbled()) {
+      for (size_t i = 0; i < n; i++) buf[i] ^= 0xA5;
+    }
+    if (write(fd_, buf, n) != (ssize_t)n) perror("write");
+  }
+
+  void on_frame(const ucp::FrameView& f, uint64_t now) {
+    last_valid_ = now;
+    if (f.id() == UCP_HELLO && hello_ && f.as<ucp_hello_t>()) {
+      ucp::Capabilities caps;
+      caps.proto_version = UCP_PROTO_VERSION;
+      caps.max_baud = kSimMaxBaud;
+      uint8_t buf[ucp::Frame<ucp_hello_ack_t>::size()];
+      size_t n = ucp::encode_hello_ack(encoder_, caps, buf, sizeof(buf));
+      if (garbled()) {
+        for (size_t i = 0; i < n; i++) buf[i] ^= 0xA5;
+      }
+      if (write(fd_, buf, n) != (ssize_t)n) perror("write");
+    } else if (f.id() == UCP_KEEP_ALIVE && f.as<ucp_alive_ping_t>()) {
+      ucp_alive_pong_t pong;
+      memset(&pong, 0, sizeof(pong));
+      send(pong);
+    } else if (f.id() == UCP_BAUD_SET) {
+      const ucp_baud_set_t* req = f.as<ucp_baud_set_t>();
+      if (!req) return;
+      ucp_baud_set_ack_t ack;
+      memset(&ack, 0, sizeof(ack));
+      ack.baud = req->baud;
+      ack.err = req->baud <= kSimMaxBaud ? UCP_ERR_OK : UCP_ERR_UNKNOWN;
+      bool lose = ack.err == UCP_ERR_OK && lose_acks.fetch_sub(1) > 0;
+      send(ack, lose);
+      if (ack.err != UCP_ERR_OK) return;
+      usleep(2000);  // As the firmware: let the answer leave, then switch
+      baud_ = req->baud;
+      fallback_ns_ = req->fallback_ms * 1000000ull;
+    }
+  }
+
+  void run() {
+    ucp::Decoder decoder;
+    uint8_t buf[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    uint64_t next_report = bench::now_ns();
+    last_valid_ = next_report;
+    while (!done_.load()) {
+      uint64_t now = bench::now_ns();
+      if (baud_ != bridge::kDefaultBaud && now - last_valid_ >= fallback_ns_) {
+        baud_ = bridge::kDefaultBaud;
+        fallbacks++;
+      }
+      if (now >= next_report) {
+        ucp_rep_t rep;
+        memset(&rep, 0, sizeof(rep));
+        send(rep);
+        next_report += kReportPeriodNs;
+      }
+      if (poll(&pfd, 1, 1) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      if (garbled()) {
+        for (ssize_t i = 0; i < n; i++) buf[i] ^= 0xA5;
+      }
+      now = bench::now_ns();
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) { on_frame(f, now); });
+    }
+  }
+
+  int fd_;
+  bool hello_;
+  int probe_fd_ = -1;
+  unsigned baud_ = bridge::kDefaultBaud;
+  uint64_t fallback_ns_ = 0;
+  uint64_t last_valid_ = 0;
+  ucp::Encoder encoder_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+// Arrival times of the reports the client gets through the bridge
+class ReportWatch {
+ public:
+  explicit ReportWatch(int fd) : fd_(fd) {
+    thread_ = std::thread([this] {
+      ucp::Decoder decoder;
+      uint8_t buf[4096];
+      for (;;) {
+        ssize_t n = read(fd_, buf, sizeof(buf));
+        if (n <= 0) return;
+        uint64_t now = bench::now_ns();
+        decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+          if (f.id() != UCP_RPM_REPORT) return;
+          std::lock_guard<std::mutex> lock(lock_);
+          times_.push_back(now);
+        });
+      }
+    });
+  }
+  ~ReportWatch() { thread_.join(); }
+
+  size_t since(uint64_t t) {
+    std::lock_guard<std::mutex> lock(lock_);
+    size_t n = 0;
+    for (uint64_t at : times_) n += at >= t;
+    return n;
+  }
+
+  // First report at or after t, 0 if none
+  uint64_t first_after(uint64_t t) {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (uint64_t at : times_) {
+      if (at >= t) return at;
+    }
+    return 0;
+  }
+
+ private:
+  int fd_;
+  std::mutex lock_;
+  std::vector<uint64_t> times_;
+  std::thread thread_;
+};
+
+static bool wait_for(bench::Rig& rig, bridge::BaudState state, double timeout_s) {
+  uint64_t end = bench::now_ns() + (uint64_t)(timeout_s * 1e9);
+  while (bench::now_ns() < end) {
+    if (rig.baud_state() == state) return true;
+    usleep(1000);
+  }
+  return false;
+}
+
+static bool report(const char* name, bool ok, bench::Rig& rig) {
+  bridge::BaudStats s = rig.baud_stats();
+  printf("%-9s %s: %u baud (%s), %llu proposals, %llu refused, %llu switches, %llu fallbacks\n", name,
+         ok ? "PASS" : "FAIL", rig.uart_baud(), bridge::baud_state_name(rig.baud_state()),
+         (unsigned long long)s.proposals, (unsigned long long)s.refused,
+         (unsigned long long)s.switches, (unsigned long long)s.fallbacks);
+  return ok;
+}
+
+static bool switch_case() {
+  bench::Rig rig;
+  rig.config.negotiate_baud = 921600;
+  if (!rig.start(1)) return false;
+  // The proposal has been waiting in the pty since open()
+  uint64_t start = bench::now_ns();
+  SimFirmware firmware(rig.master(), rig.config.serial);
+  ReportWatch watch(rig.clients()[0]);
+  bool active = wait_for(rig, bridge::BaudState::kActive, 3);
+  uint64_t active_at = bench::now_ns();
+  printf("switch: active %.1f ms after the firmware came up\n", (active_at - start) / 1e6);
+  usleep(1500 * 1000);  // Keep-alives hold the rate past fallback_ms
+  size_t reports = watch.since(active_at);
+  printf("switch: %zu reports at 921600 over 1.5 s\n", reports);
+  bool ok = active && rig.baud_state() == bridge::BaudState::kActive && rig.uart_baud() == 921600 &&
+            firmware.fallbacks == 0 && reports > 50;
+  rig.finish();
+  return report("switch", ok, rig);
+}
+
+static bool clamped_case() {
+  bench::Rig rig;
+  rig.config.negotiate_baud = 2000000;
+  if (!rig.start(1)) return false;
+  uint64_t start = bench::now_ns();
+  SimFirmware firmware(rig.master(), rig.config.serial);
+  bool active = wait_for(rig, bridge::BaudState::kActive, 3);
+  printf("clamped: active %.1f ms after the firmware came up\n", (bench::now_ns() - start) / 1e6);
+  bridge::BaudStats s = rig.baud_stats();
+  bool ok = active && rig.uart_baud() == kSimMaxBaud && s.hellos == 1 && s.proposals == 1 && s.refused == 0;
+  rig.finish();
+  return report("clamped", ok, rig);
+}
+
+static bool refused_case() {
+  bench::Rig rig;
+  rig.config.negotiate_baud = 2000000;
+  if (!rig.start(1)) return false;
+  SimFirmware firmware(rig.master(), rig.config.serial, false);
+  ReportWatch watch(rig.clients()[0]);
+  usleep(1200 * 1000);  // Unanswered queries, then the proposal
+  uint64_t t = bench::now_ns();
+  usleep(500 * 1000);
+  bool ok = rig.baud_state() == bridge::BaudState::kIdle && rig.uart_baud() == 115200 &&
+            rig.baud_stats().refused == 1 && watch.since(t) > 15;
+  rig.finish();
+  return report("refused", ok, rig);
+}
+
+static bool lost_ack_case() {
+  bench::Rig rig;
+  rig.config.negotiate_baud = 921600;
+  if (!rig.start(1)) return false;
+  // The proposal has been waiting in the pty since open()
+  uint64_t start = bench::now_ns();
+  SimFirmware firmware(rig.master(), rig.config.serial);
+  firmware.lose_acks = 1;
+  ReportWatch watch(rig.clients()[0]);
+  bool active = wait_for(rig, bridge::BaudState::kActive, 4);
+  printf("lost ack: active %.1f ms after the firmware came up\n", (bench::now_ns() - start) / 1e6);
+  bool ok = active && rig.uart_baud() == 921600 && firmware.fallbacks == 1;
+  rig.finish();
+  return report("lost ack", ok, rig);
+}
+
+static bool broken_case() {
+  bench::Rig rig;
+  rig.config.negotiate_baud = 921600;
+  if (!rig.start(1)) return false;
+  SimFirmware firmware(rig.master(), rig.config.serial);
+  ReportWatch watch(rig.clients()[0]);
+  if (!wait_for(rig, bridge::BaudState::kActive, 3)) return report("broken", false, rig);
+  usleep(500 * 1000);
+  uint64_t broke_at = bench::now_ns();
+  firmware.fast_broken = true;
+  bool fell_back = wait_for(rig, bridge::BaudState::kFallenBack, 3);
+  double fallback_ms = (bench::now_ns() - broke_at) / 1e6;
+  usleep(1000 * 1000);
+  uint64_t resumed = watch.first_after(broke_at);
+  size_t reports = watch.since(broke_at);
+  printf("broken: head fell back %.0f ms after the break, telemetry back after %.0f ms\n",
+         fallback_ms, resumed ? (resumed - broke_at) / 1e6 : -1.0);
+  // Fallback is due fallback_ms after the last pong, at most keepalive_ms before the break
+  bridge::BaudOptions o;
+  bool ok = fell_back && fallback_ms <= o.fallback_ms + 100 && rig.uart_baud() == 115200 &&
+            firmware.fallbacks == 1 && resumed && reports > 20;
+  rig.finish();
+  return report("broken", ok, rig);
+}
+
+int main() {
+  bool ok = switch_case();
+  ok = clamped_case() && ok;
+  ok = refused_case() && ok;
+  ok = lost_ack_case() && ok;
+  ok = broken_case() && ok;
+  return ok ? 0 : 1;
+}
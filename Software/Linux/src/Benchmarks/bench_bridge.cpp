@@ -0,0 +1,418 @@
+// -----------------------------------------------------------------------------
+// bridge::Bridge end to end, with a pty standing in for /dev/ttyS0
+//
+// The bench plays the firmware on the pty master and runs 1..N TCP clients on
+// loopback against a Bridge on its own thread:
+//   telemetry  : reports written to the pty at a fixed rate, latency from the
+//                pty write to each client's decoder (every client must get
+//                every frame)
+//   flat out   : reports written as fast as the pty takes them, frames/s
+//                delivered per client
+//   ... rec    : the telemetry and flat-out cases with the traffic recorder on
+//   ... scrape : the telemetry case with the metrics endpoint scraped every
+//                10 ms; scrape times, the bridge's own latency histogram
+//                against the clients' measurement, and a check that the
+//                scraped counters match Stats
+//   commands   : every client sends motor commands at 100 Hz, latency from
+//                send() to the frame decoded on the pty master, and a check
+//                that no command was lost or torn
+//   flood      : 1 kHz motor commands into a pty drained at 115200 baud,
+//                FIFO forwarding against latest-setpoint-wins coalescing
+// Timestamps ride in fields the firmware would fill (rpm[] / LED fields).
+// Usage: bench_bridge [seconds per case]
+// -----------------------------------------------------------------------------
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "bridge_rig.hpp"
+#include "request_mux.hpp"
+
+static bool write_all(int fd, const uint8_t* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+struct ClientResult {
+  uint64_t frames = 0;
+  std::vector<double> latency_us;
+};
+
+static void read_reports(int fd, bool record, ClientResult* out) {
+  ucp::Decoder decoder;
+  std::vector<uint8_t> buf(64 * 1024);
+  ssize_t n;
+  while ((n = recv(fd, buf.data(), buf.size(), 0)) > 0) {
+    uint64_t now = bench::now_ns();
+    decoder.feed(buf.data(), n, [&](const ucp::FrameView& f) {
+      const ucp_rep_t* rep = f.as<ucp_rep_t>();
+      if (!rep) return;
+      out->frames++;
+      if (record) {
+        uint64_t sent;
+        memcpy(&sent, rep->rpm, sizeof(sent));
+        out->latency_us.push_back((now - sent) / 1e3);
+      }
+    });
+  }
+}
+
+// GET the metrics page; returns the body
+static bool scrape(uint16_t port, std::string* body) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("metrics connect");
+    close(fd);
+    return false;
+  }
+  static const char kRequest[] = "GET /metrics HTTP/1.0\r\n\r\n";
+  send(fd, kRequest, sizeof(kRequest) - 1, MSG_NOSIGNAL);
+  std::string reply;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) reply.append(buf, n);
+  close(fd);
+  size_t start = reply.find("\r\n\r\n");
+  if (reply.compare(0, 12, "HTTP/1.0 200") != 0 || start == std::string::npos) return false;
+  *body = reply.substr(start + 4);
+  return true;
+}
+
+// Value of an unlabelled sample in a metrics page
+static uint64_t metric(const std::string& body, const char* name) {
+  std::string key = std::string("\n") + name + " ";
+  size_t at = body.find(key);
+  return at == std::string::npos ? UINT64_MAX : strtoull(body.c_str() + at + key.size(), NULL, 10);
+}
+
+enum class Extra { kNone, kRecord, kScrape };
+
+// rate_hz == 0 writes flat out
+static bool telemetry_case(size_t nclients, double rate_hz, double seconds,
+                           Extra extra = Extra::kNone) {
+  bench::Rig rig;
+  bool record = extra == Extra::kRecord;
+  if (record && !rig.record()) return false;
+  if (extra == Extra::kScrape) {
+    rig.config.metrics = true;
+    rig.config.metrics_port = 0;
+  }
+  if (!rig.start(nclients)) return false;
+
+  std::atomic<bool> done(false);
+  std::vector<double> scrape_us;
+  std::thread scraper;
+  if (extra == Extra::kScrape) {
+    scraper = std::thread([&] {
+      std::string body;
+      while (!done.load()) {
+        uint64_t t = bench::now_ns();
+        if (!scrape(rig.metrics_port(), &body)) break;
+        scrape_us.push_back((bench::now_ns() - t) / 1e3);
+        usleep(10 * 1000);
+      }
+    });
+  }
+
+  std::vector<ClientResult> results(nclients);
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < nclients; i++) {
+    readers.emplace_back(read_reports, rig.clients()[i], rate_hz > 0, &results[i]);
+  }
+
+  ucp::Encoder encoder;
+  ucp_rep_t rep;
+  memset(&rep, 0, sizeof(rep));
+  uint8_t frame[ucp::Frame<ucp_rep_t>::size()];
+  uint64_t sent = 0;
+  uint64_t start = bench::now_ns(), end = start + (uint64_t)(seconds * 1e9);
+  uint64_t period = rate_hz > 0 ? (uint64_t)(1e9 / rate_hz) : 0, next = start;
+  for (uint64_t now = start; now < end; now = bench::now_ns()) {
+    if (period) {
+      bench::sleep_until_ns(next);
+      next += period;
+    }
+    uint64_t ts = bench::now_ns();
+    memcpy(rep.rpm, &ts, sizeof(ts));
+    encoder.encode(rep, frame, sizeof(frame));
+    if (!write_all(rig.master(), frame, sizeof(frame))) return false;
+    sent++;
+  }
+  double elapsed = (bench::now_ns() - start) / 1e9;
+  usleep(200 * 1000);  // Drain
+  done = true;
+  if (scraper.joinable()) scraper.join();
+  // The last scrape, once everything has been delivered
+  std::string body;
+  if (extra == Extra::kScrape && !scrape(rig.metrics_port(), &body)) {
+    fprintf(stderr, "  metrics scrape failed\n");
+    return false;
+  }
+  rig.finish();
+  for (std::thread& t : readers) t.join();
+
+  uint64_t min_frames = sent;
+  std::vector<double> all;
+  for (ClientResult& r : results) {
+    min_frames = std::min(min_frames, r.frames);
+    all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+  }
+  const bridge::Stats& s = rig.stats();
+  char label[64];
+  if (rate_hz > 0) {
+    snprintf(label, sizeof(label), "telemetry %2zu client(s) %4.0f Hz%s", nclients, rate_hz,
+             record ? " rec" : extra == Extra::kScrape ? " scrape" : "");
+    bench::print_percentiles(label, all, "us");
+    if (min_frames != sent) {
+      fprintf(stderr, "  a client received %llu of %llu frames\n", (unsigned long long)min_frames,
+              (unsigned long long)sent);
+      return false;
+    }
+  } else {
+    printf("flat out  %2zu client(s)%s: %9.0f frames/s in, %9.0f frames/s per client, "
+           "%llu copies dropped on full queues\n",
+           nclients, record ? " rec" : "", sent / elapsed, min_frames / elapsed,
+           (unsigned long long)s.telemetry_dropped);
+  }
+  if (record) {
+    ucp_log::RecorderStats r = rig.recorder_stats();
+    printf("  recorded %llu frames, %llu dropped\n", (unsigned long long)r.records,
+           (unsigned long long)r.dropped);
+  }
+  if (extra == Extra::kScrape) {
+    bench::print_percentiles("  scrape", scrape_us, "us");
+    const bridge::Histogram& h = rig.latency().telemetry;
+    printf("  bridge histogram: n=%llu p50=%.1f p90=%.1f p99=%.1f max=%.1f us, %zu byte page\n",
+           (unsigned long long)h.count(), h.quantile(0.5) / 1e3, h.quantile(0.9) / 1e3,
+           h.quantile(0.99) / 1e3, h.max() / 1e3, body.size());
+    if (metric(body, "bridge_telemetry_frames_total") != s.telemetry_frames ||
+        metric(body, "bridge_telemetry_sent_total") != s.telemetry_sent ||
+        metric(body, "bridge_uart_rx_bytes_total") != s.uart_rx_bytes ||
+        metric(body, "bridge_telemetry_latency_seconds_count") != h.count() ||
+        h.count() != s.telemetry_sent) {
+      fprintf(stderr, "  scraped counters don't match the bridge's stats\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool command_case(size_t nclients, double rate_hz, double seconds) {
+  bench::Rig rig;
+  if (!rig.start(nclients)) return false;
+
+  std::atomic<bool> done(false);
+  std::vector<double> latency;
+  uint64_t received = 0;
+  ucp::Decoder decoder;
+  std::thread firmware([&] {
+    struct pollfd pfd = {rig.master(), POLLIN, 0};
+    uint8_t buf[4096];
+    while (!done.load()) {
+      if (poll(&pfd, 1, 10) <= 0) continue;
+      ssize_t n = read(pfd.fd, buf, sizeof(buf));
+      if (n <= 0) continue;
+      uint64_t now = bench::now_ns();
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        const ucp_ctl_cmd_t* cmd = f.as<ucp_ctl_cmd_t>();
+        if (!cmd) return;
+        uint64_t ts;
+        memcpy(&ts, &cmd->front_led, sizeof(ts));
+        latency.push_back((now - ts) / 1e3);
+        received++;
+      });
+    }
+  });
+
+  std::vector<uint64_t> sent(nclients, 0);
+  std::vector<std::thread> senders;
+  for (size_t i = 0; i < nclients; i++) {
+    senders.emplace_back([&, i] {
+      ucp::Encoder encoder;
+      uint64_t start = bench::now_ns(), end = start + (uint64_t)(seconds * 1e9);
+      uint64_t period = (uint64_t)(1e9 / rate_hz), next = start + i * period / nclients;
+      while (next < end) {
+        bench::sleep_until_ns(next);
+        next += period;
+        ucp::Frame<ucp_ctl_cmd_t> frame;
+        ucp::make_ctl_cmd(frame, 60, (int16_t)i);
+        uint64_t ts = bench::now_ns();
+        memcpy(&frame.msg.front_led, &ts, sizeof(ts));
+        encoder.seal(frame);
+        if (send(rig.clients()[i], frame.data(), frame.size(), MSG_NOSIGNAL) < 0) return;
+        sent[i]++;
+      }
+    });
+  }
+  for (std::thread& t : senders) t.join();
+  usleep(200 * 1000);
+  done = true;
+  firmware.join();
+  rig.finish();
+
+  // Setpoints that arrive faster than the UART drains them are coalesced;
+  // every command must either reach the firmware or be accounted for there.
+  uint64_t total = 0;
+  for (uint64_t n : sent) total += n;
+  uint64_t coalesced = rig.stats().command_coalesced;
+  char label[64];
+  snprintf(label, sizeof(label), "commands  %2zu client(s) %4.0f Hz", nclients, rate_hz);
+  bench::print_percentiles(label, latency, "us");
+  if (coalesced) printf("  %llu setpoints coalesced\n", (unsigned long long)coalesced);
+  if (received + coalesced != total || decoder.stats().crc_errors != 0) {
+    fprintf(stderr, "  firmware decoded %llu of %llu commands (%llu coalesced), %llu CRC errors\n",
+            (unsigned long long)received, (unsigned long long)total,
+            (unsigned long long)coalesced, (unsigned long long)decoder.stats().crc_errors);
+    return false;
+  }
+  return true;
+}
+
+// One teleop client floods motor setpoints at 1 kHz, far beyond the ~480
+// frames/s 115200 baud can carry, plus a keepalive every 100 ms. The
+// firmware side drains the pty at the real UART byte rate.
+static bool flood_case(bool coalesce, double seconds) {
+  bench::Rig rig;
+  rig.config.coalesce_commands = coalesce;
+  if (!rig.start(1)) return false;
+
+  const uint64_t kBaud = 115200;
+  const uint64_t kFifo = 16;  // Bytes the UART can take back to back after idling
+  std::atomic<bool> done(false);
+  std::vector<double> motor_us, ping_us;
+  // Keyed by the index the bridge gives each ping on the wire. With one
+  // client sending no other requests, a RequestMux of our own fed the same
+  // pings hands out the same indexes.
+  std::vector<uint64_t> ping_sent(256, 0);
+  bridge::RequestMux wire_indexes;
+  uint64_t last_motor_ts = 0;
+  ucp::Decoder decoder;
+  std::thread firmware([&] {
+    struct pollfd pfd = {rig.master(), POLLIN, 0};
+    uint8_t buf[256];
+    uint64_t start = bench::now_ns(), consumed = 0;
+    while (!done.load()) {
+      uint64_t now = bench::now_ns();
+      uint64_t wire = (now - start) * kBaud / 10 / 1000000000ull;
+      if (wire > consumed + kFifo) consumed = wire - kFifo;  // Idle wire doesn't bank bytes
+      size_t allowed = std::min<uint64_t>(wire - consumed, sizeof(buf));
+      if (allowed == 0 || poll(&pfd, 1, 1) <= 0) {
+        usleep(200);
+        continue;
+      }
+      ssize_t n = read(pfd.fd, buf, allowed);
+      if (n <= 0) continue;
+      consumed += n;
+      now = bench::now_ns();
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (const ucp_ctl_cmd_t* cmd = f.as<ucp_ctl_cmd_t>()) {
+          memcpy(&last_motor_ts, &cmd->front_led, sizeof(last_motor_ts));
+          motor_us.push_back((now - last_motor_ts) / 1e3);
+        } else if (f.id() == UCP_KEEP_ALIVE && ping_sent[f.index()]) {
+          ping_us.push_back((now - ping_sent[f.index()]) / 1e3);
+        }
+      });
+    }
+  });
+
+  ucp::Encoder motor_encoder, ping_encoder;
+  uint64_t sent = 0, last_sent_ts = 0;
+  uint64_t start = bench::now_ns(), end = start + (uint64_t)(seconds * 1e9);
+  uint64_t next = start;
+  for (uint64_t tick = 0; next < end; tick++) {
+    bench::sleep_until_ns(next);
+    next += 1000000;
+    int fd = rig.clients()[0];
+    if (tick % 100 == 0) {
+      ucp::Frame<ucp_alive_ping_t> ping;
+      memset(&ping, 0, sizeof(ping));
+      uint64_t now = bench::now_ns();
+      ping_sent[wire_indexes.claim(UCP_KEEP_ALIVE, ping_encoder.next_index(), 1, now)] = now;
+      ping_encoder.seal(ping);
+      send(fd, ping.data(), ping.size(), MSG_NOSIGNAL);
+    }
+    ucp::Frame<ucp_ctl_cmd_t> frame;
+    ucp::make_ctl_cmd(frame, 60, 0);
+    last_sent_ts = bench::now_ns();
+    memcpy(&frame.msg.front_led, &last_sent_ts, sizeof(last_sent_ts));
+    motor_encoder.seal(frame);
+    send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+    sent++;
+  }
+  sleep(1);  // Let the slow wire drain
+  done = true;
+  firmware.join();
+  rig.finish();
+
+  const bridge::Stats& s = rig.stats();
+  printf("1 kHz flood, %s:\n", coalesce ? "coalescing" : "FIFO (previous behaviour)");
+  bench::print_percentiles("  motor command to wire", motor_us, "us");
+  bench::print_percentiles("  keepalive to wire", ping_us, "us");
+  printf("  %llu setpoints sent, %zu reached the firmware, %llu coalesced, %llu dropped\n",
+         (unsigned long long)sent, motor_us.size(), (unsigned long long)s.command_coalesced,
+         (unsigned long long)s.command_dropped);
+  if (decoder.stats().crc_errors != 0) {
+    fprintf(stderr, "  %llu CRC errors on the wire\n", (unsigned long long)decoder.stats().crc_errors);
+    return false;
+  }
+  if (ping_us.empty()) {
+    fprintf(stderr, "  no keepalive reached the firmware\n");
+    return false;
+  }
+  if (coalesce && last_motor_ts != last_sent_ts) {
+    fprintf(stderr, "  the newest setpoint never reached the firmware\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  static const size_t counts[] = {1, 4, 16};
+
+  for (size_t n : counts) {
+    if (!telemetry_case(n, 1000, seconds)) return 1;
+  }
+  for (size_t n : counts) {
+    if (!telemetry_case(n, 0, seconds)) return 1;
+  }
+  // The same with the traffic recorder on: its cost on the loop shows as
+  // added latency and lower flat-out throughput
+  if (!telemetry_case(4, 1000, seconds, Extra::kRecord) ||
+      !telemetry_case(4, 0, seconds, Extra::kRecord)) {
+    return 1;
+  }
+  if (!telemetry_case(4, 1000, seconds, Extra::kScrape)) return 1;
+  for (size_t n : counts) {
+    if (!command_case(n, 100, seconds)) return 1;
+  }
+  if (!flood_case(false, seconds) || !flood_case(true, seconds)) return 1;
+  return 0;
+}
@@ -0,0 +1,193 @@
+// -----------------------------------------------------------------------------
+// MCU timestamps mapped into CLOCK_MONOTONIC, against arrival-time stamping
+//
+// A pty stands in for the UART. On the master side a simulated firmware runs
+// a microsecond clock that started at its own boot and runs kDriftPpm fast,
+// reads the IMU every 10 ms and reports the latest sample at 50 Hz with
+// UCP_REPORT_V2, and answers UCP_TIME_SYNC; one reply in five is stamped
+// late, as when the firmware's UART thread is held up. A ucp::Client syncs
+// every 100 ms. For every report the true sample time is known, and the
+// error of three head-side stamps is reported:
+//   rx time  : when the report was read (what telemetry had before)
+//   last sync: sample_us shifted by the newest exchange's offset, unfiltered
+//   filtered : Client::sample_time_ns(), min-RTT filtered offset and drift
+// then the drift estimate, what it is worth after a minute without sync, and
+// the cost of ClockSync::add() and to_monotonic().
+// Usage: bench_clock_sync [seconds]
+// -----------------------------------------------------------------------------
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "clock_sync.hpp"
+#include "fake_mcu.hpp"
+#include "ucp_client.hpp"
+
+static const double kDriftPpm = 80;
+static const uint64_t kImuPeriodNs = 10 * 1000000ull;
+static const uint64_t kReportPeriodNs = 20 * 1000000ull;
+
+// The simulated firmware's clock: us since its boot, running fast
+struct McuClock {
+  uint64_t boot_ns;
+  double rate = 1 + kDriftPpm * 1e-6;
+
+  uint64_t us_at(uint64_t ns) const { return (uint64_t)((ns - boot_ns) * rate / 1000); }
+  uint64_t ns_of(uint64_t us) const { return boot_ns + (uint64_t)llround(us * 1000 / rate); }
+};
+
+class SimFirmware {
+ public:
+  SimFirmware(int fd, const McuClock& clock) : fd_(fd), clock_(clock) {
+    thread_ = std::thread([this] { run(); });
+  }
+  ~SimFirmware() {
+    done_ = true;
+    thread_.join();
+  }
+
+ private:
+  template <typename T>
+  void send(const T& msg) {
+    uint8_t buf[ucp::Frame<T>::size()];
+    size_t n = encoder_.encode(msg, buf, sizeof(buf));
+    if (write(fd_, buf, n) != (ssize_t)n) perror("write");
+  }
+
+  void answer(const ucp_time_sync_t& req) {
+    if (rng_() % 5 == 0) usleep(500 + rng_() % 2500);  // Held up before the stamp
+    ucp_time_sync_ack_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.t1_ns = req.t1_ns;
+    ack.t2_us = clock_.us_at(bench::now_ns());
+    ack.t3_us = clock_.us_at(bench::now_ns());
+    send(ack);
+  }
+
+  void run() {
+    ucp::Decoder decoder;
+    uint8_t buf[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    uint64_t next_imu = bench::now_ns(), next_report = next_imu + 3 * 1000000ull;
+    uint64_t sample_us = 0;
+    while (!done_.load()) {
+      uint64_t now = bench::now_ns();
+      if (now >= next_imu) {
+        sample_us = clock_.us_at(now);
+        next_imu += kImuPeriodNs;
+      }
+      if (now >= next_report) {
+        ucp_rep_v2_t rep;
+        memset(&rep, 0, sizeof(rep));
+        rep.rep_version = UCP_REPORT_VERSION;
+        rep.sample_us = sample_us;
+        send(rep);
+        next_report += kReportPeriodNs;
+      }
+      uint64_t next = next_imu < next_report ? next_imu : next_report;
+      int timeout_ms = next > now ? (int)((next - now) / 1000000) : 0;
+      if (poll(&pfd, 1, timeout_ms) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (f.id() != UCP_TIME_SYNC) return;
+        if (const ucp_time_sync_t* req = f.as<ucp_time_sync_t>()) answer(*req);
+      });
+    }
+  }
+
+  int fd_;
+  McuClock clock_;
+  ucp::Encoder encoder_;
+  std::minstd_rand rng_{7};
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+static bool mapping_case(double seconds) {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+  McuClock mcu;
+  mcu.boot_ns = bench::now_ns() - 3600 * 1000000000ull;  // Up for an hour
+  SimFirmware firmware(pty.master, mcu);
+
+  ucp::ClientOptions options;
+  options.rate_hz = 50;
+  options.sync_interval_ms = 100;
+  ucp::Client client(options);
+
+  // Reader thread only
+  double last_offset = 0;
+  bool have_offset = false;
+  uint64_t start = bench::now_ns(), warmup = start + 2000000000ull;
+  std::vector<double> rx_err, last_err, filtered_err;
+  client.on_telemetry([&](const ucp::FrameView& f, uint64_t rx_ns) {
+    if (f.id() == UCP_TIME_SYNC) {
+      if (const ucp_time_sync_ack_t* ack = f.as<ucp_time_sync_ack_t>()) {
+        double head_mid = (ack->t1_ns + (double)rx_ns) / 2;
+        double mcu_mid = (ack->t2_us + (double)ack->t3_us) / 2 * 1000;
+        last_offset = head_mid - mcu_mid;
+        have_offset = true;
+      }
+      return;
+    }
+    const ucp_rep_v2_t* rep = f.id() == UCP_REPORT_V2 ? f.as<ucp_rep_v2_t>() : nullptr;
+    if (!rep || rx_ns < warmup || !have_offset) return;
+    double truth = (double)mcu.ns_of(rep->sample_us);
+    rx_err.push_back(fabs(rx_ns - truth) / 1e3);
+    last_err.push_back(fabs(rep->sample_us * 1000.0 + last_offset - truth) / 1e3);
+    filtered_err.push_back(fabs(client.sample_time_ns(f, rx_ns) - truth) / 1e3);
+  });
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+  usleep((useconds_t)(seconds * 1e6));
+  client.stop();
+
+  bench::print_percentiles("rx time   sample error", rx_err, "us");
+  bench::print_percentiles("last sync sample error", last_err, "us");
+  bench::print_percentiles("filtered  sample error", filtered_err, "us");
+  ucp::ClientStats s = client.stats();
+  ucp::ClockEstimate e = client.clock_estimate();
+  printf("  %llu exchanges, %llu outliers ignored; %zu kept in the window, min round trip %.1f us\n",
+         (unsigned long long)s.sync_replies, (unsigned long long)s.sync_outliers, e.samples,
+         e.min_rtt_ns / 1e3);
+  double holdover_us = fabs(e.drift_ppm - kDriftPpm) * 60;
+  printf("  drift %.2f ppm (true %.0f): 60 s without sync %.0f us off, %.0f us with offset only\n",
+         e.drift_ppm, kDriftPpm, holdover_us, kDriftPpm * 60);
+  return e.valid && s.sync_replies > 0;
+}
+
+static void cost_case() {
+  ucp::ClockSync sync;
+  const int kAdds = 100000;
+  uint64_t start = bench::now_ns();
+  for (int i = 0; i < kAdds; i++) {
+    uint64_t t1 = 1000000000ull + (uint64_t)i * 100000000ull;
+    uint64_t t2 = t1 / 1000 + 50 + (i % 7);
+    sync.add(t1, t2, t2 + 20, t1 + 200000 + (i % 5) * 1000);
+  }
+  double add_ns = (double)(bench::now_ns() - start) / kAdds;
+  const int kMaps = 1000000;
+  uint64_t acc = 0;
+  start = bench::now_ns();
+  for (int i = 0; i < kMaps; i++) acc += sync.to_monotonic(1000000 + (uint64_t)i * 10);
+  bench::do_not_optimize(acc);
+  double map_ns = (double)(bench::now_ns() - start) / kMaps;
+  printf("ClockSync::add() %.0f ns over a %zu-exchange window, to_monotonic() %.1f ns\n", add_ns,
+         ucp::ClockSyncOptions().window, map_ns);
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 8.0;
+  if (!mapping_case(seconds)) return 1;
+  cost_case();
+  return 0;
+}
@@ -0,0 +1,285 @@
+// -----------------------------------------------------------------------------
+// Batched IMU samples (UCP_IMU_BATCH) against one frame per sample
+//
+// First the UART load of streaming every 10 ms IMU sample: one UCP_TELEMETRY
+// frame per sample, and UCP_IMU_BATCH at a few subscription periods, with
+// the header and CRC bytes each sample carries.
+//
+// Then end to end over a pty: a simulated firmware takes an IMU sample every
+// 10 ms (+-150 us of jitter, and one 50 ms stall as during calibration) into
+// a ring, runs the 5 ms subscription scheduler and sends the samples in
+// batches as uart_mutex.c does. A ucp::Client subscribes to UCP_GRP_IMU_BATCH
+// every 50 ms. Each sample carries its sequence number, so the bench checks
+// that every sample arrives once and in order, and how far base_us + i *
+// period_us is from when the sample was really taken. Fails on a lost or
+// repeated sample, a rate off 100 Hz, or a timestamp more than 500 us off.
+// Finally the cost of parse_imu_batch().
+// Usage: bench_imu_batch [seconds]
+// -----------------------------------------------------------------------------
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "fake_mcu.hpp"
+#include "ucp_client.hpp"
+#include "ucp_imu_batch.hpp"
+#include "ucp_telemetry.hpp"
+
+static const double kLinkBytesPerSec = 115200 / 10.0;  // 8N1
+static const double kImuHz = 1e6 / UCP_IMU_PERIOD_US;
+static const int kJitterUs = 150;
+static const size_t kStallAt = 150;                     // Sample before the stall
+static const uint64_t kStallUs = 50000;
+
+static void bandwidth_table() {
+  printf("Streaming every IMU sample (%.0f Hz) at 115200 baud:\n", kImuHz);
+  printf("  %-34s %9s %6s %16s\n", "", "B/s", "link", "overhead/sample");
+  double per_sample = ucp::telemetry_frame_size(UCP_GRP_IMU_RAW);
+  printf("  %-34s %9.0f %5.0f%% %14.1f B\n", "UCP_TELEMETRY imu raw, 1 a frame", per_sample * kImuHz,
+         100 * per_sample * kImuHz / kLinkBytesPerSec, per_sample - sizeof(ucp_tlm_imu_raw_t));
+  static const unsigned periods_ms[] = {10, 20, 50, 100, 160};
+  for (unsigned ms : periods_ms) {
+    size_t n = (size_t)(ms * 1000 / UCP_IMU_PERIOD_US);
+    double frame = ucp::imu_batch_frame_size(n);
+    double rate = frame * kImuHz / n;
+    char name[64];
+    snprintf(name, sizeof(name), "UCP_IMU_BATCH every %u ms (%zu)", ms, n);
+    printf("  %-34s %9.0f %5.0f%% %14.1f B\n", name, rate, 100 * rate / kLinkBytesPerSec,
+           frame / n - sizeof(ucp_imu_sample_t));
+  }
+}
+
+// The firmware's IMU ring, scheduler and batching, on the pty master
+class SimFirmware {
+ public:
+  static const uint64_t kTickNs = UCP_SUB_TICK_MS * 1000000ull;
+  static const size_t kRing = 64;
+
+  explicit SimFirmware(int fd) : fd_(fd) { thread_ = std::thread([this] { run(); }); }
+  ~SimFirmware() {
+    done_ = true;
+    thread_.join();
+  }
+
+  // MCU time each sample was taken, by sequence number
+  uint64_t truth(size_t seq) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return seq < truth_.size() ? truth_[seq] : 0;
+  }
+
+ private:
+  struct Sample {
+    ucp_imu_sample_t imu;
+    uint64_t sample_us;
+  };
+
+  void write_all(const uint8_t* buf, size_t n) {
+    if (write(fd_, buf, n) != (ssize_t)n) perror("write");
+  }
+
+  void take_sample(uint64_t due_us) {
+    Sample& s = ring_[seq_ % kRing];
+    memset(&s, 0, sizeof(s));
+    s.imu.acc[0] = (int16_t)seq_;
+    s.imu.acc[2] = 16384;
+    s.imu.gyros[2] = (int16_t)(rng_() % 200) - 100;
+    s.sample_us = due_us + (int)(rng_() % (2 * kJitterUs + 1)) - kJitterUs;
+    std::lock_guard<std::mutex> lock(lock_);
+    truth_.push_back(s.sample_us);
+    seq_++;
+  }
+
+  // uart_send_imu_batch(): batches of evenly spaced samples until caught up
+  void send_batches() {
+    if (!live_) {
+      read_ = seq_;
+      live_ = true;
+      return;
+    }
+    uint32_t dropped = 0;
+    for (;;) {
+      if (seq_ - read_ > kRing) {
+        dropped += seq_ - kRing - read_;
+        read_ = seq_ - kRing;
+      }
+      size_t n = seq_ - read_ < UCP_IMU_BATCH_MAX ? seq_ - read_ : UCP_IMU_BATCH_MAX;
+      if (n == 0) return;
+      const Sample* s[UCP_IMU_BATCH_MAX];
+      for (size_t i = 0; i < n; i++) s[i] = &ring_[(read_ + i) % kRing];
+      size_t k = 1;
+      for (; k < n; k++) {
+        uint64_t gap = s[k]->sample_us - s[k - 1]->sample_us;
+        if (gap < UCP_IMU_PERIOD_US / 2 || gap > UCP_IMU_PERIOD_US * 3 / 2) break;
+      }
+      ucp::ImuBatch b;
+      b.count = (uint8_t)k;
+      b.dropped = (uint16_t)(dropped > 0xffff ? 0xffff : dropped);
+      b.period_us = k > 1 ? (uint16_t)((s[k - 1]->sample_us - s[0]->sample_us) / (k - 1)) : UCP_IMU_PERIOD_US;
+      b.base_us = s[0]->sample_us;
+      for (size_t i = 0; i < k; i++) b.samples[i] = s[i]->imu;
+      uint8_t buf[ucp::kMaxImuBatchFrame];
+      write_all(buf, ucp::encode_imu_batch(encoder_, b, buf, sizeof(buf)));
+      read_ += k;
+      dropped = 0;
+      if (k == n && n < UCP_IMU_BATCH_MAX) return;
+    }
+  }
+
+  void on_subscribe(const ucp_subscribe_t& req) {
+    ucp_subscribe_ack_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.slot = req.slot;
+    ack.groups = req.groups;
+    uint16_t ticks = (req.period_ms + UCP_SUB_TICK_MS - 1) / UCP_SUB_TICK_MS;
+    if (req.slot != 0 || req.groups != UCP_GRP_IMU_BATCH || ticks == 0) {
+      ack.err = UCP_ERR_UNKNOWN;
+    } else {
+      period_ticks_ = ticks;
+      countdown_ = 1;
+      ack.period_ms = ticks * UCP_SUB_TICK_MS;
+    }
+    uint8_t buf[ucp::Frame<ucp_subscribe_ack_t>::size()];
+    write_all(buf, encoder_.encode(ack, buf, sizeof(buf)));
+  }
+
+  void run() {
+    ucp::Decoder decoder;
+    uint8_t buf[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    uint64_t next_tick = bench::now_ns() + kTickNs;
+    uint64_t next_sample_us = bench::now_ns() / 1000 + UCP_IMU_PERIOD_US;
+    while (!done_.load()) {
+      uint64_t now = bench::now_ns();
+      while (now / 1000 >= next_sample_us) {
+        take_sample(next_sample_us);
+        next_sample_us += seq_ == kStallAt ? kStallUs : UCP_IMU_PERIOD_US;
+      }
+      while (now >= next_tick) {
+        if (period_ticks_ && --countdown_ == 0) {
+          countdown_ = period_ticks_;
+          send_batches();
+        }
+        next_tick += kTickNs;
+      }
+      if (poll(&pfd, 1, 1) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (f.id() != UCP_SUBSCRIBE) return;
+        if (const ucp_subscribe_t* req = f.as<ucp_subscribe_t>()) on_subscribe(*req);
+      });
+    }
+  }
+
+  int fd_;
+  Sample ring_[kRing];
+  size_t seq_ = 0;                 // Samples taken
+  size_t read_ = 0;                // Next to send
+  bool live_ = false;
+  uint16_t period_ticks_ = 0;
+  uint16_t countdown_ = 0;
+  std::mutex lock_;
+  std::vector<uint64_t> truth_;
+  std::minstd_rand rng_{11};
+  ucp::Encoder encoder_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+static bool end_to_end_case(double seconds) {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+  SimFirmware firmware(pty.master);
+
+  ucp::ClientOptions options;
+  options.rate_hz = 50;
+  options.sync_interval_ms = 0;
+  ucp::Client client(options);
+
+  // Reader thread only, until stop()
+  std::atomic<bool> counting{false};
+  uint64_t batches = 0, samples = 0, bytes = 0, lost = 0, repeated = 0, dropped = 0;
+  long next_seq = -1;
+  size_t smallest = UCP_IMU_BATCH_MAX, largest = 0;
+  std::vector<double> stamp_err;
+  client.on_telemetry([&](const ucp::FrameView& f, uint64_t) {
+    ucp::ImuBatch b;
+    if (!counting.load() || !ucp::parse_imu_batch(f, &b)) return;
+    batches++;
+    bytes += f.frame_len;
+    dropped += b.dropped;
+    if (b.count < smallest) smallest = b.count;
+    if (b.count > largest) largest = b.count;
+    for (size_t i = 0; i < b.count; i++) {
+      long seq = (uint16_t)b.samples[i].acc[0];
+      if (next_seq >= 0 && seq > next_seq) lost += seq - next_seq;
+      if (next_seq >= 0 && seq < next_seq) repeated++;
+      next_seq = seq + 1;
+      samples++;
+      stamp_err.push_back(fabs((double)b.sample_us(i) - (double)firmware.truth(seq)));
+    }
+  });
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+
+  uint64_t asked = bench::now_ns();
+  client.subscribe(0, UCP_GRP_IMU_BATCH, 50);
+  while (!client.subscribed(0) && bench::now_ns() - asked < 2000000000ull) usleep(1000);
+  bool confirmed = client.subscribed(0);
+  counting = true;
+  uint64_t start = bench::now_ns();
+  usleep((useconds_t)(seconds * 1e6));
+  double elapsed = (bench::now_ns() - start) / 1e9;
+  client.stop();
+
+  double hz = samples / elapsed;
+  printf("%llu samples (%.1f Hz) in %llu batches of %zu..%zu, %.0f B/s on the link\n",
+         (unsigned long long)samples, hz, (unsigned long long)batches, smallest, largest, bytes / elapsed);
+  printf("%llu lost, %llu repeated, %llu dropped on the MCU\n", (unsigned long long)lost,
+         (unsigned long long)repeated, (unsigned long long)dropped);
+  bench::print_percentiles("base_us + i * period_us error", stamp_err, "us");
+  double worst = stamp_err.empty() ? 0 : bench::percentile(stamp_err, 100);
+  bool ok = confirmed && samples > 0 && lost == 0 && repeated == 0 && dropped == 0 && hz > 0.9 * kImuHz &&
+            hz < 1.1 * kImuHz && worst < 500;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+static void parse_cost() {
+  ucp::Encoder encoder;
+  ucp::ImuBatch b;
+  memset(b.samples, 0, sizeof(b.samples));
+  b.count = UCP_IMU_BATCH_MAX;
+  b.period_us = UCP_IMU_PERIOD_US;
+  uint8_t frame[ucp::kMaxImuBatchFrame];
+  size_t len = ucp::encode_imu_batch(encoder, b, frame, sizeof(frame));
+  ucp::FrameView view = {frame, len};
+  const int kRounds = 1000000;
+  uint64_t acc = 0;
+  uint64_t start = bench::now_ns();
+  for (int i = 0; i < kRounds; i++) {
+    ucp::ImuBatch out;
+    bench::do_not_optimize(frame);  // Read the frame again every round
+    if (ucp::parse_imu_batch(view, &out)) acc += out.count + out.samples[UCP_IMU_BATCH_MAX - 1].gyros[2];
+  }
+  bench::do_not_optimize(acc);
+  printf("parse_imu_batch() %.1f ns for %d samples\n", (double)(bench::now_ns() - start) / kRounds,
+         UCP_IMU_BATCH_MAX);
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+  bandwidth_table();
+  bool ok = end_to_end_case(seconds);
+  parse_cost();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+// -----------------------------------------------------------------------------
+// Camera frames to the NPU: pushed inline by the VI grabber with a descriptor
+// allocated per frame (as the camera demo did) against the NPU feed
+// (npu_feed.h), a pool of descriptors and a latest-frame-wins mailbox
+// between the grabber and a submitter thread
+//
+// The VI channel is a mock with a depth of one: a frame the grabber hasn't
+// taken when the next one is captured is overwritten. The NPU is a mock too:
+// a push waits until the previous frame is processed, copies the image and
+// returns; processing takes about 100 ms. The bench reports frames processed
+// per second, VI frames overwritten in the channel, frames the feed dropped,
+// how old a frame is when the NPU starts on it and how long the grabber holds
+// a VI buffer. The feed fails if the channel loses a frame, a frame is
+// released other than exactly once, or its frames are not fresher.
+// Usage: bench_npu_feed [seconds]
+// -----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "npu_feed.h"
+
+static const uint64_t kFramePeriodNs = 1000000000ull / 30;
+static const uint64_t kCopyNs = 2000000;        // Image copied in the push
+static const uint64_t kProcessNs = 100000000;   // Detection, about 10 fps
+
+// The descriptor ROCKIVA_PushFrame() takes, as big as RockIvaImage
+struct Image {
+  uint32_t frame_id;
+  uint32_t channel_id;
+  uint16_t width, height;
+  uint32_t format, transform;
+  uint32_t size;
+  uint8_t* addr;
+  uint8_t* phys;
+  int32_t fd;
+  void* ext;
+};
+
+struct ViFrame {
+  uint32_t seq;
+  uint64_t captured_ns;
+  uint64_t taken_ns;
+};
+
+// VI channel with u32Depth = 1
+class MockVi {
+ public:
+  void run(uint64_t until) {
+    uint64_t next = bench::now_ns() + kFramePeriodNs;
+    for (uint32_t seq = 0; next < until; seq++, next += kFramePeriodNs) {
+      bench::sleep_until_ns(next);
+      std::lock_guard<std::mutex> guard(lock_);
+      if (full_) overwritten_++;
+      pending_ = ViFrame{seq, next, 0};
+      full_ = true;
+      captured_++;
+      ready_.notify_one();
+    }
+    std::lock_guard<std::mutex> guard(lock_);
+    done_ = true;
+    ready_.notify_all();
+  }
+
+  bool get(ViFrame* frame) {
+    std::unique_lock<std::mutex> guard(lock_);
+    ready_.wait(guard, [this] { return full_ || done_; });
+    if (!full_) return false;
+    *frame = pending_;
+    frame->taken_ns = bench::now_ns();
+    full_ = false;
+    return true;
+  }
+
+  void release(const ViFrame& frame) {
+    hold_ms.push_back((bench::now_ns() - frame.taken_ns) / 1e6);
+    released_++;
+  }
+
+  uint64_t captured_ = 0, overwritten_ = 0;
+  std::atomic<uint64_t> released_{0};
+  std::vector<double> hold_ms;  // Only the thread that releases touches it
+
+ private:
+  std::mutex lock_;
+  std::condition_variable ready_;
+  ViFrame pending_{};
+  bool full_ = false, done_ = false;
+};
+
+class MockNpu {
+ public:
+  // Waits for the previous frame, then copies this one
+  int push(const Image* image, const ViFrame& frame) {
+    bench::sleep_until_ns(busy_until_);
+    uint64_t start = bench::now_ns();
+    age_ms.push_back((start - frame.captured_ns) / 1e6);
+    bench::do_not_optimize(image->fd);
+    bench::sleep_until_ns(start + kCopyNs);
+    busy_until_ = start + kProcessNs;
+    processed++;
+    return 0;
+  }
+
+  void wait_finish() { bench::sleep_until_ns(busy_until_); }
+
+  uint64_t processed = 0;
+  std::vector<double> age_ms;
+
+ private:
+  uint64_t busy_until_ = 0;
+};
+
+struct Result {
+  double fps = 0;
+  double age_p50 = 0;
+  bool ok = true;
+};
+
+static void report(const char* name, unsigned seconds, MockVi& vi, MockNpu& npu, uint64_t dropped,
+                   Result* r) {
+  r->fps = npu.processed / (double)seconds;
+  r->age_p50 = bench::percentile(npu.age_ms, 50);
+  printf("%s\n  %llu captured, %.1f processed/s, %llu overwritten in the VI channel, "
+         "%llu dropped by the feed\n",
+         name, (unsigned long long)vi.captured_, r->fps, (unsigned long long)vi.overwritten_,
+         (unsigned long long)dropped);
+  bench::print_percentiles("  frame age at NPU start", npu.age_ms, "ms");
+  bench::print_percentiles("  VI buffer held", vi.hold_ms, "ms");
+}
+
+// The old rkipc_get_vi_to_npu(): get, malloc a descriptor, push, free, release
+static void inline_push(unsigned seconds, Result* r) {
+  MockVi vi;
+  MockNpu npu;
+  std::thread grabber([&] {
+    ViFrame frame;
+    while (vi.get(&frame)) {
+      Image* image = (Image*)malloc(sizeof(Image));
+      memset(image, 0, sizeof(Image));
+      image->frame_id = frame.seq;
+      image->fd = (int32_t)frame.seq;
+      npu.push(image, frame);
+      free(image);
+      vi.release(frame);
+    }
+  });
+  vi.run(bench::now_ns() + seconds * 1000000000ull);
+  grabber.join();
+  report("inline push", seconds, vi, npu, 0, r);
+}
+
+struct Feed {
+  MockVi vi;
+  ViFrame held[NPU_FEED_SLOTS];
+  std::mutex release_lock;
+};
+
+static void feed(unsigned seconds, Result* r) {
+  Feed f;
+  MockNpu npu;
+  Image images[NPU_FEED_SLOTS];
+  memset(images, 0, sizeof(images));
+  npu_feed_t* feed = npu_feed_create(
+      NPU_FEED_SLOTS,
+      [](void* user, npu_frame_t* frame) {
+        Feed* f = (Feed*)user;
+        std::lock_guard<std::mutex> guard(f->release_lock);
+        f->vi.release(*(ViFrame*)frame->source);
+      },
+      &f);
+  if (!feed) {
+    r->ok = false;
+    return;
+  }
+
+  std::thread submitter([&] {
+    npu_frame_t* frame;
+    while ((frame = npu_feed_take(feed, -1)) != NULL) {
+      Image* image = &images[npu_feed_index(feed, frame)];
+      image->frame_id = frame->frame_id;
+      image->fd = frame->fd;
+      npu.push(image, *(ViFrame*)frame->source);
+      npu_feed_done(feed, frame);
+      npu.wait_finish();
+    }
+  });
+  std::thread grabber([&] {
+    ViFrame vf;
+    while (f.vi.get(&vf)) {
+      npu_frame_t* frame = npu_feed_acquire(feed);
+      if (!frame) {
+        std::lock_guard<std::mutex> guard(f.release_lock);
+        f.vi.release(vf);
+        continue;
+      }
+      ViFrame* held = &f.held[npu_feed_index(feed, frame)];
+      *held = vf;
+      frame->frame_id = vf.seq;
+      frame->fd = (int32_t)vf.seq;
+      frame->source = held;
+      npu_feed_post(feed, frame);
+    }
+  });
+  f.vi.run(bench::now_ns() + seconds * 1000000000ull);
+  grabber.join();
+  npu_feed_stop(feed);
+  submitter.join();
+
+  npu_feed_stats_t s;
+  npu_feed_get_stats(feed, &s);
+  npu_feed_destroy(feed);
+  report("npu feed", seconds, f.vi, npu, s.dropped, r);
+  // Every frame taken off the channel is posted, and released once
+  bool balanced = s.posted == f.vi.captured_ - f.vi.overwritten_ && f.vi.released_ == s.posted &&
+                  s.in_flight == 0;
+  printf("  posted %llu = submitted %llu + dropped %llu + left in the mailbox %llu, %llu released\n",
+         (unsigned long long)s.posted, (unsigned long long)s.submitted, (unsigned long long)s.dropped,
+         (unsigned long long)(s.posted - s.submitted - s.dropped),
+         (unsigned long long)f.vi.released_.load());
+  if (f.vi.overwritten_ || !balanced) r->ok = false;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned seconds = argc > 1 ? atoi(argv[1]) : 5;
+  printf("VI at 30 fps, NPU at %.0f ms per frame, %u s each\n", kProcessNs / 1e6, seconds);
+
+  Result inl, fed;
+  inline_push(seconds, &inl);
+  feed(seconds, &fed);
+  bool ok = fed.ok && fed.age_p50 < inl.age_p50;
+  printf("%s: frame age p50 %.1f ms -> %.1f ms\n", ok ? "PASS" : "FAIL", inl.age_p50, fed.age_p50);
+  return ok ? 0 : 1;
+}
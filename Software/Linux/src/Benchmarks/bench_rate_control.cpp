@@ -0,0 +1,261 @@
+// -----------------------------------------------------------------------------
+// Stream rate control (rate_ctl.h) on a simulated uplink replaying bandwidth
+// traces
+//
+// Four streams, the camera demo's main and sub streams of two cameras, are
+// encoded at their current bitrate and frame rate into per-session queues
+// that behave like rtsp_sender.h's: a full queue drops packets up to a
+// keyframe, which the encoder is asked for at once. One uplink drains the
+// queues in turn at the rate the trace gives for that moment. Every
+// RATE_CTL_TICK_MS the controller gets each queue's counters and its new
+// settings go to the simulated encoders. Time is simulated, so a minute of
+// trace runs in well under a second.
+//
+// Per trace and policy the bench reports, for the watched stream (0) and
+// the others, the rate and frame rate delivered, the latency from capture to
+// delivery and the frames dropped, and how much of the link was used. It
+// fails if, on any trace, the shared-link policy leaves the watched stream
+// with a worse p95 latency or fewer frames than the fixed settings do.
+// Usage: bench_rate_control [seconds] [trace.txt]
+//   trace.txt: lines of "<ms> <kbit/s>", each rate holding until the next
+// -----------------------------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "rate_ctl.h"
+
+static const int kStreams = 4;
+static const int kWatched = 0;
+static const int kStepMs = 5;
+static const int kGop = 50;
+static const double kKeyScale = 4.0;    // A keyframe against the average frame
+static const unsigned kSlots = 64;      // RTSP_SENDER_SLOTS
+// The demo's queues: four encoder stream buffers of width * height / 4 bytes
+static const uint64_t kQueueBytes[kStreams] = {4 * 1920 * 1080 / 4, 4 * 720 * 576 / 4,
+                                               4 * 1920 * 1080 / 4, 4 * 720 * 576 / 4};
+static const rate_limits_t kLimits[kStreams] = {
+    {256, 4096, 5, 30}, {128, 1024, 5, 30}, {256, 4096, 5, 30}, {128, 1024, 5, 30}};
+
+struct Trace {
+  std::string name;
+  std::vector<std::pair<uint64_t, uint32_t>> points;  // From ms on, kbit/s
+
+  uint32_t at(uint64_t ms) const {
+    uint32_t kbps = points.empty() ? 0 : points[0].second;
+    for (const auto& p : points) {
+      if (p.first > ms) break;
+      kbps = p.second;
+    }
+    return kbps;
+  }
+};
+
+struct Packet {
+  uint64_t captured_ms;
+  uint64_t size;
+  uint64_t left;
+};
+
+struct Stream {
+  rate_setting_t setting;
+  double next_frame_ms = 0;
+  unsigned frame = 0;           // In the GOP
+  bool want_key = false;
+  bool skipping = false;
+  std::deque<Packet> queue;
+  uint64_t backlog = 0;
+  rate_sample_t sample = {};
+  uint64_t frames = 0, delivered = 0, bytes = 0;
+  std::vector<double> latency_ms;
+
+  void encode(uint64_t now, unsigned chn) {
+    double period = 1000.0 / setting.fps;
+    while (next_frame_ms <= now) {
+      next_frame_ms += period;
+      bool key = frame == 0 || want_key;
+      frame = key ? 1 : (frame + 1) % kGop;
+      want_key = false;
+      double avg = setting.kbps * 1000.0 / 8 / setting.fps;
+      uint64_t size = (uint64_t)(avg * (key ? kKeyScale : (kGop - kKeyScale) / (kGop - 1)));
+      frames++;
+      if (skipping && !key) {
+        sample.dropped++;
+        continue;
+      }
+      skipping = false;
+      if (queue.size() >= kSlots || backlog + size > kQueueBytes[chn]) {
+        // Cut to the next keyframe and ask for it
+        sample.dropped++;
+        skipping = true;
+        want_key = true;
+        continue;
+      }
+      queue.push_back({now, size, size});
+      backlog += size;
+    }
+  }
+};
+
+struct Outcome {
+  double fps[kStreams], kbps[kStreams], p50[kStreams], p95[kStreams];
+  uint64_t dropped[kStreams];
+  double used;
+};
+
+static Outcome simulate(const Trace& trace, unsigned seconds, rate_policy_t policy) {
+  Stream streams[kStreams];
+  rate_setting_t initial[kStreams];
+  for (int i = 0; i < kStreams; i++) {
+    initial[i] = {kLimits[i].max_kbps, kLimits[i].max_fps};
+    streams[i].setting = initial[i];
+  }
+  rate_ctl_t* ctl = rate_ctl_create(kStreams, kLimits, initial, &policy);
+  rate_ctl_watch(ctl, kWatched);
+
+  uint64_t end = seconds * 1000ull;
+  double credit = 0, offered = 0;
+  unsigned next = 0;
+  for (uint64_t now = 0; now < end; now += kStepMs) {
+    for (int i = 0; i < kStreams; i++) streams[i].encode(now, i);
+
+    uint32_t link = trace.at(now);
+    offered += link * kStepMs / 8.0;
+    credit += link * kStepMs / 8.0;
+    // One packet per session in turn, as the network thread sends
+    for (bool busy = true; busy && credit >= 1;) {
+      busy = false;
+      for (int k = 0; k < kStreams && credit >= 1; k++) {
+        Stream& s = streams[(next + k) % kStreams];
+        if (s.queue.empty()) continue;
+        busy = true;
+        Packet& p = s.queue.front();
+        uint64_t n = std::min<uint64_t>(p.left, (uint64_t)credit);
+        p.left -= n;
+        credit -= n;
+        s.backlog -= n;
+        s.sample.bytes_sent += n;
+        if (p.left == 0) {
+          s.delivered++;
+          s.bytes += p.size;
+          s.latency_ms.push_back((double)(now + kStepMs - p.captured_ms));
+          s.queue.pop_front();
+        }
+      }
+      next = (next + 1) % kStreams;
+    }
+    if (credit > 1500) credit = 1500;  // An idle link doesn't bank capacity
+
+    if ((now + kStepMs) % RATE_CTL_TICK_MS == 0) {
+      rate_sample_t samples[kStreams];
+      for (int i = 0; i < kStreams; i++) {
+        Stream& s = streams[i];
+        s.sample.backlog = (uint32_t)s.backlog;
+        s.sample.oldest_ms = s.queue.empty() ? 0 : (uint32_t)(now + kStepMs - s.queue.front().captured_ms);
+        samples[i] = s.sample;
+      }
+      uint32_t changed = rate_ctl_tick(ctl, now + kStepMs, samples);
+      for (int i = 0; i < kStreams; i++) {
+        if (changed & (1u << i)) streams[i].setting = *rate_ctl_setting(ctl, i);
+      }
+    }
+  }
+
+  Outcome o;
+  double sent = 0;
+  for (int i = 0; i < kStreams; i++) {
+    Stream& s = streams[i];
+    o.fps[i] = s.delivered / (double)seconds;
+    o.kbps[i] = s.bytes * 8 / 1000.0 / seconds;
+    o.p50[i] = bench::percentile(s.latency_ms, 50);
+    o.p95[i] = bench::percentile(s.latency_ms, 95);
+    o.dropped[i] = s.sample.dropped;
+    sent += s.sample.bytes_sent;
+  }
+  o.used = offered > 0 ? sent / offered : 0;
+  rate_ctl_destroy(ctl);
+  return o;
+}
+
+static void print(const char* policy, const Outcome& o) {
+  printf("  %-12s link used %3.0f %%\n", policy, o.used * 100);
+  for (int i = 0; i < kStreams; i++) {
+    printf("    /live/%d%s %5.0f kbit/s %4.1f fps, latency p50 %6.0f p95 %6.0f ms, %5llu dropped\n", i,
+           i == kWatched ? "*" : " ", o.kbps[i], o.fps[i], o.p50[i], o.p95[i],
+           (unsigned long long)o.dropped[i]);
+  }
+}
+
+static std::vector<Trace> builtin_traces(unsigned seconds) {
+  std::vector<Trace> traces;
+  uint64_t third = seconds * 1000ull / 3;
+  traces.push_back({"step 12 -> 3 -> 8 Mbit/s", {{0, 12000}, {third, 3000}, {2 * third, 8000}}});
+
+  Trace outage{"6 Mbit/s with outages", {{0, 6000}}};
+  for (uint64_t t = 10000; t + 4000 < seconds * 1000ull; t += 20000) {
+    outage.points.push_back({t, 300});
+    outage.points.push_back({t + 3000, 6000});
+  }
+  traces.push_back(outage);
+
+  // A cellular uplink: a random walk in log rate every 500 ms, 1-12 Mbit/s
+  Trace cell{"cellular random walk", {}};
+  std::mt19937 rng(7);
+  std::normal_distribution<double> step(0, 0.15);
+  double kbps = 5000;
+  for (uint64_t t = 0; t < seconds * 1000ull; t += 500) {
+    cell.points.push_back({t, (uint32_t)kbps});
+    kbps = std::min(12000.0, std::max(1000.0, kbps * exp(step(rng))));
+  }
+  traces.push_back(cell);
+  return traces;
+}
+
+static bool load_trace(const char* path, Trace* trace) {
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    perror(path);
+    return false;
+  }
+  trace->name = path;
+  unsigned long long ms;
+  unsigned kbps;
+  while (fscanf(fp, "%llu %u", &ms, &kbps) == 2) trace->points.push_back({ms, kbps});
+  fclose(fp);
+  return !trace->points.empty();
+}
+
+int main(int argc, char* argv[]) {
+  unsigned seconds = argc > 1 ? atoi(argv[1]) : 60;
+  std::vector<Trace> traces;
+  if (argc > 2) {
+    Trace t;
+    if (!load_trace(argv[2], &t)) return 1;
+    traces.push_back(t);
+  } else {
+    traces = builtin_traces(seconds);
+  }
+  printf("4 streams (4096/1024/4096/1024 kbit/s at 30 fps to start), /live/%d watched, %u s per trace\n",
+         kWatched, seconds);
+
+  bool ok = true;
+  for (const Trace& trace : traces) {
+    printf("%s\n", trace.name.c_str());
+    Outcome fixed = simulate(trace, seconds, rate_policy_fixed());
+    rate_link_policy_t state;
+    rate_link_policy_default(&state);
+    Outcome adaptive = simulate(trace, seconds, rate_policy_shared_link(&state));
+    print("fixed", fixed);
+    print("shared link", adaptive);
+    if (adaptive.p95[kWatched] > fixed.p95[kWatched] || adaptive.fps[kWatched] < fixed.fps[kWatched])
+      ok = false;
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// -----------------------------------------------------------------------------
+// Traffic recorder: cost of record() on the caller's thread while the
+// flusher writes behind it, read-back of every record, index seek against a
+// linear search, and recovery of a segment cut short as by a power loss.
+//
+// Usage: bench_recorder [records] [dir]
+//   dir defaults to a fresh directory under /tmp, removed afterwards
+//
+// The write case runs flat out, far above any UART rate, so it outpaces the
+// flusher and drops are expected; read-back only checks that every record
+// not counted as dropped is on disk intact.
+// -----------------------------------------------------------------------------
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "recorder.hpp"
+#include "ucp_codec.hpp"
+#include "ucp_log.hpp"
+
+// Synthetic timestamps: record i is at kStartNs + i * kStepNs
+static const uint64_t kStartNs = 1000000000ull;
+static const uint64_t kStepNs = 1000;
+
+static void make_frame(ucp::Encoder& encoder, uint64_t n, uint8_t* out, size_t* len) {
+  ucp_rep_t rep;
+  memset(&rep, 0, sizeof(rep));
+  rep.voltage = 1200;
+  rep.heading = (int16_t)(n % 360);
+  rep.rpm[0] = (int16_t)n;
+  *len = encoder.encode(rep, out, ucp::Frame<ucp_rep_t>::size());
+}
+
+// Returns the number of records dropped, or -1 if the recorder didn't open
+static int64_t write_case(const std::string& dir, size_t records) {
+  ucp_log::RecorderOptions options;
+  options.dir = dir;
+  options.segment_bytes = 1 << 20;   // Small segments so the run rotates many times
+  options.max_segments = 0;
+  ucp_log::Recorder recorder;
+  if (!recorder.open(options)) return -1;
+
+  ucp::Encoder encoder;
+  uint8_t frame[ucp::Frame<ucp_rep_t>::size()];
+  size_t len;
+  std::vector<double> cost;
+  cost.reserve(records);
+  uint64_t t0 = bench::now_ns();
+  for (size_t i = 0; i < records; i++) {
+    make_frame(encoder, i, frame, &len);
+    uint64_t ts = kStartNs + i * kStepNs;
+    uint64_t a = bench::now_ns();
+    recorder.record(ts, i % 8 ? ucp_log::kFromRobot : ucp_log::kToRobot, frame, len);
+    uint64_t b = bench::now_ns();
+    cost.push_back(b - a);
+    if ((i & 1023) == 0) recorder.tick(b);
+  }
+  uint64_t t1 = bench::now_ns();
+  uint64_t before = recorder.stats().dropped;
+  recorder.close();
+  uint64_t t2 = bench::now_ns();
+
+  ucp_log::RecorderStats s = recorder.stats();
+  bench::print_percentiles("record() cost", cost, "ns");
+  printf("  %zu records in %.3f s (%.0f k/s), close %.1f ms; %llu dropped, %llu segments, "
+         "%.1f MB written, %llu write errors\n",
+         records, (t1 - t0) / 1e9, records / ((t1 - t0) / 1e9) / 1e3, (t2 - t1) / 1e6,
+         (unsigned long long)before, (unsigned long long)s.segments, s.bytes_written / 1e6,
+         (unsigned long long)s.write_errors);
+  return s.dropped;
+}
+
+// Every record that wasn't dropped must come back in order with the frame it
+// was written with
+static bool read_back(const std::string& dir, size_t records, uint64_t dropped) {
+  ucp::Encoder encoder;
+  uint8_t frame[ucp::Frame<ucp_rep_t>::size()];
+  size_t len;
+  uint64_t next = 0, found = 0, bad = 0;
+  ucp_log::SegmentReader reader;
+  uint64_t t0 = bench::now_ns();
+  for (const std::string& path : ucp_log::list_segments(dir)) {
+    if (!reader.open(path)) {
+      fprintf(stderr, "  %s\n", reader.error().c_str());
+      return false;
+    }
+    if (!reader.was_closed()) bad++;
+    ucp_log::Record r;
+    for (uint64_t offset = reader.begin(); reader.next(&offset, &r);) {
+      uint64_t i = (r.timestamp_ns - kStartNs) / kStepNs;
+      if (r.timestamp_ns < kStartNs || i < next || i >= records) {
+        bad++;
+        continue;
+      }
+      while (next <= i) make_frame(encoder, next++, frame, &len);  // Encoder index follows i
+      if (r.len != len || memcmp(r.frame, frame, len) != 0) bad++;
+      found++;
+    }
+  }
+  uint64_t t1 = bench::now_ns();
+  printf("read back: %llu of %zu records (%llu dropped) in %.1f ms, %llu bad\n",
+         (unsigned long long)found, records, (unsigned long long)dropped, (t1 - t0) / 1e6,
+         (unsigned long long)bad);
+  return bad == 0 && found + dropped == records;
+}
+
+// Index seek against lower_bound over every timestamp of the segment
+static bool seek_case(const std::string& dir) {
+  std::mt19937_64 rng(7);
+  std::vector<double> cost;
+  uint64_t wrong = 0;
+  ucp_log::SegmentReader reader;
+  for (const std::string& path : ucp_log::list_segments(dir)) {
+    if (!reader.open(path)) return false;
+    std::vector<std::pair<uint64_t, uint64_t>> all;  // timestamp, offset
+    ucp_log::Record r;
+    for (uint64_t offset = reader.begin(); reader.next(&offset, &r);) all.push_back({r.timestamp_ns, r.offset});
+    if (all.empty()) continue;
+
+    uint64_t lo = all.front().first - kStepNs, hi = all.back().first + kStepNs;
+    for (int k = 0; k < 2000; k++) {
+      uint64_t ts = lo + rng() % (hi - lo + 1);
+      uint64_t a = bench::now_ns();
+      uint64_t got = reader.seek(ts);
+      uint64_t b = bench::now_ns();
+      cost.push_back(b - a);
+      auto it = std::lower_bound(all.begin(), all.end(), std::make_pair(ts, (uint64_t)0));
+      uint64_t want = it == all.end() ? reader.end() : it->second;
+      if (got != want) wrong++;
+    }
+  }
+  bench::print_percentiles("seek()", cost, "ns");
+  if (wrong) fprintf(stderr, "  %llu seeks disagree with a linear search\n", (unsigned long long)wrong);
+  return wrong == 0;
+}
+
+// Copy the first segment up to the middle of a record, with the header as it
+// is while the segment is still open, and check the reader recovers every
+// whole record before the cut.
+static bool recovery_case(const std::string& dir) {
+  std::vector<std::string> segments = ucp_log::list_segments(dir);
+  if (segments.empty()) return false;
+  ucp_log::SegmentReader closed;
+  if (!closed.open(segments.front())) return false;
+
+  uint64_t keep = closed.record_count() / 2, offset = closed.begin(), kept = 0;
+  ucp_log::Record r;
+  while (kept < keep && closed.next(&offset, &r)) kept++;
+  uint64_t cut = offset + sizeof(ucp_log::RecordHeader) + 3;  // Torn record after `kept`
+
+  ucp_log::SegmentHeader header = closed.header();
+  header.first_timestamp_ns = 0;
+  header.last_timestamp_ns = 0;
+  header.record_count = 0;
+  header.index_offset = 0;
+  header.index_count = 0;
+  std::string path = dir + "/crashed.bin";
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  const uint8_t* base = reinterpret_cast<const uint8_t*>(&closed.header());
+  bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+            write(fd, base + sizeof(header), cut - sizeof(header)) == (ssize_t)(cut - sizeof(header));
+  close(fd);
+
+  ucp_log::SegmentReader recovered;
+  ok = ok && recovered.open(path);
+  uint64_t t0 = bench::now_ns();
+  uint64_t target = ok ? recovered.seek(kStartNs + (kept / 2) * kStepNs) : 0;
+  uint64_t t1 = bench::now_ns();
+  ok = ok && !recovered.was_closed() && recovered.record_count() == kept && recovered.end() == offset;
+  printf("recovery: %llu of %llu records before the cut recovered, seek %.0f ns -> %s\n",
+         (unsigned long long)(ok ? recovered.record_count() : 0), (unsigned long long)kept,
+         (double)(t1 - t0), ok && target < recovered.end() ? "ok" : "FAILED");
+  unlink(path.c_str());
+  return ok && target < recovered.end();
+}
+
+int main(int argc, char* argv[]) {
+  size_t records = argc > 1 ? strtoull(argv[1], NULL, 0) : 2000000;
+  std::string dir;
+  bool cleanup = argc <= 2;
+  if (cleanup) {
+    char tmpl[] = "/tmp/bench_recorder.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+      perror("mkdtemp");
+      return 1;
+    }
+    dir = tmpl;
+  } else {
+    dir = argv[2];
+  }
+
+  int64_t dropped = write_case(dir, records);
+  bool ok = dropped >= 0 && read_back(dir, records, dropped);
+  ok = seek_case(dir) && ok;
+  ok = recovery_case(dir) && ok;
+
+  if (cleanup) {
+    for (const std::string& path : ucp_log::list_segments(dir)) unlink(path.c_str());
+    rmdir(dir.c_str());
+  }
+  return ok ? 0 : 1;
+}
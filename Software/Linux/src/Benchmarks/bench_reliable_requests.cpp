@@ -0,0 +1,343 @@
+// -----------------------------------------------------------------------------
+// Reliable calibration requests (ucp_reliable.h) against the single 1 s timer
+//
+// The firmware sends UCP_IMU_WRITE, UCP_MAG_WRITE and UCP_IMUMAG_READ and
+// repeats them until the head answers. First a simulation in virtual time of
+// a UART link with a 4..6 ms one-way delay that loses 0, 5, 20 and 40% of the
+// frames in each direction, 2000 runs each:
+//   legacy   : one 1 s one-shot timer; on expiry every request not yet
+//              answered is sent again, and the head answers (and applies)
+//              every copy
+//   windowed : ucp_rel_tx_t with the adaptive timeout, and a head that
+//              answers repeats with ucp_rel_rx_t
+// reporting how long the three exchanges take, the frames sent and how often
+// the head applied a request twice. Then end to end over a pty: a simulated
+// firmware with the same window against a ucp::Client answering through
+// on_request(), ignoring 30% of the answers, which must still complete every
+// exchange with the handler called once per request.
+// -----------------------------------------------------------------------------
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "fake_mcu.hpp"
+#include "ucp_client.hpp"
+#include "ucp_reliable.h"
+
+static const uint8_t kRequestIds[] = {UCP_IMU_WRITE, UCP_MAG_WRITE, UCP_IMUMAG_READ};
+static const int kRequests = 3;
+static const uint32_t kLegacyTimeoutMs = 1000;
+static const uint32_t kGiveUpMs = 120000;
+
+static int request_index(uint8_t id) {
+  for (int i = 0; i < kRequests; i++) {
+    if (kRequestIds[i] == id) return i;
+  }
+  return -1;
+}
+
+// The request frame the firmware builds, index and CRC left to the sender
+static size_t build_request(uint8_t id, uint8_t* out) {
+  size_t msg = id == UCP_IMU_WRITE ? sizeof(ucp_imu_w_t) : id == UCP_MAG_WRITE ? sizeof(ucp_mag_w_t) : sizeof(ucp_imu_r_t);
+  size_t len = msg + ucp::kFrameOverhead;
+  memset(out, 0, len);
+  for (size_t i = ucp::kSyncSize + sizeof(ucp_hd_t); i < len - ucp::kCrcSize; i++) out[i] = (uint8_t)(i * 7 + id);
+  ucp_hd_t hd = {(uint16_t)msg, id, 0};
+  memcpy(out + ucp::kSyncSize, &hd, sizeof(hd));
+  ucp::seal_raw(out, len);
+  return len;
+}
+
+// The head's answer to `request`, carrying its index
+static size_t build_answer(const uint8_t* request, uint8_t* out) {
+  uint8_t id = request[4];
+  size_t msg = id == UCP_IMUMAG_READ ? sizeof(ucp_imu_r_ack_t) : sizeof(ucp_imu_w_ack_t);
+  size_t len = msg + ucp::kFrameOverhead;
+  memset(out, 0, len);
+  ucp_hd_t hd = {(uint16_t)msg, id, request[5]};
+  memcpy(out + ucp::kSyncSize, &hd, sizeof(hd));
+  ucp::seal_raw(out, len);
+  return len;
+}
+
+struct InFlight {
+  uint32_t at_ms;
+  bool to_head;
+  std::vector<uint8_t> frame;
+};
+
+// A lossy UART in virtual time
+class Link {
+ public:
+  Link(double loss, unsigned seed) : loss_(loss), rng_(seed) {}
+
+  void send(uint32_t now_ms, bool to_head, const uint8_t* frame, size_t len) {
+    frames++;
+    if (uni_(rng_) < loss_) return;
+    uint32_t at = now_ms + 4 + (uint32_t)(rng_() % 3);
+    queue_.push_back({at, to_head, std::vector<uint8_t>(frame, frame + len)});
+  }
+
+  // Frames arriving at now_ms
+  template <typename F>
+  void deliver(uint32_t now_ms, F&& f) {
+    for (size_t i = 0; i < queue_.size();) {
+      if (queue_[i].at_ms <= now_ms) {
+        InFlight m = std::move(queue_[i]);
+        queue_.erase(queue_.begin() + i);
+        f(m);
+      } else {
+        i++;
+      }
+    }
+  }
+
+  size_t frames = 0;
+
+ private:
+  double loss_;
+  std::minstd_rand rng_;
+  std::uniform_real_distribution<double> uni_{0, 1};
+  std::deque<InFlight> queue_;
+};
+
+struct RunResult {
+  uint32_t done_ms = 0;     // All three answered
+  size_t frames = 0;        // Both directions
+  int applied_twice = 0;    // Requests the head applied more than once
+};
+
+static RunResult run_legacy(double loss, unsigned seed) {
+  Link link(loss, seed);
+  uint8_t requests[kRequests][UCP_REL_FRAME_MAX];
+  size_t lens[kRequests];
+  bool waiting[kRequests];
+  int applied[kRequests] = {};
+  for (int i = 0; i < kRequests; i++) {
+    lens[i] = build_request(kRequestIds[i], requests[i]);
+    waiting[i] = true;
+    link.send(0, true, requests[i], lens[i]);
+  }
+  uint32_t timer_ms = kLegacyTimeoutMs;
+  RunResult res;
+  for (uint32_t now = 0; now < kGiveUpMs; now++) {
+    link.deliver(now, [&](const InFlight& m) {
+      int r = request_index(m.frame[4]);
+      if (r < 0) return;  // Not one of ours
+      if (m.to_head) {
+        applied[r]++;
+        uint8_t answer[UCP_REL_FRAME_MAX];
+        link.send(now, false, answer, build_answer(m.frame.data(), answer));
+      } else {
+        waiting[r] = false;
+      }
+    });
+    if (!waiting[0] && !waiting[1] && !waiting[2]) {
+      res.done_ms = now;
+      break;
+    }
+    if (now >= timer_ms) {
+      for (int i = 0; i < kRequests; i++) {
+        if (waiting[i]) link.send(now, true, requests[i], lens[i]);
+      }
+      timer_ms = now + kLegacyTimeoutMs;
+    }
+  }
+  if (!res.done_ms) res.done_ms = kGiveUpMs;
+  res.frames = link.frames;
+  for (int i = 0; i < kRequests; i++) res.applied_twice += applied[i] > 1;
+  return res;
+}
+
+// `tx` carries the round trip estimate over from earlier exchanges, as the
+// firmware's does
+static RunResult run_windowed(ucp_rel_tx_t* tx, double loss, unsigned seed, uint32_t start_ms) {
+  Link link(loss, seed);
+  ucp_rel_rx_t rx;
+  ucp_rel_rx_init(&rx);
+  int applied[kRequests] = {};
+  for (int i = 0; i < kRequests; i++) {
+    uint8_t frame[UCP_REL_FRAME_MAX];
+    size_t len = build_request(kRequestIds[i], frame);
+    ucp_rel_send(tx, frame, len, start_ms);
+    link.send(start_ms, true, frame, len);
+  }
+  RunResult res;
+  for (uint32_t now = start_ms; now < start_ms + kGiveUpMs; now++) {
+    link.deliver(now, [&](const InFlight& m) {
+      if (m.to_head) {
+        size_t len = 0;
+        if (const uint8_t* again = ucp_rel_rx_seen(&rx, m.frame.data(), m.frame.size(), &len, now)) {
+          link.send(now, false, again, len);
+          return;
+        }
+        int r = request_index(m.frame[4]);
+        if (r < 0) return;
+        applied[r]++;
+        uint8_t answer[UCP_REL_FRAME_MAX];
+        len = build_answer(m.frame.data(), answer);
+        ucp_rel_rx_answered(&rx, m.frame.data(), m.frame.size(), answer, len, now);
+        link.send(now, false, answer, len);
+      } else {
+        ucp_rel_ack(tx, m.frame[4], m.frame[5], now);
+      }
+    });
+    if (ucp_rel_next_ms(tx, now) < 0) {
+      res.done_ms = now - start_ms;
+      break;
+    }
+    uint8_t frame[UCP_REL_FRAME_MAX];
+    while (size_t len = ucp_rel_due(tx, now, frame)) link.send(now, true, frame, len);
+  }
+  if (!res.done_ms) res.done_ms = kGiveUpMs;
+  res.frames = link.frames;
+  for (int i = 0; i < kRequests; i++) res.applied_twice += applied[i] > 1;
+  return res;
+}
+
+static bool simulation_case(double loss) {
+  const int runs = 2000;
+  std::vector<double> legacy_ms, windowed_ms;
+  size_t legacy_frames = 0, windowed_frames = 0;
+  int legacy_twice = 0, windowed_twice = 0;
+  ucp_rel_tx_t tx;
+  ucp_rel_tx_init(&tx, 0);
+  uint32_t clock_ms = 0;
+  for (int i = 0; i < runs; i++) {
+    RunResult l = run_legacy(loss, 100 + i);
+    legacy_ms.push_back(l.done_ms);
+    legacy_frames += l.frames;
+    legacy_twice += l.applied_twice;
+    RunResult w = run_windowed(&tx, loss, 100 + i, clock_ms);
+    clock_ms += w.done_ms + 1000;
+    windowed_ms.push_back(w.done_ms);
+    windowed_frames += w.frames;
+    windowed_twice += w.applied_twice;
+  }
+  printf("%2.0f%% loss:\n", loss * 100);
+  bench::print_percentiles("  legacy (ms)", legacy_ms, "ms");
+  bench::print_percentiles("  windowed (ms)", windowed_ms, "ms");
+  printf("  frames a run: legacy %.1f, windowed %.1f; applied twice: legacy %d, windowed %d; RTO now %u ms\n",
+         (double)legacy_frames / runs, (double)windowed_frames / runs, legacy_twice, windowed_twice, tx.rto_ms);
+  return windowed_twice == 0 && windowed_ms.back() < kGiveUpMs &&
+         bench::percentile(windowed_ms, 99) <= bench::percentile(legacy_ms, 99);
+}
+
+// Sends the three requests through a window and ignores some answers
+class SimFirmware {
+ public:
+  SimFirmware(int fd, double ignore) : fd_(fd), ignore_(ignore) {
+    ucp_rel_tx_init(&tx_, 0);
+    thread_ = std::thread([this] { run(); });
+  }
+  ~SimFirmware() {
+    done_ = true;
+    thread_.join();
+  }
+
+  std::atomic<bool> finished{false};
+  std::atomic<uint64_t> elapsed_ns{0};
+  std::atomic<int> retransmissions{0};
+
+ private:
+  uint32_t now_ms() const { return (uint32_t)(bench::now_ns() / 1000000); }
+
+  void run() {
+    std::minstd_rand rng(11);
+    std::uniform_real_distribution<double> uni(0, 1);
+    ucp::Decoder decoder;
+    uint64_t start = bench::now_ns();
+    for (int i = 0; i < kRequests; i++) {
+      uint8_t frame[UCP_REL_FRAME_MAX];
+      size_t len = build_request(kRequestIds[i], frame);
+      ucp_rel_send(&tx_, frame, len, now_ms());
+      if (write(fd_, frame, len) != (ssize_t)len) perror("write");
+    }
+    uint8_t buf[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    while (!done_.load()) {
+      if (ucp_rel_next_ms(&tx_, now_ms()) < 0) {
+        if (!finished) elapsed_ns = bench::now_ns() - start;
+        finished = true;
+      }
+      uint8_t frame[UCP_REL_FRAME_MAX];
+      while (size_t len = ucp_rel_due(&tx_, now_ms(), frame)) {
+        retransmissions++;
+        if (write(fd_, frame, len) != (ssize_t)len) perror("write");
+      }
+      if (poll(&pfd, 1, 1) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (request_index(f.id()) < 0 || uni(rng) < ignore_) return;
+        ucp_rel_ack(&tx_, f.id(), f.index(), now_ms());
+      });
+    }
+  }
+
+  int fd_;
+  double ignore_;
+  ucp_rel_tx_t tx_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+static bool client_case() {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+
+  ucp::ClientOptions options;
+  options.rate_hz = 100;
+  options.sync_interval_ms = 0;
+  ucp::Client client(options);
+
+  // Reader thread only
+  int handled[kRequests] = {};
+  client.on_request([&](const ucp::FrameView& f, uint8_t* body, size_t cap) -> size_t {
+    int r = request_index(f.id());
+    if (r < 0) return 0;
+    handled[r]++;
+    size_t len = f.id() == UCP_IMUMAG_READ ? sizeof(ucp_imu_r_ack_t) - sizeof(ucp_hd_t) : 1;
+    if (cap < len) return 0;
+    memset(body, 0, len);  // err = UCP_ERR_OK
+    return len;
+  });
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+  bool finished;
+  double ms;
+  int retransmissions;
+  {
+    SimFirmware firmware(pty.master, 0.3);
+    uint64_t end = bench::now_ns() + 10 * 1000000000ull;
+    while (!firmware.finished && bench::now_ns() < end) usleep(1000);
+    finished = firmware.finished;
+    ms = firmware.elapsed_ns / 1e6;
+    retransmissions = firmware.retransmissions;
+  }
+  client.stop();
+
+  ucp::ClientStats s = client.stats();
+  bool once = handled[0] == 1 && handled[1] == 1 && handled[2] == 1;
+  printf("client, 30%% of answers ignored: %s in %.1f ms, %d retransmissions, handler calls %d/%d/%d, "
+         "%llu answered, %llu repeats answered again\n",
+         finished ? "done" : "NOT done", ms, retransmissions, handled[0], handled[1], handled[2],
+         (unsigned long long)s.requests_answered, (unsigned long long)s.requests_repeated);
+  bool ok = finished && once;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (double loss : {0.0, 0.05, 0.2, 0.4}) ok = simulation_case(loss) && ok;
+  ok = client_case() && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+// -----------------------------------------------------------------------------
+// Delta-coded reports (UCP_REPORT_DELTA, ucp_delta.h) against the full report
+//
+// Runs the shared encoder and decoder over report traces at 50 Hz:
+//   parked  : the robot at rest, sensor noise only
+//   driving : ramps, turns and stops, with vibration on the IMU
+// and over every report in the ucp_log directories given on the command line
+// (recorder output, see README). The head acknowledges each keyframe two
+// reports after it was sent, as over a UART. For each trace: the bytes per
+// second of the 44-byte report, the 54-byte UCP_REPORT_V2 and the delta
+// frames, and whether every report was rebuilt exactly. Then the driving
+// trace with 5% of frames and acknowledgments lost: every report rebuilt
+// must still be exact. Then end to end over a pty: a simulated firmware
+// sends the driving trace delta-coded, and a ucp::Client acknowledges the
+// keyframes and hands the callback the rebuilt UCP_REPORT_V2 frames.
+// Finally the cost of ucp_delta_encode() and ucp_delta_decode().
+// Usage: bench_report_delta [log-dir ...]
+// -----------------------------------------------------------------------------
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "fake_mcu.hpp"
+#include "ucp_client.hpp"
+#include "ucp_delta.h"
+#include "ucp_log.hpp"
+
+static const double kReportHz = 50;
+static const uint64_t kReportPeriodUs = 20000;
+static const size_t kAckLag = 2;    // Reports between a keyframe and its acknowledgment
+
+struct Trace {
+  std::string name;
+  std::vector<ucp_delta_report_t> reports;
+};
+
+static int16_t clamp16(double v) { return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : lround(v)); }
+
+// A report as uart_mutex.c fills it: battery in `voltage`, version fixed
+static ucp_delta_report_t base_report(uint64_t sample_us) {
+  ucp_delta_report_t r;
+  memset(&r, 0, sizeof(r));
+  r.sample_us = sample_us;
+  r.rep.voltage = 87;
+  r.rep.acc[2] = 16384;
+  r.rep.mag[0] = 210;
+  r.rep.mag[1] = -95;
+  r.rep.mag[2] = 380;
+  r.rep.heading = 132;
+  r.rep.version = 0x0104;
+  return r;
+}
+
+static Trace parked_trace(double seconds) {
+  Trace t{"parked", {}};
+  std::minstd_rand rng(3);
+  std::normal_distribution<double> acc(0, 12), gyro(0, 4), mag(0, 1.5);
+  uint64_t us = 3600ull * 1000000;
+  for (size_t i = 0; i < seconds * kReportHz; i++, us += kReportPeriodUs) {
+    ucp_delta_report_t r = base_report(us + (rng() % 40));
+    for (int k = 0; k < 3; k++) {
+      r.rep.acc[k] = clamp16(r.rep.acc[k] + acc(rng));
+      r.rep.gyros[k] = clamp16(gyro(rng));
+      r.rep.mag[k] = clamp16(r.rep.mag[k] + mag(rng));
+    }
+    t.reports.push_back(r);
+  }
+  return t;
+}
+
+static Trace driving_trace(double seconds) {
+  Trace t{"driving", {}};
+  std::minstd_rand rng(5);
+  std::normal_distribution<double> acc(0, 150), gyro(0, 25), mag(0, 2), rpm(0, 2);
+  uint64_t us = 3600ull * 1000000;
+  double speed = 0, yaw_rate = 0, heading = 132;
+  for (size_t i = 0; i < seconds * kReportHz; i++, us += kReportPeriodUs) {
+    double s = i / kReportHz;
+    // 8 s cycle: accelerate, cruise, turn, brake, stand
+    double phase = fmod(s, 8.0);
+    double want_speed = phase < 6 ? 120 : 0;
+    double want_yaw = phase >= 3 && phase < 4.5 ? 45 : 0;  // deg/s
+    double accel = (want_speed - speed) * 0.1;
+    speed += accel;
+    yaw_rate += (want_yaw - yaw_rate) * 0.2;
+    heading = fmod(heading + yaw_rate / kReportHz + 360, 360);
+    ucp_delta_report_t r = base_report(us + (rng() % 40));
+    double vib = speed > 1 ? 1 : 0.1;
+    for (int k = 0; k < 4; k++) {
+      double side = (k % 2 ? 1 : -1) * yaw_rate * 0.4;
+      r.rep.rpm[k] = clamp16(speed + side + (speed > 1 ? rpm(rng) : 0));
+    }
+    r.rep.acc[0] = clamp16(accel * 300 + vib * acc(rng));
+    r.rep.acc[1] = clamp16(speed * yaw_rate * 0.6 + vib * acc(rng));
+    r.rep.acc[2] = clamp16(16384 + vib * acc(rng));
+    r.rep.gyros[0] = clamp16(vib * gyro(rng));
+    r.rep.gyros[1] = clamp16(vib * gyro(rng));
+    r.rep.gyros[2] = clamp16(yaw_rate * 16.4 + vib * gyro(rng));
+    double rad = heading * M_PI / 180;
+    r.rep.mag[0] = clamp16(230 * cos(rad) + mag(rng));
+    r.rep.mag[1] = clamp16(230 * sin(rad) + mag(rng));
+    r.rep.mag[2] = clamp16(380 + mag(rng));
+    r.rep.heading = (int16_t)lround(heading);
+    r.rep.voltage = (uint16_t)(87 - s / 120);
+    t.reports.push_back(r);
+  }
+  return t;
+}
+
+// The reports the robot sent in a recorder log: UCP_RPM_REPORT with the
+// record time as sample time, or UCP_REPORT_V2 as is
+static bool load_log(const char* dir, Trace* t) {
+  ucp_log::LogReader reader;
+  if (!reader.open(dir)) {
+    fprintf(stderr, "%s: %s\n", dir, reader.error().c_str());
+    return false;
+  }
+  t->name = dir;
+  ucp_log::Record rec;
+  while (reader.next(&rec)) {
+    if (rec.direction != ucp_log::kFromRobot) continue;
+    ucp::FrameView f = {rec.frame, rec.len};
+    if (rec.len < ucp::kFrameOverhead + sizeof(ucp_hd_t) || f.len() + ucp::kFrameOverhead != rec.len) continue;
+    ucp_delta_report_t r;
+    memset(&r, 0, sizeof(r));
+    if (const ucp_rep_t* rep = f.id() == UCP_RPM_REPORT ? f.as<ucp_rep_t>() : nullptr) {
+      r.rep = *rep;
+      r.sample_us = rec.timestamp_ns / 1000;
+    } else if (const ucp_rep_v2_t* v2 = f.id() == UCP_REPORT_V2 ? f.as<ucp_rep_v2_t>() : nullptr) {
+      memcpy((uint8_t*)&r.rep + sizeof(ucp_hd_t), &v2->voltage, UCP_DELTA_REP_BYTES);
+      r.sample_us = v2->sample_us;
+    } else {
+      continue;
+    }
+    memset(&r.rep.hd, 0, sizeof(r.rep.hd));
+    t->reports.push_back(r);
+  }
+  return true;
+}
+
+static bool same(const ucp_delta_report_t& a, const ucp_delta_report_t& b) {
+  return a.sample_us == b.sample_us &&
+         memcmp((const uint8_t*)&a.rep + sizeof(ucp_hd_t), (const uint8_t*)&b.rep + sizeof(ucp_hd_t),
+                UCP_DELTA_REP_BYTES) == 0;
+}
+
+struct RunResult {
+  size_t frames = 0, keyframes = 0, bytes = 0;  // Sent; bytes on the wire
+  size_t rebuilt = 0, wrong = 0, unresolved = 0;
+};
+
+// Encode, drop, decode and acknowledge a trace; `loss` applies to frames
+// and acknowledgments alike
+static RunResult run_trace(const Trace& t, double loss, unsigned seed) {
+  RunResult res;
+  ucp_delta_enc_t enc;
+  ucp_delta_dec_t dec;
+  ucp_delta_enc_init(&enc, UCP_DELTA_KEY_INTERVAL);
+  ucp_delta_dec_init(&dec);
+  std::minstd_rand rng(seed);
+  std::uniform_real_distribution<double> uni(0, 1);
+  std::deque<std::pair<size_t, uint8_t>> acks;  // (due at report, key_seq)
+  uint8_t body[UCP_DELTA_MSG_MAX];
+  for (size_t i = 0; i < t.reports.size(); i++) {
+    while (!acks.empty() && acks.front().first <= i) {
+      ucp_delta_enc_ack(&enc, acks.front().second);
+      acks.pop_front();
+    }
+    size_t n = ucp_delta_encode(&enc, &t.reports[i], body);
+    res.frames++;
+    res.bytes += n + sizeof(ucp_hd_t) + ucp::kFrameOverhead;
+    if (body[1] & UCP_DELTA_F_KEY) res.keyframes++;
+    if (uni(rng) < loss) continue;
+    ucp_delta_report_t out;
+    int ret = ucp_delta_decode(&dec, body, n, &out);
+    if (ret < 0) {
+      res.unresolved++;
+      continue;
+    }
+    res.rebuilt++;
+    if (!same(out, t.reports[i])) res.wrong++;
+    if (ret == UCP_DELTA_KEYFRAME && uni(rng) >= loss) acks.emplace_back(i + kAckLag, body[0]);
+  }
+  return res;
+}
+
+static bool trace_case(const Trace& t) {
+  if (t.reports.empty()) {
+    printf("  %-24s no reports\n", t.name.c_str());
+    return true;
+  }
+  RunResult r = run_trace(t, 0, 1);
+  double seconds = t.reports.size() / kReportHz;
+  double v1 = ucp::Frame<ucp_rep_t>::size() * kReportHz;
+  double v2 = ucp::Frame<ucp_rep_v2_t>::size() * kReportHz;
+  double delta = r.bytes / seconds;
+  bool ok = r.wrong == 0 && r.unresolved == 0 && r.rebuilt == t.reports.size();
+  printf("  %-24s %6zu %8.0f %8.0f %8.0f %5.1f%% %5.1f%% %6zu  %s\n", t.name.c_str(), t.reports.size(), v1, v2,
+         delta, 100 * (1 - delta / v1), 100 * (1 - delta / v2), r.keyframes, ok ? "exact" : "MISMATCH");
+  return ok;
+}
+
+static bool loss_case(const Trace& t) {
+  RunResult r = run_trace(t, 0.05, 9);
+  bool ok = r.wrong == 0 && r.rebuilt > 0;
+  printf("%s with 5%% loss: %zu of %zu frames arrived, %zu rebuilt (%zu without their keyframe), %zu wrong: %s\n",
+         t.name.c_str(), r.rebuilt + r.unresolved, r.frames, r.rebuilt, r.unresolved, r.wrong,
+         ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+// Sends a trace delta-coded at 50 Hz and applies the head's acknowledgments
+class SimFirmware {
+ public:
+  SimFirmware(int fd, const Trace& trace) : fd_(fd), trace_(trace) {
+    ucp_delta_enc_init(&enc_, UCP_DELTA_KEY_INTERVAL);
+    thread_ = std::thread([this] { run(); });
+  }
+  ~SimFirmware() {
+    done_ = true;
+    thread_.join();
+  }
+
+  std::atomic<size_t> sent{0};
+  std::atomic<uint64_t> acks{0};
+
+ private:
+  void run() {
+    ucp::Decoder decoder;
+    uint8_t buf[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    uint64_t next = bench::now_ns();
+    size_t i = 0;
+    while (!done_.load()) {
+      uint64_t now = bench::now_ns();
+      if (now >= next && i < trace_.reports.size()) {
+        uint8_t frame[sizeof(ucp_hd_t) + UCP_DELTA_MSG_MAX + ucp::kFrameOverhead];
+        size_t n = ucp_delta_encode(&enc_, &trace_.reports[i++], frame + ucp::kSyncSize + sizeof(ucp_hd_t));
+        size_t len = n + sizeof(ucp_hd_t) + ucp::kFrameOverhead;
+        encoder_.seal_bytes(frame, len, UCP_REPORT_DELTA);
+        if (write(fd_, frame, len) != (ssize_t)len) perror("write");
+        sent = i;
+        next += kReportPeriodUs * 1000;
+      }
+      if (poll(&pfd, 1, 1) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (f.id() != UCP_REPORT_DELTA) return;
+        if (const ucp_rep_delta_ack_t* ack = f.as<ucp_rep_delta_ack_t>()) {
+          ucp_delta_enc_ack(&enc_, ack->key_seq);
+          acks++;
+        }
+      });
+    }
+  }
+
+  int fd_;
+  const Trace& trace_;
+  ucp_delta_enc_t enc_;
+  ucp::Encoder encoder_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+static bool client_case(const Trace& t) {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+
+  ucp::ClientOptions options;
+  options.rate_hz = 50;
+  options.sync_interval_ms = 0;
+  ucp::Client client(options);
+
+  // Reader thread only
+  size_t reports = 0, wrong = 0;
+  client.on_telemetry([&](const ucp::FrameView& f, uint64_t) {
+    const ucp_rep_v2_t* v2 = f.id() == UCP_REPORT_V2 ? f.as<ucp_rep_v2_t>() : nullptr;
+    if (!v2) return;
+    // sample_us runs 20 ms apart from the trace start, give or take 40 us
+    size_t i = (size_t)((v2->sample_us - t.reports[0].sample_us + kReportPeriodUs / 2) / kReportPeriodUs);
+    ucp_delta_report_t r;
+    memset(&r, 0, sizeof(r));
+    r.sample_us = v2->sample_us;
+    memcpy((uint8_t*)&r.rep + sizeof(ucp_hd_t), &v2->voltage, UCP_DELTA_REP_BYTES);
+    reports++;
+    if (i >= t.reports.size() || !same(r, t.reports[i])) wrong++;
+  });
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+  SimFirmware firmware(pty.master, t);
+  uint64_t end = bench::now_ns() + (uint64_t)(t.reports.size() / kReportHz * 1e9) + 200000000ull;
+  while (firmware.sent < t.reports.size() && bench::now_ns() < end) usleep(10000);
+  usleep(100 * 1000);
+  client.stop();
+
+  ucp::ClientStats s = client.stats();
+  printf("client: %zu of %zu reports rebuilt (%llu keyframes, %llu deltas, %llu unresolved), %zu wrong, "
+         "%llu acknowledgments\n",
+         reports, firmware.sent.load(), (unsigned long long)s.report_keyframes,
+         (unsigned long long)s.report_deltas, (unsigned long long)s.report_unresolved, wrong,
+         (unsigned long long)firmware.acks.load());
+  bool ok = reports == firmware.sent && wrong == 0 && s.report_deltas > s.report_keyframes;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+static void cost_case(const Trace& t) {
+  ucp_delta_enc_t enc;
+  ucp_delta_dec_t dec;
+  ucp_delta_enc_init(&enc, UCP_DELTA_KEY_INTERVAL);
+  ucp_delta_dec_init(&dec);
+  std::vector<std::vector<uint8_t>> bodies;
+  uint8_t body[UCP_DELTA_MSG_MAX];
+  uint64_t start = bench::now_ns();
+  for (const ucp_delta_report_t& r : t.reports) {
+    size_t n = ucp_delta_encode(&enc, &r, body);
+    if (body[1] & UCP_DELTA_F_KEY) ucp_delta_enc_ack(&enc, body[0]);
+    bodies.emplace_back(body, body + n);
+  }
+  double enc_ns = (double)(bench::now_ns() - start) / t.reports.size();
+  ucp_delta_report_t out;
+  uint64_t acc = 0;
+  start = bench::now_ns();
+  for (const std::vector<uint8_t>& b : bodies) {
+    if (ucp_delta_decode(&dec, b.data(), b.size(), &out) >= 0) acc += out.rep.heading;
+  }
+  bench::do_not_optimize(acc);
+  double dec_ns = (double)(bench::now_ns() - start) / bodies.size();
+  printf("ucp_delta_encode() %.0f ns, ucp_delta_decode() %.0f ns a report\n", enc_ns, dec_ns);
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<Trace> traces = {parked_trace(60), driving_trace(60)};
+  for (int i = 1; i < argc; i++) {
+    Trace t;
+    if (load_log(argv[i], &t)) traces.push_back(t);
+  }
+  printf("Report traffic at %.0f Hz, B/s (delta saves against the report and UCP_REPORT_V2):\n", kReportHz);
+  printf("  %-24s %6s %8s %8s %8s %6s %6s %6s\n", "trace", "reps", "report", "v2", "delta", "v1", "v2",
+         "keys");
+  bool ok = true;
+  for (const Trace& t : traces) ok = trace_case(t) && ok;
+  ok = loss_case(traces[1]) && ok;
+  Trace short_drive = driving_trace(4);
+  ok = client_case(short_drive) && ok;
+  cost_case(traces[1]);
+  return ok ? 0 : 1;
+}
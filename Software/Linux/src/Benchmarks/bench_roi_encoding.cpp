@@ -0,0 +1,182 @@
+// -----------------------------------------------------------------------------
+// Detection-driven ROI encoding (roi_map.h) on synthetic detections
+//
+// People and a vehicle move across a 1920x1080 main stream for a minute of
+// simulated time. A mock detector reports them at 10 Hz, 100 ms late, with
+// jittery boxes, misses one detection in five and now and then sees
+// something that isn't there. The encoder codes regions at the frame QP and
+// the rest ROI_QP_DELTA worse; a 16x16 block costs bits as its content
+// (moving object, static background, keyframe) times 2^(-dQP/6), the usual
+// rule of thumb.
+//
+// Per configuration the bench reports how much of the objects' area the
+// regions covered (the part coded at full quality), how much of the frame
+// they took, how many regions per second had to be set on the encoder, and
+// the bitrate saved against coding the whole frame at the ROI's quality. It
+// compares regions that follow each detection as is with the default
+// persistence, hysteresis and lead, and fails unless the defaults cover at
+// least 97 % of the objects with fewer region updates and still save bits.
+// Usage: bench_roi_encoding [seconds]
+// -----------------------------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "roi_map.h"
+
+static const int kWidth = 1920, kHeight = 1080, kBlock = 16;
+static const int kFps = 30, kDetectHz = 10, kDetectDelayMs = 100;
+static const int kGop = 50;
+static const int kRoiQpDelta = 8;   // Background QP above the regions'
+static const double kMissRate = 0.2, kFalseRate = 0.05, kJitter = 0.03;
+
+// Bits of a block at the frame QP, arbitrary units
+static const double kStaticBits = 1.0, kMovingBits = 6.0, kIntraBits = 8.0;
+
+struct Object {
+  uint32_t id;
+  uint8_t priority;
+  double x, y, w, h;    // Centre and size, 1/ROI_MAP_SCALE
+  double vx, vy;        // Per second
+
+  void at(double t, double* left, double* top, double* right, double* bottom) const {
+    double cx = bounce(x + vx * t, w / 2), cy = bounce(y + vy * t, h / 2);
+    *left = cx - w / 2;
+    *top = cy - h / 2;
+    *right = cx + w / 2;
+    *bottom = cy + h / 2;
+  }
+
+  static double bounce(double v, double half) {
+    double lo = half, span = ROI_MAP_SCALE - 2 * half;
+    double p = fmod(fabs(v - lo), 2 * span);
+    return lo + (p < span ? p : 2 * span - p);
+  }
+};
+
+static std::vector<Object> scene() {
+  return {
+      {1, 3, 2000, 6000, 500, 2200, 900, 0},     // Walking across
+      {2, 3, 7000, 5500, 450, 2000, -600, 100},
+      {3, 3, 5000, 4000, 300, 1200, 0, 0},       // Standing further off
+      {4, 3, 3000, 7000, 600, 2600, 1500, -200}, // Jogging close by
+      {5, 2, 1000, 3000, 1800, 1400, 1200, 0},   // A car
+  };
+}
+
+struct Result {
+  double coverage = 0;  // Object blocks inside a region
+  double area = 0;      // Frame blocks inside a region
+  double updates = 0;   // Regions set per second
+  double saved = 0;
+};
+
+static Result run(const char* name, const roi_map_config_t& cfg, unsigned seconds) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uni(0, 1);
+  std::vector<Object> objects = scene();
+  roi_map_t* map = roi_map_create(&cfg);
+  roi_target_t target;
+  roi_target_init(&target, kWidth, kHeight);
+
+  const int bw = (kWidth + kBlock - 1) / kBlock, bh = (kHeight + kBlock - 1) / kBlock;
+  std::vector<uint8_t> in_object(bw * bh), in_roi(bw * bh);
+  double object_blocks = 0, covered = 0, roi_blocks = 0, flat_bits = 0, roi_bits = 0;
+  double bg_factor = pow(2.0, -kRoiQpDelta / 6.0);
+  uint32_t false_id = 1000;
+
+  int frames = seconds * kFps, per_detect = kFps / kDetectHz;
+  for (int f = 0; f < frames; f++) {
+    uint64_t now_ms = (uint64_t)f * 1000 / kFps;
+    double t = now_ms / 1000.0;
+
+    if (f % per_detect == 0) {
+      // The result for the frame 100 ms ago arrives now
+      double seen = t - kDetectDelayMs / 1000.0;
+      std::vector<roi_box_t> boxes;
+      for (const Object& o : objects) {
+        if (seen < 0 || uni(rng) < kMissRate) continue;
+        double l, tp, r, b;
+        o.at(seen, &l, &tp, &r, &b);
+        auto j = [&](double v, double size) { return v + (uni(rng) * 2 - 1) * kJitter * size; };
+        roi_box_t box = {o.id,
+                         (int16_t)std::max(0.0, j(l, o.w)),
+                         (int16_t)std::max(0.0, j(tp, o.h)),
+                         (int16_t)std::min(9999.0, j(r, o.w)),
+                         (int16_t)std::min(9999.0, j(b, o.h)),
+                         o.priority,
+                         (uint8_t)(60 + uni(rng) * 40)};
+        boxes.push_back(box);
+      }
+      if (uni(rng) < kFalseRate) {
+        int16_t x = (int16_t)(uni(rng) * 8000), y = (int16_t)(uni(rng) * 8000);
+        boxes.push_back({false_id++, x, y, (int16_t)(x + 800), (int16_t)(y + 1500), 3, 45});
+      }
+      roi_map_update(map, now_ms, boxes.data(), (int)boxes.size());
+      roi_target_update(&target, map, now_ms);
+    }
+
+    std::fill(in_object.begin(), in_object.end(), 0);
+    std::fill(in_roi.begin(), in_roi.end(), 0);
+    for (const Object& o : objects) {
+      double l, tp, r, b;
+      o.at(t, &l, &tp, &r, &b);
+      for (int by = 0; by < bh; by++) {
+        double cy = (by + 0.5) * kBlock * ROI_MAP_SCALE / kHeight;
+        if (cy < tp || cy > b) continue;
+        for (int bx = 0; bx < bw; bx++) {
+          double cx = (bx + 0.5) * kBlock * ROI_MAP_SCALE / kWidth;
+          if (cx >= l && cx <= r) in_object[by * bw + bx] = 1;
+        }
+      }
+    }
+    for (int i = 0; i < target.count; i++) {
+      const roi_rect_t& rc = target.rects[i];
+      for (uint32_t y = rc.y / kBlock; y < (rc.y + rc.height) / kBlock; y++)
+        for (uint32_t x = rc.x / kBlock; x < (rc.x + rc.width) / kBlock; x++) in_roi[y * bw + x] = 1;
+    }
+
+    bool intra = f % kGop == 0;
+    for (int i = 0; i < bw * bh; i++) {
+      double bits = intra ? kIntraBits : in_object[i] ? kMovingBits : kStaticBits;
+      flat_bits += bits;
+      roi_bits += in_roi[i] ? bits : bits * bg_factor;
+      object_blocks += in_object[i];
+      covered += in_object[i] && in_roi[i];
+      roi_blocks += in_roi[i];
+    }
+  }
+
+  Result res;
+  res.coverage = covered / object_blocks;
+  res.area = roi_blocks / ((double)bw * bh * frames);
+  res.updates = target.updates / (double)seconds;
+  res.saved = 1 - roi_bits / flat_bits;
+  roi_map_stats_t s;
+  roi_map_get_stats(map, &s);
+  printf("%-24s objects covered %5.1f %%, frame in regions %4.1f %%, %4.1f updates/s, "
+         "%5.1f %% bits saved (%llu tracks, %llu expired)\n",
+         name, res.coverage * 100, res.area * 100, res.updates, res.saved * 100,
+         (unsigned long long)s.tracks, (unsigned long long)s.expired);
+  roi_map_destroy(map);
+  return res;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned seconds = argc > 1 ? atoi(argv[1]) : 60;
+  printf("%dx%d at %d fps, detections at %d Hz %d ms late, %.0f %% missed, background +%d QP, %u s\n",
+         kWidth, kHeight, kFps, kDetectHz, kDetectDelayMs, kMissRate * 100, kRoiQpDelta, seconds);
+
+  roi_map_config_t raw = {0, 1, 0, 0, 0, 0};
+  roi_map_config_t tuned;
+  roi_map_default_config(&tuned);
+  Result r = run("each detection as is", raw, seconds);
+  Result d = run("defaults", tuned, seconds);
+
+  bool ok = d.coverage >= 0.97 && d.updates < r.updates && d.saved > 0;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+// -----------------------------------------------------------------------------
+// RTSP sending: every packet sent inline under one lock (as the camera demo
+// did with g_rtsp_mutex) against per-session queues drained by the network
+// thread (rtsp_sender.h)
+//
+// A file encoder (file_encoder.h) plays four channels at 30 fps into the
+// stream pump. The RTSP server is a mock: each session's client has a socket
+// buffer drained at its link rate, and tx() blocks while the buffer is full.
+// The client of session 0 gets 1 Mbit/s, less than its stream needs; the
+// others get 100 Mbit/s. Per session the bench reports packets sent per
+// second, packets the encoder or the queue dropped, the latency from a packet
+// being ready to it being sent, and packets the client can't decode (ones
+// that follow a lost packet, up to the next keyframe). Queued sending fails
+// if sessions 1-3 lose anything or any client gets undecodable packets.
+// Usage: bench_rtsp_queue [seconds] [file.h265]
+// -----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "file_encoder.h"
+#include "rtsp_sender.h"
+#include "stream_pump.h"
+
+static const int kChannels = 4;
+static const unsigned kFps[kChannels] = {30, 30, 30, 30};
+static const double kLinkBps[kChannels] = {1e6, 100e6, 100e6, 100e6};
+static const double kSocketBytes = 64 * 1024;
+static const size_t kQueueBytes = 128 * 1024;
+
+// One client, as the server's tx() sees it
+struct Client {
+  double rate = 0;            // Bytes per second
+  double level = 0;           // Bytes in the socket buffer
+  uint64_t updated = 0;
+  uint64_t sent = 0;
+  uint64_t last_pts = 0;
+  bool broken = true;         // Lost a packet since the last keyframe
+  uint64_t undecodable = 0;
+  std::vector<double> latency_us;
+
+  void drain(uint64_t now) {
+    if (updated) level = std::max(0.0, level - rate * (now - updated) / 1e9);
+    updated = now;
+  }
+};
+
+struct MockServer {
+  Client client[kChannels];
+  uint64_t events = 0;
+};
+
+// Any IRAP NAL unit in the access unit (ITU-T H.265 table 7-1)
+static bool is_keyframe(const uint8_t* data, int len) {
+  for (int i = 0; i + 3 < len; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+      int type = (data[i + 3] >> 1) & 0x3f;
+      if (type >= 16 && type <= 21) return true;
+      if (type < 16) return false;  // A non-IRAP slice
+      i += 2;
+    }
+  }
+  return false;
+}
+
+static int mock_tx(void* ctx, int chn, const uint8_t* data, int len, uint64_t pts) {
+  Client& c = ((MockServer*)ctx)->client[chn];
+  uint64_t now = bench::now_ns();
+  c.drain(now);
+  while (c.level + len > kSocketBytes) {
+    usleep((useconds_t)((c.level + len - kSocketBytes) / c.rate * 1e6) + 100);
+    c.drain(bench::now_ns());
+  }
+  c.level += len;
+  c.sent++;
+  c.latency_us.push_back(now / 1e3 - pts);
+
+  uint64_t period_us = 1000000 / kFps[chn];
+  if (c.last_pts && pts - c.last_pts > period_us * 3 / 2) c.broken = true;
+  c.last_pts = pts;
+  if (is_keyframe(data, len)) c.broken = false;
+  if (c.broken) c.undecodable++;
+  return len;
+}
+
+static int mock_ready(void* ctx, int chn, int len) {
+  Client& c = ((MockServer*)ctx)->client[chn];
+  c.drain(bench::now_ns());
+  return c.level + len <= kSocketBytes;
+}
+
+static int mock_do_event(void* ctx) {
+  ((MockServer*)ctx)->events++;
+  return 0;
+}
+
+struct Inline {
+  MockServer* server;
+  std::mutex lock;
+};
+
+static void inline_sink(void* user, int chn, const stream_packet_t* pkt) {
+  Inline* s = (Inline*)user;
+  std::lock_guard<std::mutex> guard(s->lock);
+  mock_tx(s->server, chn, pkt->data, pkt->len, pkt->pts);
+  mock_do_event(s->server);
+}
+
+static void queue_sink(void* user, int chn, const stream_packet_t* pkt) {
+  rtsp_sender_push((rtsp_sender_t*)user, chn, pkt);
+}
+
+static bool run(const char* name, const char* path, unsigned seconds, bool queued) {
+  MockServer server;
+  for (int i = 0; i < kChannels; i++) server.client[i].rate = kLinkBps[i] / 8;
+  file_encoder_t* enc = file_encoder_open(path, kChannels, kFps);
+  if (!enc) return false;
+  encoder_source_t src = file_encoder_source(enc);
+
+  Inline inl;
+  inl.server = &server;
+  rtsp_sink_t sink = {&server, mock_tx, mock_ready, mock_do_event};
+  size_t queue_bytes[kChannels];
+  for (int i = 0; i < kChannels; i++) queue_bytes[i] = kQueueBytes;
+  rtsp_sender_t* sender = queued ? rtsp_sender_create(&sink, kChannels, queue_bytes) : NULL;
+  if (queued && !sender) return false;
+  stream_pump_t* pump = queued ? stream_pump_create(&src, kChannels, queue_sink, sender)
+                               : stream_pump_create(&src, kChannels, inline_sink, &inl);
+  if (!pump) return false;
+
+  if (sender) rtsp_sender_start(sender);
+  file_encoder_start(enc);
+  std::thread loop([pump] { stream_pump_run(pump); });
+  sleep(seconds);
+  stream_pump_stop(pump);
+  loop.join();
+  file_encoder_stop(enc);
+  if (sender) rtsp_sender_stop(sender);
+
+  printf("%s\n", name);
+  bool ok = true;
+  for (int i = 0; i < kChannels; i++) {
+    file_encoder_stats_t e;
+    file_encoder_get_stats(enc, i, &e);
+    rtsp_session_stats_t q = {};
+    if (sender) rtsp_sender_get_stats(sender, i, &q);
+    Client& c = server.client[i];
+    if (c.undecodable || (i > 0 && (e.overruns || q.dropped))) ok = false;
+    printf("  /live/%d %5.0f kbit/s  %4.1f fps, %llu encoder overruns, %llu queue drops in %llu cuts, "
+           "max depth %u, %llu undecodable\n",
+           i, kLinkBps[i] / 1e3, c.sent / (double)seconds, (unsigned long long)e.overruns,
+           (unsigned long long)q.dropped, (unsigned long long)q.cuts, q.max_depth,
+           (unsigned long long)c.undecodable);
+    bench::print_percentiles("    ready to sent", c.latency_us, "us");
+  }
+  printf("  %s\n", ok ? "PASS" : "FAIL");
+
+  stream_pump_destroy(pump);
+  rtsp_sender_destroy(sender);
+  file_encoder_close(enc);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned seconds = argc > 1 ? atoi(argv[1]) : 5;
+  const char* path = argc > 2 ? argv[2] : NULL;
+  printf("%d channels at %u fps from %s, %u s each; client 0 on a %.0f kbit/s link\n", kChannels,
+         kFps[0], path ? path : "made-up stream", seconds, kLinkBps[0] / 1e3);
+
+  run("inline, one lock", path, seconds, false);
+  bool ok = run("per-session queues", path, seconds, true);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,350 @@
+// -----------------------------------------------------------------------------
+// The bridge as the one owner of the UART: setpoint arbitration and request
+// routing between concurrent clients (setpoint_arbiter.hpp, request_mux.hpp)
+//
+// A Bridge with Unix sockets on a pty whose master plays the firmware: it
+// keeps the motor commands it receives and answers UCP_TIME_SYNC with the
+// request's index, as the firmware does.
+//   arbitration : autonomy sends setpoints at 100 Hz for 2.5 s, teleop from
+//                 0.5 to 1.2 s, safety from 1.6 to 1.9 s, each on its own
+//                 socket, with a 100 ms lease. The MCU must never receive a
+//                 setpoint while a higher priority holds the lease, and each
+//                 must get the motors back when the one above goes quiet.
+//   routing     : three Unix clients and a TCP client send 500 UCP_TIME_SYNC
+//                 requests each, one at a time, all with the same index
+//                 sequence. Every client must get exactly its own answers,
+//                 with its own index; round trips are reported.
+//   cost        : offer() and a claim()/route() pair in a loop, ns per call.
+// -----------------------------------------------------------------------------
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "bridge_rig.hpp"
+
+static const unsigned kLeaseMs = 100;
+static const int kRequests = 500;
+
+static bool send_all(int fd, const uint8_t* p, size_t n) {
+  while (n > 0) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+// The firmware end of the pty
+class Mcu {
+ public:
+  struct Setpoint {
+    uint64_t at_ns;
+    int16_t tag;
+  };
+
+  explicit Mcu(int fd) : fd_(fd) {
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~Mcu() { finish(); }
+
+  void finish() {
+    done_ = true;
+    if (thread_.joinable()) thread_.join();
+  }
+
+  std::vector<Setpoint> setpoints() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return setpoints_;
+  }
+
+ private:
+  void run() {
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    ucp::Decoder decoder;
+    uint8_t buf[4096];
+    while (!done_.load()) {
+      if (poll(&pfd, 1, 10) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      uint64_t now = bench::now_ns();
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (f.id() == UCP_MOTOR_CTL) {
+          if (const ucp_ctl_cmd_t* cmd = f.as<ucp_ctl_cmd_t>()) {
+            std::lock_guard<std::mutex> lock(lock_);
+            setpoints_.push_back({now, cmd->angular});
+          }
+        } else if (f.id() == UCP_TIME_SYNC) {
+          if (const ucp_time_sync_t* req = f.as<ucp_time_sync_t>()) answer(*req);
+        }
+      });
+    }
+  }
+
+  void answer(const ucp_time_sync_t& req) {
+    ucp::Frame<ucp_time_sync_ack_t> ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.msg.hd.len = sizeof(ack.msg);
+    ack.msg.hd.id = UCP_TIME_SYNC;
+    ack.msg.hd.index = req.hd.index;
+    ack.msg.t1_ns = req.t1_ns;
+    ucp::seal_raw(reinterpret_cast<uint8_t*>(&ack), ack.size());
+    ssize_t w = write(fd_, ack.data(), ack.size());
+    (void)w;
+  }
+
+  int fd_;
+  std::atomic<bool> done_{false};
+  std::mutex lock_;
+  std::vector<Setpoint> setpoints_;
+  std::thread thread_;
+};
+
+// -----------------------------------------------------------------------------
+// arbitration
+// -----------------------------------------------------------------------------
+struct Schedule {
+  bridge::Priority priority;
+  unsigned from_ms;
+  unsigned to_ms;
+};
+
+static const Schedule kSchedules[] = {
+    {bridge::Priority::kAutonomy, 0, 2500},
+    {bridge::Priority::kTeleop, 500, 1200},
+    {bridge::Priority::kSafety, 1600, 1900},
+};
+
+// A setpoint's angular field carries its sender's priority + 1
+static int16_t tag_of(bridge::Priority p) { return (int16_t)p + 1; }
+
+static void drive(int fd, const Schedule& s, uint64_t t0, std::vector<uint64_t>* sent) {
+  ucp::Encoder encoder;
+  for (unsigned ms = s.from_ms; ms < s.to_ms; ms += 10) {
+    bench::sleep_until_ns(t0 + ms * 1000000ull);
+    ucp::Frame<ucp_ctl_cmd_t> frame;
+    ucp::make_ctl_cmd(frame, 50, tag_of(s.priority));
+    encoder.seal(frame);
+    sent->push_back(bench::now_ns());
+    if (!send_all(fd, frame.data(), frame.size())) return;
+  }
+}
+
+// Telemetry the bridge sends back is of no interest here
+static void drain(int fd) {
+  uint8_t buf[4096];
+  while (recv(fd, buf, sizeof(buf), 0) > 0) {
+  }
+}
+
+static bool arbitration_case() {
+  bench::Rig rig;
+  rig.config.lease_ms = kLeaseMs;
+  if (!rig.serve_unix() || !rig.start(0)) return false;
+  Mcu mcu(rig.master());
+
+  const size_t n = sizeof(kSchedules) / sizeof(kSchedules[0]);
+  std::vector<int> fds;
+  for (size_t i = 0; i < n; i++) {
+    int fd = rig.connect_unix(kSchedules[i].priority);
+    if (fd < 0) return false;
+    fds.push_back(fd);
+  }
+  usleep(50 * 1000);
+
+  std::vector<std::vector<uint64_t>> sent(bridge::kPriorities);
+  std::vector<std::thread> threads;
+  uint64_t t0 = bench::now_ns() + 20 * 1000000ull;
+  for (size_t i = 0; i < n; i++) {
+    threads.emplace_back(drain, fds[i]);
+    threads.emplace_back(drive, fds[i], kSchedules[i], t0, &sent[(size_t)kSchedules[i].priority]);
+  }
+  for (size_t i = 1; i < threads.size(); i += 2) threads[i].join();
+  usleep(50 * 1000);
+  mcu.finish();
+  rig.finish();
+  for (size_t i = 0; i < threads.size(); i += 2) threads[i].join();
+
+  // A setpoint must not arrive while a higher priority sent within the
+  // lease. Sends and arrivals are timed in different threads, so the lease
+  // edges get a few ms of slack.
+  const uint64_t lease = kLeaseMs * 1000000ull, slack = 5 * 1000000ull;
+  std::vector<Mcu::Setpoint> got = mcu.setpoints();
+  uint64_t violations = 0, per_tag[bridge::kPriorities + 1] = {};
+  for (const Mcu::Setpoint& s : got) {
+    if (s.tag < 1 || s.tag > (int16_t)bridge::kPriorities) continue;
+    per_tag[s.tag]++;
+    for (size_t q = s.tag; q < bridge::kPriorities; q++) {
+      for (uint64_t t : sent[q]) {
+        if (t + slack < s.at_ns && s.at_ns + slack < t + lease) violations++;
+      }
+    }
+  }
+  // Autonomy gets the motors back after teleop and after safety went quiet
+  auto arrived = [&](int16_t tag, unsigned from_ms, unsigned to_ms) {
+    for (const Mcu::Setpoint& s : got) {
+      if (s.tag == tag && s.at_ns >= t0 + from_ms * 1000000ull && s.at_ns < t0 + to_ms * 1000000ull) return true;
+    }
+    return false;
+  };
+  int16_t autonomy = tag_of(bridge::Priority::kAutonomy);
+  bool handed_back = arrived(autonomy, 1200 + kLeaseMs + 20, 1600) && arrived(autonomy, 1900 + kLeaseMs + 20, 2500);
+
+  const bridge::ArbiterStats& a = rig.arbiter_stats();
+  bool ok = violations == 0 && handed_back && per_tag[2] > 0 && per_tag[3] > 0 && a.handovers >= 4 &&
+            rig.stats().command_preempted == a.preempted;
+  printf("%-12s %s  MCU got autonomy %llu teleop %llu safety %llu; %llu preempted, %llu handovers, "
+         "%llu violations, handed back %s\n",
+         "arbitration", ok ? "PASS" : "FAIL", (unsigned long long)per_tag[1], (unsigned long long)per_tag[2],
+         (unsigned long long)per_tag[3], (unsigned long long)a.preempted, (unsigned long long)a.handovers,
+         (unsigned long long)violations, handed_back ? "yes" : "no");
+  const bridge::Latency& l = rig.latency();
+  printf("%-12s command latency p50 %.3f ms, p99 %.3f ms (socket read to UART write)\n", "",
+         l.command.quantile(0.5) / 1e6, l.command.quantile(0.99) / 1e6);
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+// routing
+// -----------------------------------------------------------------------------
+struct Requester {
+  uint64_t answered = 0;
+  uint64_t misrouted = 0;          // Someone else's answer, or one twice
+  uint64_t timeouts = 0;
+  std::vector<double> rtt_us;
+};
+
+// Wait up to `timeout_ms` for a UCP_TIME_SYNC answer; false on timeout
+static bool next_answer(int fd, ucp::Decoder& decoder, std::vector<ucp_time_sync_ack_t>& ready,
+                        int timeout_ms) {
+  uint8_t buf[4096];
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (ready.empty()) {
+    if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+      if (f.id() != UCP_TIME_SYNC) return;
+      if (const ucp_time_sync_ack_t* ack = f.as<ucp_time_sync_ack_t>()) ready.push_back(*ack);
+    });
+  }
+  return true;
+}
+
+static void request(int fd, Requester* out) {
+  ucp::Encoder encoder;  // Every client starts at index 0
+  ucp::Decoder decoder;
+  std::vector<ucp_time_sync_ack_t> ready;
+  for (int i = 0; i < kRequests; i++) {
+    ucp::Frame<ucp_time_sync_t> frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.msg.t1_ns = bench::now_ns();
+    encoder.seal(frame);
+    if (!send_all(fd, frame.data(), frame.size())) return;
+    if (!next_answer(fd, decoder, ready, 1000)) {
+      out->timeouts++;
+      continue;
+    }
+    while (!ready.empty()) {
+      const ucp_time_sync_ack_t& ack = ready.front();
+      if (ack.t1_ns == frame.msg.t1_ns && ack.hd.index == frame.msg.hd.index) {
+        out->answered++;
+        out->rtt_us.push_back((bench::now_ns() - ack.t1_ns) / 1e3);
+      } else {
+        out->misrouted++;
+      }
+      ready.erase(ready.begin());
+    }
+  }
+  // Anything still arriving was not asked for
+  if (next_answer(fd, decoder, ready, 100)) out->misrouted += ready.size();
+}
+
+static bool routing_case() {
+  bench::Rig rig;
+  if (!rig.serve_unix() || !rig.start(1)) return false;
+  Mcu mcu(rig.master());
+
+  std::vector<int> fds = {rig.clients()[0]};
+  for (bridge::Priority p : {bridge::Priority::kAutonomy, bridge::Priority::kTeleop, bridge::Priority::kSafety}) {
+    int fd = rig.connect_unix(p);
+    if (fd < 0) return false;
+    fds.push_back(fd);
+  }
+  usleep(50 * 1000);
+
+  std::vector<Requester> results(fds.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < fds.size(); i++) threads.emplace_back(request, fds[i], &results[i]);
+  for (std::thread& t : threads) t.join();
+  mcu.finish();
+  rig.finish();
+
+  bool ok = true;
+  std::vector<double> rtt;
+  static const char* const kNames[] = {"tcp", "autonomy", "teleop", "safety"};
+  for (size_t i = 0; i < results.size(); i++) {
+    const Requester& r = results[i];
+    ok = ok && r.answered == (uint64_t)kRequests && r.misrouted == 0 && r.timeouts == 0;
+    printf("%-12s %-8s %llu/%d answered, %llu misrouted, %llu timeouts\n", i ? "" : "routing", kNames[i],
+           (unsigned long long)r.answered, kRequests, (unsigned long long)r.misrouted,
+           (unsigned long long)r.timeouts);
+    rtt.insert(rtt.end(), r.rtt_us.begin(), r.rtt_us.end());
+  }
+  const bridge::MuxStats& m = rig.mux_stats();
+  printf("%-12s %s  %llu requests, %llu routed, %llu expired\n", "", ok ? "PASS" : "FAIL",
+         (unsigned long long)m.requests, (unsigned long long)m.routed, (unsigned long long)m.expired);
+  bench::print_percentiles("             round trip", rtt, "us");
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+// cost
+// -----------------------------------------------------------------------------
+static bool cost_case() {
+  const int kCalls = 10000000;
+  bridge::SetpointArbiter arbiter;
+  uint64_t now = 0, forwarded = 0;
+  uint64_t start = bench::now_ns();
+  for (int i = 0; i < kCalls; i++) {
+    now += 1000000;  // 1 ms apart, so leases come and go
+    forwarded += arbiter.offer((bridge::Priority)(i % 7 == 0 ? 2 : i % 3 == 0), now);
+  }
+  double offer_ns = (double)(bench::now_ns() - start) / kCalls;
+  bench::do_not_optimize(forwarded);
+
+  bridge::RequestMux mux;
+  uint64_t routed = 0;
+  start = bench::now_ns();
+  for (int i = 0; i < kCalls; i++) {
+    uint8_t ours = mux.claim(UCP_TIME_SYNC, (uint8_t)i, 2 + i % 4, now);
+    uint64_t owner;
+    uint8_t index;
+    routed += mux.route(UCP_TIME_SYNC, ours, now, &owner, &index);
+  }
+  double mux_ns = (double)(bench::now_ns() - start) / kCalls;
+  bench::do_not_optimize(routed);
+
+  bool ok = offer_ns < 1000 && mux_ns < 1000;
+  printf("%-12s %s  offer %.1f ns, claim + route %.1f ns\n", "cost", ok ? "PASS" : "FAIL", offer_ns, mux_ns);
+  return ok;
+}
+
+int main() {
+  bool ok = arbitration_case();
+  ok = routing_case() && ok;
+  ok = cost_case() && ok;
+  return ok ? 0 : 1;
+}
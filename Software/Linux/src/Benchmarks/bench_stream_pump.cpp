@@ -0,0 +1,153 @@
+// -----------------------------------------------------------------------------
+// Encoder stream collection: a thread per channel polling every millisecond
+// (as sample_demo_dual_camera did) against the epoll stream pump
+//
+// A file encoder (file_encoder.h) plays four channels at 30 fps, as the two
+// cameras' main and sub streams, from an H.265 file or made-up packets. Both
+// ways of collecting them run for the same time; the bench reports wakeups
+// per second, CPU time and the latency from a packet being ready to the sink
+// having it, and fails if a packet is lost or out of order.
+// Usage: bench_stream_pump [seconds] [file.h265]
+// -----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "file_encoder.h"
+#include "stream_pump.h"
+
+static const int kChannels = 4;
+static const unsigned kFps[kChannels] = {30, 30, 30, 30};
+
+struct Channel {
+  uint64_t packets = 0;
+  uint64_t keyframes = 0;
+  uint64_t last_ready = 0;
+  uint64_t disorder = 0;
+  std::vector<double> latency_us;
+};
+
+struct Result {
+  const char* name;
+  double seconds = 0;
+  double cpu_ms = 0;
+  uint64_t wakeups = 0;
+  Channel chn[kChannels];
+};
+
+static void on_packet(Result* r, int chn, const stream_packet_t* pkt) {
+  uint64_t now = bench::now_ns();
+  Channel& c = r->chn[chn];
+  c.packets++;
+  c.keyframes += pkt->keyframe;
+  if (pkt->ready_ns <= c.last_ready) c.disorder++;
+  c.last_ready = pkt->ready_ns;
+  c.latency_us.push_back((now - pkt->ready_ns) / 1e3);
+}
+
+static double cpu_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// The old venc*_get_stream loop: try, then sleep 1 ms, whether or not a
+// packet came
+static void poll_threads(encoder_source_t* src, unsigned seconds, Result* r) {
+  std::atomic<bool> quit{false};
+  std::atomic<uint64_t> wakeups{0};
+  std::vector<std::thread> threads;
+  for (int chn = 0; chn < kChannels; chn++) {
+    threads.emplace_back([&, chn] {
+      uint64_t loops = 0;
+      while (!quit.load(std::memory_order_relaxed)) {
+        stream_packet_t pkt;
+        if (src->get(src->ctx, chn, &pkt) == 0) {
+          on_packet(r, chn, &pkt);
+          src->release(src->ctx, chn, &pkt);
+        }
+        loops++;
+        usleep(1000);
+      }
+      wakeups += loops;
+    });
+  }
+  sleep(seconds);
+  quit = true;
+  for (std::thread& t : threads) t.join();
+  r->wakeups = wakeups;
+}
+
+static void pump(encoder_source_t* src, unsigned seconds, Result* r) {
+  stream_pump_t* p = stream_pump_create(
+      src, kChannels, [](void* user, int chn, const stream_packet_t* pkt) { on_packet((Result*)user, chn, pkt); }, r);
+  if (!p) return;
+  std::thread loop([p] { stream_pump_run(p); });
+  sleep(seconds);
+  stream_pump_stop(p);
+  loop.join();
+  stream_pump_stats_t s;
+  stream_pump_get_stats(p, &s);
+  r->wakeups = s.wakeups;
+  stream_pump_destroy(p);
+}
+
+static bool run(const char* name, const char* path, unsigned seconds,
+                void (*collect)(encoder_source_t*, unsigned, Result*), Result* r) {
+  r->name = name;
+  file_encoder_t* enc = file_encoder_open(path, kChannels, kFps);
+  if (!enc) return false;
+  encoder_source_t src = file_encoder_source(enc);
+  double cpu0 = cpu_ms();
+  uint64_t t0 = bench::now_ns();
+  file_encoder_start(enc);
+  collect(&src, seconds, r);
+  file_encoder_stop(enc);
+  r->seconds = (bench::now_ns() - t0) / 1e9;
+  r->cpu_ms = cpu_ms() - cpu0;
+
+  bool ok = true;
+  std::vector<double> latency;
+  uint64_t packets = 0, keyframes = 0, lost = 0;
+  for (int i = 0; i < kChannels; i++) {
+    file_encoder_stats_t e;
+    file_encoder_get_stats(enc, i, &e);
+    Channel& c = r->chn[i];
+    // The last few may still be waiting when collection stopped
+    uint64_t missing = e.produced - c.packets;
+    if (e.overruns || missing > 2 || c.disorder) ok = false;
+    lost += e.overruns;
+    packets += c.packets;
+    keyframes += c.keyframes;
+    latency.insert(latency.end(), c.latency_us.begin(), c.latency_us.end());
+  }
+  printf("%-8s %s  %llu packets (%llu keyframes), %llu lost, %.0f wakeups/s, CPU %.1f ms/s\n", name,
+         ok ? "PASS" : "FAIL", (unsigned long long)packets, (unsigned long long)keyframes,
+         (unsigned long long)lost, r->wakeups / r->seconds, r->cpu_ms / r->seconds);
+  bench::print_percentiles("         ready to sink", latency, "us");
+  file_encoder_close(enc);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned seconds = argc > 1 ? atoi(argv[1]) : 5;
+  const char* path = argc > 2 ? argv[2] : NULL;
+
+  file_encoder_t* probe = file_encoder_open(path, kChannels, kFps);
+  if (!probe) return 1;
+  printf("%d channels at %u fps, %d access units from %s, %u s each\n", kChannels, kFps[0],
+         file_encoder_units(probe), path ? path : "made-up stream", seconds);
+  file_encoder_close(probe);
+
+  Result threads, pumped;
+  bool ok = run("threads", path, seconds, poll_threads, &threads);
+  ok = run("pump", path, seconds, pump, &pumped) && ok;
+  ok = ok && pumped.wakeups < threads.wakeups;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+// -----------------------------------------------------------------------------
+// Telemetry bus: per-operation cost, publish-to-observe latency and
+// throughput with several readers, each on its own read-only mapping (as a
+// separate process would have).
+//
+// Readers poll and sched_yield() between polls rather than spin: the RV1106
+// has one core, so a spinning reader would only steal time from the writer.
+// Usage: bench_telemetry_bus [seconds per case]
+// -----------------------------------------------------------------------------
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "telemetry_bus.h"
+#include "ucp.h"
+
+static const char* kBusName = "/ucp_telemetry_bench";
+
+static void sleep_until_ns(uint64_t deadline) {
+  struct timespec ts;
+  ts.tv_sec = deadline / 1000000000ull;
+  ts.tv_nsec = deadline % 1000000000ull;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static ucp_rep_t make_report(uint64_t n) {
+  ucp_rep_t rep;
+  memset(&rep, 0, sizeof(rep));
+  rep.hd.len = sizeof(rep);
+  rep.hd.id = UCP_RPM_REPORT;
+  rep.hd.index = n & 0xff;
+  rep.voltage = 1200;
+  rep.heading = (int16_t)(n % 360);
+  return rep;
+}
+
+static void op_costs(telemetry_bus_t* bus) {
+  const int kOps = 1000000;
+  ucp_rep_t rep = make_report(0);
+
+  uint64_t t0 = bench::now_ns();
+  for (int i = 0; i < kOps; i++) {
+    rep.hd.index = i & 0xff;
+    telemetry_bus_publish(bus, &rep, sizeof(rep), t0);
+  }
+  uint64_t t1 = bench::now_ns();
+
+  const telemetry_bus_t* view = telemetry_bus_open(kBusName);
+  telemetry_sample_t s;
+  uint64_t head = telemetry_bus_head(view), acc = 0;
+  uint64_t t2 = bench::now_ns();
+  for (int i = 0; i < kOps; i++) {
+    telemetry_bus_read(view, head - 1 - (i & 511), &s);
+    acc += s.len;
+  }
+  uint64_t t3 = bench::now_ns();
+  for (int i = 0; i < kOps; i++) {
+    telemetry_bus_latest(view, UCP_RPM_REPORT, &s);
+    acc += s.seq;
+  }
+  uint64_t t4 = bench::now_ns();
+  telemetry_reader_t reader;
+  telemetry_reader_init(&reader, view, 0);
+  for (int i = 0; i < kOps; i++) acc += telemetry_reader_poll(&reader, &s);
+  uint64_t t5 = bench::now_ns();
+  bench::do_not_optimize(acc);
+  telemetry_bus_close(view);
+
+  printf("publish 44 B report        %6.1f ns\n", (t1 - t0) / (double)kOps);
+  printf("read by seq                %6.1f ns\n", (t3 - t2) / (double)kOps);
+  printf("latest report              %6.1f ns\n", (t4 - t3) / (double)kOps);
+  printf("poll with nothing new      %6.1f ns\n", (t5 - t4) / (double)kOps);
+}
+
+struct ReaderResult {
+  uint64_t frames = 0;
+  uint64_t lost = 0;
+  uint64_t torn = 0;  // Samples whose payload disagrees with their seq (must stay 0)
+  std::vector<double> latency_us;
+};
+
+static void run_reader(std::atomic<bool>* done, bool record, ReaderResult* out) {
+  const telemetry_bus_t* bus = telemetry_bus_open(kBusName);
+  if (!bus) {
+    perror("telemetry_bus_open");
+    return;
+  }
+  telemetry_reader_t reader;
+  telemetry_reader_init(&reader, bus, 0);
+  telemetry_sample_t s;
+  while (!done->load(std::memory_order_relaxed)) {
+    while (telemetry_reader_poll(&reader, &s)) {
+      uint64_t now = telemetry_now_ns();
+      ucp_rep_t rep;
+      memcpy(&rep, s.msg, sizeof(rep));
+      if (s.len != sizeof(rep) || rep.heading != (int16_t)(s.seq % 360)) out->torn++;
+      out->frames++;
+      if (record) out->latency_us.push_back((now - s.timestamp_ns) / 1e3);
+    }
+    sched_yield();
+  }
+  out->lost = reader.lost;
+  telemetry_bus_close(bus);
+}
+
+// rate_hz == 0 publishes flat out
+static bool readers_case(telemetry_bus_t* bus, size_t nreaders, double rate_hz, double seconds) {
+  std::atomic<bool> done(false);
+  std::vector<ReaderResult> results(nreaders);
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < nreaders; i++) {
+    readers.emplace_back(run_reader, &done, rate_hz > 0, &results[i]);
+  }
+  usleep(50 * 1000);
+
+  uint64_t base = telemetry_bus_head(bus);
+  uint64_t published = 0;
+  uint64_t start = bench::now_ns(), end = start + (uint64_t)(seconds * 1e9);
+  uint64_t period = rate_hz > 0 ? (uint64_t)(1e9 / rate_hz) : 0, next = start;
+  for (uint64_t now = start; now < end; now = bench::now_ns()) {
+    if (period) {
+      sleep_until_ns(next);
+      next += period;
+    }
+    // heading carries seq % 360 so readers can detect a torn copy
+    ucp_rep_t rep = make_report(base + published);
+    telemetry_bus_publish(bus, &rep, sizeof(rep), telemetry_now_ns());
+    published++;
+  }
+  double elapsed = (bench::now_ns() - start) / 1e9;
+  usleep(50 * 1000);
+  done = true;
+  for (std::thread& t : readers) t.join();
+
+  uint64_t torn = 0, min_frames = published, lost = 0;
+  std::vector<double> all;
+  for (ReaderResult& r : results) {
+    torn += r.torn;
+    lost += r.lost;
+    min_frames = std::min(min_frames, r.frames);
+    all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+  }
+  if (rate_hz > 0) {
+    char label[64];
+    snprintf(label, sizeof(label), "%zu reader(s) at %4.0f Hz", nreaders, rate_hz);
+    bench::print_percentiles(label, all, "us");
+  } else {
+    printf("%zu reader(s) flat out: %9.0f frames/s published, slowest reader %9.0f frames/s, "
+           "%llu lost to overwrite\n",
+           nreaders, published / elapsed, min_frames / elapsed, (unsigned long long)lost);
+  }
+  if (torn) {
+    fprintf(stderr, "  %llu torn samples accepted\n", (unsigned long long)torn);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+  telemetry_bus_t* bus = telemetry_bus_create(kBusName);
+  if (!bus) {
+    perror("telemetry_bus_create");
+    return 1;
+  }
+
+  op_costs(bus);
+  static const size_t counts[] = {1, 4, 8};
+  bool ok = true;
+  for (size_t n : counts) ok = ok && readers_case(bus, n, 1000, seconds);
+  for (size_t n : counts) ok = ok && readers_case(bus, n, 0, seconds);
+
+  telemetry_bus_close(bus);
+  telemetry_bus_unlink(kBusName);
+  return ok ? 0 : 1;
+}
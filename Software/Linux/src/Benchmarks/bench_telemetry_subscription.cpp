@@ -0,0 +1,256 @@
+// -----------------------------------------------------------------------------
+// Telemetry subscriptions (UCP_SUBSCRIBE / UCP_TELEMETRY) against the full report
+//
+// First the UART load of a few typical profiles, from the frame sizes: what
+// each needs with subscriptions, and with the full report sent at the
+// fastest rate the profile wants, as a fraction of a 115200 baud link.
+//
+// Then end to end over a pty: a simulated firmware runs the subscription
+// scheduler as uart_mutex.c does (a 5 ms tick, the report every 20 ms in
+// slot 0 until told otherwise), and a ucp::Client subscribes to heading at
+// 100 Hz in slot 0 and power at 1 Hz in slot 1. Reports the rate each group
+// arrived at, the bytes per second, and fails if a group is off its rate,
+// the subscriptions aren't confirmed or the report keeps coming.
+// Finally the cost of parse_telemetry().
+// Usage: bench_telemetry_subscription [seconds]
+// -----------------------------------------------------------------------------
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+#include "bench_util.hpp"
+#include "fake_mcu.hpp"
+#include "ucp_client.hpp"
+#include "ucp_telemetry.hpp"
+
+static const double kLinkBytesPerSec = 115200 / 10.0;  // 8N1
+
+struct Want {
+  uint8_t groups;
+  double hz;
+};
+
+struct Profile {
+  const char* name;
+  Want wants[3];
+  size_t n;
+};
+
+static void bandwidth_table() {
+  static const Profile profiles[] = {
+      {"heading 100 Hz, battery 1 Hz", {{UCP_GRP_ATTITUDE, 100}, {UCP_GRP_POWER, 1}}, 2},
+      {"wheels + heading 50 Hz, battery 1 Hz",
+       {{UCP_GRP_WHEELS | UCP_GRP_ATTITUDE, 50}, {UCP_GRP_POWER, 1}}, 2},
+      {"raw IMU + heading 200 Hz", {{UCP_GRP_IMU_RAW | UCP_GRP_ATTITUDE, 200}}, 1},
+      {"ToF 10 Hz, wheels 50 Hz, battery 1 Hz",
+       {{UCP_GRP_TOF, 10}, {UCP_GRP_WHEELS, 50}, {UCP_GRP_POWER, 1}}, 3},
+  };
+  const double report_bytes = ucp::Frame<ucp_rep_v2_t>::size();
+  printf("UART load at 115200 baud (full report %.0f bytes, telemetry frames %zu..%zu):\n", report_bytes,
+         ucp::telemetry_frame_size(UCP_GRP_ATTITUDE), ucp::kMaxTelemetryFrame);
+  printf("  %-40s %14s %20s\n", "profile", "subscribed", "full report");
+  for (const Profile& p : profiles) {
+    double bytes = 0, fastest = 0;
+    for (size_t i = 0; i < p.n; i++) {
+      bytes += ucp::telemetry_frame_size(p.wants[i].groups) * p.wants[i].hz;
+      if (p.wants[i].hz > fastest) fastest = p.wants[i].hz;
+    }
+    double full = report_bytes * fastest;
+    printf("  %-40s %6.0f B/s %3.0f%% %10.0f B/s %3.0f%%\n", p.name, bytes, 100 * bytes / kLinkBytesPerSec,
+           full, 100 * full / kLinkBytesPerSec);
+  }
+}
+
+// The firmware's scheduler and SUBSCRIBE handling, on the pty master
+class SimFirmware {
+ public:
+  static const uint64_t kTickNs = UCP_SUB_TICK_MS * 1000000ull;
+
+  explicit SimFirmware(int fd) : fd_(fd) {
+    subs_[0].groups = UCP_GRP_REPORT;
+    subs_[0].period_ticks = 20 / UCP_SUB_TICK_MS;
+    subs_[0].countdown = 1;
+    thread_ = std::thread([this] { run(); });
+  }
+  ~SimFirmware() {
+    done_ = true;
+    thread_.join();
+  }
+
+ private:
+  struct Sub {
+    uint8_t groups = 0;
+    uint16_t period_ticks = 0;
+    uint16_t countdown = 0;
+  };
+
+  void write_all(const uint8_t* buf, size_t n) {
+    if (write(fd_, buf, n) != (ssize_t)n) perror("write");
+  }
+
+  template <typename T>
+  void send(const T& msg) {
+    uint8_t buf[ucp::Frame<T>::size()];
+    write_all(buf, encoder_.encode(msg, buf, sizeof(buf)));
+  }
+
+  void tick() {
+    for (uint8_t slot = 0; slot < UCP_SUB_SLOTS; slot++) {
+      Sub& s = subs_[slot];
+      if (!s.groups || --s.countdown > 0) continue;
+      s.countdown = s.period_ticks;
+      if (s.groups & UCP_GRP_REPORT) {
+        ucp_rep_v2_t rep;
+        memset(&rep, 0, sizeof(rep));
+        rep.rep_version = UCP_REPORT_VERSION;
+        send(rep);
+      }
+      ucp::Telemetry t{};
+      t.slot = slot;
+      t.groups = s.groups & ucp::kTelemetryGroups;
+      if (!t.groups) continue;
+      t.sample_us = bench::now_ns() / 1000;
+      t.attitude.heading = 900;
+      t.power.voltage_cv = 1180;
+      uint8_t buf[ucp::kMaxTelemetryFrame];
+      write_all(buf, ucp::encode_telemetry(encoder_, t, buf, sizeof(buf)));
+    }
+  }
+
+  void on_subscribe(const ucp_subscribe_t& req) {
+    ucp_subscribe_ack_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.slot = req.slot;
+    ack.groups = req.groups;
+    uint16_t ticks = (req.period_ms + UCP_SUB_TICK_MS - 1) / UCP_SUB_TICK_MS;
+    if (req.slot >= UCP_SUB_SLOTS || (req.groups & ~UCP_GRP_ALL) || (req.groups && ticks == 0)) {
+      ack.err = UCP_ERR_UNKNOWN;
+      send(ack);
+      return;
+    }
+    Sub& s = subs_[req.slot];
+    s.groups = req.groups;
+    s.period_ticks = ticks;
+    s.countdown = 1;
+    ack.period_ms = req.groups ? ticks * UCP_SUB_TICK_MS : 0;
+    send(ack);
+  }
+
+  void run() {
+    ucp::Decoder decoder;
+    uint8_t buf[4096];
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    uint64_t next_tick = bench::now_ns() + kTickNs;
+    while (!done_.load()) {
+      uint64_t now = bench::now_ns();
+      while (now >= next_tick) {
+        tick();
+        next_tick += kTickNs;
+      }
+      int timeout_ms = (int)((next_tick - now) / 1000000);
+      if (poll(&pfd, 1, timeout_ms) <= 0) continue;
+      ssize_t n = read(fd_, buf, sizeof(buf));
+      if (n <= 0) continue;
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        if (f.id() != UCP_SUBSCRIBE) return;
+        if (const ucp_subscribe_t* req = f.as<ucp_subscribe_t>()) on_subscribe(*req);
+      });
+    }
+  }
+
+  int fd_;
+  Sub subs_[UCP_SUB_SLOTS];
+  ucp::Encoder encoder_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+static bool end_to_end_case(double seconds) {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+  SimFirmware firmware(pty.master);
+
+  ucp::ClientOptions options;
+  options.rate_hz = 50;
+  options.sync_interval_ms = 0;
+  ucp::Client client(options);
+
+  // Counted from `from` on, once both subscriptions are confirmed
+  std::atomic<uint64_t> from{0};
+  std::atomic<uint64_t> attitude{0}, power{0}, reports{0}, bytes{0};
+  client.on_telemetry([&](const ucp::FrameView& f, uint64_t rx_ns) {
+    uint64_t start = from.load();
+    if (!start || rx_ns < start) return;
+    bytes += f.frame_len;
+    ucp::Telemetry t;
+    if (ucp::parse_telemetry(f, &t)) {
+      if (t.has(UCP_GRP_ATTITUDE)) attitude++;
+      if (t.has(UCP_GRP_POWER)) power++;
+    } else if (f.id() == UCP_RPM_REPORT || f.id() == UCP_REPORT_V2) {
+      reports++;
+    }
+  });
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+
+  uint64_t asked = bench::now_ns();
+  client.subscribe(0, UCP_GRP_ATTITUDE, 10);
+  client.subscribe(1, UCP_GRP_POWER, 1000);
+  while (!(client.subscribed(0) && client.subscribed(1)) && bench::now_ns() - asked < 2000000000ull) {
+    usleep(1000);
+  }
+  bool confirmed = client.subscribed(0) && client.subscribed(1);
+  printf("Subscriptions confirmed after %.1f ms\n", (bench::now_ns() - asked) / 1e6);
+  usleep(50 * 1000);  // A report already on its way may still arrive
+  uint64_t start = bench::now_ns();
+  from = start;
+  usleep((useconds_t)(seconds * 1e6));
+  double elapsed = (bench::now_ns() - start) / 1e9;
+  client.stop();
+
+  double attitude_hz = attitude / elapsed, power_hz = power / elapsed;
+  double rate = bytes / elapsed;
+  double legacy = ucp::Frame<ucp_rep_v2_t>::size() * 50.0;
+  printf("heading %.1f Hz (asked 100), power %.2f Hz (asked 1), full reports %llu\n", attitude_hz,
+         power_hz, (unsigned long long)reports.load());
+  printf("%.0f B/s on the link, against %.0f B/s for the 50 Hz report\n", rate, legacy);
+  ucp::ClientStats s = client.stats();
+  printf("%llu subscribe requests sent, %llu refused\n", (unsigned long long)s.subscribe_sent,
+         (unsigned long long)s.subscribe_refused);
+  bool ok = confirmed && attitude_hz > 90 && attitude_hz < 110 && power_hz > 0.5 && power_hz < 1.5 &&
+            reports == 0 && s.subscribe_refused == 0;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+static void parse_cost() {
+  ucp::Encoder encoder;
+  ucp::Telemetry t{};
+  t.groups = ucp::kTelemetryGroups;
+  uint8_t frame[ucp::kMaxTelemetryFrame];
+  size_t len = ucp::encode_telemetry(encoder, t, frame, sizeof(frame));
+  ucp::FrameView view = {frame, len};
+  const int kRounds = 1000000;
+  uint64_t acc = 0;
+  uint64_t start = bench::now_ns();
+  for (int i = 0; i < kRounds; i++) {
+    ucp::Telemetry out;
+    bench::do_not_optimize(frame);  // Read the frame again every round
+    if (ucp::parse_telemetry(view, &out)) acc += out.groups + out.tof.range_mm[3];
+  }
+  bench::do_not_optimize(acc);
+  printf("parse_telemetry() %.1f ns for a frame with every group\n",
+         (double)(bench::now_ns() - start) / kRounds);
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+  bandwidth_table();
+  bool ok = end_to_end_case(seconds);
+  parse_cost();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// -----------------------------------------------------------------------------
+// ucp::TrajectoryScheduler against a pty-backed fake MCU
+//
+// A planner at 10 Hz tracks a smooth velocity profile (speed and angular
+// sines) and the client sends at 200 Hz. Tracking is compared three ways:
+//   setpoint : the planner calls set_setpoint() with the current value, as
+//              autonomy code did before (a staircase at 10 Hz)
+//   linear   : the planner replaces a 1 s trajectory of 100 ms waypoints
+//   cubic    : the same, interpolated along a Catmull-Rom spline
+// reporting the error between what the firmware received and the profile.
+// Then, over repeated trials:
+//   preempt  : latency from replace() to the first command of the new
+//              trajectory; fails if a command of the old one follows it
+//   e-stop   : latency from emergency_stop() to the first zero command
+// and the cost of replace() and of one setpoint() evaluation.
+// Usage: bench_trajectory [seconds per case]
+// -----------------------------------------------------------------------------
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "bench_util.hpp"
+#include "fake_mcu.hpp"
+#include "trajectory.hpp"
+
+static const unsigned kRateHz = 200;
+static const uint64_t kPlanPeriodNs = 100 * 1000000ull;
+
+static float profile_speed(uint64_t t) { return 80 * sin(2 * M_PI * (t / 1e9) / 2.0); }
+static float profile_angular(uint64_t t) { return 40 * sin(2 * M_PI * (t / 1e9) / 3.0); }
+
+struct Setup {
+  bench::Pty pty;
+  ucp::TrajectoryScheduler scheduler;
+  ucp::Client client;
+
+  Setup() : client(options()) {}
+
+  static ucp::ClientOptions options() {
+    ucp::ClientOptions o;
+    o.rate_hz = kRateHz;
+    o.stop_on_exit = false;
+    return o;
+  }
+
+  bool start() {
+    if (!pty.open()) return false;
+    client.set_source(&scheduler);
+    return client.attach(pty.open_slave(0)) && client.start();
+  }
+};
+
+enum class Mode { kSetpoint, kLinear, kCubic };
+
+static bool tracking_case(Mode mode, double seconds) {
+  Setup setup;
+  if (!setup.start()) return false;
+  bench::FakeMcu firmware(setup.pty.master);
+
+  ucp::TrajectoryOptions options;
+  options.interpolation = mode == Mode::kCubic ? ucp::Interpolation::kCubic : ucp::Interpolation::kLinear;
+  uint64_t start = bench::now_ns(), end = start + (uint64_t)(seconds * 1e9);
+  for (uint64_t next = start; next < end; next += kPlanPeriodNs) {
+    bench::sleep_until_ns(next);
+    uint64_t now = bench::now_ns();
+    if (mode == Mode::kSetpoint) {
+      setup.client.set_setpoint((int16_t)lroundf(profile_speed(now)), (int16_t)lroundf(profile_angular(now)));
+      continue;
+    }
+    ucp::Waypoint points[11];
+    for (int i = 0; i < 11; i++) {
+      uint64_t t = now + i * kPlanPeriodNs;
+      points[i] = {t, profile_speed(t), profile_angular(t)};
+    }
+    setup.scheduler.replace(points, 11, options);
+  }
+  setup.client.stop();
+
+  // Skip the first plan period, before which nothing had been planned
+  std::vector<double> speed_err, angular_err;
+  for (const bench::Command& c : firmware.finish()) {
+    if (c.at_ns < start + kPlanPeriodNs || c.at_ns > end) continue;
+    speed_err.push_back(fabs(c.speed - profile_speed(c.at_ns)));
+    angular_err.push_back(fabs(c.angular - profile_angular(c.at_ns)));
+  }
+  static const char* const kNames[] = {"setpoint 10 Hz", "linear", "cubic"};
+  char label[64];
+  snprintf(label, sizeof(label), "%-14s speed error", kNames[(int)mode]);
+  bench::print_percentiles(label, speed_err, "units");
+  snprintf(label, sizeof(label), "%-14s angular error", kNames[(int)mode]);
+  bench::print_percentiles(label, angular_err, "units");
+  if (mode != Mode::kSetpoint) {
+    ucp::TrajectoryStats s = setup.scheduler.stats();
+    printf("  %llu trajectories, %llu preempted a running one\n", (unsigned long long)s.replaced,
+           (unsigned long long)s.preempted);
+  }
+  return true;
+}
+
+// A constant-velocity trajectory from now on
+static void cruise(ucp::TrajectoryScheduler& scheduler, float speed) {
+  uint64_t now = bench::now_ns();
+  ucp::Waypoint points[2] = {{now, speed, 0}, {now + 10000000000ull, speed, 0}};
+  scheduler.replace(points, 2);
+}
+
+static bool preempt_and_stop_case() {
+  const int kTrials = 30;
+  Setup setup;
+  if (!setup.start()) return false;
+  bench::FakeMcu firmware(setup.pty.master);
+
+  std::vector<uint64_t> preempt_at, stop_at;
+  for (int i = 0; i < kTrials; i++) {
+    cruise(setup.scheduler, 50);
+    usleep(30 * 1000 + (i % 7) * 1000);  // Land at different points of the tick
+    preempt_at.push_back(bench::now_ns());
+    cruise(setup.scheduler, -50);
+    usleep(30 * 1000 + (i % 5) * 1000);
+    stop_at.push_back(bench::now_ns());
+    setup.scheduler.emergency_stop();
+    usleep(30 * 1000);
+    cruise(setup.scheduler, 50);  // Sent while stopped: must be dropped
+    usleep(20 * 1000);
+    setup.scheduler.release();
+  }
+  setup.client.stop();
+  const std::vector<bench::Command>& commands = firmware.finish();
+
+  std::vector<double> preempt_ms, stop_ms;
+  bool rollback = false;
+  size_t c = 0;
+  for (int i = 0; i < kTrials; i++) {
+    while (c < commands.size() && !(commands[c].at_ns > preempt_at[i] && commands[c].speed == -50)) c++;
+    if (c == commands.size()) break;
+    preempt_ms.push_back((commands[c].at_ns - preempt_at[i]) / 1e6);
+    for (; c < commands.size() && commands[c].at_ns <= stop_at[i]; c++) rollback |= commands[c].speed == 50;
+    while (c < commands.size() && commands[c].speed != 0) c++;
+    if (c == commands.size()) break;
+    stop_ms.push_back((commands[c].at_ns - stop_at[i]) / 1e6);
+    // Nothing but zero until release()
+    uint64_t released = stop_at[i] + 50 * 1000000ull;
+    for (; c < commands.size() && commands[c].at_ns < released; c++) rollback |= commands[c].speed != 0;
+  }
+  bench::print_percentiles("preempt to first new command", preempt_ms, "ms");
+  bench::print_percentiles("e-stop to first zero command", stop_ms, "ms");
+  ucp::TrajectoryStats s = setup.scheduler.stats();
+  printf("  tick period %.1f ms; %llu trajectories dropped for being sent while stopped\n",
+         1000.0 / kRateHz, (unsigned long long)s.dropped);
+  if (rollback || preempt_ms.size() != kTrials || stop_ms.size() != kTrials) {
+    fprintf(stderr, "  the firmware got a command from a replaced or stopped trajectory\n");
+    return false;
+  }
+  return true;
+}
+
+static void cost_case() {
+  ucp::TrajectoryScheduler scheduler;
+  ucp::Waypoint points[11];
+  for (int i = 0; i < 11; i++) points[i] = {(uint64_t)i * kPlanPeriodNs, (float)i, (float)-i};
+  const int kReplaces = 100000;
+  uint64_t start = bench::now_ns();
+  for (int i = 0; i < kReplaces; i++) scheduler.replace(points, 11);
+  double replace_ns = (double)(bench::now_ns() - start) / kReplaces;
+
+  ucp::TrajectoryOptions cubic;
+  cubic.interpolation = ucp::Interpolation::kCubic;
+  scheduler.replace(points, 11, cubic);
+  const int kTicks = 1000000;
+  ucp::Setpoint s;
+  start = bench::now_ns();
+  for (int i = 0; i < kTicks; i++) {
+    scheduler.setpoint((uint64_t)i * 1000, &s);  // 1 ms of trajectory per 1000 ticks
+    bench::do_not_optimize(s.speed);
+  }
+  double tick_ns = (double)(bench::now_ns() - start) / kTicks;
+  printf("replace() of 11 waypoints %.0f ns, cubic setpoint() %.1f ns\n", replace_ns, tick_ns);
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+  for (Mode mode : {Mode::kSetpoint, Mode::kLinear, Mode::kCubic}) {
+    if (!tracking_case(mode, seconds)) return 1;
+  }
+  if (!preempt_and_stop_case()) return 1;
+  cost_case();
+  return 0;
+}
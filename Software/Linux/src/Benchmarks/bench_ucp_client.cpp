@@ -0,0 +1,133 @@
+// -----------------------------------------------------------------------------
+// Motor command cadence: ucp::Client against the old move.cpp loop
+//
+// A pty stands in for /dev/ttyS0; the bench plays the firmware on the master
+// side, from a SCHED_FIFO thread when allowed, and timestamps every decoded
+// motor command. For each rate it runs
+//   usleep loop : write() on an O_SYNC fd, then usleep(period), as move.cpp did
+//   client      : ucp::Client, timerfd ticks on a SCHED_FIFO sender thread
+// once on an idle machine and once with a busy SCHED_OTHER thread competing
+// for the CPU. Reported: inter-send period percentiles, the achieved rate
+// (drift from the nominal one) and the client's missed ticks. Finally the
+// cost of set_setpoint() while the sender runs.
+// Usage: bench_ucp_client [seconds per case]
+// -----------------------------------------------------------------------------
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "fake_mcu.hpp"
+#include "ucp_client.hpp"
+
+// A SCHED_OTHER thread that never sleeps
+class CpuHog {
+ public:
+  explicit CpuHog(bool on) {
+    if (!on) return;
+    thread_ = std::thread([this] {
+      uint64_t x = 0;
+      while (!done_.load(std::memory_order_relaxed)) bench::do_not_optimize(x++);
+    });
+  }
+  ~CpuHog() {
+    done_ = true;
+    if (thread_.joinable()) thread_.join();
+  }
+
+ private:
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+};
+
+static void report(const char* name, unsigned rate_hz, bool loaded,
+                   const std::vector<bench::Command>& commands, double seconds) {
+  std::vector<uint64_t> at;
+  for (const bench::Command& c : commands) at.push_back(c.at_ns);
+  std::vector<double> period_us;
+  for (size_t i = 1; i < at.size(); i++) period_us.push_back((at[i] - at[i - 1]) / 1e3);
+  char label[64];
+  snprintf(label, sizeof(label), "%-11s %3u Hz %s", name, rate_hz, loaded ? "loaded" : "idle  ");
+  bench::print_percentiles(label, period_us, "us");
+  double achieved = at.size() > 1 ? (at.size() - 1) / ((at.back() - at.front()) / 1e9) : 0;
+  printf("  %zu commands in %.1f s, %.2f Hz achieved (%+.2f %%)\n", at.size(), seconds, achieved,
+         (achieved / rate_hz - 1) * 100);
+}
+
+// The old move.cpp pattern
+static bool usleep_case(unsigned rate_hz, bool loaded, double seconds) {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+  int fd = pty.open_slave(O_SYNC);
+  bench::FakeMcu firmware(pty.master);
+  CpuHog hog(loaded);
+  ucp::Encoder encoder;
+  uint64_t end = bench::now_ns() + (uint64_t)(seconds * 1e9);
+  while (bench::now_ns() < end) {
+    ucp::Frame<ucp_ctl_cmd_t> frame;
+    ucp::make_ctl_cmd(frame, 60, 0);
+    encoder.seal(frame);
+    if (write(fd, frame.data(), frame.size()) < 0) perror("write");
+    usleep(1000000 / rate_hz);
+  }
+  report("usleep loop", rate_hz, loaded, firmware.finish(), seconds);
+  close(fd);
+  return true;
+}
+
+static bool client_case(unsigned rate_hz, bool loaded, double seconds) {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+  bench::FakeMcu firmware(pty.master);
+  CpuHog hog(loaded);
+  ucp::ClientOptions options;
+  options.rate_hz = rate_hz;
+  options.stop_on_exit = false;
+  ucp::Client client(options);
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+  client.set_setpoint(60, 0);
+  usleep((useconds_t)(seconds * 1e6));
+  client.stop();
+  report("client", rate_hz, loaded, firmware.finish(), seconds);
+  ucp::ClientStats s = client.stats();
+  printf("  sender %s, %llu missed ticks, %llu blocked writes\n",
+         s.realtime ? "SCHED_FIFO" : "SCHED_OTHER (no permission for SCHED_FIFO)",
+         (unsigned long long)s.missed_ticks, (unsigned long long)s.write_blocked);
+  return s.write_errors == 0;
+}
+
+// Producers hammering the mailbox while the sender runs
+static bool mailbox_case() {
+  bench::Pty pty;
+  if (!pty.open()) return false;
+  bench::FakeMcu firmware(pty.master);
+  ucp::ClientOptions options;
+  options.rate_hz = ucp::Client::kMaxRateHz;
+  options.stop_on_exit = false;
+  ucp::Client client(options);
+  if (!client.attach(pty.open_slave(0)) || !client.start()) return false;
+  const int kCalls = 1000000;
+  uint64_t start = bench::now_ns();
+  for (int i = 0; i < kCalls; i++) client.set_setpoint((int16_t)i, (int16_t)-i);
+  double ns = (double)(bench::now_ns() - start) / kCalls;
+  client.stop();
+  firmware.finish();
+  printf("set_setpoint(): %.1f ns per call with the sender at %u Hz\n", ns, client.rate_hz());
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  static const unsigned rates[] = {50, 100, 500};
+  for (bool loaded : {false, true}) {
+    for (unsigned rate : rates) {
+      if (!usleep_case(rate, loaded, seconds) || !client_case(rate, loaded, seconds)) return 1;
+    }
+  }
+  return mailbox_case() ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// -----------------------------------------------------------------------------
+// Motor command encode throughput: the original malloc/memcpy send_ctl_cmd
+// path from move.cpp against ucp::Encoder writing into a stack frame.
+//
+// Both variants are measured encode-only and encode + write() to /dev/null so
+// the syscall cost is visible separately from the packet building cost.
+// Usage: bench_ucp_codec [packets]
+// -----------------------------------------------------------------------------
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench_util.hpp"
+#include "ucp_codec.hpp"
+
+// The pre-codec implementation, kept verbatim apart from the sink.
+typedef struct uart_cmd {
+  uint8_t* data;
+  int len;
+} uart_cmd_t;
+
+static uint64_t legacy_sink;
+
+static void legacy_send_ctl_cmd(int fd, uint16_t linear, uint16_t angular) {
+  ucp_ctl_cmd_t ctl_cmd = {};
+  ctl_cmd.hd.len = sizeof(ucp_ctl_cmd_t);
+  ctl_cmd.hd.id = 0x2;
+  ctl_cmd.hd.index = 0;
+  ctl_cmd.speed = linear;
+  ctl_cmd.angular = angular;
+
+  uint16_t head = 0xfffd;
+  uint16_t crc;
+  uart_cmd_t cmd = {};
+  cmd.data = (uint8_t*)malloc(sizeof(ucp_ctl_cmd_t) + 5);
+  cmd.len = sizeof(ucp_ctl_cmd_t) + 4;
+
+  memcpy(cmd.data, &head, 2);
+  memcpy(cmd.data + 2, &ctl_cmd, sizeof(ucp_ctl_cmd_t));
+  crc = ucp::crc16((uint8_t*)cmd.data, sizeof(ucp_ctl_cmd_t) + 2);
+  memcpy(cmd.data + 2 + sizeof(ucp_ctl_cmd_t), &crc, 2);
+
+  if (fd >= 0) {
+    if (write(fd, cmd.data, cmd.len) < 0) perror("write");
+  } else {
+    legacy_sink += cmd.data[cmd.len - 1];
+  }
+
+  if (cmd.data) {
+    free(cmd.data);
+  }
+}
+
+static ucp::Encoder encoder;
+static uint64_t codec_sink;
+
+static void codec_send_ctl_cmd(int fd, int16_t linear, int16_t angular) {
+  ucp::Frame<ucp_ctl_cmd_t> frame;
+  ucp::make_ctl_cmd(frame, linear, angular);
+  encoder.seal(frame);
+
+  if (fd >= 0) {
+    if (write(fd, frame.data(), frame.size()) < 0) perror("write");
+  } else {
+    codec_sink += frame.crc[1];
+  }
+}
+
+template <typename Fn>
+static double run(const char* label, long packets, int fd, Fn&& send) {
+  uint64_t start = bench::now_ns();
+  for (long i = 0; i < packets; i++) {
+    send(fd, (int16_t)(i & 0x7f), (int16_t)(-(i & 0x3f)));
+  }
+  uint64_t elapsed = bench::now_ns() - start;
+  double pps = packets * 1e9 / elapsed;
+  printf("%-34s %10.0f packets/s  %7.1f ns/packet\n", label, pps, (double)elapsed / packets);
+  return pps;
+}
+
+int main(int argc, char* argv[]) {
+  long packets = argc > 1 ? atol(argv[1]) : 5000000;
+
+  // Both paths must put identical bytes on the wire (index aside).
+  ucp::Frame<ucp_ctl_cmd_t> frame;
+  ucp::make_ctl_cmd(frame, 60, -20);
+  ucp::Encoder check;
+  check.seal(frame);
+  uint8_t legacy[24] = {0xfd, 0xff};
+  ucp_ctl_cmd_t cmd = {};
+  cmd.hd.len = sizeof(cmd);
+  cmd.hd.id = UCP_MOTOR_CTL;
+  cmd.speed = 60;
+  cmd.angular = -20;
+  memcpy(legacy + 2, &cmd, sizeof(cmd));
+  uint16_t crc = ucp::crc16(legacy, 22);
+  memcpy(legacy + 22, &crc, 2);
+  if (memcmp(legacy, frame.data(), sizeof(legacy)) != 0) {
+    fprintf(stderr, "codec output differs from legacy send_ctl_cmd\n");
+    return 1;
+  }
+
+  printf("== encode only (%ld packets) ==\n", packets);
+  double legacy_pps = run("legacy send_ctl_cmd (malloc)", packets, -1, legacy_send_ctl_cmd);
+  double codec_pps = run("ucp::Encoder (stack frame)", packets, -1, codec_send_ctl_cmd);
+  printf("speedup: %.2fx\n", codec_pps / legacy_pps);
+
+  int fd = open("/dev/null", O_WRONLY);
+  if (fd < 0) {
+    perror("open /dev/null");
+    return 1;
+  }
+  long io_packets = packets / 5;
+  printf("== encode + write(/dev/null) (%ld packets) ==\n", io_packets);
+  legacy_pps = run("legacy send_ctl_cmd (malloc)", io_packets, fd, legacy_send_ctl_cmd);
+  codec_pps = run("ucp::Encoder (stack frame)", io_packets, fd, codec_send_ctl_cmd);
+  printf("speedup: %.2fx\n", codec_pps / legacy_pps);
+  close(fd);
+
+  bench::do_not_optimize(legacy_sink);
+  bench::do_not_optimize(codec_sink);
+  return 0;
+}
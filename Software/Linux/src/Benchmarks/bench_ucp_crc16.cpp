@@ -0,0 +1,132 @@
+// -----------------------------------------------------------------------------
+// CRC16 kernels: bit-for-bit check against the legacy table code, then MB/s
+// for the 24-byte motor command, the 44-byte report and OTA-sized buffers.
+// Exits non-zero if any kernel disagrees with the legacy result.
+// Usage: bench_ucp_crc16 [seconds per case]
+// -----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "bench_util.hpp"
+#include "ucp_crc.h"
+
+// Copy of the crc16() that used to live in move.cpp/uart_mutex.c, with the
+// tables rebuilt from the polynomial so the check is independent of ucp_crc.c.
+static uint8_t legacy_hi[256], legacy_lo[256];
+
+static void legacy_init() {
+  for (int i = 0; i < 256; i++) {
+    uint16_t c = i;
+    for (int b = 0; b < 8; b++) c = (c & 1) ? (c >> 1) ^ 0xA001 : c >> 1;
+    legacy_hi[i] = c & 0xff;
+    legacy_lo[i] = c >> 8;
+  }
+}
+
+static uint16_t legacy_crc16(const uint8_t* msg, size_t len) {
+  uint8_t crc_hi = 0xFF;
+  uint8_t crc_lo = 0xFF;
+  uint8_t index;
+
+  while (len--) {
+    index = crc_lo ^ *msg++;
+    crc_lo = crc_hi ^ legacy_hi[index];
+    crc_hi = legacy_lo[index];
+  }
+  return (crc_hi << 8 | crc_lo);
+}
+
+typedef uint16_t (*crc_fn)(uint16_t, const void*, size_t);
+
+struct Kernel {
+  const char* name;
+  crc_fn fn;
+};
+
+static const Kernel kernels[] = {
+  {"bytewise", ucp_crc16_bytewise},
+  {"slice8", ucp_crc16_slice8},
+  {"clmul", ucp_crc16_clmul},
+  {"dispatch", ucp_crc16_update},
+};
+
+static bool verify(const std::vector<uint8_t>& buf) {
+  bool ok = true;
+  for (size_t off = 0; off < 16; off++) {
+    for (size_t len = 0; off + len <= buf.size(); len += (len < 300 ? 1 : 97)) {
+      uint16_t want = legacy_crc16(buf.data() + off, len);
+      for (const Kernel& k : kernels) {
+        uint16_t got = k.fn(UCP_CRC_INIT, buf.data() + off, len);
+        if (got != want) {
+          fprintf(stderr, "MISMATCH %s off=%zu len=%zu got=%04x want=%04x\n", k.name, off, len,
+                  got, want);
+          ok = false;
+        }
+      }
+      // Split updates must compose.
+      size_t half = len / 3;
+      uint16_t split = ucp_crc16_update(UCP_CRC_INIT, buf.data() + off, half);
+      split = ucp_crc16_update(split, buf.data() + off + half, len - half);
+      if (split != want) {
+        fprintf(stderr, "MISMATCH split off=%zu len=%zu\n", off, len);
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+static void measure(const char* name, crc_fn fn, const std::vector<uint8_t>& buf, size_t len,
+                    double seconds) {
+  uint64_t iters = 0, bytes = 0;
+  uint16_t acc = 0;
+  uint64_t start = bench::now_ns(), deadline = start + (uint64_t)(seconds * 1e9), now;
+  size_t offset = 0;
+  do {
+    for (int i = 0; i < 256; i++) {
+      acc ^= fn(UCP_CRC_INIT, buf.data() + offset, len);
+      offset = (offset + len) % (buf.size() - len + 1);
+    }
+    iters += 256;
+    bytes += 256 * len;
+    now = bench::now_ns();
+  } while (now < deadline);
+  bench::do_not_optimize(acc);
+  double secs = (now - start) / 1e9;
+  printf("  %-9s %9.1f MB/s  %8.1f ns/call\n", name, bytes / secs / 1e6, (now - start) / (double)iters);
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 0.3;
+  legacy_init();
+
+  std::vector<uint8_t> buf(1 << 20);
+  srand(1234);
+  for (uint8_t& b : buf) b = rand() & 0xff;
+
+  std::vector<uint8_t> small(buf.begin(), buf.begin() + 4096);
+  if (!verify(small)) return 1;
+  printf("all kernels match the legacy crc16 (clmul %s)\n",
+         ucp_crc16_has_clmul() ? "available" : "not available, falls back to slice8");
+
+  static const struct {
+    const char* label;
+    size_t len;
+  } cases[] = {
+    {"24 B motor command", 24},
+    {"44 B report", 44},
+    {"4 KB", 4096},
+    {"64 KB OTA image chunk", 65536},
+    {"1 MB OTA image", 1 << 20},
+  };
+  for (const auto& c : cases) {
+    printf("%s:\n", c.label);
+    measure("legacy", [](uint16_t, const void* p, size_t n) {
+      return legacy_crc16((const uint8_t*)p, n);
+    }, buf, c.len, seconds);
+    for (const Kernel& k : kernels) measure(k.name, k.fn, buf, c.len, seconds);
+  }
+  return 0;
+}
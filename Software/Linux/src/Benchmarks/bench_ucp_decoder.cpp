@@ -0,0 +1,215 @@
+// -----------------------------------------------------------------------------
+// ucp::Decoder fuzz and throughput harness
+//
+// Fuzz: builds a stream of reports, calibration acks and pongs mixed with
+// garbage, truncated frames, bad headers and CRC-corrupted frames, feeds it in
+// randomized fragment sizes and checks that every intact frame comes out
+// exactly once and in order. Exits non-zero on a missing or reordered frame.
+//
+// Throughput: clean report streams fed in UART-sized and large chunks.
+// Usage: bench_ucp_decoder [fuzz rounds] [seconds per throughput case]
+// -----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "ucp_decoder.hpp"
+
+struct Expected {
+  uint8_t id;
+  uint8_t index;
+  uint16_t crc;
+};
+
+static ucp::Encoder encoder;
+
+template <typename T>
+static void append(std::vector<uint8_t>& out, const T& msg, uint8_t id, std::mt19937& rng,
+                   std::vector<Expected>* expected) {
+  T m = msg;
+  uint8_t* raw = reinterpret_cast<uint8_t*>(&m);
+  for (size_t i = sizeof(ucp_hd_t); i < sizeof(T); i++) raw[i] = rng() & 0xff;
+  uint8_t frame[ucp::kMaxFrameLen];
+  size_t len = encoder.encode(m, frame, sizeof(frame), id);
+  if (expected) expected->push_back({id, frame[5], (uint16_t)(frame[len - 2] | frame[len - 1] << 8)});
+  out.insert(out.end(), frame, frame + len);
+}
+
+static void append_valid(std::vector<uint8_t>& out, std::mt19937& rng,
+                         std::vector<Expected>* expected) {
+  switch (rng() % 4) {
+    case 0: append(out, ucp_rep_t{}, UCP_RPM_REPORT, rng, expected); break;
+    case 1: append(out, ucp_imu_r_ack_t{}, UCP_IMUMAG_READ, rng, expected); break;
+    case 2: append(out, ucp_alive_pong_t{}, UCP_KEEP_ALIVE, rng, expected); break;
+    default: append(out, ucp_imu_correct_ack_t{}, UCP_IMU_CORRECTION_START, rng, expected); break;
+  }
+}
+
+// Noise that must not produce frames: random bytes, truncated frames,
+// preambles with impossible headers and frames with a flipped byte.
+static void append_noise(std::vector<uint8_t>& out, std::mt19937& rng) {
+  switch (rng() % 5) {
+    case 0: {
+      size_t n = 1 + rng() % 40;
+      for (size_t i = 0; i < n; i++) out.push_back(rng() & 0xff);
+      break;
+    }
+    case 1: {
+      std::vector<uint8_t> f;
+      append_valid(f, rng, nullptr);
+      // Don't cut right before a 0xFD: the next frame's preamble would put it
+      // back and the "truncated" frame would be valid on the wire.
+      size_t cut = 1 + rng() % (f.size() - 1);
+      while (f[cut] == ucp::kSync0) cut--;
+      f.resize(cut);
+      out.insert(out.end(), f.begin(), f.end());
+      break;
+    }
+    case 2: {
+      uint8_t bad[] = {0xfd, 0xff, (uint8_t)(rng() & 0xff), 0x7f, 0x44};  // hd.len far too large
+      out.insert(out.end(), bad, bad + sizeof(bad));
+      break;
+    }
+    case 3: {
+      uint8_t bad[] = {0xfd, 0xff, 0x28, 0x00, 0xee};  // Unknown id
+      out.insert(out.end(), bad, bad + sizeof(bad));
+      break;
+    }
+    default: {
+      std::vector<uint8_t> f;
+      append_valid(f, rng, nullptr);
+      f[ucp::kSyncSize + sizeof(ucp_hd_t) + rng() % (f.size() - 8)] ^= 1 + rng() % 255;
+      out.insert(out.end(), f.begin(), f.end());
+      break;
+    }
+  }
+}
+
+static bool fuzz_round(unsigned seed, size_t frames, ucp::DecoderStats* total) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> stream;
+  std::vector<Expected> expected;
+  for (size_t i = 0; i < frames; i++) {
+    if (rng() % 3 == 0) append_noise(stream, rng);
+    append_valid(stream, rng, &expected);
+  }
+
+  ucp::Decoder decoder;
+  std::vector<Expected> got;
+  auto on_frame = [&](const ucp::FrameView& f) {
+    got.push_back({f.id(), f.index(), (uint16_t)(f.frame[f.frame_len - 2] | f.frame[f.frame_len - 1] << 8)});
+    if (f.id() == UCP_RPM_REPORT && !f.as<ucp_rep_t>()) fprintf(stderr, "report view rejected\n");
+  };
+
+  size_t pos = 0;
+  while (pos < stream.size()) {
+    size_t chunk;
+    switch (rng() % 4) {
+      case 0: chunk = 1; break;                       // Byte at a time
+      case 1: chunk = 1 + rng() % 8; break;           // Split headers
+      case 2: chunk = 1 + rng() % 64; break;          // Split frames
+      default: chunk = 1 + rng() % 4096; break;       // Merged segments
+    }
+    if (chunk > stream.size() - pos) chunk = stream.size() - pos;
+    decoder.feed(stream.data() + pos, chunk, on_frame);
+    pos += chunk;
+  }
+  decoder.flush(on_frame);  // End of stream: release frames queued behind a truncated header
+
+  // Every intact frame must appear, in order. Extra frames can only come from
+  // noise that happens to pass the 16-bit CRC (about 1 in 65536 candidates).
+  // Such a frame can also swallow intact frames it overlaps; that is what the
+  // wire would do too, so losses right after a spurious frame are counted,
+  // and any other loss is a decoder bug.
+  auto same = [](const Expected& a, const Expected& b) {
+    return a.id == b.id && a.index == b.index && a.crc == b.crc;
+  };
+  size_t j = 0, extra = 0, swallowed = 0;
+  bool after_spurious = false;
+  for (const Expected& e : got) {
+    size_t k = j;
+    while (k < expected.size() && k < j + 8 && !same(e, expected[k])) k++;
+    if (k == expected.size() || k == j + 8) {
+      extra++;
+      after_spurious = true;
+      continue;
+    }
+    if (k > j && !after_spurious) break;
+    swallowed += k - j;
+    j = k + 1;
+    after_spurious = false;
+  }
+  if (after_spurious && j < expected.size()) {
+    swallowed += expected.size() - j;
+    j = expected.size();
+  }
+  const ucp::DecoderStats& s = decoder.stats();
+  total->frames += s.frames;
+  total->bytes += s.bytes;
+  total->resyncs += s.resyncs;
+  total->discarded += s.discarded;
+  total->crc_errors += s.crc_errors;
+  total->bad_headers += s.bad_headers;
+  if (j != expected.size()) {
+    fprintf(stderr, "seed %u: matched %zu of %zu frames (%zu unexpected)\n", seed, j,
+            expected.size(), extra);
+    return false;
+  }
+  if (extra) {
+    printf("seed %u: %zu spurious frame(s) from CRC collisions, %zu frame(s) swallowed\n", seed,
+           extra, swallowed);
+  }
+  return true;
+}
+
+static void throughput(const char* label, size_t chunk, double seconds) {
+  std::mt19937 rng(7);
+  std::vector<uint8_t> stream;
+  while (stream.size() < (1 << 20)) append(stream, ucp_rep_t{}, UCP_RPM_REPORT, rng, nullptr);
+
+  ucp::Decoder decoder;
+  uint64_t frames = 0, calls = 0, max_per_call = 0, bytes = 0;
+  int16_t acc = 0;
+  uint64_t start = bench::now_ns(), deadline = start + (uint64_t)(seconds * 1e9), now;
+  do {
+    for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+      size_t n = std::min(chunk, stream.size() - pos);
+      size_t got = decoder.feed(stream.data() + pos, n, [&](const ucp::FrameView& f) {
+        acc += f.as<ucp_rep_t>()->heading;
+      });
+      frames += got;
+      max_per_call = std::max<uint64_t>(max_per_call, got);
+      calls++;
+      bytes += n;
+    }
+    now = bench::now_ns();
+  } while (now < deadline);
+  bench::do_not_optimize(acc);
+  double secs = (now - start) / 1e9;
+  printf("%-26s %10.0f frames/s %8.1f MB/s  up to %llu frames per feed()\n", label, frames / secs,
+         bytes / secs / 1e6, (unsigned long long)max_per_call);
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 200;
+  double seconds = argc > 2 ? atof(argv[2]) : 0.5;
+
+  ucp::DecoderStats total;
+  for (int i = 0; i < rounds; i++) {
+    if (!fuzz_round(1000 + i, 2000, &total)) return 1;
+  }
+  printf("fuzz: %d rounds ok, %llu frames, %llu resyncs, %llu bytes discarded, "
+         "%llu CRC errors, %llu bad headers\n",
+         rounds, (unsigned long long)total.frames, (unsigned long long)total.resyncs,
+         (unsigned long long)total.discarded, (unsigned long long)total.crc_errors,
+         (unsigned long long)total.bad_headers);
+
+  throughput("1 byte chunks", 1, seconds);
+  throughput("32 byte chunks (UART)", 32, seconds);
+  throughput("1460 byte chunks (TCP)", 1460, seconds);
+  throughput("64 KB chunks", 65536, seconds);
+  return 0;
+}
@@ -0,0 +1,241 @@
+// -----------------------------------------------------------------------------
+// Motor commands over a lossy link: the TCP path against the UDP control port
+//
+// One client sends setpoints at 100 Hz through an emulated link to a Bridge on
+// a pty; the bench plays the firmware on the pty master. The link adds a
+// one-way delay and, per packet, loss and reordering (a packet held back
+// behind later ones). The same random draws are used for both transports:
+//   UDP : a lost datagram is gone, a reordered one arrives late and the
+//         bridge drops it as stale
+//   TCP : the stream stalls behind the gap. A loss is repaired by fast
+//         retransmit (three later segments, then a round trip), a reordered
+//         segment by its late arrival, and every later command waits
+// Reported per case: latency from send to the firmware for delivered
+// commands, the age of the firmware's newest setpoint sampled every
+// millisecond (what the robot is actually acting on), and for UDP the
+// round trip measured from the bridge's acks. The bench fails if the
+// firmware ever receives a setpoint older than one it already has.
+// Usage: bench_udp_control [seconds per case]
+// -----------------------------------------------------------------------------
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "bridge_rig.hpp"
+#include "udp_control.hpp"
+
+static const double kRateHz = 100;
+static const uint64_t kOneWayNs = 10 * 1000000ull;   // Emulated link delay
+static const uint64_t kReorderNs = 30 * 1000000ull;  // Extra delay of a reordered packet
+
+struct LinkCase {
+  const char* name;
+  double loss;
+  double reorder;
+};
+
+// What the firmware saw: arrival time and the command's send time
+struct Arrival {
+  uint64_t at;
+  uint64_t sent;
+};
+
+static bool run_case(bool use_udp, const LinkCase& link, double seconds) {
+  bench::Rig rig;
+  rig.config.udp = use_udp;
+  rig.config.udp_port = 0;
+  if (!rig.start(1)) return false;
+
+  int udp_fd = -1;
+  if (use_udp) {
+    udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(rig.udp_port());
+    if (connect(udp_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+      perror("udp connect");
+      return false;
+    }
+  }
+
+  std::atomic<bool> done(false);
+  std::vector<Arrival> arrivals;
+  ucp::Decoder decoder;
+  std::thread firmware([&] {
+    struct pollfd pfd = {rig.master(), POLLIN, 0};
+    uint8_t buf[4096];
+    while (!done.load()) {
+      if (poll(&pfd, 1, 10) <= 0) continue;
+      ssize_t n = read(pfd.fd, buf, sizeof(buf));
+      if (n <= 0) continue;
+      uint64_t now = bench::now_ns();
+      decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+        const ucp_ctl_cmd_t* cmd = f.as<ucp_ctl_cmd_t>();
+        if (!cmd) return;
+        uint64_t ts;
+        memcpy(&ts, &cmd->front_led, sizeof(ts));
+        arrivals.push_back({now, ts});
+      });
+    }
+  });
+
+  // Acks and telemetry coming back over UDP
+  std::vector<double> rtt_ms;
+  std::thread ack_reader;
+  if (use_udp) {
+    ack_reader = std::thread([&] {
+      struct pollfd pfd = {udp_fd, POLLIN, 0};
+      uint8_t buf[512];
+      while (!done.load()) {
+        if (poll(&pfd, 1, 10) <= 0) continue;
+        ssize_t n = recv(udp_fd, buf, sizeof(buf), MSG_DONTWAIT);
+        bridge::udp::Header hd;
+        if (n < (ssize_t)sizeof(hd)) continue;
+        memcpy(&hd, buf, sizeof(hd));
+        if (hd.type != bridge::udp::kAck) continue;
+        rtt_ms.push_back((bench::now_ns() - hd.stamp_ns) / 1e6);
+      }
+    });
+  }
+
+  // The sender and the emulated link. Packets wait in `link_queue` until
+  // their delivery time; TCP deliveries are additionally kept in order.
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<double> draw(0, 1);
+  std::multimap<uint64_t, std::vector<uint8_t>> link_queue;
+  uint64_t period = (uint64_t)(1e9 / kRateHz);
+  uint64_t tcp_stall = 3 * period + 2 * kOneWayNs;
+  uint64_t last_delivery = 0;
+  ucp::Encoder encoder;
+  uint32_t seq = 0;
+  uint64_t sent = 0, lost = 0;
+  uint64_t start = bench::now_ns(), end = start + (uint64_t)(seconds * 1e9);
+  uint64_t next_send = start;
+  for (;;) {
+    uint64_t now = bench::now_ns();
+    if (next_send < end && now >= next_send) {
+      ucp::Frame<ucp_ctl_cmd_t> frame;
+      ucp::make_ctl_cmd(frame, 60, 0);
+      memcpy(&frame.msg.front_led, &now, sizeof(now));
+      encoder.seal(frame);
+
+      std::vector<uint8_t> packet;
+      if (use_udp) {
+        bridge::udp::Header hd;
+        memset(&hd, 0, sizeof(hd));
+        hd.magic = bridge::udp::kMagic;
+        hd.type = bridge::udp::kCommand;
+        hd.seq = seq++;
+        hd.stamp_ns = now;
+        packet.assign((uint8_t*)&hd, (uint8_t*)&hd + sizeof(hd));
+      }
+      packet.insert(packet.end(), frame.data(), frame.data() + frame.size());
+
+      bool drop = draw(rng) < link.loss;
+      bool late = draw(rng) < link.reorder;
+      uint64_t at = now + kOneWayNs;
+      if (use_udp) {
+        if (late) at += kReorderNs;
+        if (!drop) link_queue.emplace(at, std::move(packet));
+      } else {
+        if (drop) at += tcp_stall;
+        else if (late) at += kReorderNs;
+        at = std::max(at, last_delivery);  // In order, behind any stall
+        last_delivery = at;
+        link_queue.emplace(at, std::move(packet));
+      }
+      lost += drop && use_udp;
+      sent++;
+      next_send += period;
+    }
+
+    while (!link_queue.empty() && link_queue.begin()->first <= now) {
+      const std::vector<uint8_t>& p = link_queue.begin()->second;
+      if (use_udp) {
+        send(udp_fd, p.data(), p.size(), 0);
+      } else {
+        send(rig.clients()[0], p.data(), p.size(), MSG_NOSIGNAL);
+      }
+      link_queue.erase(link_queue.begin());
+    }
+    if (next_send >= end && link_queue.empty()) break;
+    uint64_t wake = next_send < end ? next_send : UINT64_MAX;
+    if (!link_queue.empty()) wake = std::min(wake, link_queue.begin()->first);
+    bench::sleep_until_ns(wake);
+  }
+  usleep(200 * 1000);
+  done = true;
+  firmware.join();
+  if (ack_reader.joinable()) ack_reader.join();
+  rig.finish();
+  if (udp_fd >= 0) close(udp_fd);
+
+  // Latency of delivered commands, setpoint age and rollbacks
+  std::vector<double> latency_ms, age_ms;
+  uint64_t rollbacks = 0, newest = 0;
+  for (const Arrival& a : arrivals) {
+    latency_ms.push_back((a.at - a.sent) / 1e6);
+    if (a.sent < newest) rollbacks++;
+    newest = std::max(newest, a.sent);
+  }
+  if (!arrivals.empty()) {
+    size_t i = 0;
+    uint64_t have = 0;
+    for (uint64_t t = arrivals.front().at; t < end; t += 1000000) {
+      while (i < arrivals.size() && arrivals[i].at <= t) have = std::max(have, arrivals[i++].sent);
+      age_ms.push_back((t - have) / 1e6);
+    }
+  }
+
+  char label[64];
+  snprintf(label, sizeof(label), "%s %s latency", use_udp ? "udp" : "tcp", link.name);
+  bench::print_percentiles(label, latency_ms, "ms");
+  snprintf(label, sizeof(label), "%s %s setpoint age", use_udp ? "udp" : "tcp", link.name);
+  bench::print_percentiles(label, age_ms, "ms");
+  printf("  %llu of %llu commands reached the firmware (%llu lost on the link",
+         (unsigned long long)arrivals.size(), (unsigned long long)sent, (unsigned long long)lost);
+  if (use_udp) {
+    const bridge::Stats& s = rig.stats();
+    printf(", %llu stale dropped by the bridge, %llu coalesced)\n", (unsigned long long)s.udp_stale,
+           (unsigned long long)s.command_coalesced);
+    bench::print_percentiles("  ack round trip", rtt_ms, "ms");
+  } else {
+    printf(", %llu coalesced)\n", (unsigned long long)rig.stats().command_coalesced);
+  }
+  if (rollbacks) {
+    fprintf(stderr, "  firmware received %llu setpoints older than one it had\n",
+            (unsigned long long)rollbacks);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+  static const LinkCase cases[] = {
+      {"clean     ", 0, 0},
+      {"2%/2%     ", 0.02, 0.02},
+      {"5%/5%     ", 0.05, 0.05},
+  };
+  printf("link: %.0f ms one way; loss/reorder per case, reordered packets %.0f ms late\n",
+         kOneWayNs / 1e6, kReorderNs / 1e6);
+  for (const LinkCase& c : cases) {
+    if (!run_case(false, c, seconds) || !run_case(true, c, seconds)) return 1;
+  }
+  return 0;
+}
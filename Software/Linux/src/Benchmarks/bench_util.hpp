@@ -0,0 +1,61 @@
+// -----------------------------------------------------------------------------
+// Small helpers shared by the head-side benchmarks: a monotonic clock and
+// sleep, a guard against dead-code elimination and percentile reporting.
+// -----------------------------------------------------------------------------
+#ifndef BENCH_UTIL_HPP
+#define BENCH_UTIL_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace bench {
+
+inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Sleep until an absolute CLOCK_MONOTONIC time
+inline void sleep_until_ns(uint64_t deadline) {
+  struct timespec ts;
+  ts.tv_sec = deadline / 1000000000ull;
+  ts.tv_nsec = deadline % 1000000000ull;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// Keep the compiler from discarding a computed value.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Sorts `samples` in place and returns the requested percentile (0..100).
+inline double percentile(std::vector<double>& samples, double pct) {
+  if (samples.empty()) return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t idx = (size_t)(pct / 100.0 * (samples.size() - 1) + 0.5);
+  return samples[std::min(idx, samples.size() - 1)];
+}
+
+// Prints "label: p50 p90 p99 p99.9 max" in the given unit.
+inline void print_percentiles(const char* label, std::vector<double>& samples, const char* unit) {
+  if (samples.empty()) {
+    printf("%-28s no samples\n", label);
+    return;
+  }
+  double p50 = percentile(samples, 50);
+  double p90 = percentile(samples, 90);
+  double p99 = percentile(samples, 99);
+  double p999 = percentile(samples, 99.9);
+  printf("%-28s n=%zu p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f %s\n", label,
+         samples.size(), p50, p90, p99, p999, samples.back(), unit);
+}
+
+}  // namespace bench
+
+#endif  // BENCH_UTIL_HPP
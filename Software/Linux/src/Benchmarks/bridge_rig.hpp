@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------------------
+// Test rig shared by the bridge benchmarks: a bridge::Bridge on its own
+// thread, a pty standing in for /dev/ttyS0 and loopback TCP clients, and
+// optionally Unix socket clients.
+// -----------------------------------------------------------------------------
+#ifndef BENCH_BRIDGE_RIG_HPP
+#define BENCH_BRIDGE_RIG_HPP
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "bridge.hpp"
+
+namespace bench {
+
+// A Bridge on a fresh pty with `nclients` connected TCP clients. Adjust
+// `config` before start() to change bridge settings.
+class Rig {
+ public:
+  Rig() {
+    config.tcp_port = 0;
+    config.loopback_only = true;
+    config.client_queue = 256 * 1024;
+    config.telemetry_bus = "/ucp_telemetry_bench_bridge";
+    config.verbose = false;
+  }
+
+  bool start(size_t nclients) {
+    master_ = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_ < 0 || grantpt(master_) < 0 || unlockpt(master_) < 0) {
+      perror("posix_openpt");
+      return false;
+    }
+    // Hold the slave open until the bridge has it, so the master never sees a hangup
+    int slave = open(ptsname(master_), O_RDWR | O_NOCTTY);
+
+    config.serial = ptsname(master_);
+    if (!config.unix_dir) config.max_clients = nclients;  // Else Unix clients come later
+    bridge_.reset(new bridge::Bridge(config));
+    bool ok = bridge_->open();
+    close(slave);
+    if (!ok) return false;
+    loop_ = std::thread([this] { bridge_->run(); });
+
+    for (size_t i = 0; i < nclients; i++) {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons(bridge_->port());
+      if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return false;
+      }
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      clients_.push_back(fd);
+    }
+    usleep(100 * 1000);  // Let the loop accept everyone before traffic starts
+    return true;
+  }
+
+  // Stop the loop; client sockets are shut down so blocked readers return
+  void finish() {
+    bridge_->stop();
+    loop_.join();
+    for (int fd : clients_) shutdown(fd, SHUT_RDWR);
+  }
+
+  ~Rig() {
+    for (int fd : clients_) close(fd);
+    bridge_.reset();  // Removes its sockets
+    if (!unix_dir_.empty()) rmdir(unix_dir_.c_str());
+    telemetry_bus_unlink(config.telemetry_bus);
+    if (master_ >= 0) close(master_);
+    if (!record_dir_.empty()) {
+      for (const std::string& path : ucp_log::list_segments(record_dir_)) unlink(path.c_str());
+      rmdir(record_dir_.c_str());
+    }
+  }
+
+  // Record the traffic into a temporary directory, removed with the rig
+  bool record() {
+    char tmpl[] = "/tmp/bench_bridge.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+      perror("mkdtemp");
+      return false;
+    }
+    record_dir_ = tmpl;
+    config.record_dir = record_dir_.c_str();
+    return true;
+  }
+
+  // Serve Unix sockets from a temporary directory, removed with the rig
+  bool serve_unix() {
+    char tmpl[] = "/tmp/bench_bridge_sock.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+      perror("mkdtemp");
+      return false;
+    }
+    unix_dir_ = tmpl;
+    config.unix_dir = unix_dir_.c_str();
+    return true;
+  }
+
+  // A client connected to the socket of priority `p`, closed with the rig
+  int connect_unix(bridge::Priority p) {
+    const std::string& path = bridge_->unix_path(p);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+      perror(path.c_str());
+      if (fd >= 0) close(fd);
+      return -1;
+    }
+    clients_.push_back(fd);
+    return fd;
+  }
+
+  int master() const { return master_; }
+  const std::vector<int>& clients() const { return clients_; }
+  const bridge::Stats& stats() const { return bridge_->stats(); }
+  uint16_t udp_port() const { return bridge_->udp_port(); }
+  uint16_t metrics_port() const { return bridge_->metrics_port(); }
+  const bridge::Latency& latency() const { return bridge_->latency(); }
+  ucp_log::RecorderStats recorder_stats() const { return bridge_->recorder_stats(); }
+  unsigned uart_baud() const { return bridge_->uart_baud(); }
+  bridge::BaudState baud_state() const { return bridge_->baud_state(); }
+  bridge::BaudStats baud_stats() const { return bridge_->baud_stats(); }
+  const bridge::ArbiterStats& arbiter_stats() const { return bridge_->arbiter_stats(); }
+  const bridge::MuxStats& mux_stats() const { return bridge_->mux_stats(); }
+
+  bridge::Config config;
+
+ private:
+  int master_ = -1;
+  std::vector<int> clients_;
+  std::unique_ptr<bridge::Bridge> bridge_;
+  std::thread loop_;
+  std::string record_dir_;
+  std::string unix_dir_;
+};
+
+}  // namespace bench
+
+#endif  // BENCH_BRIDGE_RIG_HPP
@@ -0,0 +1,114 @@
+// -----------------------------------------------------------------------------
+// A pty standing in for /dev/ttyS0, and the firmware end of it: a thread on
+// the master side that decodes the motor commands the head sends and keeps
+// their arrival times. Shared by the client benchmarks.
+// -----------------------------------------------------------------------------
+#ifndef BENCH_FAKE_MCU_HPP
+#define BENCH_FAKE_MCU_HPP
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "ucp_decoder.hpp"
+
+namespace bench {
+
+// The slave side is raw, like a UART
+struct Pty {
+  int master = -1;
+  const char* slave = nullptr;
+
+  bool open() {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+      perror("posix_openpt");
+      return false;
+    }
+    slave = ptsname(master);
+    return true;
+  }
+
+  int open_slave(int flags) {
+    int fd = ::open(slave, O_RDWR | O_NOCTTY | flags);
+    struct termios tty;
+    if (fd >= 0 && tcgetattr(fd, &tty) == 0) {
+      cfmakeraw(&tty);
+      tcsetattr(fd, TCSANOW, &tty);
+    }
+    return fd;
+  }
+
+  ~Pty() {
+    if (master >= 0) close(master);
+  }
+};
+
+// One motor command as the firmware received it
+struct Command {
+  uint64_t at_ns;
+  int16_t speed;
+  int16_t angular;
+};
+
+// Reads the pty master from a SCHED_FIFO thread when allowed, so the
+// timestamps measure the sender and not this reader
+class FakeMcu {
+ public:
+  explicit FakeMcu(int fd) : fd_(fd) {
+    thread_ = std::thread([this] {
+      struct sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = 60;
+      pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      struct pollfd pfd = {fd_, POLLIN, 0};
+      ucp::Decoder decoder;
+      uint8_t buf[4096];
+      while (!done_.load()) {
+        if (poll(&pfd, 1, 10) <= 0) continue;
+        ssize_t n = read(fd_, buf, sizeof(buf));
+        if (n <= 0) continue;
+        uint64_t now = now_ns();
+        decoder.feed(buf, n, [&](const ucp::FrameView& f) {
+          if (const ucp_ctl_cmd_t* cmd = f.as<ucp_ctl_cmd_t>()) {
+            commands_.push_back({now, cmd->speed, cmd->angular});
+          }
+        });
+      }
+    });
+  }
+
+  ~FakeMcu() {
+    done_ = true;
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // Stop reading and return what arrived
+  const std::vector<Command>& finish() {
+    usleep(50 * 1000);
+    done_ = true;
+    if (thread_.joinable()) thread_.join();
+    return commands_;
+  }
+
+ private:
+  int fd_;
+  std::atomic<bool> done_{false};
+  std::vector<Command> commands_;
+  std::thread thread_;
+};
+
+}  // namespace bench
+
+#endif  // BENCH_FAKE_MCU_HPP
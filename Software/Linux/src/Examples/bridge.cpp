@@ -0,0 +1,112 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bridge.hpp"
+
+#define SERIAL_DEVICE "/dev/ttyS0"
+#define TCP_PORT 8888
+
+static bridge::Bridge* g_bridge = NULL;
+
+static void on_signal(int signo) {
+  (void)signo;
+  if (g_bridge) g_bridge->stop();
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-d serial device] [-p tcp port] [-u udp port] [-c max clients] [-t shm name | -T]\n"
+          "          [-r dir] [-m metrics port] [-b baud] [-U dir] [-l lease ms] [-q]\n"
+          "  defaults: -d %s -p %d -c 16 -t %s\n"
+          "  -u: also accept commands as UDP datagrams on this port (see udp_control.hpp)\n"
+          "  -T: don't publish telemetry to shared memory\n"
+          "  -r: record all UART traffic to a log in dir (read it with ucp_log_dump)\n"
+          "  -m: serve Prometheus metrics over HTTP on this port\n"
+          "  -b: switch the UART to this rate (e.g. 921600) if the firmware agrees\n"
+          "  -U: also serve Unix sockets safety, teleop and autonomy in dir, one per priority\n"
+          "  -l: a priority keeps the motors this long after its last setpoint (default 500)\n",
+          prog, SERIAL_DEVICE, TCP_PORT, TELEMETRY_BUS_NAME);
+}
+
+// -----------------------------------------------------------------------------
+// TCP <-> UART bridge: every connected client receives the robot's telemetry,
+// and command frames from any client are forwarded to the UART, motor
+// setpoints by priority.
+// -----------------------------------------------------------------------------
+int main(int argc, char* argv[]) {
+  bridge::Config config;
+  config.serial = SERIAL_DEVICE;
+  config.tcp_port = TCP_PORT;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:p:u:c:t:Tr:m:b:U:l:qh")) != -1) {
+    switch (opt) {
+      case 'd': config.serial = optarg; break;
+      case 'p': config.tcp_port = atoi(optarg); break;
+      case 'u':
+        config.udp = true;
+        config.udp_port = atoi(optarg);
+        break;
+      case 'c': config.max_clients = atoi(optarg); break;
+      case 't': config.telemetry_bus = optarg; break;
+      case 'T': config.telemetry_bus = NULL; break;
+      case 'r': config.record_dir = optarg; break;
+      case 'm':
+        config.metrics = true;
+        config.metrics_port = atoi(optarg);
+        break;
+      case 'b': config.negotiate_baud = atoi(optarg); break;
+      case 'U': config.unix_dir = optarg; break;
+      case 'l': config.lease_ms = atoi(optarg); break;
+      case 'q': config.verbose = false; break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  bridge::Bridge bridge(config);
+  if (!bridge.open()) return 1;
+
+  g_bridge = &bridge;
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  bool ok = bridge.run();
+
+  const bridge::Stats& s = bridge.stats();
+  printf("\n[Bridge] %llu telemetry frames in, %llu out, %llu dropped; %llu commands, %llu dropped\n",
+         (unsigned long long)s.telemetry_frames, (unsigned long long)s.telemetry_sent,
+         (unsigned long long)s.telemetry_dropped, (unsigned long long)s.command_frames,
+         (unsigned long long)s.command_dropped);
+  if (config.udp) {
+    printf("[Bridge] UDP: %llu commands forwarded, %llu stale setpoints, %llu duplicates, %llu rejected\n",
+           (unsigned long long)s.udp_commands, (unsigned long long)s.udp_stale,
+           (unsigned long long)s.udp_duplicates, (unsigned long long)s.udp_rejected);
+  }
+  if (s.command_preempted || bridge.mux_stats().requests) {
+    printf("[Bridge] Arbitration: %llu setpoints preempted, %llu handovers; %llu answers routed, %llu expired\n",
+           (unsigned long long)s.command_preempted, (unsigned long long)bridge.arbiter_stats().handovers,
+           (unsigned long long)bridge.mux_stats().routed, (unsigned long long)bridge.mux_stats().expired);
+  }
+  const bridge::Latency& l = bridge.latency();
+  if (l.command.count() || l.telemetry.count()) {
+    printf("[Bridge] Latency p50/p99: commands %.2f/%.2f ms, telemetry %.2f/%.2f ms\n",
+           l.command.quantile(0.5) / 1e6, l.command.quantile(0.99) / 1e6,
+           l.telemetry.quantile(0.5) / 1e6, l.telemetry.quantile(0.99) / 1e6);
+  }
+  if (config.negotiate_baud) {
+    bridge::BaudStats b = bridge.baud_stats();
+    printf("[Bridge] UART %u baud (%s), %llu switches, %llu fallbacks\n", bridge.uart_baud(),
+           bridge::baud_state_name(bridge.baud_state()), (unsigned long long)b.switches,
+           (unsigned long long)b.fallbacks);
+  }
+  if (config.record_dir) {
+    ucp_log::RecorderStats r = bridge.recorder_stats();
+    printf("[Bridge] Recorded %llu frames to %s, %llu dropped\n", (unsigned long long)r.records,
+           config.record_dir, (unsigned long long)r.dropped);
+  }
+  printf("[Bridge] Cleaned up and exiting.\n");
+  return ok ? 0 : 1;
+}
@@ -20,21 +20,26 @@ extern "C" {
 #include <time.h>
 #include <unistd.h>
 
+#include "npu_feed.h"
+#include "rate_ctl.h"
+#include "roi_map.h"
 #include "rtsp_demo.h"
+#include "rtsp_sender.h"
 #include "sample_comm.h"
+#include "stream_pump.h"
 #include <stdatomic.h>
 
-pthread_mutex_t g_rtsp_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define VENC_CHN_NUM 4 // camera 0: main, sub; camera 1: main, sub
+
 static rtsp_demo_handle g_rtsplive = NULL;
-static rtsp_session_handle g_rtsp_session_0, g_rtsp_session_1, g_rtsp_session_2,
-    g_rtsp_session_3;
+static rtsp_session_handle g_rtsp_session[VENC_CHN_NUM];
 static int rociva_run_flag = 0;
 static RockIvaHandle rkba_handle;
 static RockIvaBaTaskParams initParams;
 static RockIvaInitParam globalParams;
 typedef struct _rkMpiCtx {
-	SAMPLE_VI_CTX_S vi[4]; // camera 0: 0,1; camera 1: 2,3
-	SAMPLE_VENC_CTX_S venc[4];
+	SAMPLE_VI_CTX_S vi[VENC_CHN_NUM]; // camera 0: 0,1; camera 1: 2,3
+	SAMPLE_VENC_CTX_S venc[VENC_CHN_NUM];
 } SAMPLE_MPI_CTX_S;
 
 static bool quit = false;
@@ -43,7 +48,7 @@ static void sigterm_handler(int sig) {
 	quit = true;
 }
 
-static RK_CHAR optstr[] = "?::r:f:W:H:w:h:s:n:b:";
+static RK_CHAR optstr[] = "?::r:f:W:H:w:h:s:n:b:v:";
 static const struct option long_options[] = {
     {"hdr", required_argument, NULL, 'r'},
     {"fps", required_argument, NULL, 'f'},
@@ -54,171 +59,260 @@ static const struct option long_options[] = {
     {"sensorid", required_argument, NULL, 's'},
     {"enable_npu", required_argument, NULL, 'n'},
     {"buf_share", required_argument, NULL, 'b'},
+    {"watch", required_argument, NULL, 'v'},
     {"help", optional_argument, NULL, '?'},
     {NULL, 0, NULL, 0},
 };
 
 /******************************************************************************
- * function : venc thread
+ * function : venc stream pump
+ *
+ * One thread takes the packets of every encoder channel as they are ready
+ * (see stream_pump.h), waiting on the channels' RK_MPI_VENC_GetFd()
+ * descriptors, and queues each for the channel's RTSP session.
  ******************************************************************************/
-static void *venc0_get_stream(void *pArgs) {
-	printf("#Start %s , arg:%p\n", __func__, pArgs);
-	SAMPLE_VENC_CTX_S *ctx = (SAMPLE_VENC_CTX_S *)(pArgs);
-	RK_S32 s32Ret = RK_FAILURE;
-	// char name[256] = {0};
-	// FILE *fp = RK_NULL;
-	void *pData = RK_NULL;
-	RK_S32 loopCount = 0;
+typedef struct _vencSource {
+	VENC_STREAM_S stStream[VENC_CHN_NUM];
+	VENC_PACK_S stPack[VENC_CHN_NUM];
+	RK_S32 loopCount[VENC_CHN_NUM];
+} VENC_SOURCE_S;
 
-	while (!quit) {
-		s32Ret = SAMPLE_COMM_VENC_GetStream(ctx, &pData);
-		if (s32Ret == RK_SUCCESS) {
-			RK_LOGD("chn:%d, loopCount:%d wd:%d\n", ctx->s32ChnId, loopCount,
-			        ctx->stFrame.pstPack->u32Len);
-			// exit when complete
-			if (ctx->s32loopCount > 0) {
-				if (loopCount >= ctx->s32loopCount) {
-					SAMPLE_COMM_VENC_ReleaseStream(ctx);
-					quit = true;
-					break;
-				}
-			}
+static VENC_SOURCE_S g_venc_source;
+static stream_pump_t *g_stream_pump = NULL;
+static pthread_t venc_stream_thread;
 
-			PrintStreamDetails(ctx->s32ChnId, ctx->stFrame.pstPack->u32Len);
-			pthread_mutex_lock(&g_rtsp_mutex);
-			rtsp_tx_video(g_rtsp_session_0, pData, ctx->stFrame.pstPack->u32Len,
-			              ctx->stFrame.pstPack->u64PTS);
-			rtsp_do_event(g_rtsplive);
-			pthread_mutex_unlock(&g_rtsp_mutex);
+/******************************************************************************
+ * function : rtsp sender
+ *
+ * Packets wait in a queue per session (see rtsp_sender.h) for the network
+ * thread, which alone calls into the RTSP server; a client that falls behind
+ * loses its packets up to the next keyframe, which is asked for at once.
+ ******************************************************************************/
+#define RTSP_QUEUE_BUF_NUM 4 // Queue bytes, in encoder stream buffers
 
-			SAMPLE_COMM_VENC_ReleaseStream(ctx);
-			loopCount++;
-		}
-		usleep(1000);
-	}
+static rtsp_sender_t *g_rtsp_sender = NULL;
 
-	return RK_NULL;
+static int rtsp_sink_tx(void *arg, int chn, const uint8_t *data, int len, uint64_t pts) {
+	(void)arg;
+	return rtsp_tx_video(g_rtsp_session[chn], data, len, pts);
 }
 
-static void *venc1_get_stream(void *pArgs) {
-	printf("#Start %s , arg:%p\n", __func__, pArgs);
-	SAMPLE_VENC_CTX_S *ctx = (SAMPLE_VENC_CTX_S *)(pArgs);
-	RK_S32 s32Ret = RK_FAILURE;
-	// char name[256] = {0};
-	// FILE *fp = RK_NULL;
-	void *pData = RK_NULL;
-	RK_S32 loopCount = 0;
+static int rtsp_sink_do_event(void *arg) { return rtsp_do_event((rtsp_demo_handle)arg); }
 
-	while (!quit) {
-		s32Ret = SAMPLE_COMM_VENC_GetStream(ctx, &pData);
-		if (s32Ret == RK_SUCCESS) {
-			RK_LOGD("chn:%d, loopCount:%d wd:%d\n", ctx->s32ChnId, loopCount,
-			        ctx->stFrame.pstPack->u32Len);
-			// exit when complete
-			if (ctx->s32loopCount > 0) {
-				if (loopCount >= ctx->s32loopCount) {
-					SAMPLE_COMM_VENC_ReleaseStream(ctx);
-					quit = true;
-					break;
-				}
-			}
+static void rtsp_request_idr(void *arg, int chn) {
+	(void)arg;
+	RK_MPI_VENC_RequestIDR(chn, RK_TRUE);
+}
 
-			PrintStreamDetails(ctx->s32ChnId, ctx->stFrame.pstPack->u32Len);
-			pthread_mutex_lock(&g_rtsp_mutex);
-			rtsp_tx_video(g_rtsp_session_1, pData, ctx->stFrame.pstPack->u32Len,
-			              ctx->stFrame.pstPack->u64PTS);
-			rtsp_do_event(g_rtsplive);
-			pthread_mutex_unlock(&g_rtsp_mutex);
+static void rtsp_print_stats(RK_S32 s32CamNum) {
+	for (int i = 0; i < s32CamNum; i++) {
+		rtsp_session_stats_t s;
+		rtsp_sender_get_stats(g_rtsp_sender, i, &s);
+		printf("rtsp /live/%d: sent %llu, depth %u (max %u), dropped %llu in %llu cuts\n", i,
+		       (unsigned long long)s.sent, s.depth, s.max_depth, (unsigned long long)s.dropped,
+		       (unsigned long long)s.cuts);
+	}
+}
 
-			SAMPLE_COMM_VENC_ReleaseStream(ctx);
-			loopCount++;
-		}
-		usleep(1000);
+/******************************************************************************
+ * function : stream rate control
+ *
+ * Every RATE_CTL_TICK_MS the sender's counters go to the rate controller
+ * (see rate_ctl.h), which shares what the uplink carries among the streams,
+ * the watched one first, and lowers bitrate and frame rate before the
+ * queues build up delay. Bitrate and frame rate are part of the channel's
+ * rate control attribute, so a change goes through RK_MPI_VENC_SetChnAttr().
+ ******************************************************************************/
+static rate_ctl_t *g_rate_ctl = NULL;
+static rate_link_policy_t g_rate_policy;
+
+static void rate_apply(VENC_CHN chn, const rate_setting_t *setting) {
+	VENC_CHN_ATTR_S stChnAttr;
+	RK_S32 s32Ret = RK_MPI_VENC_GetChnAttr(chn, &stChnAttr);
+	if (s32Ret != RK_SUCCESS) {
+		printf("RK_MPI_VENC_GetChnAttr chn %d fail %x\n", chn, s32Ret);
+		return;
+	}
+	switch (stChnAttr.stRcAttr.enRcMode) {
+	case VENC_RC_MODE_H265CBR:
+		stChnAttr.stRcAttr.stH265Cbr.u32BitRate = setting->kbps;
+		stChnAttr.stRcAttr.stH265Cbr.fr32DstFrameRateNum = setting->fps;
+		stChnAttr.stRcAttr.stH265Cbr.fr32DstFrameRateDen = 1;
+		break;
+	case VENC_RC_MODE_H264CBR:
+		stChnAttr.stRcAttr.stH264Cbr.u32BitRate = setting->kbps;
+		stChnAttr.stRcAttr.stH264Cbr.fr32DstFrameRateNum = setting->fps;
+		stChnAttr.stRcAttr.stH264Cbr.fr32DstFrameRateDen = 1;
+		break;
+	default:
+		return;
 	}
+	s32Ret = RK_MPI_VENC_SetChnAttr(chn, &stChnAttr);
+	if (s32Ret != RK_SUCCESS)
+		printf("RK_MPI_VENC_SetChnAttr chn %d fail %x\n", chn, s32Ret);
+}
 
-	return RK_NULL;
+static void rate_ctl_update(RK_S32 s32CamNum) {
+	rate_sample_t samples[VENC_CHN_NUM];
+	for (int i = 0; i < s32CamNum; i++) {
+		rtsp_session_stats_t s;
+		rtsp_sender_get_stats(g_rtsp_sender, i, &s);
+		samples[i].bytes_sent = s.bytes_sent;
+		samples[i].dropped = s.dropped;
+		samples[i].backlog = s.backlog;
+		samples[i].oldest_ms = s.oldest_ms;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uint64_t now_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	uint32_t changed = rate_ctl_tick(g_rate_ctl, now_ms, samples);
+	for (int i = 0; i < s32CamNum; i++) {
+		if (changed & (1u << i))
+			rate_apply(i, rate_ctl_setting(g_rate_ctl, i));
+	}
 }
 
-static void *venc2_get_stream(void *pArgs) {
-	printf("#Start %s , arg:%p\n", __func__, pArgs);
-	SAMPLE_VENC_CTX_S *ctx = (SAMPLE_VENC_CTX_S *)(pArgs);
-	RK_S32 s32Ret = RK_FAILURE;
-	// char name[256] = {0};
-	// FILE *fp = RK_NULL;
-	void *pData = RK_NULL;
-	RK_S32 loopCount = 0;
+static void rate_print_stats(RK_S32 s32CamNum) {
+	for (int i = 0; i < s32CamNum; i++) {
+		const rate_setting_t *setting = rate_ctl_setting(g_rate_ctl, i);
+		printf("rate /live/%d: %u kbps at %u fps (link estimate %u kbps)\n", i, setting->kbps,
+		       setting->fps, g_rate_policy.budget_kbps);
+	}
+}
 
-	while (!quit) {
-		s32Ret = SAMPLE_COMM_VENC_GetStream(ctx, &pData);
-		if (s32Ret == RK_SUCCESS) {
-			RK_LOGD("chn:%d, loopCount:%d wd:%d\n", ctx->s32ChnId, loopCount,
-			        ctx->stFrame.pstPack->u32Len);
-			// exit when complete
-			if (ctx->s32loopCount > 0) {
-				if (loopCount >= ctx->s32loopCount) {
-					SAMPLE_COMM_VENC_ReleaseStream(ctx);
-					quit = true;
-					break;
-				}
-			}
+static int venc_source_fd(void *arg, int chn) {
+	(void)arg;
+	return RK_MPI_VENC_GetFd(chn);
+}
 
-			PrintStreamDetails(ctx->s32ChnId, ctx->stFrame.pstPack->u32Len);
-			pthread_mutex_lock(&g_rtsp_mutex);
-			rtsp_tx_video(g_rtsp_session_2, pData, ctx->stFrame.pstPack->u32Len,
-			              ctx->stFrame.pstPack->u64PTS);
-			rtsp_do_event(g_rtsplive);
-			pthread_mutex_unlock(&g_rtsp_mutex);
+static int venc_source_get(void *arg, int chn, stream_packet_t *pkt) {
+	VENC_SOURCE_S *src = (VENC_SOURCE_S *)arg;
+	VENC_STREAM_S *stream = &src->stStream[chn];
+	stream->pstPack = &src->stPack[chn];
+	if (RK_MPI_VENC_GetStream(chn, stream, 0) != RK_SUCCESS)
+		return -1;
+	pkt->data = (const uint8_t *)RK_MPI_MB_Handle2VirAddr(stream->pstPack->pMbBlk);
+	pkt->len = stream->pstPack->u32Len;
+	pkt->pts = stream->pstPack->u64PTS;
+	pkt->keyframe = stream->pstPack->DataType.enH265EType == H265E_NALU_IDRSLICE ||
+	                stream->pstPack->DataType.enH265EType == H265E_NALU_ISLICE;
+	pkt->ready_ns = 0;
+	return 0;
+}
 
-			SAMPLE_COMM_VENC_ReleaseStream(ctx);
-			loopCount++;
-		}
-		usleep(1000);
+static void venc_source_release(void *arg, int chn, stream_packet_t *pkt) {
+	VENC_SOURCE_S *src = (VENC_SOURCE_S *)arg;
+	(void)pkt;
+	RK_MPI_VENC_ReleaseStream(chn, &src->stStream[chn]);
+}
+
+static void venc_stream_sink(void *user, int chn, const stream_packet_t *pkt) {
+	SAMPLE_MPI_CTX_S *ctx = (SAMPLE_MPI_CTX_S *)user;
+	RK_S32 *loopCount = &g_venc_source.loopCount[chn];
+
+	RK_LOGD("chn:%d, loopCount:%d wd:%d\n", chn, *loopCount, pkt->len);
+	// exit when complete
+	if (ctx->venc[chn].s32loopCount > 0 && *loopCount >= ctx->venc[chn].s32loopCount) {
+		quit = true;
+		return;
 	}
 
-	return RK_NULL;
+	PrintStreamDetails(chn, pkt->len);
+	rtsp_sender_push(g_rtsp_sender, chn, pkt);
+	(*loopCount)++;
 }
 
-static void *venc3_get_stream(void *pArgs) {
+static void *venc_stream_pump(void *pArgs) {
 	printf("#Start %s , arg:%p\n", __func__, pArgs);
-	SAMPLE_VENC_CTX_S *ctx = (SAMPLE_VENC_CTX_S *)(pArgs);
-	RK_S32 s32Ret = RK_FAILURE;
-	// char name[256] = {0};
-	// FILE *fp = RK_NULL;
-	void *pData = RK_NULL;
-	RK_S32 loopCount = 0;
-
-	while (!quit) {
-		s32Ret = SAMPLE_COMM_VENC_GetStream(ctx, &pData);
-		if (s32Ret == RK_SUCCESS) {
-			RK_LOGD("chn:%d, loopCount:%d wd:%d\n", ctx->s32ChnId, loopCount,
-			        ctx->stFrame.pstPack->u32Len);
-			// exit when complete
-			if (ctx->s32loopCount > 0) {
-				if (loopCount >= ctx->s32loopCount) {
-					SAMPLE_COMM_VENC_ReleaseStream(ctx);
-					quit = true;
-					break;
-				}
-			}
+	prctl(PR_SET_NAME, "venc_stream_pump", 0, 0, 0);
+	stream_pump_run((stream_pump_t *)pArgs);
+	return RK_NULL;
+}
 
-			PrintStreamDetails(ctx->s32ChnId, ctx->stFrame.pstPack->u32Len);
-			pthread_mutex_lock(&g_rtsp_mutex);
-			rtsp_tx_video(g_rtsp_session_3, pData, ctx->stFrame.pstPack->u32Len,
-			              ctx->stFrame.pstPack->u64PTS);
-			rtsp_do_event(g_rtsplive);
-			pthread_mutex_unlock(&g_rtsp_mutex);
+/******************************************************************************
+ * function : detection roi
+ *
+ * Detections of camera 0 become regions of interest (see roi_map.h) on its
+ * main and sub streams, coded ROI_QP better than the rate control's QP;
+ * under CBR the rest of the frame pays for it. The NPU sees the whole frame
+ * of VI channel 1, so its boxes, in 1/10000 of the frame, fit both encoders.
+ ******************************************************************************/
+#define ROI_QP (-8)  // Relative to the frame QP
+#define ROI_VENC_NUM 2 // Camera 0: main, sub
+
+static roi_map_t *g_roi_map = NULL;
+static roi_target_t g_roi_target[ROI_VENC_NUM];
+
+static uint8_t roi_priority(RockIvaObjectType type) {
+	switch (type) {
+	case ROCKIVA_OBJECT_TYPE_FACE:
+	case ROCKIVA_OBJECT_TYPE_PERSON:
+	case ROCKIVA_OBJECT_TYPE_HEAD:
+	case ROCKIVA_OBJECT_TYPE_BABY:
+		return 3;
+	case ROCKIVA_OBJECT_TYPE_VEHICLE:
+	case ROCKIVA_OBJECT_TYPE_NON_VEHICLE:
+	case ROCKIVA_OBJECT_TYPE_MOTORCYCLE:
+	case ROCKIVA_OBJECT_TYPE_BICYCLE:
+		return 2;
+	default:
+		return 1;
+	}
+}
 
-			SAMPLE_COMM_VENC_ReleaseStream(ctx);
-			loopCount++;
+static void roi_apply(VENC_CHN chn, const roi_target_t *target, uint32_t changed) {
+	for (int i = 0; i < ROI_MAP_REGIONS; i++) {
+		if (!(changed & (1u << i)))
+			continue;
+		VENC_ROI_ATTR_S stRoiAttr;
+		memset(&stRoiAttr, 0, sizeof(stRoiAttr));
+		stRoiAttr.u32Index = i;
+		stRoiAttr.bEnable = i < target->count ? RK_TRUE : RK_FALSE;
+		stRoiAttr.bAbsQp = RK_FALSE;
+		stRoiAttr.s32Qp = ROI_QP;
+		stRoiAttr.bIntra = RK_FALSE;
+		if (i < target->count) {
+			stRoiAttr.stRect.s32X = target->rects[i].x;
+			stRoiAttr.stRect.s32Y = target->rects[i].y;
+			stRoiAttr.stRect.u32Width = target->rects[i].width;
+			stRoiAttr.stRect.u32Height = target->rects[i].height;
 		}
-		usleep(1000);
+		RK_S32 s32Ret = RK_MPI_VENC_SetRoiAttr(chn, &stRoiAttr);
+		if (s32Ret != RK_SUCCESS)
+			printf("RK_MPI_VENC_SetRoiAttr chn %d index %d fail %x\n", chn, i, s32Ret);
 	}
+}
 
-	return RK_NULL;
+static void roi_on_detections(const RockIvaBaResult *result) {
+	roi_box_t boxes[ROCKIVA_MAX_OBJ_NUM];
+	int count = 0;
+	for (uint32_t i = 0; i < result->objNum && i < ROCKIVA_MAX_OBJ_NUM; i++) {
+		const RockIvaObjectInfo *obj = &result->triggerObjects[i].objInfo;
+		boxes[count].id = obj->objId;
+		boxes[count].left = obj->rect.topLeft.x;
+		boxes[count].top = obj->rect.topLeft.y;
+		boxes[count].right = obj->rect.bottomRight.x;
+		boxes[count].bottom = obj->rect.bottomRight.y;
+		boxes[count].priority = roi_priority(obj->type);
+		boxes[count].score = (uint8_t)obj->score;
+		count++;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uint64_t now_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	roi_map_update(g_roi_map, now_ms, boxes, count);
+	for (int i = 0; i < ROI_VENC_NUM; i++) {
+		uint32_t changed = roi_target_update(&g_roi_target[i], g_roi_map, now_ms);
+		if (changed)
+			roi_apply(i, &g_roi_target[i], changed);
+	}
 }
 
 void rkba_callback(const RockIvaBaResult *result, const RockIvaExecuteStatus status,
                    void *userData) {
+	// Every result counts, empty ones too, so regions of objects gone expire
+	if (g_roi_map)
+		roi_on_detections(result);
 	if (result->objNum == 0)
 		return;
 	printf("status is %d, frame %d, result->objNum is %d\n", status, result->frameId,
@@ -321,48 +415,81 @@ int rockiva_deinit() {
 	return 0;
 }
 
-int rkipc_rockiva_write_nv12_frame_by_fd(uint16_t width, uint16_t height,
-                                         uint32_t frame_id, int32_t fd) {
-	int ret;
+/******************************************************************************
+ * function : vi to npu
+ *
+ * The grabber takes every frame of VI channel 1 as it comes and posts it to
+ * the NPU feed (see npu_feed.h); the submitter pushes the newest one to the
+ * NPU whenever the NPU is free, and frames it had no time for are released
+ * at once. Each feed slot has its own RockIvaImage, filled in once here.
+ ******************************************************************************/
+#define NPU_VI_PIPE 0
+#define NPU_VI_CHN 1
+
+static npu_feed_t *g_npu_feed = NULL;
+static RockIvaImage g_npu_image[NPU_FEED_SLOTS];
+static VIDEO_FRAME_INFO_S g_npu_vi_frame[NPU_FEED_SLOTS];
+pthread_t get_vi_to_npu_thread;
+pthread_t npu_submit_thread;
+
+static void npu_frame_release(void *user, npu_frame_t *frame) {
+	(void)user;
+	RK_S32 s32Ret =
+	    RK_MPI_VI_ReleaseChnFrame(NPU_VI_PIPE, NPU_VI_CHN, (VIDEO_FRAME_INFO_S *)frame->source);
+	if (s32Ret != RK_SUCCESS)
+		printf("RK_MPI_VI_ReleaseChnFrame fail %x\n", s32Ret);
+}
+
+static void rkipc_rockiva_image_init(void) {
+	memset(g_npu_image, 0, sizeof(g_npu_image));
+	for (int i = 0; i < NPU_FEED_SLOTS; i++) {
+		g_npu_image[i].info.transformMode = ROCKIVA_IMAGE_TRANSFORM_NONE;
+		g_npu_image[i].info.format = ROCKIVA_IMAGE_FORMAT_YUV420SP_NV12;
+		g_npu_image[i].dataAddr = NULL;
+		g_npu_image[i].dataPhyAddr = NULL;
+	}
+}
+
+int rkipc_rockiva_write_nv12_frame(const npu_frame_t *frame) {
 	if (!rociva_run_flag)
 		return 0;
-	RockIvaImage *image = (RockIvaImage *)malloc(sizeof(RockIvaImage));
-	memset(image, 0, sizeof(RockIvaImage));
-	image->info.transformMode = ROCKIVA_IMAGE_TRANSFORM_NONE;
-	image->info.width = width;
-	image->info.height = height;
-	image->info.format = ROCKIVA_IMAGE_FORMAT_YUV420SP_NV12;
-	image->frameId = frame_id;
-	image->dataAddr = NULL;
-	image->dataPhyAddr = NULL;
-	image->dataFd = fd;
-	ret = ROCKIVA_PushFrame(rkba_handle, image, NULL);
-	free(image);
-
-	return ret;
+	RockIvaImage *image = &g_npu_image[npu_feed_index(g_npu_feed, frame)];
+	image->info.width = frame->width;
+	image->info.height = frame->height;
+	image->frameId = frame->frame_id;
+	image->dataFd = frame->fd;
+	return ROCKIVA_PushFrame(rkba_handle, image, NULL);
 }
 
-pthread_t get_vi_to_npu_thread;
 static void *rkipc_get_vi_to_npu(void *arg) {
 	printf("#Start %s thread, arg:%p\n", __func__, arg);
+	prctl(PR_SET_NAME, "vi_to_npu", 0, 0, 0);
 	int s32Ret;
 	int32_t loopCount = 0;
 	VIDEO_FRAME_INFO_S stViFrame;
 
 	while (!quit) {
-		s32Ret = RK_MPI_VI_GetChnFrame(0, 1, &stViFrame, 1000);
+		s32Ret = RK_MPI_VI_GetChnFrame(NPU_VI_PIPE, NPU_VI_CHN, &stViFrame, 1000);
 		if (s32Ret == RK_SUCCESS) {
 			RK_LOGD("loopCount is %d, w is %d, h is %d, seq is %d, pts is %lld\n",
 			        loopCount, stViFrame.stVFrame.u32Width, stViFrame.stVFrame.u32Height,
 			        stViFrame.stVFrame.u32TimeRef, stViFrame.stVFrame.u64PTS / 1000);
-			// void *data = RK_MPI_MB_Handle2VirAddr(stViFrame.stVFrame.pMbBlk);
-			int32_t fd = RK_MPI_MB_Handle2Fd(stViFrame.stVFrame.pMbBlk);
-
-			rkipc_rockiva_write_nv12_frame_by_fd(
-			    stViFrame.stVFrame.u32Width, stViFrame.stVFrame.u32Height, loopCount, fd);
-			s32Ret = RK_MPI_VI_ReleaseChnFrame(0, 1, &stViFrame);
-			if (s32Ret != RK_SUCCESS)
-				printf("RK_MPI_VI_ReleaseChnFrame fail %x\n", s32Ret);
+			npu_frame_t *frame = npu_feed_acquire(g_npu_feed);
+			if (frame) {
+				VIDEO_FRAME_INFO_S *held = &g_npu_vi_frame[npu_feed_index(g_npu_feed, frame)];
+				*held = stViFrame;
+				frame->frame_id = loopCount;
+				frame->fd = RK_MPI_MB_Handle2Fd(stViFrame.stVFrame.pMbBlk);
+				frame->width = stViFrame.stVFrame.u32Width;
+				frame->height = stViFrame.stVFrame.u32Height;
+				frame->pts = stViFrame.stVFrame.u64PTS;
+				frame->source = held;
+				npu_feed_post(g_npu_feed, frame);
+			} else {
+				s32Ret = RK_MPI_VI_ReleaseChnFrame(NPU_VI_PIPE, NPU_VI_CHN, &stViFrame);
+				if (s32Ret != RK_SUCCESS)
+					printf("RK_MPI_VI_ReleaseChnFrame fail %x\n", s32Ret);
+			}
 			loopCount++;
 		} else {
 			printf("RK_MPI_VI_GetChnFrame timeout %x\n", s32Ret);
@@ -371,6 +498,29 @@ static void *rkipc_get_vi_to_npu(void *arg) {
 	return NULL;
 }
 
+static void *rkipc_npu_submit(void *arg) {
+	printf("#Start %s thread, arg:%p\n", __func__, arg);
+	prctl(PR_SET_NAME, "npu_submit", 0, 0, 0);
+	npu_frame_t *frame;
+	while ((frame = npu_feed_take(g_npu_feed, -1)) != NULL) {
+		uint32_t frame_id = frame->frame_id;
+		int ret = rkipc_rockiva_write_nv12_frame(frame);
+		npu_feed_done(g_npu_feed, frame);
+		// Take the next frame once the NPU is free, so it is the newest
+		if (ret == ROCKIVA_RET_SUCCESS && rociva_run_flag)
+			ROCKIVA_WaitFinish(rkba_handle, frame_id, 1000);
+	}
+	return NULL;
+}
+
+static void npu_print_stats(void) {
+	npu_feed_stats_t s;
+	npu_feed_get_stats(g_npu_feed, &s);
+	printf("npu: %llu frames, %llu submitted, %llu dropped, %u in flight\n",
+	       (unsigned long long)s.posted, (unsigned long long)s.submitted,
+	       (unsigned long long)s.dropped, s.in_flight);
+}
+
 static void print_usage(const RK_CHAR *name) {
 	printf("usage example:\n");
 	printf("\t%s -s 0 -W 1920 -H 1080 -w 720 -h 576 -f 30 -r 0 -s 1 -W 1920 -H 1080 -w "
@@ -389,6 +539,7 @@ static void print_usage(const RK_CHAR *name) {
 	printf("\t-h | --sub_height: sub-stream height, Default 576\n");
 	printf("\t-n | --enable_npu: enable npu, Default 1\n");
 	printf("\t-b | --buf_share: enable buf share, Default 1\n");
+	printf("\t-v | --watch: stream the operator watches, given bandwidth first, Default 0\n");
 }
 /******************************************************************************
  * function    : main()
@@ -416,13 +567,14 @@ int main(int argc, char *argv[]) {
 	int cam_1_video_1_height = 576;
 	int enable_npu = 1;
 	int enable_buf_share = 1;
+	int watch_chn = 0;
 	CODEC_TYPE_E enCodecType = RK_CODEC_TYPE_H265;
 	VENC_RC_MODE_E enRcMode = VENC_RC_MODE_H265CBR;
 	RK_CHAR *pCodecName = "H265";
 	RK_S32 s32CamId = -1;
 	MPP_CHN_S vi_chn[6], venc_chn[4];
 	RK_CHAR *pOutPathVenc = "/userdata";
-	RK_S32 s32CamNum = 4;
+	RK_S32 s32CamNum = VENC_CHN_NUM;
 	RK_S32 s32loopCnt = -1;
 	RK_S32 s32BitRate = 4 * 1024;
 	RK_S32 i;
@@ -495,6 +647,9 @@ int main(int argc, char *argv[]) {
 		case 'b':
 			enable_buf_share = atoi(optarg);
 			break;
+		case 'v':
+			watch_chn = atoi(optarg);
+			break;
 		case '?':
 		default:
 			print_usage(argv[0]);
@@ -534,18 +689,13 @@ int main(int argc, char *argv[]) {
 
 	// init rtsp
 	g_rtsplive = create_rtsp_demo(554);
-	g_rtsp_session_0 = rtsp_new_session(g_rtsplive, "/live/0");
-	g_rtsp_session_1 = rtsp_new_session(g_rtsplive, "/live/1");
-	g_rtsp_session_2 = rtsp_new_session(g_rtsplive, "/live/2");
-	g_rtsp_session_3 = rtsp_new_session(g_rtsplive, "/live/3");
-	rtsp_set_video(g_rtsp_session_0, RTSP_CODEC_ID_VIDEO_H265, NULL, 0);
-	rtsp_set_video(g_rtsp_session_1, RTSP_CODEC_ID_VIDEO_H265, NULL, 0);
-	rtsp_set_video(g_rtsp_session_2, RTSP_CODEC_ID_VIDEO_H265, NULL, 0);
-	rtsp_set_video(g_rtsp_session_3, RTSP_CODEC_ID_VIDEO_H265, NULL, 0);
-	rtsp_sync_video_ts(g_rtsp_session_0, rtsp_get_reltime(), rtsp_get_ntptime());
-	rtsp_sync_video_ts(g_rtsp_session_1, rtsp_get_reltime(), rtsp_get_ntptime());
-	rtsp_sync_video_ts(g_rtsp_session_2, rtsp_get_reltime(), rtsp_get_ntptime());
-	rtsp_sync_video_ts(g_rtsp_session_3, rtsp_get_reltime(), rtsp_get_ntptime());
+	for (i = 0; i < s32CamNum; i++) {
+		char path[16];
+		snprintf(path, sizeof(path), "/live/%d", i);
+		g_rtsp_session[i] = rtsp_new_session(g_rtsplive, path);
+		rtsp_set_video(g_rtsp_session[i], RTSP_CODEC_ID_VIDEO_H265, NULL, 0);
+		rtsp_sync_video_ts(g_rtsp_session[i], rtsp_get_reltime(), rtsp_get_ntptime());
+	}
 
 	if (enable_npu)
 		rockiva_init();
@@ -588,10 +738,16 @@ int main(int argc, char *argv[]) {
 		ctx->vi[i].stChnAttr.enCompressMode = COMPRESS_MODE_NONE;
 		ctx->vi[i].stChnAttr.stFrameRate.s32SrcFrameRate = -1;
 		ctx->vi[i].stChnAttr.stFrameRate.s32DstFrameRate = -1;
-		if ((i == 1) && enable_npu) { // NPU only 10 fps,  need anothor buffer
-			ctx->vi[i].stChnAttr.stIspOpt.u32BufCount = 3;
+		if ((i == 1) && enable_npu) {
+			// One frame waiting in the NPU feed and one being pushed, besides the encoder's
+			ctx->vi[i].stChnAttr.stIspOpt.u32BufCount = 4;
 			ctx->vi[i].stChnAttr.u32Depth = 1;
-			pthread_create(&get_vi_to_npu_thread, NULL, rkipc_get_vi_to_npu, NULL);
+			rkipc_rockiva_image_init();
+			g_npu_feed = npu_feed_create(NPU_FEED_SLOTS, npu_frame_release, RK_NULL);
+			if (g_npu_feed) {
+				pthread_create(&npu_submit_thread, NULL, rkipc_npu_submit, NULL);
+				pthread_create(&get_vi_to_npu_thread, NULL, rkipc_get_vi_to_npu, NULL);
+			}
 		}
 		SAMPLE_COMM_VI_CreateChn(&ctx->vi[i]);
 
@@ -632,14 +788,7 @@ int main(int argc, char *argv[]) {
 		ctx->venc[i].u32BitRate = s32BitRate;
 		ctx->venc[i].enCodecType = enCodecType;
 		ctx->venc[i].enRcMode = enRcMode;
-		if (i == 0)
-			ctx->venc[i].getStreamCbFunc = venc0_get_stream;
-		if (i == 1)
-			ctx->venc[i].getStreamCbFunc = venc1_get_stream;
-		if (i == 2)
-			ctx->venc[i].getStreamCbFunc = venc2_get_stream;
-		if (i == 3)
-			ctx->venc[i].getStreamCbFunc = venc3_get_stream;
+		ctx->venc[i].getStreamCbFunc = RK_NULL; // The stream pump collects every channel
 		ctx->venc[i].s32loopCount = s32loopCnt;
 		ctx->venc[i].dstFilePath = pOutPathVenc;
 		// H264  66：Baseline  77：Main Profile 100：High Profile
@@ -661,21 +810,102 @@ int main(int argc, char *argv[]) {
 	SAMPLE_COMM_Bind(&vi_chn[2], &venc_chn[2]);
 	SAMPLE_COMM_Bind(&vi_chn[3], &venc_chn[3]);
 
+	if (enable_npu) {
+		roi_map_config_t roi_cfg;
+		roi_map_default_config(&roi_cfg);
+		roi_target_init(&g_roi_target[0], cam_0_video_0_width, cam_0_video_0_height);
+		roi_target_init(&g_roi_target[1], cam_0_video_1_width, cam_0_video_1_height);
+		g_roi_map = roi_map_create(&roi_cfg);
+	}
+
+	rtsp_sink_t rtsp_sink = {g_rtsplive, rtsp_sink_tx, RK_NULL, rtsp_sink_do_event};
+	size_t queue_bytes[VENC_CHN_NUM];
+	for (i = 0; i < s32CamNum; i++)
+		queue_bytes[i] = RTSP_QUEUE_BUF_NUM * ctx->venc[i].stChnAttr.stVencAttr.u32BufSize;
+	g_rtsp_sender = rtsp_sender_create(&rtsp_sink, s32CamNum, queue_bytes);
+	if (!g_rtsp_sender) {
+		printf("rtsp sender create failed\n");
+		quit = true;
+	} else {
+		rtsp_sender_on_cut(g_rtsp_sender, rtsp_request_idr, RK_NULL);
+		rtsp_sender_start(g_rtsp_sender);
+	}
+
+	rate_limits_t rate_limits[VENC_CHN_NUM];
+	rate_setting_t rate_initial[VENC_CHN_NUM];
+	for (i = 0; i < s32CamNum; i++) {
+		rate_limits[i].max_kbps = s32BitRate;
+		rate_limits[i].min_kbps = s32BitRate / 8 > 128 ? s32BitRate / 8 : 128;
+		rate_limits[i].max_fps = ctx->venc[i].u32Fps;
+		rate_limits[i].min_fps = ctx->venc[i].u32Fps < 5 ? ctx->venc[i].u32Fps : 5;
+		rate_initial[i].kbps = s32BitRate;
+		rate_initial[i].fps = ctx->venc[i].u32Fps;
+	}
+	rate_link_policy_default(&g_rate_policy);
+	rate_policy_t rate_policy = rate_policy_shared_link(&g_rate_policy);
+	if (g_rtsp_sender)
+		g_rate_ctl = rate_ctl_create(s32CamNum, rate_limits, rate_initial, &rate_policy);
+	if (g_rate_ctl)
+		rate_ctl_watch(g_rate_ctl, watch_chn);
+
+	encoder_source_t venc_source = {&g_venc_source, venc_source_fd, venc_source_get,
+	                                venc_source_release};
+	g_stream_pump = g_rtsp_sender ? stream_pump_create(&venc_source, s32CamNum, venc_stream_sink, ctx)
+	                              : NULL;
+	if (!g_stream_pump) {
+		printf("stream pump create failed\n");
+		quit = true;
+	} else {
+		pthread_create(&venc_stream_thread, NULL, venc_stream_pump, g_stream_pump);
+	}
+
 	printf("%s initial finish\n", __func__);
 
+	RK_U32 u32Ticks = 0;
 	while (!quit) {
-		sleep(1);
+		usleep(RATE_CTL_TICK_MS * 1000);
+		if (g_rate_ctl)
+			rate_ctl_update(s32CamNum);
+		if (++u32Ticks % (10000 / RATE_CTL_TICK_MS) != 0)
+			continue;
+		if (g_rtsp_sender)
+			rtsp_print_stats(s32CamNum);
+		if (g_rate_ctl)
+			rate_print_stats(s32CamNum);
+		if (g_npu_feed)
+			npu_print_stats();
 	}
 
 	printf("%s exit!\n", __func__);
-	for (i = 0; i < s32CamNum; i++) {
-		if (ctx->venc[i].getStreamCbFunc) {
-			pthread_join(ctx->venc[i].getStreamThread, NULL);
-		}
+	if (g_stream_pump) {
+		stream_pump_stop(g_stream_pump);
+		pthread_join(venc_stream_thread, NULL);
+		stream_pump_destroy(g_stream_pump);
+		g_stream_pump = NULL;
+	}
+	if (g_rate_ctl) {
+		rate_ctl_destroy(g_rate_ctl);
+		g_rate_ctl = NULL;
+	}
+	if (g_rtsp_sender) {
+		rtsp_sender_destroy(g_rtsp_sender);
+		g_rtsp_sender = NULL;
+	}
+	for (i = 0; i < s32CamNum; i++)
+		RK_MPI_VENC_CloseFd(i);
+	if (g_npu_feed) {
+		pthread_join(get_vi_to_npu_thread, NULL);
+		npu_feed_stop(g_npu_feed);
+		pthread_join(npu_submit_thread, NULL);
+		npu_feed_destroy(g_npu_feed);
+		g_npu_feed = NULL;
 	}
 	if (enable_npu)
 		rockiva_deinit();
-	pthread_join(get_vi_to_npu_thread, NULL);
+	if (g_roi_map) {
+		roi_map_destroy(g_roi_map);
+		g_roi_map = NULL;
+	}
 
 	if (g_rtsplive)
 		rtsp_del_demo(g_rtsplive);
@@ -0,0 +1,98 @@
+/*
+ * Print the robot's telemetry from the shared-memory bus that tcp_bridge
+ * publishes. Shows how another process (e.g. the camera demo) reads battery,
+ * wheel RPM and heading without touching the UART or a socket.
+ *
+ * Usage: telemetry_echo [-n shm name] [-a]
+ *   default: print the newest report 10 times a second
+ *   -a     : print every frame on the bus in order, with lost-frame counts
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry_bus.h"
+#include "ucp.h"
+
+/* The firmware sends UCP_REPORT_V2 instead of the plain report once a head
+ * has started clock sync */
+static int is_report(const telemetry_sample_t *s)
+{
+    return (s->id == UCP_RPM_REPORT && s->len == sizeof(ucp_rep_t)) ||
+           (s->id == UCP_REPORT_V2 && s->len == sizeof(ucp_rep_v2_t));
+}
+
+static void print_report(const telemetry_sample_t *s)
+{
+    if (s->id == UCP_REPORT_V2) {
+        ucp_rep_v2_t rep;
+        memcpy(&rep, s->msg, sizeof(rep));
+        printf("seq %llu  %.3f s  mcu %.3f s  battery %u  rpm %d %d %d %d  heading %d\n",
+               (unsigned long long)s->seq, s->timestamp_ns / 1e9, rep.sample_us / 1e6, rep.voltage,
+               rep.rpm[0], rep.rpm[1], rep.rpm[2], rep.rpm[3], rep.heading);
+        return;
+    }
+    ucp_rep_t rep;
+    memcpy(&rep, s->msg, sizeof(rep));
+    printf("seq %llu  %.3f s  battery %u  rpm %d %d %d %d  heading %d\n",
+           (unsigned long long)s->seq, s->timestamp_ns / 1e9, rep.voltage,
+           rep.rpm[0], rep.rpm[1], rep.rpm[2], rep.rpm[3], rep.heading);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = TELEMETRY_BUS_NAME;
+    int all = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:a")) != -1) {
+        switch (opt) {
+        case 'n': name = optarg; break;
+        case 'a': all = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n shm name] [-a]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);   // Line by line even into a pipe
+
+    const telemetry_bus_t *bus = telemetry_bus_open(name);
+    if (!bus) {
+        perror("telemetry_bus_open (is tcp_bridge running?)");
+        return 1;
+    }
+
+    telemetry_sample_t s, v2;
+    if (!all) {
+        for (;;) {
+            int have = telemetry_bus_latest(bus, UCP_RPM_REPORT, &s) == 0 && is_report(&s);
+            if (telemetry_bus_latest(bus, UCP_REPORT_V2, &v2) == 0 && is_report(&v2) &&
+                (!have || v2.seq > s.seq)) {
+                s = v2;
+                have = 1;
+            }
+            if (have)
+                print_report(&s);
+            usleep(100 * 1000);
+        }
+    }
+
+    telemetry_reader_t reader;
+    uint64_t lost = 0;
+    telemetry_reader_init(&reader, bus, 0);
+    for (;;) {
+        while (telemetry_reader_poll(&reader, &s)) {
+            if (reader.lost != lost) {
+                printf("(%llu frames lost)\n", (unsigned long long)(reader.lost - lost));
+                lost = reader.lost;
+            }
+            if (is_report(&s))
+                print_report(&s);
+            else
+                printf("seq %llu  %.3f s  id 0x%02x  len %u\n", (unsigned long long)s.seq,
+                       s.timestamp_ns / 1e9, s.id, s.len);
+        }
+        usleep(1000);
+    }
+}
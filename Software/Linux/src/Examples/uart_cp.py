@@ -1,4 +1,4 @@
-from ctypes import Structure, c_uint8, c_uint16, c_int16, c_uint32
+from ctypes import Structure, c_uint8, c_uint16, c_int16, c_uint32, c_uint64, sizeof
 
 
 # =========================================================================
@@ -14,6 +14,34 @@ UCP_MAG_WRITE            = 0x7
 UCP_IMUMAG_READ          = 0x8
 UCP_OTA                  = 0x9
 UCP_STATE                = 0xA
+UCP_TIME_SYNC            = 0xB
+UCP_REPORT_V2            = 0xC
+UCP_BAUD_SET             = 0xD
+UCP_SUBSCRIBE            = 0xE
+UCP_TELEMETRY            = 0xF
+UCP_IMU_BATCH            = 0x10
+UCP_REPORT_DELTA         = 0x11
+UCP_HELLO                = 0x12
+
+UCP_PROTO_VERSION        = 1
+UCP_HELLO_ID_BYTES       = 32
+
+UCP_REPORT_VERSION       = 2
+
+# Telemetry field groups, in the order their payloads follow UcpTelemetry
+UCP_GRP_WHEELS           = 1 << 0
+UCP_GRP_IMU_RAW          = 1 << 1
+UCP_GRP_ATTITUDE         = 1 << 2
+UCP_GRP_POWER            = 1 << 3
+UCP_GRP_TOF              = 1 << 4
+UCP_GRP_IMU_BATCH        = 1 << 5    # Sent as UCP_IMU_BATCH, not in UCP_TELEMETRY
+UCP_GRP_REPORT_DELTA     = 1 << 6    # The report as UCP_REPORT_DELTA
+UCP_GRP_REPORT           = 1 << 7
+UCP_SUB_SLOTS            = 8
+UCP_SUB_TICK_MS          = 5
+UCP_IMU_PERIOD_US        = 10000
+UCP_IMU_BATCH_MAX        = 16
+UCP_DELTA_F_KEY          = 1 << 0
 
 
 # =========================================================================
@@ -34,6 +62,29 @@ class UcpImuCorrectionType:
     UICT_IMU = 2
 
 
+# =========================================================================
+# CRC16 (Modbus, init 0xFFFF), same result as ucp_crc16() in ucp_crc.c
+# =========================================================================
+def _crc16_table():
+    table = []
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+        table.append(crc)
+    return table
+
+
+_CRC16_TABLE = _crc16_table()
+
+
+def crc16(data: bytes, crc: int = 0xFFFF) -> int:
+    table = _CRC16_TABLE
+    for b in data:
+        crc = (crc >> 8) ^ table[(crc ^ b) & 0xFF]
+    return crc
+
+
 # =========================================================================
 # Message Structures
 # =========================================================================
@@ -108,6 +159,292 @@ class UcpRep(Structure):
     ]
 
 
+class UcpTimeSync(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",    UcpHd),
+        ("t1_ns", c_uint64),
+    ]
+
+
+class UcpTimeSyncAck(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",    UcpHd),
+        ("t1_ns", c_uint64),
+        ("t2_us", c_uint64),
+        ("t3_us", c_uint64),
+    ]
+
+
+class UcpRepV2(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",          UcpHd),
+        ("rep_version", c_uint8),
+        ("reserve0",    c_uint8),
+        ("sample_us",   c_uint64),
+        ("voltage",     c_uint16),
+        ("rpm",         c_int16 * 4),
+        ("acc",         c_int16 * 3),
+        ("gyros",       c_int16 * 3),
+        ("mag",         c_int16 * 3),
+        ("heading",     c_int16),
+        ("stop_switch", c_uint8),
+        ("error_code",  c_uint8),
+        ("reserve",     c_uint16),
+        ("version",     c_uint16),
+    ]
+
+
+class UcpBaudSet(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",          UcpHd),
+        ("baud",        c_uint32),
+        ("fallback_ms", c_uint16),
+    ]
+
+
+class UcpBaudSetAck(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",   UcpHd),
+        ("baud", c_uint32),
+        ("err",  c_uint8),
+    ]
+
+
+class UcpSubscribe(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",        UcpHd),
+        ("slot",      c_uint8),
+        ("groups",    c_uint8),
+        ("period_ms", c_uint16),
+    ]
+
+
+class UcpSubscribeAck(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",        UcpHd),
+        ("slot",      c_uint8),
+        ("groups",    c_uint8),
+        ("period_ms", c_uint16),
+        ("err",       c_uint8),
+    ]
+
+
+# Followed by the payload of each group in `groups`, lowest bit first
+class UcpTelemetry(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",        UcpHd),
+        ("slot",      c_uint8),
+        ("groups",    c_uint8),
+        ("sample_us", c_uint64),
+    ]
+
+
+class UcpTlmWheels(Structure):
+    _pack_ = 1
+    _fields_ = [("rpm", c_int16 * 4)]
+
+
+class UcpTlmImuRaw(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("acc",   c_int16 * 3),
+        ("gyros", c_int16 * 3),
+        ("mag",   c_int16 * 3),
+    ]
+
+
+class UcpTlmAttitude(Structure):
+    _pack_ = 1
+    _fields_ = [("heading", c_int16)]
+
+
+class UcpTlmPower(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("battery",    c_uint16),
+        ("voltage_cv", c_uint16),
+        ("current_ca", c_int16),
+        ("power_dw",   c_uint16),
+    ]
+
+
+class UcpTlmTof(Structure):
+    _pack_ = 1
+    _fields_ = [("range_mm", c_uint16 * 4)]
+
+
+# Payload type of each group, in wire order
+UCP_TLM_GROUPS = [
+    (UCP_GRP_WHEELS,   UcpTlmWheels),
+    (UCP_GRP_IMU_RAW,  UcpTlmImuRaw),
+    (UCP_GRP_ATTITUDE, UcpTlmAttitude),
+    (UCP_GRP_POWER,    UcpTlmPower),
+    (UCP_GRP_TOF,      UcpTlmTof),
+]
+
+
+# Split a UCP_TELEMETRY message (header included, sync and CRC not) into its
+# UcpTelemetry header and a {group bit: payload} dict
+def parse_telemetry(message: bytes):
+    head = UcpTelemetry.from_buffer_copy(message)
+    offset = sizeof(UcpTelemetry)
+    payloads = {}
+    for bit, cls in UCP_TLM_GROUPS:
+        if head.groups & bit:
+            payloads[bit] = cls.from_buffer_copy(message, offset)
+            offset += sizeof(cls)
+    return head, payloads
+
+
+class UcpImuSample(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("acc",   c_int16 * 3),
+        ("gyros", c_int16 * 3),
+    ]
+
+
+# Followed by `count` UcpImuSample; sample i was taken at base_us + i * period_us
+class UcpImuBatch(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",        UcpHd),
+        ("slot",      c_uint8),
+        ("count",     c_uint8),
+        ("dropped",   c_uint16),
+        ("period_us", c_uint16),
+        ("base_us",   c_uint64),
+    ]
+
+
+# Split a UCP_IMU_BATCH message (header included, sync and CRC not) into its
+# UcpImuBatch header and a list of (sample_us, UcpImuSample)
+def parse_imu_batch(message: bytes):
+    head = UcpImuBatch.from_buffer_copy(message)
+    samples = []
+    for i in range(head.count):
+        offset = sizeof(UcpImuBatch) + i * sizeof(UcpImuSample)
+        samples.append((head.base_us + i * head.period_us,
+                        UcpImuSample.from_buffer_copy(message, offset)))
+    return head, samples
+
+
+# Followed by a keyframe or a delta, see ucp_delta.h
+class UcpRepDelta(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",      UcpHd),
+        ("key_seq", c_uint8),
+        ("flags",   c_uint8),
+    ]
+
+
+class UcpRepDeltaAck(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",      UcpHd),
+        ("key_seq", c_uint8),
+    ]
+
+
+# UcpRep fields in delta mask bit order from bit 1 (bit 0 is sample_us)
+UCP_DELTA_FIELDS = [("acc", 0), ("acc", 1), ("acc", 2), ("gyros", 0), ("gyros", 1), ("gyros", 2),
+                    ("heading", None), ("mag", 0), ("mag", 1), ("mag", 2),
+                    ("rpm", 0), ("rpm", 1), ("rpm", 2), ("rpm", 3), ("voltage", None),
+                    ("stop_switch", None), ("error_code", None), ("reserve", None), ("version", None)]
+
+
+def _varint(data: bytes, p: int):
+    value, shift = 0, 0
+    while True:
+        b = data[p]
+        p += 1
+        value |= (b & 0x7f) << shift
+        if not b & 0x80:
+            return value, p
+        shift += 7
+
+
+def _unzigzag(z: int):
+    return (z >> 1) ^ -(z & 1)
+
+
+# Rebuilds UCP_REPORT_DELTA messages (header included, sync and CRC not).
+# decode() returns (sample_us, UcpRep, key_seq to acknowledge or None), or
+# None for a delta whose keyframe it doesn't have.
+class UcpDeltaDecoder:
+    def __init__(self):
+        self.keys = {}  # key_seq: (sample_us, UcpRep), the newest few
+
+    def decode(self, message: bytes):
+        head = UcpRepDelta.from_buffer_copy(message)
+        body = message[sizeof(UcpRepDelta):]
+        if head.flags & UCP_DELTA_F_KEY:
+            sample_us = int.from_bytes(body[:8], "little")
+            rep = UcpRep.from_buffer_copy(bytes(sizeof(UcpHd)) + body[8:8 + sizeof(UcpRep) - sizeof(UcpHd)])
+            self.keys.pop(head.key_seq, None)
+            self.keys[head.key_seq] = (sample_us, rep)
+            while len(self.keys) > 8:
+                self.keys.pop(next(iter(self.keys)))
+            return sample_us, rep, head.key_seq
+        if head.key_seq not in self.keys:
+            return None
+        sample_us, key = self.keys[head.key_seq]
+        rep = UcpRep.from_buffer_copy(bytes(key))
+        mask, p = _varint(body, 0)
+        if mask & 1:
+            z, p = _varint(body, p)
+            sample_us += _unzigzag(z)
+        for bit, (name, i) in enumerate(UCP_DELTA_FIELDS, start=1):
+            if not mask & (1 << bit):
+                continue
+            z, p = _varint(body, p)
+            if i is None:
+                setattr(rep, name, getattr(rep, name) + _unzigzag(z))
+            else:
+                getattr(rep, name)[i] += _unzigzag(z)
+        return sample_us, rep, None
+
+
+class UcpHello(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",              UcpHd),
+        ("proto_version",   c_uint8),
+    ]
+
+
+# Capabilities of the MCU; later protocol versions append fields
+class UcpHelloAck(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("hd",              UcpHd),
+        ("proto_version",   c_uint8),
+        ("report_version",  c_uint8),
+        ("app_version",     c_uint16),
+        ("max_baud",        c_uint32),
+        ("groups",          c_uint8),
+        ("sub_slots",       c_uint8),
+        ("sub_tick_ms",     c_uint16),
+        ("imu_batch_max",   c_uint8),
+        ("rel_window",      c_uint8),
+        ("rx_buffer",       c_uint16),
+        ("max_frame",       c_uint16),
+        ("rx_ids",          c_uint8 * UCP_HELLO_ID_BYTES),   # Bit id % 8 of byte id // 8: handled
+    ]
+
+    def handles(self, msg_id: int) -> bool:
+        return bool(self.rx_ids[msg_id // 8] >> (msg_id % 8) & 1)
+
+
 class UcpMagW(Structure):
     _pack_ = 1
     _fields_ = [
@@ -185,6 +522,35 @@ class UcpOtaAck(Structure):
     ]
 
 
+# =========================================================================
+# UDP control transport (tcp_bridge -u, see src/bridge/udp_control.hpp)
+# A command datagram is a UdpHd followed by one whole UCP frame; acks are a
+# UdpHd alone with seq and stamp_ns echoed.
+# =========================================================================
+UDP_MAGIC = 0xA5
+UDP_COMMAND = 1
+UDP_ACK = 2
+UDP_TELEMETRY = 3
+
+UDP_ACK_ACCEPTED = 0
+UDP_ACK_STALE = 1
+UDP_ACK_DUPLICATE = 2
+UDP_ACK_REJECTED = 3
+UDP_ACK_PREEMPTED = 4
+
+
+class UdpHd(Structure):
+    _pack_ = 1
+    _fields_ = [
+        ("magic",    c_uint8),
+        ("type",     c_uint8),
+        ("status",   c_uint8),
+        ("reserved", c_uint8),
+        ("seq",      c_uint32),
+        ("stamp_ns", c_uint64),
+    ]
+
+
 class UcpState:
     UCP_STATE_UNKNOWN = 0
     UCP_STATE_SIMABSENT = 1
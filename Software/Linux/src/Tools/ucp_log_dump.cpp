@@ -0,0 +1,105 @@
+// -----------------------------------------------------------------------------
+// Print a UART traffic log recorded by `tcp_bridge -r dir`.
+//
+// Usage: ucp_log_dump [-s from] [-e to] [-x] [-i] dir
+//   -s, -e : time window in seconds from the first record of the log; each
+//            segment is entered with an index seek, not a scan
+//   -x     : hex dump every frame
+//   -i     : only list the segments (records, time span, closed or recovered)
+// -----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "ucp.h"
+#include "ucp_log.hpp"
+
+static void print_record(const ucp_log::Record& r, uint64_t origin, bool hex) {
+  printf("%12.6f %s", (r.timestamp_ns - origin) / 1e9,
+         r.direction == ucp_log::kToRobot ? "tx" : "rx");
+  if (r.len >= 2 + sizeof(ucp_hd_t) + 2) {
+    ucp_hd_t hd;
+    memcpy(&hd, r.frame + 2, sizeof(hd));
+    printf("  id 0x%02x  index %3u  len %3u", hd.id, hd.index, hd.len);
+  } else {
+    printf("  len %zu", r.len);
+  }
+  if (hex) {
+    for (size_t i = 0; i < r.len; i++) printf("%s%02x", i % 16 ? " " : "\n    ", r.frame[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  double from = 0, to = -1;
+  bool hex = false, info = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:e:xih")) != -1) {
+    switch (opt) {
+      case 's': from = atof(optarg); break;
+      case 'e': to = atof(optarg); break;
+      case 'x': hex = true; break;
+      case 'i': info = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-s from] [-e to] [-x] [-i] dir\n", argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-s from] [-e to] [-x] [-i] dir\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> segments = ucp_log::list_segments(argv[optind]);
+  if (segments.empty()) {
+    fprintf(stderr, "%s: no log segments\n", argv[optind]);
+    return 1;
+  }
+
+  // Times are shown relative to the first record of the whole log
+  uint64_t origin = 0;
+  ucp_log::SegmentReader reader;
+  for (const std::string& path : segments) {
+    ucp_log::Record r;
+    if (!reader.open(path)) continue;
+    uint64_t offset = reader.begin();
+    if (reader.next(&offset, &r)) {
+      origin = r.timestamp_ns;
+      break;
+    }
+  }
+  uint64_t start_ns = origin + (uint64_t)(from * 1e9);
+  uint64_t end_ns = to < 0 ? UINT64_MAX : origin + (uint64_t)(to * 1e9);
+
+  for (const std::string& path : segments) {
+    if (!reader.open(path)) {
+      fprintf(stderr, "%s\n", reader.error().c_str());
+      continue;
+    }
+    if (info) {
+      ucp_log::Record first, last;
+      uint64_t offset = reader.begin();
+      bool any = reader.next(&offset, &first);
+      last = first;
+      while (reader.next(&offset, &last)) {
+      }
+      printf("%s  %llu records  %.3f .. %.3f s  %s\n", path.c_str(),
+             (unsigned long long)reader.record_count(),
+             any ? (first.timestamp_ns - origin) / 1e9 : 0.0,
+             any ? (last.timestamp_ns - origin) / 1e9 : 0.0,
+             reader.was_closed() ? "closed" : "recovered (no index)");
+      continue;
+    }
+
+    ucp_log::Record r;
+    for (uint64_t offset = reader.seek(start_ns); reader.next(&offset, &r);) {
+      if (r.timestamp_ns > end_ns) return 0;
+      print_record(r, origin, hex);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,265 @@
+// -----------------------------------------------------------------------------
+// Replay a UART traffic log recorded by `tcp_bridge -r dir`.
+//
+// Usage: ucp_replay [-p | -c host:port | -D] [-x speed] [-s from] [-e to]
+//                   [-d rx|tx|all] [-l loops] [-w seconds] dir
+//   -p     : (default) play the robot: create a pty, print its path for
+//            `tcp_bridge -d`, and write the recorded UART frames to it
+//   -c     : play a client: connect to a bridge and send the recorded commands
+//   -D     : feed the frames to a ucp::Decoder in this process
+//   -x     : speed factor, 1 = as recorded, 0 = as fast as the sink takes them
+//   -s, -e : time window in seconds from the first record of the log
+//   -d     : directions to send (default rx for -p and -D, tx for -c)
+//   -l     : play the window this many times
+//   -w     : with -p, seconds to wait after creating the pty (default 2)
+//
+// Prints throughput and timing fidelity (lateness against the schedule and
+// error in the gaps between frames) for every pass.
+// -----------------------------------------------------------------------------
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "replay.hpp"
+#include "ucp_decoder.hpp"
+#include "ucp_log.hpp"
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int signo) {
+  (void)signo;
+  g_stop = 1;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-p | -c host:port | -D] [-x speed] [-s from] [-e to] [-d rx|tx|all] "
+          "[-l loops] [-w seconds] dir\n",
+          prog);
+}
+
+// A pty master or a socket. Writes wait for room with poll(), and whatever
+// the other side sends back meanwhile is read and decoded so it never
+// backs up into the peer.
+class FdSink {
+ public:
+  explicit FdSink(int fd) : fd_(fd) {}
+
+  bool send(const uint8_t* p, size_t n) {
+    while (n > 0) {
+      ssize_t w = write(fd_, p, n);
+      if (w > 0) {
+        p += w;
+        n -= w;
+        continue;
+      }
+      if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("write");
+        return false;
+      }
+      if (!wait(POLLOUT)) return false;
+    }
+    drain();
+    return true;
+  }
+
+  // Read what is waiting without blocking
+  void drain() {
+    uint8_t buf[4096];
+    ssize_t n;
+    while ((n = read(fd_, buf, sizeof(buf))) > 0) {
+      bytes_back_ += n;
+      decoder_.feed(buf, n, [this](const ucp::FrameView&) { frames_back_++; });
+    }
+  }
+
+  uint64_t bytes_back() const { return bytes_back_; }
+  uint64_t frames_back() const { return frames_back_; }
+
+ private:
+  bool wait(short events) {
+    struct pollfd pfd = {fd_, (short)(events | POLLIN), 0};
+    if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) return false;
+    if (pfd.revents & POLLIN) drain();
+    return !(pfd.revents & (POLLERR | POLLHUP)) && !g_stop;
+  }
+
+  int fd_;
+  ucp::Decoder decoder_;
+  uint64_t bytes_back_ = 0;
+  uint64_t frames_back_ = 0;
+};
+
+static int open_pty(std::string* slave_path, int* slave_fd) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+  *slave_path = ptsname(master);
+  // Keep a raw slave open ourselves so the master never sees a hangup
+  // between bridge restarts
+  *slave_fd = open(slave_path->c_str(), O_RDWR | O_NOCTTY);
+  struct termios tty;
+  if (*slave_fd >= 0 && tcgetattr(*slave_fd, &tty) == 0) {
+    cfmakeraw(&tty);
+    tcsetattr(*slave_fd, TCSANOW, &tty);
+  }
+  return master;
+}
+
+static int connect_tcp(const char* target) {
+  std::string host = target;
+  size_t colon = host.rfind(':');
+  if (colon == std::string::npos) {
+    fprintf(stderr, "expected host:port, got %s\n", target);
+    return -1;
+  }
+  std::string port = host.substr(colon + 1);
+  host.resize(colon);
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+    fprintf(stderr, "can't resolve %s\n", target);
+    return -1;
+  }
+  int fd = socket(res->ai_family, res->ai_socktype, 0);
+  if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+    perror("connect");
+    freeaddrinfo(res);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  freeaddrinfo(res);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static void print_stats(int pass, const ucp_log::ReplayStats& s) {
+  double elapsed = s.elapsed_ns / 1e9;
+  printf("pass %d: %llu frames, %llu bytes in %.3f s (recorded %.3f s, %.2fx)", pass,
+         (unsigned long long)s.frames, (unsigned long long)s.bytes, elapsed, s.recorded_ns / 1e9,
+         elapsed > 0 ? s.recorded_ns / 1e9 / elapsed : 0.0);
+  if (elapsed > 0) printf(", %.0f frames/s, %.2f MB/s", s.frames / elapsed, s.bytes / elapsed / 1e6);
+  printf("\n");
+  if (s.lateness.max == 0 && s.gap_error.max == 0) return;  // Not paced
+  printf("  lateness   p50 %.1f  p99 %.1f  max %.1f us\n", s.lateness.p50 / 1e3,
+         s.lateness.p99 / 1e3, s.lateness.max / 1e3);
+  printf("  gap error  p50 %.1f  p99 %.1f  max %.1f us\n", s.gap_error.p50 / 1e3,
+         s.gap_error.p99 / 1e3, s.gap_error.max / 1e3);
+}
+
+int main(int argc, char* argv[]) {
+  enum { kPty, kTcp, kDecode } mode = kPty;
+  const char* target = NULL;
+  const char* directions = NULL;
+  ucp_log::ReplayOptions options;
+  int loops = 1;
+  double wait_s = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "pc:Dx:s:e:d:l:w:h")) != -1) {
+    switch (opt) {
+      case 'p': mode = kPty; break;
+      case 'c': mode = kTcp; target = optarg; break;
+      case 'D': mode = kDecode; break;
+      case 'x': options.speed = atof(optarg); break;
+      case 's': options.from_ns = (uint64_t)(atof(optarg) * 1e9); break;
+      case 'e': options.to_ns = (uint64_t)(atof(optarg) * 1e9); break;
+      case 'd': directions = optarg; break;
+      case 'l': loops = atoi(optarg); break;
+      case 'w': wait_s = atof(optarg); break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  options.directions = mode == kTcp ? options.kReplayToRobot : options.kReplayFromRobot;
+  if (directions) {
+    if (!strcmp(directions, "rx")) options.directions = options.kReplayFromRobot;
+    else if (!strcmp(directions, "tx")) options.directions = options.kReplayToRobot;
+    else if (!strcmp(directions, "all")) options.directions = options.kReplayFromRobot | options.kReplayToRobot;
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  ucp_log::LogReader log;
+  if (!log.open(argv[optind])) {
+    fprintf(stderr, "%s\n", log.error().c_str());
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  prctl(PR_SET_TIMERSLACK, 1000UL);  // Wake within 1 us of a frame's due time, not the default 50
+
+  int fd = -1, slave = -1;
+  if (mode == kPty) {
+    std::string path;
+    fd = open_pty(&path, &slave);
+    if (fd < 0) return 1;
+    printf("Replaying into %s (start the bridge with -d %s)\n", path.c_str(), path.c_str());
+    fflush(stdout);
+    usleep((useconds_t)(wait_s * 1e6));
+  } else if (mode == kTcp) {
+    fd = connect_tcp(target);
+    if (fd < 0) return 1;
+  }
+
+  FdSink out(fd);
+  ucp::Decoder decoder;
+  uint64_t decoded = 0;
+  ucp_log::Replayer replayer(options);
+  bool ok = true;
+  for (int pass = 1; pass <= loops && !g_stop; pass++) {
+    ucp_log::ReplayStats s;
+    if (mode == kDecode) {
+      s = replayer.run(log, [&](const ucp_log::Record& r) {
+        decoder.feed(r.frame, r.len, [&](const ucp::FrameView&) { decoded++; });
+        return !g_stop;
+      });
+    } else {
+      s = replayer.run(log, [&](const ucp_log::Record& r) { return out.send(r.frame, r.len); });
+    }
+    print_stats(pass, s);
+    if (s.sink_failed && !g_stop) ok = false;
+    if (s.frames == 0) break;
+  }
+
+  if (mode == kDecode) {
+    const ucp::DecoderStats& ds = decoder.stats();
+    printf("decoder: %llu frames, %llu resyncs, %llu CRC errors\n", (unsigned long long)decoded,
+           (unsigned long long)ds.resyncs, (unsigned long long)ds.crc_errors);
+  } else {
+    usleep(100 * 1000);  // Catch the peer's last answers
+    out.drain();
+    printf("received back: %llu bytes, %llu frames\n", (unsigned long long)out.bytes_back(),
+           (unsigned long long)out.frames_back());
+    close(fd);
+    if (slave >= 0) close(slave);
+  }
+  return ok ? 0 : 1;
+}
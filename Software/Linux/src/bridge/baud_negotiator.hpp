@@ -0,0 +1,282 @@
+// -----------------------------------------------------------------------------
+// UART rate negotiation with the MCU (UCP_BAUD_SET)
+//
+// Both ends boot at 115200. The head proposes a faster rate and the switch
+// happens at one well-defined point, the MCU's answer:
+//
+//   kAsking      UCP_HELLO sent, resent every reply_timeout_ms; an answer
+//                lowers the target to the MCU's max_baud, no answer after
+//                `hellos` tries (firmware from before UCP_HELLO) proposes
+//                the target as is
+//   kProposing   BAUD_SET{baud, fallback_ms} sent at the old rate, resent
+//                every reply_timeout_ms; a refusal or no answer ends it
+//   kSettling    the answer arrived, after which the MCU switches; the head
+//                switches too and stays quiet for settle_ms
+//   kConfirming  keep-alives at the new rate until a pong comes back
+//   kActive      the new rate works; a keep-alive every keepalive_ms, and
+//                fallback_ms without a pong falls back
+//   kFallenBack  back at 115200, where the MCU also returns on its own after
+//                fallback_ms without a valid frame from the head
+//
+// Commands from clients are held while holding() (proposing through
+// confirming), so nothing is sent at a rate the other side isn't at. The
+// negotiator only decides; a BaudLink does the sending and switching, which
+// keeps it independent of the bridge's event loop. Call tick() by deadline().
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_BAUD_NEGOTIATOR_HPP
+#define BRIDGE_BAUD_NEGOTIATOR_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp_decoder.hpp"
+#include "ucp_hello.hpp"
+
+namespace bridge {
+
+constexpr unsigned kDefaultBaud = 115200;
+
+// Carries out the negotiator's decisions
+class BaudLink {
+ public:
+  virtual ~BaudLink() {}
+  // Write a frame to the UART ahead of any held commands
+  virtual void send_frame(const uint8_t* frame, size_t len) = 0;
+  // Switch the UART once everything written has left
+  virtual bool set_baud(unsigned baud) = 0;
+};
+
+enum class BaudState { kIdle, kAsking, kProposing, kSettling, kConfirming, kActive, kFallenBack };
+
+inline const char* baud_state_name(BaudState s) {
+  switch (s) {
+    case BaudState::kIdle: return "idle";
+    case BaudState::kAsking: return "asking";
+    case BaudState::kProposing: return "proposing";
+    case BaudState::kSettling: return "settling";
+    case BaudState::kConfirming: return "confirming";
+    case BaudState::kActive: return "active";
+    case BaudState::kFallenBack: return "fallen back";
+  }
+  return "?";
+}
+
+struct BaudOptions {
+  unsigned target = 921600;        // Rate to propose, at most
+  unsigned hellos = 3;             // UCP_HELLO queries before proposing blind, 0 to not ask
+  unsigned reply_timeout_ms = 200; // Before resending the query or proposal
+  unsigned proposals = 8;          // Sent before giving up; spans fallback_ms, see below
+  unsigned settle_ms = 20;         // Quiet time after switching, while the MCU switches
+  unsigned confirm_timeout_ms = 100;
+  unsigned confirms = 3;           // Keep-alives tried at the new rate
+  unsigned keepalive_ms = 250;     // Keep-alive period once active
+  unsigned fallback_ms = 1000;     // Silence after which both sides return to 115200
+};
+
+struct BaudStats {
+  uint64_t hellos = 0;             // UCP_HELLO queries sent
+  uint64_t proposals = 0;          // BAUD_SET requests sent
+  uint64_t refused = 0;            // Answers with an error
+  uint64_t switches = 0;           // Rate changes confirmed by a pong
+  uint64_t fallbacks = 0;          // Returns to 115200 after a failed or dead switch
+  uint64_t keepalives = 0;         // Keep-alives sent to confirm or hold the rate
+};
+
+class BaudNegotiator {
+ public:
+  BaudNegotiator(const BaudOptions& options, BaudLink* link) : options_(options), link_(link) {}
+
+  // Ask the MCU's capabilities, then propose options.target or the MCU's
+  // max_baud if lower. Proposing the default rate only confirms it.
+  void start(uint64_t now) {
+    attempts_ = 0;
+    target_ = options_.target;
+    if (options_.hellos > 0) {
+      ask(now);
+    } else {
+      propose(now);
+    }
+  }
+
+  // Every valid frame read from the UART
+  void on_frame(const ucp::FrameView& f, uint64_t now) {
+    if (f.id() == UCP_KEEP_ALIVE && f.as<ucp_alive_pong_t>()) {
+      last_pong_ = now;
+      if (state_ == BaudState::kConfirming) {
+        state_ = BaudState::kActive;
+        stats_.switches++;
+        next_keepalive_ = now + ms(options_.keepalive_ms);
+      }
+      return;
+    }
+    if (state_ == BaudState::kAsking && ucp::parse_hello(f, &caps_)) {
+      target_ = caps_.best_baud(options_.target);
+      attempts_ = 0;
+      if (target_ <= kDefaultBaud) {
+        state_ = BaudState::kIdle;  // Nothing faster to switch to
+      } else {
+        propose(now);
+      }
+      return;
+    }
+    if (state_ != BaudState::kProposing || f.id() != UCP_BAUD_SET) return;
+    const ucp_baud_set_ack_t* ack = f.as<ucp_baud_set_ack_t>();
+    if (!ack || ack->baud != target_) return;
+    if (ack->err != UCP_ERR_OK) {
+      stats_.refused++;
+      state_ = BaudState::kIdle;
+      return;
+    }
+    // The MCU switches once this answer has left it
+    if (!link_->set_baud(target_)) {
+      fall_back();
+      return;
+    }
+    baud_ = target_;
+    state_ = BaudState::kSettling;
+    deadline_ = now + ms(options_.settle_ms);
+  }
+
+  void tick(uint64_t now) {
+    switch (state_) {
+      case BaudState::kAsking:
+        if (now < deadline_) return;
+        if (attempts_ < options_.hellos) {
+          ask(now);
+        } else {
+          attempts_ = 0;
+          propose(now);  // No answer: the MCU predates UCP_HELLO
+        }
+        return;
+      case BaudState::kProposing:
+        if (now < deadline_) return;
+        if (attempts_ < options_.proposals) {
+          propose(now);
+        } else {
+          state_ = BaudState::kIdle;  // No answer: the MCU predates BAUD_SET
+        }
+        return;
+      case BaudState::kSettling:
+        if (now < deadline_) return;
+        state_ = BaudState::kConfirming;
+        attempts_ = 0;
+        confirm(now);
+        return;
+      case BaudState::kConfirming:
+        if (now < deadline_) return;
+        if (attempts_ < options_.confirms) {
+          confirm(now);
+        } else {
+          fall_back();
+        }
+        return;
+      case BaudState::kActive:
+        if (now - last_pong_ >= ms(options_.fallback_ms)) {
+          fall_back();
+          return;
+        }
+        if (now >= next_keepalive_) {
+          send_keepalive();
+          next_keepalive_ = now + ms(options_.keepalive_ms);
+        }
+        return;
+      default:
+        return;
+    }
+  }
+
+  // When tick() next has something to do, 0 for never
+  uint64_t deadline() const {
+    switch (state_) {
+      case BaudState::kAsking:
+      case BaudState::kProposing:
+      case BaudState::kSettling:
+      case BaudState::kConfirming:
+        return deadline_;
+      case BaudState::kActive: {
+        uint64_t dead = last_pong_ + ms(options_.fallback_ms);
+        return next_keepalive_ < dead ? next_keepalive_ : dead;
+      }
+      default:
+        return 0;
+    }
+  }
+
+  // Commands must wait: the rates on both ends may differ
+  bool holding() const {
+    return state_ == BaudState::kProposing || state_ == BaudState::kSettling ||
+           state_ == BaudState::kConfirming;
+  }
+
+  BaudState state() const { return state_; }
+  unsigned baud() const { return baud_; }
+  // What the MCU answered to UCP_HELLO; known() is false without an answer
+  const ucp::Capabilities& capabilities() const { return caps_; }
+  const BaudStats& stats() const { return stats_; }
+
+ private:
+  static uint64_t ms(unsigned v) { return (uint64_t)v * 1000000ull; }
+
+  void ask(uint64_t now) {
+    ucp::Frame<ucp_hello_t> frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.msg.proto_version = UCP_PROTO_VERSION;
+    encoder_.seal(frame);
+    link_->send_frame(frame.data(), frame.size());
+    stats_.hellos++;
+    attempts_++;
+    state_ = BaudState::kAsking;
+    deadline_ = now + ms(options_.reply_timeout_ms);
+  }
+
+  void propose(uint64_t now) {
+    ucp::Frame<ucp_baud_set_t> frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.msg.baud = target_;
+    frame.msg.fallback_ms = (uint16_t)options_.fallback_ms;
+    encoder_.seal(frame);
+    link_->send_frame(frame.data(), frame.size());
+    stats_.proposals++;
+    attempts_++;
+    state_ = BaudState::kProposing;
+    deadline_ = now + ms(options_.reply_timeout_ms);
+  }
+
+  void confirm(uint64_t now) {
+    send_keepalive();
+    attempts_++;
+    deadline_ = now + ms(options_.confirm_timeout_ms);
+  }
+
+  void send_keepalive() {
+    ucp::Frame<ucp_alive_ping_t> frame;
+    encoder_.seal(frame);
+    link_->send_frame(frame.data(), frame.size());
+    stats_.keepalives++;
+  }
+
+  void fall_back() {
+    link_->set_baud(kDefaultBaud);
+    baud_ = kDefaultBaud;
+    state_ = BaudState::kFallenBack;
+    stats_.fallbacks++;
+  }
+
+  BaudOptions options_;
+  BaudLink* link_;
+  ucp::Encoder encoder_;
+  BaudState state_ = BaudState::kIdle;
+  unsigned target_ = 0;
+  unsigned baud_ = kDefaultBaud;
+  unsigned attempts_ = 0;
+  uint64_t deadline_ = 0;
+  uint64_t last_pong_ = 0;
+  uint64_t next_keepalive_ = 0;
+  ucp::Capabilities caps_;
+  BaudStats stats_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_BAUD_NEGOTIATOR_HPP
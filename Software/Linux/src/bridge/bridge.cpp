@@ -0,0 +1,974 @@
+#include "bridge.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+#include "serial_port.hpp"
+
+namespace bridge {
+
+static const size_t kReadChunk = 4096;
+static const int kMaxEvents = 32;
+static const int kUartReadsPerWake = 4;   // Bound UART reads per wakeup so clients aren't starved
+static const int kRecorderTickMs = 100;
+static const size_t kMaxMetricsConns = 4;
+static const size_t kMaxMetricsRequest = 4096;
+
+// RequestMux owners besides the clients' tags: answers to UDP clients and to
+// the baud negotiator go to everyone, as all frames did before the mux
+static const uint64_t kEveryoneTag = 1;
+static const uint64_t kFirstClientTag = 2;
+
+static uint64_t monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void accumulate(ucp::DecoderStats& into, const ucp::DecoderStats& s) {
+  into.frames += s.frames;
+  into.bytes += s.bytes;
+  into.resyncs += s.resyncs;
+  into.discarded += s.discarded;
+  into.crc_errors += s.crc_errors;
+  into.bad_headers += s.bad_headers;
+}
+
+// A listening TCP socket on `port` (0 for any free one); the port actually
+// bound is stored in `bound`
+static int listen_tcp(uint16_t port, bool loopback_only, uint16_t* bound) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+  addr.sin_port = htons(port);
+
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    close(fd);
+    return -1;
+  }
+  if (listen(fd, 16) < 0) {
+    perror("listen");
+    close(fd);
+    return -1;
+  }
+
+  socklen_t len = sizeof(addr);
+  getsockname(fd, (struct sockaddr*)&addr, &len);
+  *bound = ntohs(addr.sin_port);
+  return fd;
+}
+
+// A listening Unix socket at `path`, replacing one an earlier run left
+static int listen_unix(const std::string& path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[Bridge] Socket path %s too long\n", path.c_str());
+    return -1;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("unix socket");
+    return -1;
+  }
+  unlink(path.c_str());
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("unix bind");
+    close(fd);
+    return -1;
+  }
+  if (listen(fd, 16) < 0) {
+    perror("unix listen");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+Bridge::Bridge(const Config& config)
+    : config_(config), uart_out_(config.uart_queue, false), next_tag_(kFirstClientTag), arbiter_(config.lease_ms) {
+  uart_baud_ = config.uart_baud;
+  byte_ns_ = 10ull * 1000000000ull / config.uart_baud;
+}
+
+Bridge::~Bridge() {
+  for (auto& it : clients_) close(it.first);
+  for (auto& it : metrics_conns_) close(it.first);
+  if (server_fd_ >= 0) close(server_fd_);
+  for (size_t p = 0; p < kPriorities; p++) {
+    if (unix_fds_[p] < 0) continue;
+    close(unix_fds_[p]);
+    unlink(unix_paths_[p].c_str());
+  }
+  if (metrics_fd_ >= 0) close(metrics_fd_);
+  if (udp_fd_ >= 0) close(udp_fd_);
+  if (uart_fd_ >= 0) close(uart_fd_);
+  if (wake_fd_ >= 0) close(wake_fd_);
+  if (timer_fd_ >= 0) close(timer_fd_);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+  telemetry_bus_close(bus_);
+  if (recorder_) recorder_->close();
+}
+
+bool Bridge::open() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0 || timer_fd_ < 0) {
+    perror("epoll/eventfd/timerfd");
+    return false;
+  }
+
+  speed_t speed;
+  if (!baud_to_speed(config_.uart_baud, &speed)) {
+    fprintf(stderr, "[Bridge] Unsupported baud rate %u\n", config_.uart_baud);
+    return false;
+  }
+  uart_fd_ = open_serial(config_.serial, speed);
+  if (uart_fd_ < 0) return false;
+  if (config_.verbose) printf("[Bridge] Serial %s initialized.\n", config_.serial);
+
+  if (!setup_server()) return false;
+  if (config_.unix_dir && !setup_unix()) return false;
+  if (config_.udp && !setup_udp()) return false;
+  if (config_.metrics && !setup_metrics()) return false;
+
+  // The bus is optional: without it the bridge still serves TCP clients
+  if (config_.telemetry_bus) {
+    bus_ = telemetry_bus_create(config_.telemetry_bus);
+    if (!bus_) {
+      perror("telemetry bus");
+    } else if (config_.verbose) {
+      printf("[Bridge] Publishing telemetry on shm %s\n", config_.telemetry_bus);
+    }
+  }
+
+  if (config_.record_dir) {
+    ucp_log::RecorderOptions options;
+    options.dir = config_.record_dir;
+    recorder_.reset(new ucp_log::Recorder);
+    if (!recorder_->open(options)) return false;
+    if (config_.verbose) printf("[Bridge] Recording UART traffic to %s\n", config_.record_dir);
+  }
+
+  watch(wake_fd_, EPOLLIN, false);
+  watch(timer_fd_, EPOLLIN, false);
+  watch(uart_fd_, EPOLLIN, false);
+  watch(server_fd_, EPOLLIN, false);
+  for (int fd : unix_fds_) {
+    if (fd >= 0) watch(fd, EPOLLIN, false);
+  }
+  if (udp_fd_ >= 0) watch(udp_fd_, EPOLLIN, false);
+  if (metrics_fd_ >= 0) watch(metrics_fd_, EPOLLIN, false);
+
+  if (config_.negotiate_baud) {
+    BaudOptions options;
+    options.target = config_.negotiate_baud;
+    baud_.reset(new BaudNegotiator(options, this));
+    baud_->start(monotonic_ns());
+  }
+  return true;
+}
+
+bool Bridge::setup_server() {
+  server_fd_ = listen_tcp(config_.tcp_port, config_.loopback_only, &port_);
+  if (server_fd_ < 0) return false;
+  if (config_.verbose) printf("[Bridge] Listening on TCP port %d...\n", port_);
+  return true;
+}
+
+bool Bridge::setup_unix() {
+  if (mkdir(config_.unix_dir, 0755) < 0 && errno != EEXIST) {
+    perror(config_.unix_dir);
+    return false;
+  }
+  for (size_t p = 0; p < kPriorities; p++) {
+    unix_paths_[p] = std::string(config_.unix_dir) + "/" + priority_name((Priority)p);
+    unix_fds_[p] = listen_unix(unix_paths_[p]);
+    if (unix_fds_[p] < 0) return false;
+  }
+  if (config_.verbose) printf("[Bridge] Listening on Unix sockets in %s\n", config_.unix_dir);
+  return true;
+}
+
+bool Bridge::setup_metrics() {
+  metrics_fd_ = listen_tcp(config_.metrics_port, config_.loopback_only, &metrics_port_);
+  if (metrics_fd_ < 0) return false;
+  if (config_.verbose) printf("[Bridge] Serving metrics on TCP port %d\n", metrics_port_);
+  return true;
+}
+
+bool Bridge::setup_udp() {
+  udp_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (udp_fd_ < 0) {
+    perror("udp socket");
+    return false;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(config_.loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+  addr.sin_port = htons(config_.udp_port);
+  if (bind(udp_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("udp bind");
+    return false;
+  }
+
+  socklen_t len = sizeof(addr);
+  getsockname(udp_fd_, (struct sockaddr*)&addr, &len);
+  udp_port_ = ntohs(addr.sin_port);
+  if (config_.verbose) printf("[Bridge] Listening on UDP port %d...\n", udp_port_);
+  return true;
+}
+
+void Bridge::watch(int fd, uint32_t events, bool modify) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  epoll_ctl(epoll_fd_, modify ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+}
+
+void Bridge::stop() {
+  uint64_t one = 1;
+  ssize_t ret = write(wake_fd_, &one, sizeof(one));
+  (void)ret;
+}
+
+// Wake up now and then while recording so a quiet link's last frames still
+// reach the disk, and when the baud negotiation has a timeout due
+int Bridge::loop_timeout_ms() const {
+  int timeout = recorder_ ? kRecorderTickMs : -1;
+  uint64_t deadline = baud_ ? baud_->deadline() : 0;
+  if (deadline) {
+    uint64_t now = monotonic_ns();
+    int ms = deadline > now ? (int)((deadline - now + 999999) / 1000000) : 0;
+    if (timeout < 0 || ms < timeout) timeout = ms;
+  }
+  return timeout;
+}
+
+bool Bridge::run() {
+  struct epoll_event events[kMaxEvents];
+  for (;;) {
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, loop_timeout_ms());
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("epoll_wait");
+      return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      uint32_t ev = events[i].events;
+
+      if (fd == wake_fd_) {
+        uint64_t count;
+        ssize_t ret = read(wake_fd_, &count, sizeof(count));
+        (void)ret;
+        return true;
+      }
+      if (fd == timer_fd_) {
+        uint64_t expirations;
+        ssize_t ret = read(timer_fd_, &expirations, sizeof(expirations));
+        (void)ret;
+        if (!flush_uart()) return false;
+        continue;
+      }
+      if (fd == server_fd_) {
+        accept_clients(fd, Priority::kTeleop, false);
+        continue;
+      }
+      if (fd == udp_fd_) {
+        read_udp();
+        continue;
+      }
+      if (fd == metrics_fd_) {
+        accept_metrics();
+        continue;
+      }
+      if (fd == uart_fd_) {
+        if ((ev & EPOLLIN) && !read_uart()) return false;
+        if ((ev & (EPOLLERR | EPOLLHUP)) && !(ev & EPOLLIN)) {
+          fprintf(stderr, "[Bridge] Serial %s hung up.\n", config_.serial);
+          return false;
+        }
+        if ((ev & EPOLLOUT) && !flush_uart()) return false;
+        continue;
+      }
+
+      auto it = clients_.find(fd);
+      if (it == clients_.end()) {
+        if (metrics_conns_.count(fd)) serve_metrics(fd, ev);
+        for (size_t p = 0; p < kPriorities; p++) {
+          if (fd == unix_fds_[p]) accept_clients(fd, (Priority)p, true);
+        }
+        continue;  // Or closed earlier in this batch
+      }
+      if (ev & EPOLLOUT) {
+        flush_client(*it->second);
+        it = clients_.find(fd);
+        if (it == clients_.end()) continue;
+      }
+      if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) read_client(*it->second);
+    }
+
+    if (baud_) baud_->tick(monotonic_ns());
+
+    // Write everything the batch produced: one send per client per wakeup
+    // no matter how many frames arrived.
+    if ((!uart_out_.empty() || !commands_.empty()) && !uart_want_out_ && !flush_uart()) {
+      return false;
+    }
+    for (auto it = clients_.begin(); it != clients_.end();) {
+      Client& client = *it->second;
+      ++it;  // flush_client may close and erase the client
+      if (!client.out.empty() && !client.want_out) flush_client(client);
+    }
+    if (recorder_) recorder_->tick(monotonic_ns());
+  }
+}
+
+void Bridge::accept_clients(int listen_fd, Priority priority, bool local) {
+  for (;;) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = accept4(listen_fd, local ? NULL : (struct sockaddr*)&addr, local ? NULL : &len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+      return;
+    }
+    if (clients_.size() >= config_.max_clients) {
+      stats_.clients_rejected++;
+      if (config_.verbose) fprintf(stderr, "[Bridge] Client limit reached, rejecting.\n");
+      close(fd);
+      continue;
+    }
+
+    uint64_t tag = next_tag_++;
+    std::unique_ptr<Client> client(new Client(fd, config_.client_queue, tag, priority, local));
+    if (local) {
+      snprintf(client->name, sizeof(client->name), "%s#%llu", priority_name(priority),
+               (unsigned long long)tag);
+    } else {
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      snprintf(client->name, sizeof(client->name), "%s:%d", inet_ntoa(addr.sin_addr),
+               ntohs(addr.sin_port));
+    }
+    if (config_.verbose) printf("[Bridge] Client connected from %s\n", client->name);
+    watch(fd, EPOLLIN | EPOLLRDHUP, false);
+    clients_[fd] = std::move(client);
+    stats_.clients_accepted++;
+  }
+}
+
+bool Bridge::read_uart() {
+  uint8_t buf[kReadChunk];
+  for (int i = 0; i < kUartReadsPerWake; i++) {
+    ssize_t n = read(uart_fd_, buf, sizeof(buf));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      perror("read serial");
+      return false;
+    }
+    if (n == 0) return true;
+    stats_.uart_rx_bytes += n;
+    uart_rx_ns_ = monotonic_ns();
+    uart_decoder_.feed(buf, n, [this](const ucp::FrameView& f) { on_telemetry(f); });
+    if ((size_t)n < sizeof(buf)) return true;
+  }
+  return true;
+}
+
+void Bridge::read_client(Client& client) {
+  uint8_t buf[kReadChunk];
+  for (;;) {
+    ssize_t n = recv(client.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+    }
+    if (n <= 0) {
+      close_client(client.fd);
+      return;
+    }
+    stats_.client_rx_bytes += n;
+    client_rx_ns_ = monotonic_ns();
+    client.decoder.feed(buf, n, [this, &client](const ucp::FrameView& f) {
+      on_command(f, client.tag, client.priority);
+    });
+    if ((size_t)n < sizeof(buf)) return;
+  }
+}
+
+void Bridge::close_client(int fd) {
+  auto it = clients_.find(fd);
+  if (it == clients_.end()) return;
+  if (config_.verbose) printf("[Bridge] Client %s disconnected.\n", it->second->name);
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+  accumulate(closed_decoders_, it->second->decoder.stats());
+  mux_.forget(it->second->tag);
+  clients_.erase(it);
+}
+
+ucp::DecoderStats Bridge::tcp_decoder_stats() const {
+  ucp::DecoderStats total = closed_decoders_;
+  for (auto& it : clients_) accumulate(total, it.second->decoder.stats());
+  return total;
+}
+
+void Bridge::queue_telemetry(Client& client, const ucp::FrameView& frame) {
+  if (client.out.push(frame.frame, frame.frame_len)) {
+    client.queued_bytes += frame.frame_len;
+    client.pending.push_back({client.queued_bytes, uart_rx_ns_});
+    stats_.telemetry_sent++;
+  } else {
+    stats_.telemetry_dropped++;
+  }
+}
+
+void Bridge::on_telemetry(const ucp::FrameView& received) {
+  stats_.telemetry_frames++;
+  if (baud_) baud_->on_frame(received, uart_rx_ns_);
+  record(ucp_log::kFromRobot, received.frame, received.frame_len, uart_rx_ns_);
+  if (bus_) telemetry_bus_publish(bus_, received.message(), received.len(), uart_rx_ns_);
+
+  // An answer gets back the index its request came with, and goes to the
+  // client that asked only
+  ucp::FrameView frame = received;
+  uint8_t answer[ucp::kMaxFrameLen];
+  uint64_t owner;
+  uint8_t index;
+  if (mux_.route(received.id(), received.index(), uart_rx_ns_, &owner, &index)) {
+    memcpy(answer, received.frame, received.frame_len);
+    reindex_frame(answer, received.frame_len, index);
+    frame = {answer, received.frame_len};
+    if (owner != kEveryoneTag) {
+      for (auto& it : clients_) {
+        if (it.second->tag == owner) queue_telemetry(*it.second, frame);
+      }
+      return;
+    }
+  }
+
+  for (auto& it : clients_) queue_telemetry(*it.second, frame);
+  if (udp_peers_.empty()) return;
+
+  // One datagram per UDP client. A full socket buffer drops the datagram,
+  // which is what the network would do anyway.
+  uint64_t expire = (uint64_t)config_.udp_timeout_ms * 1000000ull;
+  udp::Header hd;
+  memset(&hd, 0, sizeof(hd));
+  hd.magic = udp::kMagic;
+  hd.type = udp::kTelemetry;
+  hd.stamp_ns = uart_rx_ns_;
+  struct iovec iov[2] = {{&hd, sizeof(hd)}, {const_cast<uint8_t*>(frame.frame), frame.frame_len}};
+  uint64_t now = monotonic_ns();
+  for (size_t i = 0; i < udp_peers_.size();) {
+    UdpPeer& peer = udp_peers_[i];
+    if (uart_rx_ns_ > peer.last_heard_ns + expire) {
+      udp_peers_[i] = udp_peers_.back();
+      udp_peers_.pop_back();
+      continue;
+    }
+    hd.seq = peer.tx_seq++;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &peer.addr;
+    msg.msg_namelen = sizeof(peer.addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (sendmsg(udp_fd_, &msg, MSG_DONTWAIT) >= 0) {
+      stats_.telemetry_sent++;
+      stats_.client_tx_bytes += sizeof(hd) + frame.frame_len;
+      latency_.telemetry.record(now - uart_rx_ns_);
+    } else {
+      stats_.telemetry_dropped++;
+    }
+    i++;
+  }
+}
+
+void Bridge::read_udp() {
+  uint8_t buf[sizeof(udp::Header) + ucp::kMaxFrameLen + 1];
+  for (int i = 0; i < kMaxEvents; i++) {
+    struct sockaddr_in from;
+    socklen_t len = sizeof(from);
+    ssize_t n = recvfrom(udp_fd_, buf, sizeof(buf), 0, (struct sockaddr*)&from, &len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;  // EAGAIN, or an ICMP error from a client that went away
+    }
+    stats_.client_rx_bytes += n;
+    client_rx_ns_ = monotonic_ns();
+    on_udp_command(from, buf, n);
+  }
+}
+
+Bridge::UdpPeer* Bridge::udp_peer(const struct sockaddr_in& addr, uint64_t now) {
+  for (UdpPeer& peer : udp_peers_) {
+    if (peer.addr.sin_addr.s_addr == addr.sin_addr.s_addr && peer.addr.sin_port == addr.sin_port) {
+      return &peer;
+    }
+  }
+  // Make room by forgetting clients that went quiet
+  uint64_t expire = (uint64_t)config_.udp_timeout_ms * 1000000ull;
+  for (size_t i = 0; i < udp_peers_.size();) {
+    if (now > udp_peers_[i].last_heard_ns + expire) {
+      udp_peers_[i] = udp_peers_.back();
+      udp_peers_.pop_back();
+    } else {
+      i++;
+    }
+  }
+  if (udp_peers_.size() >= config_.max_clients) return nullptr;
+  udp_peers_.emplace_back();
+  udp_peers_.back().addr = addr;
+  if (config_.verbose) {
+    printf("[Bridge] UDP client %s:%d\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+  }
+  return &udp_peers_.back();
+}
+
+void Bridge::on_udp_command(const struct sockaddr_in& from, const uint8_t* data, size_t n) {
+  udp::Header hd;
+  if (n < sizeof(hd)) {
+    stats_.udp_rejected++;
+    return;
+  }
+  memcpy(&hd, data, sizeof(hd));
+  if (hd.magic != udp::kMagic || hd.type != udp::kCommand) {
+    stats_.udp_rejected++;
+    return;
+  }
+
+  // The payload must be exactly one whole, CRC-valid frame
+  const uint8_t* payload = data + sizeof(hd);
+  size_t payload_len = n - sizeof(hd);
+  ucp::FrameView frame = {nullptr, 0};
+  udp_decoder_.reset();
+  udp_decoder_.feed(payload, payload_len, [&](const ucp::FrameView& f) {
+    if (!frame.frame) frame = f;
+  });
+  uint64_t now = client_rx_ns_;
+  UdpPeer* peer = nullptr;
+  uint8_t status = udp::kRejected;
+  if (frame.frame && frame.frame == payload && frame.frame_len == payload_len) {
+    peer = udp_peer(from, now);
+  }
+  if (peer) {
+    peer->last_heard_ns = now;
+    bool setpoint = classify_command(frame.id()) == CommandClass::kSetpoint;
+    if (!peer->window.accept(hd.seq)) {
+      status = udp::kDuplicate;
+      stats_.udp_duplicates++;
+    } else if (setpoint && peer->have_setpoint && !udp::seq_after(hd.seq, peer->last_setpoint)) {
+      status = udp::kStale;
+      stats_.udp_stale++;
+    } else {
+      if (setpoint) {
+        peer->have_setpoint = true;
+        peer->last_setpoint = hd.seq;
+      }
+      switch (on_command(frame, kEveryoneTag, Priority::kTeleop)) {
+        case CommandResult::kQueued:
+          status = udp::kAccepted;
+          stats_.udp_commands++;
+          break;
+        case CommandResult::kPreempted:
+          status = udp::kPreempted;
+          break;
+        case CommandResult::kDropped:
+          status = udp::kRejected;
+          break;
+      }
+    }
+  } else {
+    stats_.udp_rejected++;
+  }
+
+  // Ack everything that looked like ours, so the client can measure RTT and
+  // see what happened to each command
+  hd.type = udp::kAck;
+  hd.status = status;
+  sendto(udp_fd_, &hd, sizeof(hd), MSG_DONTWAIT, (const struct sockaddr*)&from, sizeof(from));
+}
+
+Bridge::CommandResult Bridge::on_command(const ucp::FrameView& received, uint64_t tag, Priority priority) {
+  if (classify_command(received.id()) == CommandClass::kSetpoint && !arbiter_.offer(priority, client_rx_ns_)) {
+    stats_.command_preempted++;
+    return CommandResult::kPreempted;
+  }
+  if (received.id() == UCP_BAUD_SET) {
+    // The MCU would switch and leave the bridge talking at the old rate
+    refuse_baud_set(received, tag);
+    stats_.command_dropped++;
+    return CommandResult::kDropped;
+  }
+  // Without the scheduler there is nowhere to hold commands during a rate
+  // change; they'd arrive garbled, so drop them. Decide before a request
+  // takes an index of the bridge, so drops don't show up as expired.
+  bool room = config_.coalesce_commands ? commands_.has_room(received.id())
+                                        : !(baud_ && baud_->holding()) && uart_out_.fits(received.frame_len);
+  if (!room) {
+    stats_.command_dropped++;
+    return CommandResult::kDropped;
+  }
+
+  ucp::FrameView frame = received;
+  uint8_t request[ucp::kMaxFrameLen];
+  if (expects_answer(received.id())) {
+    memcpy(request, received.frame, received.frame_len);
+    reindex_frame(request, received.frame_len,
+                  mux_.claim(received.id(), received.index(), tag, client_rx_ns_));
+    frame = {request, received.frame_len};
+  }
+  if (config_.coalesce_commands) {
+    uint64_t coalesced = commands_.stats().coalesced;
+    commands_.push(frame, client_rx_ns_);
+    stats_.command_coalesced += commands_.stats().coalesced - coalesced;
+  } else {
+    uart_out_.push(frame.frame, frame.frame_len);
+    uart_queued_bytes_ += frame.frame_len;
+    uart_pending_.push_back({uart_queued_bytes_, client_rx_ns_});
+    record(ucp_log::kToRobot, frame.frame, frame.frame_len, monotonic_ns());
+  }
+  stats_.command_frames++;
+  return CommandResult::kQueued;
+}
+
+// Answer a client's UCP_BAUD_SET as the MCU answers a rate it doesn't
+// support, so the client doesn't wait out its timeout. The bridge owns the
+// rate (see baud_negotiator.hpp). A UDP client has its kRejected ack.
+void Bridge::refuse_baud_set(const ucp::FrameView& request, uint64_t tag) {
+  const ucp_baud_set_t* set = request.as<ucp_baud_set_t>();
+  if (!set || tag == kEveryoneTag) return;
+  ucp::Frame<ucp_baud_set_ack_t> ack;
+  memset(&ack, 0, sizeof(ack));
+  ack.msg.hd.len = sizeof(ucp_baud_set_ack_t);
+  ack.msg.hd.id = UCP_BAUD_SET;
+  ack.msg.hd.index = request.index();
+  ack.msg.baud = set->baud;
+  ack.msg.err = UCP_ERR_UNKNOWN;
+  ucp::seal_raw(reinterpret_cast<uint8_t*>(&ack), sizeof(ack));
+  for (auto& it : clients_) {
+    Client& client = *it.second;
+    if (client.tag == tag && client.out.push(ack.data(), ack.size())) {
+      client.queued_bytes += ack.size();
+      client.pending.push_back({client.queued_bytes, client_rx_ns_});
+    }
+  }
+}
+
+void Bridge::flush_client(Client& client) {
+  size_t before = client.out.size();
+  if (!client.out.flush(client.fd)) {
+    close_client(client.fd);
+    return;
+  }
+  size_t sent = before - client.out.size();
+  stats_.client_tx_bytes += sent;
+  client.sent_bytes += sent;
+  if (!client.pending.empty() && client.pending.front().end <= client.sent_bytes) {
+    uint64_t now = monotonic_ns();
+    while (!client.pending.empty() && client.pending.front().end <= client.sent_bytes) {
+      latency_.telemetry.record(now - client.pending.front().rx_ns);
+      client.pending.pop_front();
+    }
+  }
+  bool want_out = !client.out.empty();
+  if (want_out != client.want_out) {
+    watch(client.fd, EPOLLIN | EPOLLRDHUP | (want_out ? (uint32_t)EPOLLOUT : 0u), true);
+    client.want_out = want_out;
+  }
+}
+
+// Bytes handed to the UART that haven't left the wire yet: the larger of
+// the baud-rate model and what the driver still holds.
+size_t Bridge::uart_backlog(uint64_t now) const {
+  size_t modelled = wire_busy_until_ > now ? (wire_busy_until_ - now + byte_ns_ - 1) / byte_ns_ : 0;
+  int outq = 0;
+  if (ioctl(uart_fd_, TIOCOUTQ, &outq) < 0) outq = 0;
+  return (size_t)outq > modelled ? outq : modelled;
+}
+
+// Move the next scheduled command into uart_out_ if the wire has room.
+// Otherwise arm the timer for when it will, and return false.
+bool Bridge::release_command() {
+  if (baud_ && baud_->holding()) return false;
+  const FrameSlot* next = commands_.peek();
+  if (!next) return false;
+
+  uint64_t now = monotonic_ns();
+  size_t backlog = uart_backlog(now);
+  if (backlog > 0 && backlog + next->len > config_.uart_inflight) {
+    uint64_t wait = (backlog + next->len - config_.uart_inflight) * byte_ns_;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = wait / 1000000000ull;
+    its.it_value.tv_nsec = wait % 1000000000ull;
+    timerfd_settime(timer_fd_, 0, &its, NULL);
+    return false;
+  }
+
+  uart_out_.push(next->data, next->len);
+  uart_queued_bytes_ += next->len;
+  uart_pending_.push_back({uart_queued_bytes_, next->rx_ns});
+  record(ucp_log::kToRobot, next->data, next->len, now);
+  wire_busy_until_ = (wire_busy_until_ > now ? wire_busy_until_ : now) + next->len * byte_ns_;
+  commands_.pop();
+  return true;
+}
+
+// The negotiator's frames skip the scheduler, which is holding commands.
+// They take an index of the mux too, so no client's answer is mistaken for
+// theirs.
+void Bridge::send_frame(const uint8_t* data, size_t len) {
+  uint64_t now = monotonic_ns();
+  uint8_t frame[ucp::kMaxFrameLen];
+  if (len > sizeof(frame)) return;
+  memcpy(frame, data, len);
+  ucp::FrameView view = {frame, len};
+  reindex_frame(frame, len, mux_.claim(view.id(), view.index(), kEveryoneTag, now));
+  if (!uart_out_.push(frame, len)) return;
+  uart_queued_bytes_ += len;
+  record(ucp_log::kToRobot, frame, len, now);
+  wire_busy_until_ = (wire_busy_until_ > now ? wire_busy_until_ : now) + len * byte_ns_;
+  flush_uart();
+}
+
+bool Bridge::set_baud(unsigned baud) {
+  if (!set_serial_baud(uart_fd_, baud)) return false;
+  uart_baud_ = baud;
+  byte_ns_ = 10ull * 1000000000ull / baud;
+  wire_busy_until_ = 0;  // tcdrain emptied the wire
+  if (config_.verbose) printf("[Bridge] UART now at %u baud.\n", baud);
+  return true;
+}
+
+bool Bridge::flush_uart() {
+  for (;;) {
+    size_t before = uart_out_.size();
+    if (!uart_out_.flush(uart_fd_)) {
+      perror("write serial");
+      return false;
+    }
+    stats_.uart_tx_bytes += before - uart_out_.size();
+    if (!uart_pending_.empty() && uart_pending_.front().end <= stats_.uart_tx_bytes) {
+      uint64_t now = monotonic_ns();
+      while (!uart_pending_.empty() && uart_pending_.front().end <= stats_.uart_tx_bytes) {
+        latency_.command.record(now - uart_pending_.front().rx_ns);
+        uart_pending_.pop_front();
+      }
+    }
+    if (!uart_out_.empty() || !config_.coalesce_commands || !release_command()) break;
+  }
+  bool want_out = !uart_out_.empty();
+  if (want_out != uart_want_out_) {
+    watch(uart_fd_, EPOLLIN | (want_out ? (uint32_t)EPOLLOUT : 0u), true);
+    uart_want_out_ = want_out;
+    // A stall lasts from the first byte the driver refused until it drained
+    if (want_out) {
+      stats_.uart_write_stalls++;
+      uart_stall_start_ = monotonic_ns();
+    } else {
+      latency_.uart_stall.record(monotonic_ns() - uart_stall_start_);
+    }
+  }
+  return true;
+}
+
+void Bridge::accept_metrics() {
+  for (;;) {
+    int fd = accept4(metrics_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+      return;
+    }
+    if (metrics_conns_.size() >= kMaxMetricsConns) {
+      close(fd);
+      continue;
+    }
+    watch(fd, EPOLLIN | EPOLLRDHUP, false);
+    metrics_conns_[fd];
+  }
+}
+
+void Bridge::close_metrics(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+  metrics_conns_.erase(fd);
+}
+
+// Read the request until its blank line, answer with the current metrics
+// whatever was asked for, and close
+void Bridge::serve_metrics(int fd, uint32_t events) {
+  MetricsConn& conn = metrics_conns_[fd];
+  if (conn.response.empty()) {
+    char buf[1024];
+    bool eof = false;
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      if (n == 0) {
+        eof = true;  // A client may shut down its side after the request
+        break;
+      }
+      if (n < 0 || conn.request.size() + n > kMaxMetricsRequest) {
+        close_metrics(fd);
+        return;
+      }
+      conn.request.append(buf, n);
+    }
+    if (conn.request.find("\r\n\r\n") == std::string::npos &&
+        conn.request.find("\n\n") == std::string::npos) {
+      if (eof) close_metrics(fd);
+      return;
+    }
+
+    std::string body;
+    body.reserve(16 * 1024);
+    stats_.metrics_scrapes++;
+    render_metrics(body);
+    char head[160];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                     body.size());
+    conn.response.assign(head, n);
+    conn.response += body;
+  } else if (!(events & EPOLLOUT)) {
+    return;
+  }
+
+  while (conn.sent < conn.response.size()) {
+    ssize_t w = send(fd, conn.response.data() + conn.sent, conn.response.size() - conn.sent,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        watch(fd, EPOLLOUT, true);
+        return;
+      }
+      break;
+    }
+    conn.sent += w;
+  }
+  close_metrics(fd);
+}
+
+void Bridge::render_metrics(std::string& out) const {
+  MetricsWriter m(out);
+  m.counter("bridge_uart_rx_bytes_total", "Bytes read from the UART.", stats_.uart_rx_bytes);
+  m.counter("bridge_uart_tx_bytes_total", "Bytes written to the UART.", stats_.uart_tx_bytes);
+  m.counter("bridge_client_rx_bytes_total", "Bytes read from TCP and UDP clients.",
+            stats_.client_rx_bytes);
+  m.counter("bridge_client_tx_bytes_total", "Bytes written to TCP and UDP clients.",
+            stats_.client_tx_bytes);
+  m.counter("bridge_telemetry_frames_total", "Frames decoded from the UART.", stats_.telemetry_frames);
+  m.counter("bridge_telemetry_sent_total", "Telemetry frame copies queued to clients.",
+            stats_.telemetry_sent);
+  m.counter("bridge_telemetry_dropped_total", "Telemetry frame copies dropped on a full client queue.",
+            stats_.telemetry_dropped);
+  m.counter("bridge_command_frames_total", "Command frames accepted from clients.",
+            stats_.command_frames);
+  m.counter("bridge_command_dropped_total", "Commands dropped on a full UART queue.",
+            stats_.command_dropped);
+  m.counter("bridge_command_coalesced_total", "Motor setpoints replaced before reaching the UART.",
+            stats_.command_coalesced);
+  m.counter("bridge_command_preempted_total", "Motor setpoints overridden by a higher priority.",
+            stats_.command_preempted);
+  m.counter("bridge_setpoint_handovers_total", "Times another priority took over the motors.",
+            arbiter_.stats().handovers);
+  m.counter("bridge_answers_routed_total", "MCU answers sent to the requesting client only.",
+            mux_.stats().routed);
+  m.counter("bridge_requests_expired_total", "Requests the MCU never answered.", mux_.stats().expired);
+  m.counter("bridge_uart_write_stalls_total", "Times the UART refused bytes with some still queued.",
+            stats_.uart_write_stalls);
+  m.gauge("bridge_uart_baud", "Current UART rate.", uart_baud_);
+  BaudStats baud = baud_stats();
+  m.counter("bridge_uart_baud_switches_total", "UART rate changes confirmed by the MCU.", baud.switches);
+  m.counter("bridge_uart_baud_fallbacks_total", "Returns to 115200 after a failed or dead rate change.",
+            baud.fallbacks);
+
+  // Decoder health per link
+  ucp::DecoderStats links[3] = {uart_decoder_.stats(), tcp_decoder_stats(), udp_decoder_.stats()};
+  static const char* const kLinks[3] = {"link=\"uart\"", "link=\"tcp\"", "link=\"udp\""};
+  m.header("bridge_crc_errors_total", "counter", "Well-formed frames whose CRC failed.");
+  for (int i = 0; i < 3; i++) m.sample("bridge_crc_errors_total", links[i].crc_errors, kLinks[i]);
+  m.header("bridge_resyncs_total", "counter", "Times a decoder skipped bytes to find a frame.");
+  for (int i = 0; i < 3; i++) m.sample("bridge_resyncs_total", links[i].resyncs, kLinks[i]);
+  m.header("bridge_discarded_bytes_total", "counter", "Bytes skipped while resynchronizing.");
+  for (int i = 0; i < 3; i++) m.sample("bridge_discarded_bytes_total", links[i].discarded, kLinks[i]);
+
+  m.header("bridge_clients", "gauge", "Connected clients.");
+  size_t local = 0;
+  for (auto& it : clients_) local += it.second->local;
+  m.sample("bridge_clients", clients_.size() - local, "transport=\"tcp\"");
+  m.sample("bridge_clients", local, "transport=\"unix\"");
+  m.sample("bridge_clients", udp_peers_.size(), "transport=\"udp\"");
+  m.counter("bridge_clients_accepted_total", "TCP and Unix connections accepted.", stats_.clients_accepted);
+  m.counter("bridge_clients_rejected_total", "TCP and Unix connections refused at the client limit.",
+            stats_.clients_rejected);
+  if (udp_fd_ >= 0) {
+    m.counter("bridge_udp_commands_total", "UDP commands forwarded.", stats_.udp_commands);
+    m.counter("bridge_udp_stale_total", "UDP setpoints older than one already forwarded.",
+              stats_.udp_stale);
+    m.counter("bridge_udp_duplicates_total", "UDP commands seen before.", stats_.udp_duplicates);
+    m.counter("bridge_udp_rejected_total", "Malformed UDP datagrams.", stats_.udp_rejected);
+  }
+  if (recorder_) {
+    ucp_log::RecorderStats r = recorder_->stats();
+    m.counter("bridge_recorder_records_total", "Frames recorded.", r.records);
+    m.counter("bridge_recorder_dropped_total", "Frames not recorded for lack of buffers.", r.dropped);
+    m.counter("bridge_recorder_write_errors_total", "Failed log writes.", r.write_errors);
+  }
+  m.counter("bridge_metrics_scrapes_total", "Requests to this endpoint.", stats_.metrics_scrapes);
+
+  m.histogram("bridge_command_latency_seconds",
+              "From reading a command off a client socket to writing its last byte to the UART.",
+              latency_.command);
+  m.histogram("bridge_telemetry_latency_seconds",
+              "From reading a frame off the UART to writing its last byte to a client socket.",
+              latency_.telemetry);
+  m.histogram("bridge_uart_stall_seconds", "How long the UART refused writes.", latency_.uart_stall);
+}
+
+}  // namespace bridge
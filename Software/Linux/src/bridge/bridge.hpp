@@ -0,0 +1,290 @@
+// -----------------------------------------------------------------------------
+// UART <-> TCP bridge
+//
+// One non-blocking epoll loop owns the UART, the listening socket and every
+// client. UART bytes are read as soon as they arrive, whether or not any
+// client is talking, decoded into UCP frames and fanned out to all connected
+// clients. Client bytes are decoded too, and only whole, CRC-valid command
+// frames are queued for the UART, so commands from several clients are
+// interleaved frame by frame and never byte by byte.
+//
+// Commands go through a CommandQueue (control first, newest motor setpoint
+// next, bulk last) and are released to the UART only while the bytes still
+// in flight, as modelled from the baud rate and reported by TIOCOUTQ, stay
+// under uart_inflight. Stale setpoints are replaced in the bridge instead of
+// queueing in the kernel TTY buffer.
+//
+// Each client has a bounded send queue; a client that stops reading loses
+// telemetry frames (counted in Stats) instead of stalling the loop.
+//
+// Every telemetry frame is also published, timestamped, on the shared-memory
+// telemetry bus so other local processes can read it (see telemetry_bus.h).
+//
+// With udp set, commands are also accepted as datagrams on udp_port (see
+// udp_control.hpp), acked, and telemetry is streamed back to every UDP
+// client heard from in the last udp_timeout_ms.
+//
+// With record_dir set, every frame from the UART and every command handed
+// to it is appended to a segmented traffic log (see recorder.hpp). The loop
+// only copies frames into memory; a background thread does the disk writes.
+//
+// With negotiate_baud set, the bridge proposes that UART rate to the MCU
+// right after open (see baud_negotiator.hpp). Client commands wait while the
+// rates may differ, about settle_ms plus a round trip when it works, and the
+// UART falls back to 115200 if keep-alives stop coming back.
+//
+// With unix_dir set, local programs connect to Unix-domain sockets in that
+// directory instead of opening the UART themselves: `safety`, `teleop` and
+// `autonomy`, one per priority. File permissions decide who may use which.
+// Motor setpoints from all clients go through a SetpointArbiter (see
+// setpoint_arbiter.hpp): a priority holding a lease preempts the ones below
+// it; TCP and UDP clients count as teleop. Requests that expect an answer get
+// an index of the bridge (see request_mux.hpp), so each answer goes back to
+// the client that asked, with its own index.
+//
+// With metrics set, counters and latency histograms are served as Prometheus
+// text on metrics_port (GET anything). The endpoint is served by the same
+// loop that updates them, so they are plain integers with no locking and a
+// scrape never sees a half-updated histogram.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_BRIDGE_HPP
+#define BRIDGE_BRIDGE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <netinet/in.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "baud_negotiator.hpp"
+#include "command_queue.hpp"
+#include "histogram.hpp"
+#include "recorder.hpp"
+#include "request_mux.hpp"
+#include "setpoint_arbiter.hpp"
+#include "telemetry_bus.h"
+#include "tx_queue.hpp"
+#include "ucp_decoder.hpp"
+#include "udp_control.hpp"
+
+namespace bridge {
+
+struct Config {
+  const char* serial = "/dev/ttyS0";     // UART device, or the slave side of a pty
+  uint16_t tcp_port = 8888;              // 0 picks a free port, see Bridge::port()
+  bool loopback_only = false;            // Bind 127.0.0.1 instead of all interfaces
+  size_t max_clients = 16;               // Further connections are closed on accept (TCP and Unix, UDP)
+  size_t client_queue = 64 * 1024;       // Telemetry backlog per client before frames drop
+  unsigned uart_baud = 115200;
+  unsigned negotiate_baud = 0;           // Propose this UART rate to the MCU after open, 0 to not
+  bool coalesce_commands = true;         // false: plain FIFO into the TTY, no pacing
+  size_t uart_inflight = 32;             // Bytes allowed between us and the wire (coalescing)
+  size_t uart_queue = 2 * 1024;          // FIFO command backlog when not coalescing
+  const char* telemetry_bus = TELEMETRY_BUS_NAME;  // shm name, NULL to not publish
+  const char* record_dir = nullptr;      // Traffic log directory, NULL to not record
+  bool udp = false;                      // Also serve the UDP control port
+  uint16_t udp_port = 8889;              // 0 picks a free port, see Bridge::udp_port()
+  unsigned udp_timeout_ms = 3000;        // Stop streaming to a UDP client this long after it went quiet
+  const char* unix_dir = nullptr;        // Serve Unix sockets safety, teleop, autonomy here, NULL to not
+  unsigned lease_ms = SetpointArbiter::kDefaultLeaseMs;  // Setpoint lease of a priority
+  bool metrics = false;                  // Serve Prometheus metrics over HTTP
+  uint16_t metrics_port = 9100;          // 0 picks a free port, see Bridge::metrics_port()
+  bool verbose = true;                   // Log connects and disconnects
+};
+
+struct Stats {
+  uint64_t uart_rx_bytes = 0;
+  uint64_t uart_tx_bytes = 0;
+  uint64_t uart_write_stalls = 0;        // Times the UART stopped taking bytes with some still queued
+  uint64_t client_rx_bytes = 0;          // Read from TCP and UDP clients
+  uint64_t client_tx_bytes = 0;          // Written to TCP and UDP clients
+  uint64_t telemetry_frames = 0;         // Frames decoded from the UART
+  uint64_t telemetry_sent = 0;           // Frame copies queued to clients
+  uint64_t telemetry_dropped = 0;        // Frame copies dropped on a full client queue
+  uint64_t command_frames = 0;           // Frames accepted from clients
+  uint64_t command_dropped = 0;          // Commands dropped on a full UART queue
+  uint64_t command_coalesced = 0;        // Motor setpoints replaced before reaching the UART
+  uint64_t command_preempted = 0;        // Motor setpoints overridden by a higher priority
+  uint64_t clients_accepted = 0;
+  uint64_t clients_rejected = 0;
+  uint64_t udp_commands = 0;             // Datagrams queued for the UART (also counted in command_frames)
+  uint64_t udp_stale = 0;                // Setpoints older than one already forwarded
+  uint64_t udp_duplicates = 0;
+  uint64_t udp_rejected = 0;             // Malformed, or from a new client with the table full
+  uint64_t metrics_scrapes = 0;
+};
+
+// Latency histograms, in nanoseconds
+struct Latency {
+  Histogram command;                     // Client bytes read -> last byte of the frame written to the UART
+  Histogram telemetry;                   // UART bytes read -> last byte of the frame written to a client
+  Histogram uart_stall;                  // UART write stall, from the first refused byte until drained
+};
+
+class Bridge : private BaudLink {
+ public:
+  explicit Bridge(const Config& config);
+  ~Bridge();
+
+  Bridge(const Bridge&) = delete;
+  Bridge& operator=(const Bridge&) = delete;
+
+  // Open the UART, the listening socket and the epoll set. Returns false with
+  // the reason printed.
+  bool open();
+
+  // Serve until stop(). Returns false if the UART fails.
+  bool run();
+
+  // Ask run() to return. Safe from a signal handler or another thread.
+  void stop();
+
+  uint16_t port() const { return port_; }
+  uint16_t udp_port() const { return udp_port_; }
+  uint16_t metrics_port() const { return metrics_port_; }
+  unsigned uart_baud() const { return uart_baud_; }
+  BaudState baud_state() const { return baud_ ? baud_->state() : BaudState::kIdle; }
+  BaudStats baud_stats() const { return baud_ ? baud_->stats() : BaudStats(); }
+  size_t clients() const { return clients_.size(); }
+  const ArbiterStats& arbiter_stats() const { return arbiter_.stats(); }
+  const MuxStats& mux_stats() const { return mux_.stats(); }
+  // The socket clients of priority `p` connect to; empty without unix_dir
+  const std::string& unix_path(Priority p) const { return unix_paths_[(size_t)p]; }
+  const Stats& stats() const { return stats_; }
+  const Latency& latency() const { return latency_; }
+  const ucp::DecoderStats& uart_decoder_stats() const { return uart_decoder_.stats(); }
+  // Decoder totals over every TCP client, past and present
+  ucp::DecoderStats tcp_decoder_stats() const;
+  // Zeroes when not recording
+  ucp_log::RecorderStats recorder_stats() const {
+    return recorder_ ? recorder_->stats() : ucp_log::RecorderStats();
+  }
+
+  // Append the Prometheus text for everything above. Call from the loop
+  // thread, or after run() returned.
+  void render_metrics(std::string& out) const;
+
+ private:
+  // A frame in a byte queue: where it ends in the queue's running byte
+  // count, and when it entered the bridge
+  struct Pending {
+    uint64_t end;
+    uint64_t rx_ns;
+  };
+
+  struct Client {
+    Client(int fd, size_t queue, uint64_t tag, Priority priority, bool local)
+        : fd(fd), tag(tag), priority(priority), local(local), out(queue, true) {}
+    int fd;
+    uint64_t tag;                        // Names the client to the RequestMux, never reused
+    Priority priority;
+    bool local;                          // Connected over a Unix socket
+
+    ucp::Decoder decoder;
+    TxQueue out;
+    bool want_out = false;               // EPOLLOUT armed
+    uint64_t queued_bytes = 0;           // Pushed to `out` since connect
+    uint64_t sent_bytes = 0;             // Written to the socket since connect
+    std::deque<Pending> pending;         // Frames in `out`, for telemetry latency
+    char name[32];
+  };
+
+  // An HTTP connection to the metrics endpoint
+  struct MetricsConn {
+    std::string request;
+    std::string response;
+    size_t sent = 0;
+  };
+
+  // A UDP client, identified by its address
+  struct UdpPeer {
+    struct sockaddr_in addr;
+    uint64_t last_heard_ns = 0;
+    udp::SequenceWindow window;
+    bool have_setpoint = false;
+    uint32_t last_setpoint = 0;          // Sequence number of the newest setpoint forwarded
+    uint32_t tx_seq = 0;                 // Telemetry datagrams sent
+  };
+
+  bool setup_server();
+  bool setup_unix();
+  bool setup_udp();
+  bool setup_metrics();
+  void accept_metrics();
+  void serve_metrics(int fd, uint32_t events);
+  void close_metrics(int fd);
+  void read_udp();
+  void on_udp_command(const struct sockaddr_in& from, const uint8_t* data, size_t n);
+  UdpPeer* udp_peer(const struct sockaddr_in& addr, uint64_t now);
+  void accept_clients(int listen_fd, Priority priority, bool local);
+  bool read_uart();
+  void read_client(Client& client);
+  void close_client(int fd);
+  void on_telemetry(const ucp::FrameView& frame);
+  void queue_telemetry(Client& client, const ucp::FrameView& frame);
+  // What became of a client's command
+  enum class CommandResult { kQueued, kDropped, kPreempted };
+  CommandResult on_command(const ucp::FrameView& frame, uint64_t tag, Priority priority);
+  void refuse_baud_set(const ucp::FrameView& request, uint64_t tag);
+  void flush_client(Client& client);
+  bool flush_uart();
+  bool release_command();
+  size_t uart_backlog(uint64_t now) const;
+  void watch(int fd, uint32_t events, bool modify);
+  int loop_timeout_ms() const;
+  // BaudLink
+  void send_frame(const uint8_t* frame, size_t len) override;
+  bool set_baud(unsigned baud) override;
+  void record(ucp_log::Direction direction, const uint8_t* frame, size_t len, uint64_t ns) {
+    if (recorder_) recorder_->record(ns, direction, frame, len);
+  }
+
+  Config config_;
+  int epoll_fd_ = -1;
+  int uart_fd_ = -1;
+  int server_fd_ = -1;
+  int wake_fd_ = -1;
+  int timer_fd_ = -1;                    // Wakes the loop when the UART has room again
+  int udp_fd_ = -1;
+  int metrics_fd_ = -1;
+  int unix_fds_[kPriorities] = {-1, -1, -1};
+  std::string unix_paths_[kPriorities];
+  uint16_t port_ = 0;
+  uint16_t udp_port_ = 0;
+  uint16_t metrics_port_ = 0;
+
+  ucp::Decoder uart_decoder_;
+  uint64_t uart_rx_ns_ = 0;              // When the bytes being decoded were read
+  telemetry_bus_t* bus_ = nullptr;
+  std::unique_ptr<ucp_log::Recorder> recorder_;
+  TxQueue uart_out_;
+  bool uart_want_out_ = false;
+  uint64_t uart_queued_bytes_ = 0;       // Pushed to uart_out_ since open
+  std::deque<Pending> uart_pending_;     // Client frames in uart_out_, for command latency
+  uint64_t uart_stall_start_ = 0;
+  uint64_t client_rx_ns_ = 0;            // When the client bytes being decoded were read
+  CommandQueue commands_;
+  unsigned uart_baud_ = 0;
+  uint64_t byte_ns_ = 0;                 // Wire time of one byte (10 bits, 8N1)
+  std::unique_ptr<BaudNegotiator> baud_;
+  uint64_t wire_busy_until_ = 0;         // Modelled end of the last byte handed to the UART
+  std::unordered_map<int, std::unique_ptr<Client>> clients_;
+  uint64_t next_tag_;
+  SetpointArbiter arbiter_;
+  RequestMux mux_;
+  std::vector<UdpPeer> udp_peers_;
+  ucp::Decoder udp_decoder_;
+  ucp::DecoderStats closed_decoders_;    // Sum over disconnected TCP clients
+  std::unordered_map<int, MetricsConn> metrics_conns_;
+  Stats stats_;
+  Latency latency_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_BRIDGE_HPP
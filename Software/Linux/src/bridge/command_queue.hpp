@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------------------
+// Frame scheduler for the UART transmit side of the bridge
+//
+// Commands are sorted into three classes and drained in this order:
+//   control  : keepalive, clock sync, IMU/magnetometer calibration, OTA
+//   setpoint : UCP_MOTOR_CTL; only the newest one is kept, an older setpoint
+//              still waiting for the wire is replaced (latest setpoint wins)
+//   bulk     : everything else
+// Control and bulk frames are FIFO within their class. All storage is fixed;
+// when a class is full the new frame is dropped and counted.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_COMMAND_QUEUE_HPP
+#define BRIDGE_COMMAND_QUEUE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp_decoder.hpp"
+
+namespace bridge {
+
+enum class CommandClass { kControl, kSetpoint, kBulk };
+
+inline CommandClass classify_command(uint8_t id) {
+  switch (id) {
+    case UCP_MOTOR_CTL:
+      return CommandClass::kSetpoint;
+    case UCP_KEEP_ALIVE:
+    case UCP_TIME_SYNC:
+    case UCP_SUBSCRIBE:
+    case UCP_REPORT_DELTA:
+    case UCP_HELLO:
+    case UCP_IMU_CORRECTION_START:
+    case UCP_IMU_CORRECTION_END:
+    case UCP_IMU_WRITE:
+    case UCP_MAG_WRITE:
+    case UCP_IMUMAG_READ:
+    case UCP_OTA:
+      return CommandClass::kControl;
+    default:
+      return CommandClass::kBulk;
+  }
+}
+
+struct CommandStats {
+  uint64_t queued = 0;       // Frames accepted
+  uint64_t coalesced = 0;    // Setpoints replaced by a newer one before reaching the wire
+  uint64_t dropped = 0;      // Control/bulk frames dropped on a full class queue
+};
+
+// One stored frame
+struct FrameSlot {
+  uint16_t len = 0;
+  uint64_t rx_ns = 0;        // When the frame was read from its client
+  uint8_t data[ucp::kMaxFrameLen];
+
+  void assign(const ucp::FrameView& frame, uint64_t received_ns) {
+    len = frame.frame_len;
+    rx_ns = received_ns;
+    memcpy(data, frame.frame, frame.frame_len);
+  }
+};
+
+// Fixed-capacity FIFO of frames
+template <size_t N>
+class FrameRing {
+ public:
+  bool push(const ucp::FrameView& frame, uint64_t rx_ns) {
+    if (count_ == N) return false;
+    slots_[(head_ + count_) % N].assign(frame, rx_ns);
+    count_++;
+    return true;
+  }
+  const FrameSlot& front() const { return slots_[head_]; }
+  void pop() {
+    head_ = (head_ + 1) % N;
+    count_--;
+  }
+  bool empty() const { return count_ == 0; }
+  bool full() const { return count_ == N; }
+  size_t size() const { return count_; }
+
+ private:
+  FrameSlot slots_[N];
+  size_t head_ = 0;
+  size_t count_ = 0;
+};
+
+class CommandQueue {
+ public:
+  static const size_t kControlDepth = 16;
+  static const size_t kBulkDepth = 16;
+
+  // Whether push() would take a frame with message `id` now
+  bool has_room(uint8_t id) const {
+    switch (classify_command(id)) {
+      case CommandClass::kControl:
+        return !control_.full();
+      case CommandClass::kBulk:
+        return !bulk_.full();
+      default:
+        return true;  // A setpoint replaces the waiting one
+    }
+  }
+
+  // Returns false if the frame was dropped. `rx_ns` travels with the frame
+  // to measure its time in the bridge.
+  bool push(const ucp::FrameView& frame, uint64_t rx_ns = 0) {
+    bool ok = true;
+    switch (classify_command(frame.id())) {
+      case CommandClass::kSetpoint:
+        if (has_setpoint_) stats_.coalesced++;
+        setpoint_.assign(frame, rx_ns);
+        has_setpoint_ = true;
+        break;
+      case CommandClass::kControl:
+        ok = control_.push(frame, rx_ns);
+        break;
+      case CommandClass::kBulk:
+        ok = bulk_.push(frame, rx_ns);
+        break;
+    }
+    if (ok) {
+      stats_.queued++;
+    } else {
+      stats_.dropped++;
+    }
+    return ok;
+  }
+
+  // The frame that goes on the wire next, or nullptr when idle
+  const FrameSlot* peek() const {
+    if (!control_.empty()) return &control_.front();
+    if (has_setpoint_) return &setpoint_;
+    if (!bulk_.empty()) return &bulk_.front();
+    return nullptr;
+  }
+
+  // Remove the frame peek() returned
+  void pop() {
+    if (!control_.empty()) {
+      control_.pop();
+    } else if (has_setpoint_) {
+      has_setpoint_ = false;
+    } else if (!bulk_.empty()) {
+      bulk_.pop();
+    }
+  }
+
+  bool empty() const { return peek() == nullptr; }
+  const CommandStats& stats() const { return stats_; }
+
+ private:
+  FrameRing<kControlDepth> control_;
+  FrameRing<kBulkDepth> bulk_;
+  FrameSlot setpoint_;
+  bool has_setpoint_ = false;
+  CommandStats stats_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_COMMAND_QUEUE_HPP
@@ -0,0 +1,98 @@
+// -----------------------------------------------------------------------------
+// Latency histogram with HDR-style log-linear buckets
+//
+// Values below 16 get a bucket each. Above that, every power of two is split
+// into 16 equal sub-buckets, so any recorded value is known to within 1/16
+// (6.25 %) from 1 ns up to 2^48 ns (78 hours). record() is a count leading
+// zeros, a shift and an increment: no allocation, no search, no locks. The
+// histogram has a single writer and is read by the same thread (the bridge
+// serves its metrics from its own loop).
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_HISTOGRAM_HPP
+#define BRIDGE_HISTOGRAM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace bridge {
+
+class Histogram {
+ public:
+  static const int kSubBits = 4;
+  static const uint64_t kSubBuckets = 1 << kSubBits;   // Per power of two
+  static const int kMaxBits = 48;                       // Larger values land in the last bucket
+  static const size_t kBuckets = kSubBuckets + (kMaxBits - kSubBits) * kSubBuckets;
+
+  Histogram() { reset(); }
+
+  void record(uint64_t value) {
+    counts_[index_of(value)]++;
+    count_++;
+    sum_ += value;
+    if (value > max_) max_ = value;
+  }
+
+  void reset() {
+    memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t max() const { return max_; }
+
+  // Upper end of the bucket holding the q-quantile (0..1), 0 when empty
+  uint64_t quantile(double q) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        uint64_t upper = upper_bound(i);
+        return upper < max_ ? upper : max_;
+      }
+    }
+    return max_;
+  }
+
+  uint64_t bucket(size_t i) const { return counts_[i]; }
+
+  // First bucket holding values >= 2^bits. Bucket edges line up with powers
+  // of two, so counts below 2^bits (the cumulative `le` buckets of a
+  // Prometheus histogram) are exact.
+  static size_t pow2_index(int bits) {
+    if (bits <= kSubBits) return (size_t)1 << bits;
+    if (bits >= kMaxBits) return kBuckets;
+    return kSubBuckets + (size_t)(bits - kSubBits) * kSubBuckets;
+  }
+
+  static size_t index_of(uint64_t value) {
+    if (value < kSubBuckets) return (size_t)value;
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= kMaxBits) return kBuckets - 1;
+    int shift = msb - kSubBits;
+    return kSubBuckets + (size_t)shift * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+  }
+
+  // Largest value that maps to bucket i
+  static uint64_t upper_bound(size_t i) {
+    if (i < kSubBuckets) return i;
+    size_t shift = (i - kSubBuckets) / kSubBuckets;
+    uint64_t sub = (i - kSubBuckets) % kSubBuckets;
+    return ((kSubBuckets + sub + 1) << shift) - 1;
+  }
+
+ private:
+  uint64_t counts_[kBuckets];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_HISTOGRAM_HPP
@@ -0,0 +1,82 @@
+// -----------------------------------------------------------------------------
+// Prometheus text exposition (format 0.0.4) for the bridge's counters
+//
+// Appends to a caller-owned string, so a scrape costs one render into a
+// reused buffer. Histograms are recorded in nanoseconds and exposed in
+// seconds with one `le` bucket per power of two from 1 us to 17 s.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_METRICS_HPP
+#define BRIDGE_METRICS_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "histogram.hpp"
+
+namespace bridge {
+
+class MetricsWriter {
+ public:
+  static const int kFirstBucketBits = 10;  // 1.024 us
+  static const int kLastBucketBits = 34;   // 17.2 s
+
+  explicit MetricsWriter(std::string& out) : out_(out) {}
+
+  // HELP and TYPE lines, once per metric name
+  void header(const char* name, const char* type, const char* help) {
+    append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  }
+
+  // One sample; `labels` is the inside of the braces, e.g. link="uart"
+  void sample(const char* name, uint64_t value, const char* labels = nullptr) {
+    if (labels) {
+      append("%s{%s} %llu\n", name, labels, (unsigned long long)value);
+    } else {
+      append("%s %llu\n", name, (unsigned long long)value);
+    }
+  }
+
+  void counter(const char* name, const char* help, uint64_t value) {
+    header(name, "counter", help);
+    sample(name, value);
+  }
+
+  void gauge(const char* name, const char* help, uint64_t value) {
+    header(name, "gauge", help);
+    sample(name, value);
+  }
+
+  // `h` holds nanoseconds
+  void histogram(const char* name, const char* help, const Histogram& h) {
+    header(name, "histogram", help);
+    uint64_t below = 0;
+    size_t i = 0;
+    for (int bits = kFirstBucketBits; bits <= kLastBucketBits; bits++) {
+      size_t end = Histogram::pow2_index(bits);
+      for (; i < end; i++) below += h.bucket(i);
+      // Bucket edges are exclusive (values < 2^bits), so the inclusive
+      // `le` bound is one nanosecond less
+      append("%s_bucket{le=\"%.9g\"} %llu\n", name, ((1ull << bits) - 1) / 1e9,
+             (unsigned long long)below);
+    }
+    append("%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h.count());
+    append("%s_sum %.9f\n", name, h.sum() / 1e9);
+    append("%s_count %llu\n", name, (unsigned long long)h.count());
+  }
+
+ private:
+  template <typename... Args>
+  void append(const char* fmt, Args... args) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), fmt, args...);
+    if (n > 0) out_.append(line, (size_t)n < sizeof(line) ? n : sizeof(line) - 1);
+  }
+
+  std::string& out_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_METRICS_HPP
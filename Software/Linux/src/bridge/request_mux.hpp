@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+// Request/answer multiplexing over the one UART
+//
+// The firmware answers a request with the request's hd.index. Clients pick
+// their indexes on their own, so two of them may use the same one at once.
+// The bridge therefore gives each request that expects an answer an index of
+// its own (never 0, which firmware older than the echo answers with), and
+// remembers whose request it was. The answer goes back to that client alone,
+// with the client's index restored, instead of to everyone; frames no request
+// claims (telemetry, the MCU's own requests) still go to every client.
+//
+// A retransmission (same client, ID and index, see ucp_reliable.h) gets the
+// index its first transmission got, so the firmware still recognizes it, and
+// repeated answers go to the requester too. Entries are forgotten timeout_ms
+// after the last transmission, or when the index comes round again 255
+// requests later.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_REQUEST_MUX_HPP
+#define BRIDGE_REQUEST_MUX_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ucp_decoder.hpp"
+
+namespace bridge {
+
+// Head requests the firmware answers with the same ID and hd.index
+inline bool expects_answer(uint8_t id) {
+  switch (id) {
+    case UCP_KEEP_ALIVE:
+    case UCP_IMU_CORRECTION_START:
+    case UCP_IMU_CORRECTION_END:
+    case UCP_OTA:
+    case UCP_TIME_SYNC:
+    case UCP_BAUD_SET:
+    case UCP_SUBSCRIBE:
+    case UCP_HELLO:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Put `index` into a whole frame and seal it again
+inline void reindex_frame(uint8_t* frame, size_t len, uint8_t index) {
+  frame[ucp::kSyncSize + 3] = index;
+  ucp::seal_raw(frame, len);
+}
+
+struct MuxStats {
+  uint64_t requests = 0;           // Requests given an index of the bridge
+  uint64_t routed = 0;             // Answers sent to their requester only
+  uint64_t expired = 0;            // Entries dropped unanswered
+};
+
+class RequestMux {
+ public:
+  static const unsigned kDefaultTimeoutMs = 2000;
+
+  explicit RequestMux(unsigned timeout_ms = kDefaultTimeoutMs) : timeout_ns_((uint64_t)timeout_ms * 1000000ull) {}
+
+  // A request for message `id` with the client's `index` from `owner` (any
+  // nonzero tag of the caller's). Returns the index to send it with.
+  uint8_t claim(uint8_t id, uint8_t index, uint64_t owner, uint64_t now) {
+    // A retransmission: the same requester, ID and index, still live. Clients
+    // pick indexes independently, so the index alone doesn't identify it.
+    for (unsigned i = 1; i < 256; i++) {
+      Entry& e = entries_[i];
+      if (e.owner == owner && e.id == id && e.index == index && now <= e.expires) {
+        e.expires = now + timeout_ns_;
+        return (uint8_t)i;
+      }
+    }
+    if (next_ == 0) next_ = 1;
+    uint8_t ours = next_++;
+    Entry* e = &entries_[ours];
+    if (e->owner && !e->answered && now <= e->expires) stats_.expired++;  // Unanswered for 255 requests
+    e->owner = owner;
+    e->expires = now + timeout_ns_;
+    e->id = id;
+    e->index = index;
+    e->answered = false;
+    stats_.requests++;
+    return ours;
+  }
+
+  // A frame from the MCU. If it answers a claimed request, returns true with
+  // the requester in *owner and its index in *index.
+  bool route(uint8_t id, uint8_t ours, uint64_t now, uint64_t* owner, uint8_t* index) {
+    Entry& e = entries_[ours];
+    if (!e.owner || e.id != id) return false;
+    if (now > e.expires) {
+      if (!e.answered) stats_.expired++;
+      e.owner = 0;
+      return false;
+    }
+    e.answered = true;
+    *owner = e.owner;
+    *index = e.index;
+    stats_.routed++;
+    return true;
+  }
+
+  // `owner` went away; answers to it go to everyone
+  void forget(uint64_t owner) {
+    for (Entry& e : entries_) {
+      if (e.owner == owner) e.owner = 0;
+    }
+  }
+
+  const MuxStats& stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    uint64_t owner = 0;            // 0 = free
+    uint64_t expires = 0;
+    uint8_t id = 0;
+    uint8_t index = 0;             // The requester's
+    bool answered = false;
+  };
+
+  uint64_t timeout_ns_;
+  Entry entries_[256];
+  uint8_t next_ = 1;
+  MuxStats stats_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_REQUEST_MUX_HPP
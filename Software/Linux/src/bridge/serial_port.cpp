@@ -0,0 +1,84 @@
+#include "serial_port.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace bridge {
+
+int open_serial(const char* device, speed_t baud) {
+  int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    perror("Open serial");
+    return -1;
+  }
+
+  struct termios tty;
+  memset(&tty, 0, sizeof tty);
+  if (tcgetattr(fd, &tty) != 0) {
+    perror("tcgetattr");
+    close(fd);
+    return -1;
+  }
+
+  cfsetospeed(&tty, baud);
+  cfsetispeed(&tty, baud);
+
+  tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;
+  tty.c_iflag = 0;
+  tty.c_lflag = 0;
+  tty.c_oflag = 0;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+
+  tty.c_cflag |= (CLOCAL | CREAD);
+  tty.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    perror("tcsetattr");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool baud_to_speed(unsigned baud, speed_t* speed) {
+  static const struct {
+    unsigned baud;
+    speed_t speed;
+  } table[] = {
+    {9600, B9600},     {19200, B19200},   {38400, B38400},     {57600, B57600},
+    {115200, B115200}, {230400, B230400}, {460800, B460800},   {921600, B921600},
+    {1000000, B1000000}, {1500000, B1500000}, {2000000, B2000000},
+  };
+  for (const auto& t : table) {
+    if (t.baud == baud) {
+      *speed = t.speed;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool set_serial_baud(int fd, unsigned baud) {
+  speed_t speed;
+  if (!baud_to_speed(baud, &speed)) {
+    fprintf(stderr, "[Serial] Unsupported baud rate %u\n", baud);
+    return false;
+  }
+  struct termios tty;
+  if (tcdrain(fd) != 0 || tcgetattr(fd, &tty) != 0) {
+    perror("tcdrain/tcgetattr");
+    return false;
+  }
+  cfsetospeed(&tty, speed);
+  cfsetispeed(&tty, speed);
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    perror("tcsetattr");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace bridge
@@ -0,0 +1,25 @@
+// -----------------------------------------------------------------------------
+// UART setup shared by the head-side daemons
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_SERIAL_PORT_HPP
+#define BRIDGE_SERIAL_PORT_HPP
+
+#include <termios.h>
+
+namespace bridge {
+
+// Open `device` raw 8N1 at `baud`, non-blocking. Works on real UARTs and on
+// the slave side of a pty. Returns the fd, or -1 with the reason printed.
+int open_serial(const char* device, speed_t baud = B115200);
+
+// Map a numeric baud rate (115200) to its termios constant (B115200).
+// Returns false for rates termios doesn't define.
+bool baud_to_speed(unsigned baud, speed_t* speed);
+
+// Wait until everything written to `fd` has left, then change its rate.
+// Returns false with the reason printed.
+bool set_serial_baud(int fd, unsigned baud);
+
+}  // namespace bridge
+
+#endif  // BRIDGE_SERIAL_PORT_HPP
@@ -0,0 +1,92 @@
+// -----------------------------------------------------------------------------
+// Motor setpoint arbitration between local clients of the bridge
+//
+// Every client has a priority, lowest first:
+//   autonomy : planners and other programs driving on their own
+//   teleop   : an operator (move, the web UI over TCP or UDP)
+//   safety   : a stop that overrides everything
+// A setpoint from a client renews its priority's lease for lease_ms and goes
+// to the MCU only while no higher priority holds a lease. A teleop client
+// that stops sending thus hands the robot back to autonomy lease_ms after its
+// last setpoint, and a safety client holds the robot for as long as it keeps
+// sending. Within one priority the newest setpoint wins, as before.
+//
+// Other commands are not arbitrated. offer() is a few compares; the bridge
+// calls it from its loop, so it needs no locking.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_SETPOINT_ARBITER_HPP
+#define BRIDGE_SETPOINT_ARBITER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace bridge {
+
+enum class Priority : uint8_t { kAutonomy, kTeleop, kSafety };
+
+constexpr size_t kPriorities = 3;
+
+inline const char* priority_name(Priority p) {
+  switch (p) {
+    case Priority::kAutonomy: return "autonomy";
+    case Priority::kTeleop: return "teleop";
+    case Priority::kSafety: return "safety";
+  }
+  return "?";
+}
+
+struct ArbiterStats {
+  uint64_t forwarded = 0;          // Setpoints passed to the MCU
+  uint64_t preempted = 0;          // Dropped: a higher priority held a lease
+  uint64_t handovers = 0;          // Times the forwarded priority changed
+};
+
+class SetpointArbiter {
+ public:
+  static const unsigned kDefaultLeaseMs = 500;
+
+  explicit SetpointArbiter(unsigned lease_ms = kDefaultLeaseMs) : lease_ns_((uint64_t)lease_ms * 1000000ull) {}
+
+  // A setpoint from a client at priority `p` arrived at `now` (ns). Returns
+  // true if it goes to the MCU.
+  bool offer(Priority p, uint64_t now) {
+    size_t level = (size_t)p;
+    expires_[level] = now + lease_ns_;
+    for (size_t q = level + 1; q < kPriorities; q++) {
+      if (expires_[q] > now) {
+        stats_.preempted++;
+        return false;
+      }
+    }
+    if (have_owner_ && owner_ != p) stats_.handovers++;
+    owner_ = p;
+    have_owner_ = true;
+    stats_.forwarded++;
+    return true;
+  }
+
+  // The priority whose setpoints reach the MCU at `now`; false when no
+  // lease is held
+  bool owner(uint64_t now, Priority* out) const {
+    for (size_t q = kPriorities; q-- > 0;) {
+      if (expires_[q] > now) {
+        *out = (Priority)q;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const ArbiterStats& stats() const { return stats_; }
+
+ private:
+  uint64_t lease_ns_;
+  uint64_t expires_[kPriorities] = {};
+  Priority owner_ = Priority::kAutonomy;
+  bool have_owner_ = false;
+  ArbiterStats stats_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_SETPOINT_ARBITER_HPP
@@ -0,0 +1,76 @@
+// -----------------------------------------------------------------------------
+// Bounded outgoing byte queue for a non-blocking fd. Frames are pushed whole
+// or not at all, so a slow reader loses complete frames and never receives a
+// torn one.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_TX_QUEUE_HPP
+#define BRIDGE_TX_QUEUE_HPP
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace bridge {
+
+class TxQueue {
+ public:
+  // `socket` selects send(MSG_NOSIGNAL) so a vanished peer can't raise SIGPIPE
+  TxQueue(size_t capacity, bool socket) : capacity_(capacity), socket_(socket) {
+    buf_.reserve(capacity);
+  }
+
+  bool fits(size_t n) const { return size() + n <= capacity_; }
+
+  // Queue one frame. Returns false (and queues nothing) if it doesn't fit.
+  bool push(const uint8_t* data, size_t n) {
+    if (!fits(n)) return false;
+    if (head_ > 0 && buf_.size() + n > capacity_) compact();
+    buf_.insert(buf_.end(), data, data + n);
+    return true;
+  }
+
+  // Write as much as the fd accepts. Returns false on a write error other
+  // than EAGAIN; the queue is left as it was.
+  bool flush(int fd) {
+    while (head_ < buf_.size()) {
+      const uint8_t* p = buf_.data() + head_;
+      size_t n = buf_.size() - head_;
+      ssize_t w = socket_ ? send(fd, p, n, MSG_NOSIGNAL | MSG_DONTWAIT) : write(fd, p, n);
+      if (w < 0) {
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      head_ += w;
+    }
+    clear();
+    return true;
+  }
+
+  size_t size() const { return buf_.size() - head_; }
+  bool empty() const { return size() == 0; }
+  void clear() {
+    buf_.clear();
+    head_ = 0;
+  }
+
+ private:
+  void compact() {
+    memmove(buf_.data(), buf_.data() + head_, size());
+    buf_.resize(size());
+    head_ = 0;
+  }
+
+  std::vector<uint8_t> buf_;
+  size_t head_ = 0;
+  size_t capacity_;
+  bool socket_;
+};
+
+}  // namespace bridge
+
+#endif  // BRIDGE_TX_QUEUE_HPP
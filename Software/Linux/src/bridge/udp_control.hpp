@@ -0,0 +1,98 @@
+// -----------------------------------------------------------------------------
+// UDP control transport: datagram format and sequence tracking
+//
+// Over TCP one lost segment holds back every later command until it is
+// retransmitted. Over UDP each command stands alone: a lost setpoint is
+// simply superseded by the next one. Every datagram carries a wrapper header
+// with a 32-bit sequence number, so the 8-bit hd.index inside the UCP frame
+// stays whatever the client put there.
+//
+//   command   client -> bridge  Header + one whole UCP frame
+//   ack       bridge -> client  Header only, seq and stamp_ns echoed, status set
+//   telemetry bridge -> client  Header + one whole UCP frame
+//
+// All fields are little-endian, as on the UART. The bridge accepts a command
+// sequence number once (duplicates are acked but not forwarded) and forwards
+// a motor setpoint only if it is newer than the last one forwarded, so a
+// setpoint delayed behind a newer one can never roll the robot back to it.
+// -----------------------------------------------------------------------------
+#ifndef BRIDGE_UDP_CONTROL_HPP
+#define BRIDGE_UDP_CONTROL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace bridge {
+namespace udp {
+
+constexpr uint8_t kMagic = 0xA5;
+
+enum Type : uint8_t {
+  kCommand = 1,
+  kAck = 2,
+  kTelemetry = 3,
+};
+
+enum AckStatus : uint8_t {
+  kAccepted = 0,     // Forwarded to the UART queue
+  kStale = 1,        // Setpoint older than one already forwarded
+  kDuplicate = 2,    // Sequence number seen before
+  kRejected = 3,     // Not one whole, CRC-valid frame, or no room in the bridge
+  kPreempted = 4,    // Setpoint refused: a higher priority holds the motors
+};
+
+#pragma pack(push, 1)
+struct Header {
+  uint8_t magic;     // kMagic
+  uint8_t type;      // Type
+  uint8_t status;    // AckStatus in acks, 0 otherwise
+  uint8_t reserved;
+  uint32_t seq;      // Client's command sequence; per-client counter for telemetry
+  uint64_t stamp_ns; // Command: client's clock, echoed in the ack for RTT;
+                     // telemetry: bridge CLOCK_MONOTONIC when the frame was read
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Header) == 16, "UDP header is 16 bytes");
+
+// True if a is after b, modulo 2^32
+inline bool seq_after(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+// Which of the last 64 sequence numbers have been seen (the IPsec
+// anti-replay window). Anything older than the window counts as seen.
+class SequenceWindow {
+ public:
+  // Returns true the first time `seq` is offered
+  bool accept(uint32_t seq) {
+    if (!started_) {
+      started_ = true;
+      highest_ = seq;
+      bits_ = 1;
+      return true;
+    }
+    if (seq_after(seq, highest_)) {
+      uint32_t shift = seq - highest_;
+      bits_ = shift >= 64 ? 1 : (bits_ << shift) | 1;
+      highest_ = seq;
+      return true;
+    }
+    uint32_t back = highest_ - seq;
+    if (back >= 64) return false;
+    uint64_t bit = 1ull << back;
+    if (bits_ & bit) return false;
+    bits_ |= bit;
+    return true;
+  }
+
+  uint32_t highest() const { return highest_; }
+
+ private:
+  bool started_ = false;
+  uint32_t highest_ = 0;
+  uint64_t bits_ = 0;
+};
+
+}  // namespace udp
+}  // namespace bridge
+
+#endif  // BRIDGE_UDP_CONTROL_HPP
@@ -0,0 +1,125 @@
+#include "clock_sync.hpp"
+
+#include <math.h>
+
+#include "ucp_codec.hpp"
+
+namespace ucp {
+
+// Drift is only fitted over at least this much MCU time; below it, the
+// offset alone is better than a slope through noise
+static const double kMinFitSpanNs = 1e9;
+// Crystals are within a few hundred ppm; anything beyond is a bad fit
+static const double kMaxRate = 1e-3;
+// Round trips this close to the shortest are always kept, so a window of
+// equally good exchanges isn't thinned out by timer granularity
+static const uint64_t kRttFloorNs = 20000;
+
+ClockSyncOptions clock_sync_options_for_baud(unsigned baud) {
+  ClockSyncOptions o;
+  if (baud == 0) return o;
+  // 8N1: ten bit times per byte
+  o.request_wire_ns = Frame<ucp_time_sync_t>::size() * 10 * 1000000000ull / baud;
+  o.reply_wire_ns = Frame<ucp_time_sync_ack_t>::size() * 10 * 1000000000ull / baud;
+  return o;
+}
+
+ClockSync::ClockSync(const ClockSyncOptions& options) : options_(options) {
+  if (options_.window == 0) options_.window = 1;
+  if (options_.window > kMaxWindow) options_.window = kMaxWindow;
+}
+
+void ClockSync::reset() {
+  next_ = 0;
+  count_ = 0;
+  offset_ = 0;
+  rate_ = 0;
+  min_rtt_ = 0;
+  used_ = 0;
+}
+
+bool ClockSync::add(uint64_t t1_ns, uint64_t t2_us, uint64_t t3_us, uint64_t t4_ns) {
+  if (t4_ns < t1_ns || t3_us < t2_us) return false;
+  // First-byte times: the request started arriving request_wire_ns before
+  // t2, the reply reached the head reply_wire_ns before t4
+  uint64_t t2 = t2_us * 1000, t3 = t3_us * 1000;
+  t2 = t2 > options_.request_wire_ns ? t2 - options_.request_wire_ns : 0;
+  if (t4_ns - t1_ns > options_.reply_wire_ns) t4_ns -= options_.reply_wire_ns;
+  if (t3 < t2) t2 = t3;
+
+  Exchange e;
+  e.mcu_ns = t2 + (t3 - t2) / 2;
+  e.head_ns = t1_ns + (t4_ns - t1_ns) / 2;
+  uint64_t total = t4_ns - t1_ns, turnaround = t3 - t2;
+  e.rtt_ns = total > turnaround ? total - turnaround : 0;
+
+  if (count_ > 0) {
+    const Exchange& last = ring_[(next_ + kMaxWindow - 1) % kMaxWindow];
+    if (e.mcu_ns < last.mcu_ns) reset();  // MCU rebooted
+  }
+  ring_[next_] = e;
+  next_ = (next_ + 1) % kMaxWindow;
+  if (count_ < options_.window) count_++;
+  fit();
+  return e.rtt_ns <= (uint64_t)(min_rtt_ * (1 + options_.rtt_slack)) + kRttFloorNs;
+}
+
+void ClockSync::fit() {
+  size_t newest = (next_ + kMaxWindow - 1) % kMaxWindow;
+  min_rtt_ = UINT64_MAX;
+  for (size_t i = 0; i < count_; i++) {
+    const Exchange& e = ring_[(newest + kMaxWindow - i) % kMaxWindow];
+    if (e.rtt_ns < min_rtt_) min_rtt_ = e.rtt_ns;
+  }
+  uint64_t gate = (uint64_t)(min_rtt_ * (1 + options_.rtt_slack)) + kRttFloorNs;
+
+  // Newest kept exchange is the reference; the fit works on differences
+  // from it so the doubles keep nanosecond precision
+  bool have_ref = false;
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, min_x = 0;
+  for (size_t i = 0; i < count_; i++) {
+    const Exchange& e = ring_[(newest + kMaxWindow - i) % kMaxWindow];
+    if (e.rtt_ns > gate) continue;
+    if (!have_ref) {
+      ref_mcu_ = e.mcu_ns;
+      ref_head_ = e.head_ns;
+      have_ref = true;
+    }
+    double x = (double)(int64_t)(e.mcu_ns - ref_mcu_);
+    double y = (double)(int64_t)(e.head_ns - ref_head_) - x;  // Offset change
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    if (x < min_x) min_x = x;
+  }
+  used_ = (size_t)n;
+
+  double rate = 0;
+  double var = n * sxx - sx * sx;
+  if (n >= 2 && -min_x >= kMinFitSpanNs && var > 0) rate = (n * sxy - sx * sy) / var;
+  if (fabs(rate) > kMaxRate) rate = 0;
+  rate_ = rate;
+  offset_ = (sy - rate * sx) / n;
+}
+
+uint64_t ClockSync::to_monotonic(uint64_t mcu_us) const {
+  double x = (double)(int64_t)(mcu_us * 1000 - ref_mcu_);
+  int64_t delta = llround(x * (1 + rate_) + offset_);
+  if (delta < 0 && (uint64_t)-delta > ref_head_) return 0;
+  return ref_head_ + delta;
+}
+
+ClockEstimate ClockSync::estimate() const {
+  ClockEstimate e;
+  if (!valid()) return e;
+  e.valid = true;
+  e.offset_ns = (double)(int64_t)(ref_head_ - ref_mcu_) + offset_;
+  e.drift_ppm = -rate_ / (1 + rate_) * 1e6;
+  e.min_rtt_ns = min_rtt_;
+  e.samples = used_;
+  return e;
+}
+
+}  // namespace ucp
@@ -0,0 +1,90 @@
+// -----------------------------------------------------------------------------
+// Head <-> MCU clock mapping from UCP_TIME_SYNC exchanges
+//
+// Each exchange gives four timestamps, NTP style:
+//   t1  head sends the request         (CLOCK_MONOTONIC ns)
+//   t2  MCU receives it                (MCU us since boot)
+//   t3  MCU sends the reply            (MCU us)
+//   t4  head reads the reply           (CLOCK_MONOTONIC ns)
+// The round trip minus the MCU's turnaround, (t4 - t1) - (t3 - t2), is the
+// path delay, and with symmetric paths the MCU's midpoint (t2 + t3) / 2 was
+// taken at the head's midpoint (t1 + t4) / 2. Paths are only symmetric once
+// the frames' own time on the wire is taken out: t2 and t4 are stamped after
+// the last byte, so the request's and the reply's serialization time (set
+// from the baud rate) is subtracted from them first.
+//
+// Exchanges that waited anywhere (a busy UART, a late thread) come back with
+// a long round trip and a skewed midpoint. Over a window of recent exchanges
+// only those within a margin of the shortest round trip are kept, and a
+// least-squares line through their midpoints gives the offset and the MCU's
+// drift, so MCU timestamps between and after exchanges map with the rate
+// error taken out. An MCU clock that steps backwards (a reboot) resets it.
+// -----------------------------------------------------------------------------
+#ifndef UCP_CLOCK_SYNC_HPP
+#define UCP_CLOCK_SYNC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ucp {
+
+struct ClockSyncOptions {
+  size_t window = 32;              // Exchanges the fit looks back over, up to kMaxWindow
+  double rtt_slack = 0.5;          // Keep round trips up to (1 + slack) x the shortest
+  uint64_t request_wire_ns = 0;    // Serialization time of the request frame
+  uint64_t reply_wire_ns = 0;      // and of the reply frame
+};
+
+// Wire times of the sync frames at `baud` (8N1), 0 for a link without one
+ClockSyncOptions clock_sync_options_for_baud(unsigned baud);
+
+struct ClockEstimate {
+  bool valid = false;              // At least one exchange
+  double offset_ns = 0;            // head - MCU at the newest kept exchange
+  double drift_ppm = 0;            // How fast the MCU clock runs against the head's
+  uint64_t min_rtt_ns = 0;         // Shortest round trip in the window
+  size_t samples = 0;              // Exchanges the fit used
+};
+
+class ClockSync {
+ public:
+  static const size_t kMaxWindow = 64;
+
+  explicit ClockSync(const ClockSyncOptions& options = ClockSyncOptions());
+
+  // Feed one exchange. Returns false when it was an outlier the fit ignores.
+  bool add(uint64_t t1_ns, uint64_t t2_us, uint64_t t3_us, uint64_t t4_ns);
+
+  bool valid() const { return count_ > 0; }
+
+  // CLOCK_MONOTONIC time of an MCU timestamp; only meaningful when valid()
+  uint64_t to_monotonic(uint64_t mcu_us) const;
+
+  ClockEstimate estimate() const;
+  void reset();
+
+ private:
+  struct Exchange {
+    uint64_t mcu_ns;               // MCU midpoint
+    uint64_t head_ns;              // Head midpoint
+    uint64_t rtt_ns;
+  };
+
+  void fit();
+
+  ClockSyncOptions options_;
+  Exchange ring_[kMaxWindow];
+  size_t next_ = 0;
+  size_t count_ = 0;
+  // head = ref_head + (mcu - ref_mcu) * (1 + rate_) + offset_
+  uint64_t ref_mcu_ = 0;
+  uint64_t ref_head_ = 0;
+  double offset_ = 0;
+  double rate_ = 0;
+  uint64_t min_rtt_ = 0;
+  size_t used_ = 0;
+};
+
+}  // namespace ucp
+
+#endif  // UCP_CLOCK_SYNC_HPP
@@ -0,0 +1,159 @@
+#include "trajectory.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+namespace ucp {
+
+static int16_t to_command(float v) {
+  if (!(v == v)) return 0;  // NaN
+  float r = roundf(v);
+  if (r > INT16_MAX) return INT16_MAX;
+  if (r < INT16_MIN) return INT16_MIN;
+  return (int16_t)r;
+}
+
+uint64_t TrajectoryScheduler::now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+bool TrajectoryScheduler::replace(const Waypoint* points, size_t n, const TrajectoryOptions& options) {
+  if (n == 0 || n > kMaxWaypoints) return false;
+  for (size_t i = 1; i < n; i++) {
+    if (points[i].t_ns <= points[i - 1].t_ns) return false;
+  }
+  publish(points, n, options);
+  replaced_++;
+  return true;
+}
+
+void TrajectoryScheduler::cancel() { publish(nullptr, 0, TrajectoryOptions()); }
+
+void TrajectoryScheduler::release() {
+  std::lock_guard<std::mutex> lock(writer_lock_);
+  if (!stopped_.load(std::memory_order_acquire)) return;
+  min_generation_.store(generation_ + 1, std::memory_order_release);
+  stopped_.store(false, std::memory_order_release);
+}
+
+// Fill the back slot and swap it into the middle
+void TrajectoryScheduler::publish(const Waypoint* points, size_t n, const TrajectoryOptions& options) {
+  std::lock_guard<std::mutex> lock(writer_lock_);
+  Slot& slot = slots_[back_];
+  slot.generation = ++generation_;
+  slot.options = options;
+  slot.count = n;
+  if (n) memcpy(slot.points, points, n * sizeof(Waypoint));
+  back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+}
+
+// Swap the newest published slot into the front, if there is one
+bool TrajectoryScheduler::take_fresh() {
+  if (!(middle_.load(std::memory_order_acquire) & kFresh)) return false;
+  front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+  cursor_ = 0;
+  return true;
+}
+
+Setpoint TrajectoryScheduler::last_output() const {
+  uint32_t word = last_output_.load(std::memory_order_relaxed);
+  Setpoint s;
+  s.speed = (int16_t)(word & 0xffff);
+  s.angular = (int16_t)(word >> 16);
+  return s;
+}
+
+void TrajectoryScheduler::set_output(const Setpoint& s) {
+  last_output_.store((uint32_t)(uint16_t)s.speed | (uint32_t)(uint16_t)s.angular << 16,
+                     std::memory_order_relaxed);
+}
+
+TrajectoryStats TrajectoryScheduler::stats() const {
+  TrajectoryStats s;
+  s.replaced = replaced_.load();
+  s.preempted = preempted_.load();
+  s.dropped = dropped_.load();
+  s.stopped_ticks = stopped_ticks_.load();
+  return s;
+}
+
+bool TrajectoryScheduler::setpoint(uint64_t tick_ns, Setpoint* out) {
+  if (stopped_.load(std::memory_order_acquire)) {
+    if (take_fresh() && slots_[front_].count) dropped_++;
+    following_ = false;
+    *out = Setpoint();
+    set_output(*out);
+    stopped_ticks_++;
+    return true;
+  }
+
+  if (take_fresh()) {
+    const Slot& slot = slots_[front_];
+    bool old = slot.generation < min_generation_.load(std::memory_order_acquire);
+    if (old && slot.count) dropped_++;
+    if (following_ && slot.count && !old) preempted_++;
+    following_ = slot.count > 0 && !old;
+  }
+  if (!following_) return false;
+
+  const Slot& slot = slots_[front_];
+  const Waypoint& last = slot.points[slot.count - 1];
+  Setpoint s;
+  if (tick_ns < last.t_ns + slot.options.hold_ns) {
+    float speed, angular;
+    evaluate(slot, tick_ns, &speed, &angular);
+    s.speed = to_command(speed);
+    s.angular = to_command(angular);
+  }
+  *out = s;
+  set_output(s);
+  return true;
+}
+
+void TrajectoryScheduler::evaluate(const Slot& slot, uint64_t t, float* speed, float* angular) {
+  const Waypoint* p = slot.points;
+  size_t n = slot.count;
+  if (t <= p[0].t_ns) {
+    *speed = p[0].speed;
+    *angular = p[0].angular;
+    return;
+  }
+  if (t >= p[n - 1].t_ns) {
+    *speed = p[n - 1].speed;
+    *angular = p[n - 1].angular;
+    return;
+  }
+  // Tick times only move forward, so the segment search resumes where the
+  // last tick left off
+  if (cursor_ >= n - 1 || p[cursor_].t_ns > t) cursor_ = 0;
+  while (p[cursor_ + 1].t_ns <= t) cursor_++;
+  size_t i = cursor_;
+
+  double h = (double)(p[i + 1].t_ns - p[i].t_ns);
+  double u = (double)(t - p[i].t_ns) / h;
+  if (slot.options.interpolation == Interpolation::kLinear) {
+    *speed = (float)(p[i].speed + (p[i + 1].speed - p[i].speed) * u);
+    *angular = (float)(p[i].angular + (p[i + 1].angular - p[i].angular) * u);
+    return;
+  }
+
+  // Cubic Hermite with Catmull-Rom tangents for uneven spacing; the end
+  // segments use one-sided differences
+  size_t a = i > 0 ? i - 1 : i;
+  size_t b = i + 2 < n ? i + 2 : i + 1;
+  double ta = (double)(p[i + 1].t_ns - p[a].t_ns);
+  double tb = (double)(p[b].t_ns - p[i].t_ns);
+  double u2 = u * u, u3 = u2 * u;
+  double h00 = 2 * u3 - 3 * u2 + 1, h10 = u3 - 2 * u2 + u;
+  double h01 = -2 * u3 + 3 * u2, h11 = u3 - u2;
+  double m0 = (p[i + 1].speed - p[a].speed) / ta * h, m1 = (p[b].speed - p[i].speed) / tb * h;
+  *speed = (float)(h00 * p[i].speed + h10 * m0 + h01 * p[i + 1].speed + h11 * m1);
+  m0 = (p[i + 1].angular - p[a].angular) / ta * h;
+  m1 = (p[b].angular - p[i].angular) / tb * h;
+  *angular = (float)(h00 * p[i].angular + h10 * m0 + h01 * p[i + 1].angular + h11 * m1);
+}
+
+}  // namespace ucp
@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------------------
+// Timestamped velocity trajectories for ucp::Client
+//
+// A planner hands over a whole trajectory at once: waypoints of (time, speed,
+// angular) in CLOCK_MONOTONIC nanoseconds. The client's sender thread asks
+// the scheduler for a setpoint at every tick's scheduled time, and the
+// scheduler interpolates between the waypoints around it, linearly or along
+// a cubic (Catmull-Rom) spline. A planner running at a few Hz thus drives
+// the robot with smooth commands at the client's full rate.
+//
+//   before the first waypoint   the first waypoint's velocities
+//   after the last one          the last one's, for hold_ns, then zero
+//
+// replace() swaps in a new trajectory atomically: the sender's next tick
+// follows it, and nothing of the old one is sent after that. It goes through
+// a triple buffer, so neither side ever waits for the other and nothing is
+// allocated: the planner writes a spare slot, the sender picks up the newest
+// complete one. emergency_stop() makes every following tick send zero until
+// release(); trajectories replaced in the meantime are dropped, so the
+// robot only moves again on a trajectory sent after release().
+// -----------------------------------------------------------------------------
+#ifndef UCP_TRAJECTORY_HPP
+#define UCP_TRAJECTORY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "ucp_client.hpp"
+
+namespace ucp {
+
+struct Waypoint {
+  uint64_t t_ns;                   // CLOCK_MONOTONIC
+  float speed;                     // ucp_ctl_cmd_t units
+  float angular;
+};
+
+enum class Interpolation { kLinear, kCubic };
+
+struct TrajectoryOptions {
+  Interpolation interpolation = Interpolation::kLinear;
+  uint64_t hold_ns = 200 * 1000000ull;  // Keep the last velocities this long past the end
+};
+
+struct TrajectoryStats {
+  uint64_t replaced = 0;           // Trajectories accepted by replace()
+  uint64_t preempted = 0;          // Picked up by the sender while following an older one
+  uint64_t dropped = 0;            // Discarded because of an emergency stop
+  uint64_t stopped_ticks = 0;      // Ticks that sent zero for an emergency stop
+};
+
+class TrajectoryScheduler : public SetpointSource {
+ public:
+  static const size_t kMaxWaypoints = 256;
+
+  // The clock waypoints are in
+  static uint64_t now_ns();
+
+  // Replace everything not yet sent with `points`, which must be in strictly
+  // increasing time. Returns false (and changes nothing) for an empty, too
+  // long or unordered trajectory. Safe from several planner threads.
+  bool replace(const Waypoint* points, size_t n, const TrajectoryOptions& options = TrajectoryOptions());
+
+  // Drop the trajectory and hand the ticks back to Client::set_setpoint()
+  void cancel();
+
+  // Send zero from the next tick on, until release(). Wait-free.
+  void emergency_stop() { stopped_.store(true, std::memory_order_release); }
+  void release();
+  bool stopped() const { return stopped_.load(std::memory_order_acquire); }
+
+  // The setpoint most recently computed, e.g. to start a replacement
+  // trajectory from where the robot is
+  Setpoint last_output() const;
+
+  TrajectoryStats stats() const;
+
+  // SetpointSource, called on the sender thread
+  bool setpoint(uint64_t tick_ns, Setpoint* out) override;
+
+ private:
+  struct Slot {
+    uint64_t generation = 0;       // Order of replace() calls, 0 = empty
+    TrajectoryOptions options;
+    size_t count = 0;              // 0 = no trajectory (cancelled)
+    Waypoint points[kMaxWaypoints];
+  };
+
+  static const uint8_t kIndexMask = 3;
+  static const uint8_t kFresh = 4; // Middle slot not yet picked up
+
+  void publish(const Waypoint* points, size_t n, const TrajectoryOptions& options);
+  bool take_fresh();
+  void evaluate(const Slot& slot, uint64_t t, float* speed, float* angular);
+  void set_output(const Setpoint& s);
+
+  Slot slots_[3];
+  std::atomic<uint8_t> middle_{1};
+  // Writer side (under writer_lock_)
+  std::mutex writer_lock_;
+  uint8_t back_ = 2;
+  uint64_t generation_ = 0;
+  // Sender side
+  uint8_t front_ = 0;
+  size_t cursor_ = 0;              // Segment the last tick fell in
+  bool following_ = false;         // front_ holds a trajectory to follow
+
+  std::atomic<bool> stopped_{false};
+  std::atomic<uint64_t> min_generation_{0};   // Older trajectories predate the last release()
+  std::atomic<uint32_t> last_output_{0};
+  std::atomic<uint64_t> replaced_{0};
+  std::atomic<uint64_t> preempted_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> stopped_ticks_{0};
+};
+
+}  // namespace ucp
+
+#endif  // UCP_TRAJECTORY_HPP
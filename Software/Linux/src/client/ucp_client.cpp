@@ -0,0 +1,556 @@
+#include "ucp_client.hpp"
+
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serial_port.hpp"
+
+namespace ucp {
+
+static const size_t kReadChunk = 4096;
+// Subscription requests are repeated this often until answered, then at
+// the slower rate
+static const uint64_t kSubscribeRetryNs = 200 * 1000000ull;
+static const uint64_t kSubscribeRefreshNs = 5000 * 1000000ull;
+// Capability queries: this many, this far apart, before giving up
+static const unsigned kHelloTries = 5;
+static const uint64_t kHelloRetryNs = 200 * 1000000ull;
+
+static uint64_t monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+Client::Client(const ClientOptions& options)
+    : options_(options), clock_(clock_sync_options_for_baud(options.link_baud)) {
+  ucp_delta_dec_init(&delta_dec_);
+  ucp_rel_rx_init(&rel_rx_);
+  rate_hz_ = options.rate_hz < kMinRateHz ? kMinRateHz
+             : options.rate_hz > kMaxRateHz ? kMaxRateHz
+                                            : options.rate_hz;
+}
+
+Client::~Client() {
+  stop();
+  if (fd_ >= 0) close(fd_);
+  if (timer_fd_ >= 0) close(timer_fd_);
+  if (wake_fd_ >= 0) close(wake_fd_);
+}
+
+bool Client::open_serial(const char* device, unsigned baud) {
+  speed_t speed;
+  if (!bridge::baud_to_speed(baud, &speed)) {
+    fprintf(stderr, "[Client] Unsupported baud rate %u\n", baud);
+    return false;
+  }
+  int fd = bridge::open_serial(device, speed);
+  if (fd < 0) return false;
+  if (options_.link_baud == 0) {
+    options_.link_baud = baud;
+    std::lock_guard<std::mutex> lock(clock_lock_);
+    clock_ = ClockSync(clock_sync_options_for_baud(baud));
+  }
+  return attach(fd);
+}
+
+bool Client::connect_tcp(const char* host, uint16_t port) {
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, service, &hints, &res) != 0) {
+    fprintf(stderr, "[Client] Can't resolve %s\n", host);
+    return false;
+  }
+  int fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+    perror("connect");
+    freeaddrinfo(res);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  freeaddrinfo(res);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return attach(fd);
+}
+
+bool Client::connect_unix(const char* path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[Client] Socket path %s too long\n", path);
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror(path);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  return attach(fd);
+}
+
+bool Client::attach(int fd) {
+  if (fd_ >= 0) close(fd_);
+  fd_ = fd;
+  int type;
+  socklen_t len = sizeof(type);
+  socket_ = getsockopt(fd_, SOL_SOCKET, SO_TYPE, &type, &len) == 0;
+  // Neither thread may block in read() or write(): the reader waits in
+  // poll() so stop() can wake it, the sender must never wait on the fd
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+bool Client::start() {
+  if (fd_ < 0 || running_) return false;
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (timer_fd_ < 0 || wake_fd_ < 0) {
+    perror("timerfd/eventfd");
+    return false;
+  }
+
+  // Absolute ticks: a late wakeup doesn't push the following ones back
+  uint64_t period = 1000000000ull / rate_hz_;
+  uint64_t first = monotonic_ns() + period;
+  struct itimerspec its;
+  its.it_value.tv_sec = first / 1000000000ull;
+  its.it_value.tv_nsec = first % 1000000000ull;
+  its.it_interval.tv_sec = period / 1000000000ull;
+  its.it_interval.tv_nsec = period % 1000000000ull;
+  if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+    perror("timerfd_settime");
+    return false;
+  }
+  next_tick_ns_ = first;
+
+  running_ = true;
+  sender_ = std::thread([this] { send_loop(); });
+  reader_ = std::thread([this] { read_loop(); });
+  return true;
+}
+
+void Client::stop() {
+  if (!running_.exchange(false)) return;
+  uint64_t one = 1;
+  ssize_t ret = write(wake_fd_, &one, sizeof(one));
+  (void)ret;
+  sender_.join();  // Returns after at most one period
+  reader_.join();
+}
+
+ClientStats Client::stats() const {
+  ClientStats s;
+  s.sent = sent_.load();
+  s.missed_ticks = missed_ticks_.load();
+  s.write_blocked = write_blocked_.load();
+  s.write_errors = write_errors_.load();
+  s.telemetry_frames = telemetry_frames_.load();
+  s.sync_sent = sync_sent_.load();
+  s.sync_replies = sync_replies_.load();
+  s.sync_outliers = sync_outliers_.load();
+  s.subscribe_sent = subscribe_sent_.load();
+  s.subscribe_refused = subscribe_refused_.load();
+  s.report_keyframes = report_keyframes_.load();
+  s.report_deltas = report_deltas_.load();
+  s.report_unresolved = report_unresolved_.load();
+  s.requests_answered = requests_answered_.load();
+  s.requests_repeated = requests_repeated_.load();
+  s.answers_dropped = answers_dropped_.load();
+  s.hello_sent = hello_sent_.load();
+  s.realtime = realtime_.load();
+  return s;
+}
+
+bool Client::capabilities(Capabilities* out) const {
+  if (!have_caps_.load(std::memory_order_acquire)) return false;
+  std::lock_guard<std::mutex> lock(caps_lock_);
+  *out = caps_;
+  return true;
+}
+
+bool Client::clock_synced() const {
+  std::lock_guard<std::mutex> lock(clock_lock_);
+  return clock_.valid();
+}
+
+ClockEstimate Client::clock_estimate() const {
+  std::lock_guard<std::mutex> lock(clock_lock_);
+  return clock_.estimate();
+}
+
+uint64_t Client::mcu_to_monotonic(uint64_t mcu_us) const {
+  std::lock_guard<std::mutex> lock(clock_lock_);
+  return clock_.to_monotonic(mcu_us);
+}
+
+uint64_t Client::sample_time_ns(const FrameView& frame, uint64_t rx_ns) const {
+  uint64_t sample_us;
+  if (frame.id() == UCP_REPORT_V2) {
+    const ucp_rep_v2_t* rep = frame.as<ucp_rep_v2_t>();
+    if (!rep || rep->rep_version != UCP_REPORT_VERSION) return rx_ns;
+    sample_us = rep->sample_us;
+  } else if (frame.id() == UCP_TELEMETRY && frame.len() >= sizeof(ucp_telemetry_t)) {
+    memcpy(&sample_us, frame.message() + offsetof(ucp_telemetry_t, sample_us), sizeof(sample_us));
+  } else if (frame.id() == UCP_IMU_BATCH && frame.len() >= sizeof(ucp_imu_batch_t)) {
+    memcpy(&sample_us, frame.message() + offsetof(ucp_imu_batch_t, base_us), sizeof(sample_us));
+  } else {
+    return rx_ns;
+  }
+  std::lock_guard<std::mutex> lock(clock_lock_);
+  return clock_.valid() ? clock_.to_monotonic(sample_us) : rx_ns;
+}
+
+// Periods as the firmware applies them: rounded up to its scheduler tick
+static uint16_t sub_period(uint8_t groups, uint16_t period_ms) {
+  if (!groups) return 0;
+  return (period_ms + UCP_SUB_TICK_MS - 1) / UCP_SUB_TICK_MS * UCP_SUB_TICK_MS;
+}
+
+uint32_t Client::pack_sub(uint8_t groups, uint16_t period_ms) {
+  return kSubSet | (uint32_t)groups << 16 | sub_period(groups, period_ms);
+}
+
+bool Client::subscribe(uint8_t slot, uint8_t groups, uint16_t period_ms) {
+  if (slot >= UCP_SUB_SLOTS || (groups & ~UCP_GRP_ALL) || (groups && period_ms == 0)) return false;
+  sub_wanted_[slot].store(pack_sub(groups, period_ms), std::memory_order_release);
+  return true;
+}
+
+bool Client::subscribed(uint8_t slot) const {
+  if (slot >= UCP_SUB_SLOTS) return false;
+  uint32_t wanted = sub_wanted_[slot].load(std::memory_order_acquire);
+  return wanted && sub_confirmed_[slot].load(std::memory_order_acquire) == wanted;
+}
+
+void Client::send_loop() {
+  if (options_.priority > 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = options_.priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err == 0) {
+      realtime_ = true;
+    } else {
+      fprintf(stderr, "[Client] SCHED_FIFO for the sender: %s\n", strerror(err));
+    }
+  }
+
+  uint64_t period = 1000000000ull / rate_hz_;
+  uint64_t sync_period = (uint64_t)options_.sync_interval_ms * 1000000ull;
+  uint64_t next_sync_ns = next_tick_ns_;
+  while (running_.load(std::memory_order_relaxed)) {
+    uint64_t expirations = 0;
+    if (read(timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+    if (expirations > 1) missed_ticks_ += expirations - 1;
+    uint64_t tick_ns = next_tick_ns_ + (expirations - 1) * period;
+    next_tick_ns_ = tick_ns + period;
+    Setpoint setpoint;
+    if (source_ && source_->setpoint(tick_ns, &setpoint)) {
+      send_setpoint(setpoint);
+    } else if (have_setpoint_.load(std::memory_order_acquire)) {
+      send_setpoint(unpack(mailbox_.load(std::memory_order_acquire)));
+    }
+    // After the setpoint, so sync never delays a command
+    if (sync_period && tick_ns >= next_sync_ns) {
+      send_sync();
+      next_sync_ns = tick_ns + sync_period;
+    }
+    send_hello(tick_ns);
+    send_subscriptions(tick_ns);
+    send_delta_ack();
+    send_answers();
+  }
+
+  // Give the fd a few periods to take the stop
+  if (options_.stop_on_exit && (have_setpoint_.load() || source_)) {
+    for (int i = 0; i < 10 && !send_setpoint(Setpoint()); i++) usleep(1000000 / rate_hz_);
+  }
+}
+
+// send(MSG_NOSIGNAL) on sockets so a vanished bridge can't raise SIGPIPE
+ssize_t Client::write_fd(const uint8_t* p, size_t n) {
+  return socket_ ? send(fd_, p, n, MSG_NOSIGNAL) : write(fd_, p, n);
+}
+
+bool Client::send_frame(const uint8_t* data, size_t len) {
+  // Finish a frame the fd only took part of before starting the next, so
+  // the stream never carries a torn frame
+  while (pending_len_ > 0) {
+    ssize_t w = write_fd(pending_, pending_len_);
+    if (w > 0) {
+      memmove(pending_, pending_ + w, pending_len_ - w);
+      pending_len_ -= w;
+      continue;
+    }
+    if (w < 0 && errno == EINTR) continue;
+    if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      write_errors_++;
+    } else {
+      write_blocked_++;
+    }
+    return false;
+  }
+
+  ssize_t w;
+  do {
+    w = write_fd(data, len);
+  } while (w < 0 && errno == EINTR);
+  if (w < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      write_blocked_++;
+    } else {
+      write_errors_++;
+    }
+    return false;
+  }
+  if ((size_t)w < len) {
+    pending_len_ = len - w;
+    memcpy(pending_, data + w, pending_len_);
+  }
+  return true;
+}
+
+bool Client::send_setpoint(const Setpoint& setpoint) {
+  static_assert(Frame<ucp_ctl_cmd_t>::size() <= sizeof(pending_), "setpoint frame must fit pending_");
+  Frame<ucp_ctl_cmd_t> frame;
+  make_ctl_cmd(frame, setpoint.speed, setpoint.angular);
+  frame.msg.front_led = setpoint.front_led;
+  frame.msg.back_led = setpoint.back_led;
+  encoder_.seal(frame);
+  if (!send_frame(frame.data(), frame.size())) return false;
+  sent_++;
+  return true;
+}
+
+void Client::send_sync() {
+  static_assert(Frame<ucp_time_sync_t>::size() <= sizeof(pending_), "sync frame must fit pending_");
+  Frame<ucp_time_sync_t> frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.msg.t1_ns = monotonic_ns();
+  encoder_.seal(frame);
+  sync_t1_.store(frame.msg.t1_ns, std::memory_order_release);
+  if (send_frame(frame.data(), frame.size())) sync_sent_++;
+}
+
+// Sender thread: a query every kHelloRetryNs until answered or out of tries
+void Client::send_hello(uint64_t tick_ns) {
+  static_assert(Frame<ucp_hello_t>::size() <= sizeof(pending_), "hello frame must fit pending_");
+  if (hello_tries_ >= kHelloTries || tick_ns < hello_due_ || have_caps_.load(std::memory_order_acquire)) return;
+  Frame<ucp_hello_t> frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.msg.proto_version = UCP_PROTO_VERSION;
+  encoder_.seal(frame);
+  if (!send_frame(frame.data(), frame.size())) return;  // Next tick
+  hello_sent_++;
+  hello_tries_++;
+  hello_due_ = tick_ns + kHelloRetryNs;
+}
+
+// Sender thread: a changed subscription goes out on this tick, an
+// unanswered one every kSubscribeRetryNs, a confirmed one every
+// kSubscribeRefreshNs
+void Client::send_subscriptions(uint64_t tick_ns) {
+  static_assert(Frame<ucp_subscribe_t>::size() <= sizeof(pending_), "subscribe frame must fit pending_");
+  for (uint8_t slot = 0; slot < UCP_SUB_SLOTS; slot++) {
+    uint32_t wanted = sub_wanted_[slot].load(std::memory_order_acquire);
+    if (!wanted || (wanted == sub_sent_[slot] && tick_ns < sub_due_[slot])) continue;
+    Frame<ucp_subscribe_t> frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.msg.slot = slot;
+    frame.msg.groups = (uint8_t)(wanted >> 16);
+    frame.msg.period_ms = (uint16_t)wanted;
+    encoder_.seal(frame);
+    if (!send_frame(frame.data(), frame.size())) return;  // Next tick
+    subscribe_sent_++;
+    bool confirmed = sub_confirmed_[slot].load(std::memory_order_acquire) == wanted;
+    sub_sent_[slot] = wanted;
+    sub_due_[slot] = tick_ns + (confirmed ? kSubscribeRefreshNs : kSubscribeRetryNs);
+  }
+}
+
+// Sender thread: acknowledge the newest keyframe, once
+void Client::send_delta_ack() {
+  static_assert(Frame<ucp_rep_delta_ack_t>::size() <= sizeof(pending_), "ack frame must fit pending_");
+  uint32_t ack = delta_ack_.exchange(0, std::memory_order_acq_rel);
+  if (!ack) return;
+  Frame<ucp_rep_delta_ack_t> frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.msg.key_seq = (uint8_t)ack;
+  encoder_.seal(frame);
+  if (!send_frame(frame.data(), frame.size())) {
+    uint32_t none = 0;
+    delta_ack_.compare_exchange_strong(none, ack);  // Next tick, unless a newer keyframe came
+  }
+}
+
+// Sender thread: answers the reader queued, oldest first
+void Client::send_answers() {
+  if (!have_answers_.load(std::memory_order_acquire)) return;
+  std::lock_guard<std::mutex> lock(answers_lock_);
+  while (answers_count_ > 0) {
+    if (!send_frame(answers_[answers_head_], answer_lens_[answers_head_])) return;  // Next tick
+    answers_head_ = (answers_head_ + 1) % kAnswerQueue;
+    answers_count_--;
+  }
+  have_answers_.store(false, std::memory_order_release);
+}
+
+// Reader thread
+void Client::queue_answer(const uint8_t* frame, size_t len) {
+  std::lock_guard<std::mutex> lock(answers_lock_);
+  if (answers_count_ == kAnswerQueue) {
+    answers_dropped_++;  // The firmware asks again
+    return;
+  }
+  size_t tail = (answers_head_ + answers_count_) % kAnswerQueue;
+  memcpy(answers_[tail], frame, len);
+  answer_lens_[tail] = (uint8_t)len;
+  answers_count_++;
+  have_answers_.store(true, std::memory_order_release);
+}
+
+// Reader thread: answer a calibration request from the firmware, or repeat
+// the answer to one already handled. The answer carries the request's
+// hd.index, which is how the firmware matches it.
+void Client::on_request_frame(const FrameView& f) {
+  if (!request_handler_) return;
+  uint32_t now_ms = (uint32_t)(monotonic_ns() / 1000000);
+  size_t len = 0;
+  if (const uint8_t* answer = ucp_rel_rx_seen(&rel_rx_, f.frame, f.frame_len, &len, now_ms)) {
+    requests_repeated_++;
+    queue_answer(answer, len);
+    return;
+  }
+  uint8_t frame[UCP_REL_FRAME_MAX];
+  size_t body = request_handler_(f, frame + kSyncSize + sizeof(ucp_hd_t),
+                                 sizeof(frame) - kFrameOverhead - sizeof(ucp_hd_t));
+  if (body == 0) return;
+  len = body + sizeof(ucp_hd_t) + kFrameOverhead;
+  ucp_hd_t hd;
+  hd.len = (uint16_t)(body + sizeof(ucp_hd_t));
+  hd.id = f.id();
+  hd.index = f.index();
+  memcpy(frame + kSyncSize, &hd, sizeof(hd));
+  seal_raw(frame, len);
+  ucp_rel_rx_answered(&rel_rx_, f.frame, f.frame_len, frame, len, now_ms);
+  requests_answered_++;
+  queue_answer(frame, len);
+}
+
+// Reader thread: hand the callback the UCP_REPORT_V2 a UCP_REPORT_DELTA
+// stands for
+void Client::on_report_delta(const FrameView& f, uint64_t rx_ns) {
+  ucp_delta_report_t r;
+  int ret = f.len() < sizeof(ucp_rep_delta_t)
+                ? UCP_DELTA_MALFORMED
+                : ucp_delta_decode(&delta_dec_, f.message() + sizeof(ucp_hd_t), f.len() - sizeof(ucp_hd_t), &r);
+  if (ret < 0) {
+    report_unresolved_++;
+    return;
+  }
+  if (ret == UCP_DELTA_KEYFRAME) {
+    report_keyframes_++;
+    delta_ack_.store(kAckSet | f.message()[offsetof(ucp_rep_delta_t, key_seq)], std::memory_order_release);
+  } else {
+    report_deltas_++;
+  }
+  Frame<ucp_rep_v2_t> frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.msg.rep_version = UCP_REPORT_VERSION;
+  frame.msg.sample_us = r.sample_us;
+  memcpy(&frame.msg.voltage, (const uint8_t*)&r.rep + sizeof(ucp_hd_t), UCP_DELTA_REP_BYTES);
+  rebuild_encoder_.seal(frame);
+  telemetry_frames_++;
+  if (callback_) callback_(FrameView{frame.data(), frame.size()}, rx_ns);
+}
+
+// Reader thread
+void Client::on_subscribe_reply(const ucp_subscribe_ack_t& ack) {
+  if (ack.slot >= UCP_SUB_SLOTS) return;
+  if (ack.err != UCP_ERR_OK) {
+    subscribe_refused_++;
+    return;
+  }
+  sub_confirmed_[ack.slot].store(pack_sub(ack.groups, ack.period_ms), std::memory_order_release);
+}
+
+// Reader thread. Another head on the same bridge gets the replies to our
+// requests and we get theirs, so only the one to our newest request counts.
+void Client::on_sync_reply(const ucp_time_sync_ack_t& ack, uint64_t rx_ns) {
+  if (ack.t1_ns == 0 || ack.t1_ns != sync_t1_.load(std::memory_order_acquire)) return;
+  bool kept;
+  {
+    std::lock_guard<std::mutex> lock(clock_lock_);
+    kept = clock_.add(ack.t1_ns, ack.t2_us, ack.t3_us, rx_ns);
+  }
+  sync_replies_++;
+  if (!kept) sync_outliers_++;
+}
+
+void Client::read_loop() {
+  Decoder decoder;
+  uint8_t buf[kReadChunk];
+  struct pollfd pfds[2] = {{fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+  while (running_.load(std::memory_order_relaxed)) {
+    if (poll(pfds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      return;
+    }
+    if (pfds[1].revents) return;  // stop()
+    ssize_t n = read(fd_, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+    if (n <= 0) {
+      fprintf(stderr, "[Client] Connection closed.\n");
+      return;
+    }
+    uint64_t now = monotonic_ns();
+    decoder.feed(buf, n, [&](const FrameView& f) {
+      if (f.id() == UCP_TIME_SYNC) {
+        if (const ucp_time_sync_ack_t* ack = f.as<ucp_time_sync_ack_t>()) on_sync_reply(*ack, now);
+      } else if (f.id() == UCP_SUBSCRIBE) {
+        if (const ucp_subscribe_ack_t* ack = f.as<ucp_subscribe_ack_t>()) on_subscribe_reply(*ack);
+      } else if (f.id() == UCP_HELLO) {
+        Capabilities caps;
+        if (parse_hello(f, &caps)) {
+          std::lock_guard<std::mutex> lock(caps_lock_);
+          caps_ = caps;
+          have_caps_.store(true, std::memory_order_release);
+        }
+      } else if (f.id() == UCP_REPORT_DELTA) {
+        on_report_delta(f, now);
+        return;
+      } else if ((f.id() == UCP_IMU_WRITE && f.as<ucp_imu_w_t>()) || (f.id() == UCP_MAG_WRITE && f.as<ucp_mag_w_t>()) ||
+                 (f.id() == UCP_IMUMAG_READ && f.as<ucp_imu_r_t>())) {
+        on_request_frame(f);
+      }
+      telemetry_frames_++;
+      if (callback_) callback_(f, now);
+    });
+  }
+}
+
+}  // namespace ucp
@@ -0,0 +1,305 @@
+// -----------------------------------------------------------------------------
+// Real-time UCP client: steady motor setpoints out, decoded telemetry in
+//
+// The client owns one fd (a UART, or a TCP or Unix socket connection to
+// tcp_bridge) and two threads:
+//   sender : woken by a periodic timerfd at rate_hz (50..500), sends the
+//            newest setpoint as one ucp_ctl_cmd_t frame per tick. It runs
+//            SCHED_FIFO when allowed, and never blocks on the fd: if the fd
+//            can't take the frame, that tick is skipped and counted, and the
+//            next tick sends the then-newest setpoint.
+//   reader : decodes everything the fd returns and hands each frame to the
+//            telemetry callback, on the reader thread.
+//
+// set_setpoint() stores into a single-slot atomic mailbox, so any number of
+// producer threads can update it at any rate without ever blocking on, or
+// being blocked by, the sender. Ticks are counted from an absolute timer, so
+// the cadence doesn't drift with the time the write takes. A SetpointSource
+// (e.g. a TrajectoryScheduler, see trajectory.hpp) can instead compute the
+// setpoint for each tick's scheduled time.
+//
+// Every sync_interval_ms the sender also sends a UCP_TIME_SYNC request, and
+// the reader feeds the replies to a ClockSync (clock_sync.hpp). Once the
+// firmware has seen one it reports with UCP_REPORT_V2, whose sample_us
+// sample_time_ns() maps into CLOCK_MONOTONIC.
+//
+// subscribe() picks the telemetry the firmware sends: field groups and a
+// period per subscription slot (see ucp_telemetry.hpp). The sender sends the
+// request after the next tick's setpoint and repeats it until the firmware
+// answers, then every few seconds so a restarted firmware picks it up again.
+// With UCP_GRP_REPORT_DELTA the firmware sends the report delta-coded
+// (ucp_delta.h): the reader rebuilds each one into the UCP_REPORT_V2 it
+// stands for before the callback sees it, and the sender acknowledges
+// keyframes so later deltas can refer to them.
+//
+// On its first ticks the sender asks the firmware's capabilities
+// (UCP_HELLO, see ucp_hello.hpp) until answered or kHelloTries went
+// unanswered, as they do from firmware older than UCP_HELLO. capabilities()
+// then tells e.g. whether subscribe() can ask for UCP_GRP_REPORT_DELTA.
+//
+// The firmware sends its calibration to the head to keep (UCP_IMU_WRITE,
+// UCP_MAG_WRITE) and reads it back after boot (UCP_IMUMAG_READ), repeating
+// each request with the same hd.index until answered (ucp_reliable.h). A
+// handler set with on_request() answers them on the reader thread; the
+// reader remembers its answers, so a repeated request gets the same answer
+// again instead of reaching the handler twice. The sender writes answers on
+// its next tick.
+//
+//   ucp::Client client;
+//   client.on_telemetry([](const ucp::FrameView& f, uint64_t rx_ns) { ... });
+//   if (!client.open_serial("/dev/ttyS0") || !client.start()) return 1;
+//   client.set_setpoint(60, 0);
+// -----------------------------------------------------------------------------
+#ifndef UCP_CLIENT_HPP
+#define UCP_CLIENT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "clock_sync.hpp"
+#include "ucp_decoder.hpp"
+#include "ucp_hello.hpp"
+#include "ucp_delta.h"
+#include "ucp_reliable.h"
+
+namespace ucp {
+
+struct ClientOptions {
+  unsigned rate_hz = 100;          // Setpoint rate, clamped to kMinRateHz..kMaxRateHz
+  int priority = 50;               // SCHED_FIFO priority of the sender, 0 to stay SCHED_OTHER
+  bool stop_on_exit = true;        // Send a zero setpoint when stopping
+  unsigned sync_interval_ms = 1000;  // Clock sync requests, 0 to never send them
+  unsigned link_baud = 0;          // UART baud behind the fd, for clock sync; open_serial() sets it
+};
+
+struct ClientStats {
+  uint64_t sent = 0;               // Setpoint frames written
+  uint64_t missed_ticks = 0;       // Timer periods that passed without the sender running
+  uint64_t write_blocked = 0;      // Ticks skipped because the fd was full
+  uint64_t write_errors = 0;
+  uint64_t telemetry_frames = 0;   // Frames delivered to the callback
+  uint64_t sync_sent = 0;          // UCP_TIME_SYNC requests written
+  uint64_t sync_replies = 0;       // Replies to them fed to the clock estimate
+  uint64_t sync_outliers = 0;      // of which the estimate ignored for a long round trip
+  uint64_t subscribe_sent = 0;     // UCP_SUBSCRIBE requests written
+  uint64_t subscribe_refused = 0;  // Answered with an error
+  uint64_t report_keyframes = 0;   // UCP_REPORT_DELTA keyframes received
+  uint64_t report_deltas = 0;      // and deltas rebuilt against one
+  uint64_t report_unresolved = 0;  // Dropped: malformed, or their keyframe never arrived
+  uint64_t requests_answered = 0;  // Firmware requests answered by the handler
+  uint64_t requests_repeated = 0;  // Repeats answered again without it
+  uint64_t answers_dropped = 0;    // Answers the sender had no room for
+  uint64_t hello_sent = 0;         // UCP_HELLO queries written
+  bool realtime = false;           // The sender got SCHED_FIFO
+};
+
+// What the robot should do, as carried by ucp_ctl_cmd_t
+struct Setpoint {
+  int16_t speed = 0;
+  int16_t angular = 0;
+  int16_t front_led = 0;
+  int16_t back_led = 0;
+};
+
+// Computes setpoints on the sender thread, so it must not block
+class SetpointSource {
+ public:
+  virtual ~SetpointSource() {}
+  // The setpoint for the tick scheduled at `tick_ns` (CLOCK_MONOTONIC).
+  // Returning false leaves that tick to the mailbox.
+  virtual bool setpoint(uint64_t tick_ns, Setpoint* out) = 0;
+};
+
+class Client {
+ public:
+  static const unsigned kMinRateHz = 50;
+  static const unsigned kMaxRateHz = 500;
+
+  // Called on the reader thread with every decoded frame and the
+  // CLOCK_MONOTONIC time its bytes were read
+  using TelemetryCallback = std::function<void(const FrameView& frame, uint64_t rx_ns)>;
+
+  // Called on the reader thread with each new calibration request from the
+  // firmware (ucp_imu_w_t, ucp_mag_w_t or ucp_imu_r_t). Writes the answer's
+  // message body, after ucp_hd_t (err, and the values for a read), into
+  // `body` and returns its length; 0 leaves the request unanswered.
+  using RequestHandler = std::function<size_t(const FrameView& request, uint8_t* body, size_t cap)>;
+
+  explicit Client(const ClientOptions& options = ClientOptions());
+  ~Client();
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  // Pick the transport; each returns false with the reason printed
+  bool open_serial(const char* device, unsigned baud = 115200);
+  bool connect_tcp(const char* host, uint16_t port);
+  bool connect_unix(const char* path);  // One of tcp_bridge -U's sockets
+  bool attach(int fd);             // Adopt an open fd, closed with the client
+
+  // Set before start()
+  void on_telemetry(TelemetryCallback callback) { callback_ = std::move(callback); }
+  void on_request(RequestHandler handler) { request_handler_ = std::move(handler); }
+  void set_source(SetpointSource* source) { source_ = source; }
+
+  // Start the sender and reader threads. Nothing is sent until the first
+  // set_setpoint().
+  bool start();
+
+  // Join both threads (after a final zero setpoint with stop_on_exit)
+  void stop();
+
+  // Wait-free; the sender picks up the newest value on its next tick
+  void set_setpoint(const Setpoint& setpoint) {
+    mailbox_.store(pack(setpoint), std::memory_order_release);
+    have_setpoint_.store(true, std::memory_order_release);
+  }
+  void set_setpoint(int16_t speed, int16_t angular) {
+    Setpoint s;
+    s.speed = speed;
+    s.angular = angular;
+    set_setpoint(s);
+  }
+
+  // Ask for `groups` (UCP_GRP_* bits) every period_ms from subscription
+  // `slot`; groups = 0 ends it. Wait-free. Returns false for a slot, group
+  // or period the firmware would refuse.
+  bool subscribe(uint8_t slot, uint8_t groups, uint16_t period_ms);
+  // The firmware confirmed the newest subscribe() for `slot`
+  bool subscribed(uint8_t slot) const;
+
+  // What the firmware answered to UCP_HELLO. False, with *out untouched,
+  // until it has; firmware older than UCP_HELLO never does.
+  bool capabilities(Capabilities* out) const;
+
+  unsigned rate_hz() const { return rate_hz_; }
+  ClientStats stats() const;
+
+  // MCU clock mapping; safe from any thread, including the telemetry callback
+  bool clock_synced() const;
+  ClockEstimate clock_estimate() const;
+  uint64_t mcu_to_monotonic(uint64_t mcu_us) const;
+
+  // When the sample in `frame` was taken: the mapped sample_us of a
+  // UCP_REPORT_V2 or UCP_TELEMETRY, or base_us of a UCP_IMU_BATCH, once the
+  // clock is synced, rx_ns otherwise
+  uint64_t sample_time_ns(const FrameView& frame, uint64_t rx_ns) const;
+
+ private:
+  // The four int16 fields in one word, so the mailbox is a plain atomic
+  static uint64_t pack(const Setpoint& s) {
+    return (uint64_t)(uint16_t)s.speed | (uint64_t)(uint16_t)s.angular << 16 |
+           (uint64_t)(uint16_t)s.front_led << 32 | (uint64_t)(uint16_t)s.back_led << 48;
+  }
+  static Setpoint unpack(uint64_t word) {
+    Setpoint s;
+    s.speed = (int16_t)(word & 0xffff);
+    s.angular = (int16_t)(word >> 16 & 0xffff);
+    s.front_led = (int16_t)(word >> 32 & 0xffff);
+    s.back_led = (int16_t)(word >> 48 & 0xffff);
+    return s;
+  }
+
+  void send_loop();
+  void read_loop();
+  bool send_setpoint(const Setpoint& setpoint);
+  void send_sync();
+  void send_hello(uint64_t tick_ns);
+  static uint32_t pack_sub(uint8_t groups, uint16_t period_ms);
+  void send_subscriptions(uint64_t tick_ns);
+  void on_subscribe_reply(const ucp_subscribe_ack_t& ack);
+  void on_report_delta(const FrameView& frame, uint64_t rx_ns);
+  void send_delta_ack();
+  void on_request_frame(const FrameView& frame);
+  void queue_answer(const uint8_t* frame, size_t len);
+  void send_answers();
+  bool send_frame(const uint8_t* data, size_t len);
+  ssize_t write_fd(const uint8_t* p, size_t n);
+  void on_sync_reply(const ucp_time_sync_ack_t& ack, uint64_t rx_ns);
+
+  ClientOptions options_;
+  unsigned rate_hz_;
+  int fd_ = -1;
+  bool socket_ = false;
+  int timer_fd_ = -1;
+  int wake_fd_ = -1;               // Interrupts the reader's poll on stop()
+  TelemetryCallback callback_;
+  RequestHandler request_handler_;
+  SetpointSource* source_ = nullptr;
+  uint64_t next_tick_ns_ = 0;      // Scheduled time of the next timer expiration
+  std::thread sender_;
+  std::thread reader_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint64_t> mailbox_{0};
+  std::atomic<bool> have_setpoint_{false};
+  Encoder encoder_;                // Sender thread only
+  uint8_t pending_[UCP_REL_FRAME_MAX];  // Rest of a frame the fd only took part of
+  size_t pending_len_ = 0;
+  std::atomic<uint64_t> sync_t1_{0};  // t1 of the request in flight; replies to others are ignored
+
+  // Subscriptions as (kSubSet | groups << 16 | period_ms): wanted by
+  // subscribe(), and as confirmed by the firmware
+  static const uint32_t kSubSet = 1u << 31;
+  std::atomic<uint32_t> sub_wanted_[UCP_SUB_SLOTS] = {};
+  std::atomic<uint32_t> sub_confirmed_[UCP_SUB_SLOTS] = {};
+  uint32_t sub_sent_[UCP_SUB_SLOTS] = {};  // Sender thread only: last value sent
+  uint64_t sub_due_[UCP_SUB_SLOTS] = {};   // and when to send it again
+
+  // UCP_REPORT_DELTA: the reader's keyframes, and the keyframe for the
+  // sender to acknowledge as (kAckSet | key_seq)
+  static const uint32_t kAckSet = 1u << 31;
+  ucp_delta_dec_t delta_dec_;
+  Encoder rebuild_encoder_;        // Reader thread only: seals rebuilt reports
+  std::atomic<uint32_t> delta_ack_{0};
+
+  // Firmware requests: the reader's remembered answers, and the answers
+  // waiting for the sender
+  static const size_t kAnswerQueue = 8;
+  ucp_rel_rx_t rel_rx_;
+  std::mutex answers_lock_;
+  uint8_t answers_[kAnswerQueue][UCP_REL_FRAME_MAX];
+  uint8_t answer_lens_[kAnswerQueue] = {};
+  size_t answers_head_ = 0;
+  size_t answers_count_ = 0;
+  std::atomic<bool> have_answers_{false};
+
+  // UCP_HELLO: queries sent and when the next is due (sender thread only),
+  // and the answer
+  unsigned hello_tries_ = 0;
+  uint64_t hello_due_ = 0;
+  std::atomic<bool> have_caps_{false};
+  mutable std::mutex caps_lock_;
+  Capabilities caps_;
+
+  mutable std::mutex clock_lock_;
+  ClockSync clock_;
+
+  std::atomic<uint64_t> sent_{0};
+  std::atomic<uint64_t> missed_ticks_{0};
+  std::atomic<uint64_t> write_blocked_{0};
+  std::atomic<uint64_t> write_errors_{0};
+  std::atomic<uint64_t> telemetry_frames_{0};
+  std::atomic<uint64_t> sync_sent_{0};
+  std::atomic<uint64_t> sync_replies_{0};
+  std::atomic<uint64_t> sync_outliers_{0};
+  std::atomic<uint64_t> subscribe_sent_{0};
+  std::atomic<uint64_t> subscribe_refused_{0};
+  std::atomic<uint64_t> report_keyframes_{0};
+  std::atomic<uint64_t> report_deltas_{0};
+  std::atomic<uint64_t> report_unresolved_{0};
+  std::atomic<uint64_t> requests_answered_{0};
+  std::atomic<uint64_t> requests_repeated_{0};
+  std::atomic<uint64_t> answers_dropped_{0};
+  std::atomic<uint64_t> hello_sent_{0};
+  std::atomic<bool> realtime_{false};
+};
+
+}  // namespace ucp
+
+#endif  // UCP_CLIENT_HPP
@@ -0,0 +1,264 @@
+#include "recorder.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace ucp_log {
+
+static uint64_t realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+Recorder::~Recorder() { close(); }
+
+bool Recorder::open(const RecorderOptions& options) {
+  options_ = options;
+  if (mkdir(options_.dir.c_str(), 0755) < 0 && errno != EEXIST) {
+    perror(("recorder: mkdir " + options_.dir).c_str());
+    return false;
+  }
+
+  // Continue numbering after whatever is already in the directory
+  for (const std::string& path : list_segments(options_.dir)) {
+    unsigned n = 0;
+    sscanf(path.c_str() + path.rfind('/') + 1, "ucp-%u", &n);
+    if (n >= next_segment_) next_segment_ = n + 1;
+    segments_.push_back(path);
+  }
+  if (!open_segment()) return false;
+
+  if (options_.buffers < 2) options_.buffers = 2;
+  for (size_t i = 0; i < options_.buffers; i++) {
+    storage_.emplace_back(new Buffer);
+    storage_.back()->data.resize(options_.buffer_bytes);
+    free_.push_back(storage_.back().get());
+  }
+  current_ = free_.back();
+  free_.pop_back();
+  stopping_ = false;
+  flusher_ = std::thread(&Recorder::flusher_main, this);
+  return true;
+}
+
+void Recorder::record(uint64_t timestamp_ns, Direction direction, const uint8_t* frame, size_t len) {
+  size_t need = record_size(len);
+  if (current_->used + need > current_->data.size()) {
+    handoff();
+    if (current_->used + need > current_->data.size()) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  uint8_t* p = current_->data.data() + current_->used;
+  RecordHeader rh;
+  rh.timestamp_ns = timestamp_ns;
+  rh.len = (uint16_t)len;
+  rh.direction = direction;
+  rh.flags = 0;
+  memcpy(p, &rh, sizeof(rh));
+  memcpy(p + sizeof(rh), frame, len);
+  memset(p + sizeof(rh) + len, 0, need - sizeof(rh) - len);
+  if (current_->used == 0) current_since_ns_ = timestamp_ns;
+  current_->used += need;
+  records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Recorder::tick(uint64_t now_ns) {
+  if (current_ && current_->used > 0 && now_ns - current_since_ns_ >= options_.flush_interval_ns) {
+    handoff();
+  }
+}
+
+// Pass the current buffer to the flusher and take a free one. Without a free
+// buffer the current one is kept and further records drop until one returns.
+void Recorder::handoff() {
+  if (current_->used == 0) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_.empty()) return;
+  full_.push_back(current_);
+  current_ = free_.back();
+  free_.pop_back();
+  current_->used = 0;
+  cv_.notify_one();
+}
+
+void Recorder::close() {
+  if (!flusher_.joinable()) return;
+  if (current_->used > 0) {
+    // Wait for a free buffer here: close() is not on the hot path
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !free_.empty(); });
+    full_.push_back(current_);
+    current_ = free_.back();
+    free_.pop_back();
+    current_->used = 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  flusher_.join();
+  finish_segment();
+}
+
+RecorderStats Recorder::stats() const {
+  RecorderStats s;
+  s.records = records_.load(std::memory_order_relaxed);
+  s.dropped = dropped_.load(std::memory_order_relaxed);
+  s.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+  s.segments = segments_opened_.load(std::memory_order_relaxed);
+  s.write_errors = write_errors_.load(std::memory_order_relaxed);
+  return s;
+}
+
+// -----------------------------------------------------------------------------
+// Flusher thread
+// -----------------------------------------------------------------------------
+void Recorder::flusher_main() {
+  std::vector<Buffer*> batch;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !full_.empty(); });
+      if (full_.empty() && stopping_) return;
+      batch.swap(full_);
+    }
+    write_buffers(batch);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (Buffer* b : batch) {
+        b->used = 0;
+        free_.push_back(b);
+      }
+    }
+    cv_.notify_all();  // close() may be waiting for a free buffer
+    batch.clear();
+  }
+}
+
+// Walk the records of each buffer to index them and to split at segment
+// boundaries, then write the slices with as few writev calls as possible.
+void Recorder::write_buffers(std::vector<Buffer*>& batch) {
+  for (Buffer* b : batch) {
+    uint8_t* base = b->data.data();
+    size_t start = 0, pos = 0;
+    while (pos < b->used) {
+      RecordHeader rh;
+      memcpy(&rh, base + pos, sizeof(rh));
+      size_t size = record_size(rh.len);
+
+      if (segment_offset_ + size > options_.segment_bytes && header_.record_count > 0) {
+        if (pos > start) pending_.push_back({base + start, pos - start});
+        finish_segment();
+        open_segment();
+        start = pos;
+      }
+
+      if (header_.record_count % options_.index_every == 0) {
+        index_.push_back({rh.timestamp_ns, segment_offset_});
+      }
+      if (header_.first_timestamp_ns == 0) header_.first_timestamp_ns = rh.timestamp_ns;
+      header_.last_timestamp_ns = rh.timestamp_ns;
+      header_.record_count++;
+      segment_offset_ += size;
+      pos += size;
+    }
+    if (pos > start) pending_.push_back({base + start, pos - start});
+  }
+  write_pending();
+}
+
+void Recorder::write_pending() {
+  size_t i = 0;
+  while (i < pending_.size()) {
+    int count = (int)std::min<size_t>(pending_.size() - i, IOV_MAX);
+    ssize_t n = fd_ >= 0 ? writev(fd_, &pending_[i], count) : -1;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      write_errors_.fetch_add(1, std::memory_order_relaxed);
+      segment_ok_ = false;
+      break;  // Keep recording; the segment reader stops at the first bad record
+    }
+    bytes_written_.fetch_add(n, std::memory_order_relaxed);
+    // Skip fully written slices, trim a partly written one
+    while (n > 0) {
+      if ((size_t)n >= pending_[i].iov_len) {
+        n -= pending_[i].iov_len;
+        i++;
+      } else {
+        pending_[i].iov_base = static_cast<uint8_t*>(pending_[i].iov_base) + n;
+        pending_[i].iov_len -= n;
+        n = 0;
+      }
+    }
+  }
+  pending_.clear();
+}
+
+bool Recorder::open_segment() {
+  char name[32];
+  snprintf(name, sizeof(name), "/ucp-%06u.log", next_segment_++);
+  std::string path = options_.dir + name;
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    perror(("recorder: " + path).c_str());
+    write_errors_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  memset(&header_, 0, sizeof(header_));
+  memcpy(header_.magic, kMagic, sizeof(kMagic));
+  header_.version = kVersion;
+  header_.header_size = sizeof(SegmentHeader);
+  header_.created_realtime_ns = realtime_ns();
+  header_.index_every = options_.index_every;
+  segment_ok_ = write(fd_, &header_, sizeof(header_)) == (ssize_t)sizeof(header_);
+  if (!segment_ok_) write_errors_.fetch_add(1, std::memory_order_relaxed);
+  segment_offset_ = sizeof(header_);
+  index_.clear();
+  segments_opened_.fetch_add(1, std::memory_order_relaxed);
+
+  segments_.push_back(path);
+  while (options_.max_segments > 0 && segments_.size() > options_.max_segments) {
+    unlink(segments_.front().c_str());
+    segments_.pop_front();
+  }
+  return true;
+}
+
+// Append the index after the data and fill in the header. After a write
+// error the offsets can't be trusted, so the segment is left without an
+// index and the reader scans it like one cut short by a crash.
+void Recorder::finish_segment() {
+  write_pending();
+  if (fd_ < 0) return;
+  if (segment_ok_) {
+    size_t index_bytes = index_.size() * sizeof(IndexEntry);
+    if (pwrite(fd_, index_.data(), index_bytes, segment_offset_) == (ssize_t)index_bytes) {
+      header_.index_offset = segment_offset_;
+      header_.index_count = index_.size();
+    } else {
+      write_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (pwrite(fd_, &header_, sizeof(header_), 0) != (ssize_t)sizeof(header_)) {
+      write_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  fdatasync(fd_);
+  ::close(fd_);
+  fd_ = -1;
+}
+
+}  // namespace ucp_log
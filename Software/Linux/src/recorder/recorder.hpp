@@ -0,0 +1,121 @@
+// -----------------------------------------------------------------------------
+// Recorder: appends UCP frames to a segmented log (format in ucp_log.hpp)
+//
+// record() runs on the bridge's event loop and never makes a syscall: it
+// copies the frame into a preallocated buffer. Full buffers, or partly full
+// ones older than flush_interval (see tick()), are handed to a background
+// thread that writes them with writev, rotates segments and writes each
+// segment's index when it closes. The hand-off takes a mutex only once per
+// buffer. If the disk falls so far behind that no buffer is free, records
+// are dropped and counted, and the loop is never blocked.
+// -----------------------------------------------------------------------------
+#ifndef UCP_RECORDER_HPP
+#define UCP_RECORDER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ucp_log.hpp"
+
+namespace ucp_log {
+
+struct RecorderOptions {
+  std::string dir;                              // Created if missing
+  size_t segment_bytes = 16 << 20;              // Rotate after this much data
+  size_t max_segments = 64;                     // Oldest segments are deleted beyond this, 0 keeps all
+  size_t buffer_bytes = 64 << 10;
+  size_t buffers = 8;                           // In flight to the flusher, including the one being filled
+  uint64_t flush_interval_ns = 200000000ull;    // Longest a record waits in memory
+  uint32_t index_every = 64;                    // Records per index entry
+};
+
+struct RecorderStats {
+  uint64_t records = 0;          // Accepted by record()
+  uint64_t dropped = 0;          // No free buffer
+  uint64_t bytes_written = 0;
+  uint64_t segments = 0;         // Opened by this recorder
+  uint64_t write_errors = 0;
+};
+
+class Recorder {
+ public:
+  Recorder() = default;
+  ~Recorder();
+  Recorder(const Recorder&) = delete;
+  Recorder& operator=(const Recorder&) = delete;
+
+  // Create the directory, open the first segment and start the flusher.
+  // Returns false with the reason printed.
+  bool open(const RecorderOptions& options);
+
+  // Append one frame. Called from a single thread.
+  void record(uint64_t timestamp_ns, Direction direction, const uint8_t* frame, size_t len);
+
+  // Called periodically from the recording thread: hands over a partly
+  // filled buffer once its first record is flush_interval old.
+  void tick(uint64_t now_ns);
+
+  // Write everything out, close the segment with its index, stop the flusher
+  void close();
+
+  bool is_open() const { return flusher_.joinable(); }
+  RecorderStats stats() const;
+
+ private:
+  struct Buffer {
+    std::vector<uint8_t> data;
+    size_t used = 0;
+  };
+
+  void handoff();
+  void flusher_main();
+  void write_buffers(std::vector<Buffer*>& batch);
+  bool open_segment();
+  void finish_segment();
+  void write_pending();
+
+  RecorderOptions options_;
+
+  // Recording thread
+  Buffer* current_ = nullptr;
+  uint64_t current_since_ns_ = 0;
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+
+  // Shared, under mutex_
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Buffer*> free_;
+  std::vector<Buffer*> full_;
+  bool stopping_ = false;
+
+  std::vector<std::unique_ptr<Buffer>> storage_;
+  std::thread flusher_;
+
+  // Flusher thread
+  int fd_ = -1;
+  uint32_t next_segment_ = 1;
+  uint64_t segment_offset_ = 0;
+  bool segment_ok_ = false;                     // No write error in the current segment
+  SegmentHeader header_;
+  std::vector<IndexEntry> index_;
+  std::vector<struct iovec> pending_;           // Slices of buffers not yet written
+  std::deque<std::string> segments_;            // Existing segment paths, oldest first
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> segments_opened_{0};
+  std::atomic<uint64_t> write_errors_{0};
+};
+
+}  // namespace ucp_log
+
+#endif  // UCP_RECORDER_HPP
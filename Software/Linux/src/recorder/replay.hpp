@@ -0,0 +1,152 @@
+// -----------------------------------------------------------------------------
+// Replayer: plays the frames of a recorded log back into a sink, keeping the
+// recorded spacing between them
+//
+// Frame i is due at start + (t_i - t_0) / speed. With speed == 0 frames go
+// out back to back, which measures how fast the sink can take them. The
+// schedule depends only on the recorded timestamps, so two runs over the same
+// log send the same bytes in the same order.
+//
+// Timing fidelity is reported two ways for every frame sent:
+//   lateness   : actual send time minus due time (a slow sink accumulates it)
+//   gap error  : actual gap to the previous frame minus the scheduled gap
+//                (jitter, independent of any constant offset)
+// -----------------------------------------------------------------------------
+#ifndef UCP_REPLAY_HPP
+#define UCP_REPLAY_HPP
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "ucp_log.hpp"
+
+namespace ucp_log {
+
+struct ReplayOptions {
+  double speed = 1.0;                  // 1 = recorded speed, 0 = as fast as possible
+  int directions = kReplayFromRobot;   // Which recorded directions to send
+  uint64_t from_ns = 0;                // Time window, from the first record of the log
+  uint64_t to_ns = UINT64_MAX;
+
+  static constexpr int kReplayFromRobot = 1 << kFromRobot;
+  static constexpr int kReplayToRobot = 1 << kToRobot;
+};
+
+// Percentiles of one distribution, in nanoseconds
+struct Spread {
+  double p50 = 0, p99 = 0, max = 0;
+};
+
+struct ReplayStats {
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t elapsed_ns = 0;             // Wall time of the replay
+  uint64_t recorded_ns = 0;            // Span of the replayed records as recorded
+  Spread lateness;                     // Both zero with speed == 0
+  Spread gap_error;                    // |actual gap - scheduled gap|
+  bool sink_failed = false;
+};
+
+class Replayer {
+ public:
+  explicit Replayer(const ReplayOptions& options) : options_(options) {}
+
+  // Send every selected record to sink(const Record&), which returns false
+  // to stop. `log` is positioned at the start of the window first.
+  template <typename Sink>
+  ReplayStats run(LogReader& log, Sink&& sink) {
+    ReplayStats stats;
+    std::vector<double> late, gap;
+
+    log.rewind();
+    Record r;
+    if (!log.next(&r)) return stats;
+    uint64_t origin = r.timestamp_ns;
+    uint64_t window_start = origin + options_.from_ns;
+    uint64_t window_end = options_.to_ns == UINT64_MAX ? UINT64_MAX : origin + options_.to_ns;
+    log.seek(window_start);
+
+    bool first = true;
+    uint64_t t0 = 0, start = 0, prev_due = 0, prev_sent = 0, last_ts = 0;
+    while (log.next(&r) && r.timestamp_ns <= window_end) {
+      if (!(options_.directions & (1 << r.direction))) continue;
+
+      uint64_t now = now_ns();
+      if (first) {
+        t0 = r.timestamp_ns;
+        start = now;
+      }
+      uint64_t due = start;
+      if (options_.speed > 0) {
+        // Never schedule backwards, even if the log's timestamps do step back
+        due = std::max(start + (uint64_t)((r.timestamp_ns - std::min(t0, r.timestamp_ns)) / options_.speed),
+                       prev_due);
+        if (due > now) {
+          sleep_until(due);
+          now = now_ns();
+        }
+      }
+      if (!sink(r)) {
+        stats.sink_failed = true;
+        break;
+      }
+
+      if (options_.speed > 0) late.push_back((double)(now - due));
+      if (options_.speed > 0 && !first) {
+        double scheduled = (double)(due - prev_due);
+        double actual = (double)(now - prev_sent);
+        gap.push_back(actual > scheduled ? actual - scheduled : scheduled - actual);
+      }
+      first = false;
+      prev_due = due;
+      prev_sent = now;
+      last_ts = r.timestamp_ns;
+      stats.frames++;
+      stats.bytes += r.len;
+    }
+
+    if (stats.frames > 0) {
+      stats.elapsed_ns = now_ns() - start;
+      stats.recorded_ns = last_ts - t0;
+    }
+    stats.lateness = spread(late);
+    stats.gap_error = spread(gap);
+    return stats;
+  }
+
+ private:
+  static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+  static void sleep_until(uint64_t deadline) {
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+  }
+
+  static Spread spread(std::vector<double>& v) {
+    Spread s;
+    if (v.empty()) return s;
+    std::sort(v.begin(), v.end());
+    s.p50 = v[v.size() / 2];
+    s.p99 = v[std::min(v.size() - 1, (size_t)(v.size() * 0.99))];
+    s.max = v.back();
+    return s;
+  }
+
+  ReplayOptions options_;
+};
+
+}  // namespace ucp_log
+
+#endif  // UCP_REPLAY_HPP
@@ -0,0 +1,179 @@
+#include "ucp_log.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace ucp_log {
+
+static const uint32_t kDefaultIndexEvery = 64;
+
+SegmentReader::~SegmentReader() { close(); }
+
+void SegmentReader::close() {
+  if (base_) munmap(const_cast<uint8_t*>(base_), size_);
+  base_ = nullptr;
+  header_ = nullptr;
+  index_ = nullptr;
+  index_count_ = 0;
+  built_index_.clear();
+  size_ = 0;
+}
+
+bool SegmentReader::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error_ = path + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SegmentHeader)) {
+    error_ = path + ": too short for a segment header";
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    error_ = path + ": " + strerror(errno);
+    return false;
+  }
+  base_ = static_cast<const uint8_t*>(p);
+  size_ = st.st_size;
+  header_ = reinterpret_cast<const SegmentHeader*>(base_);
+
+  if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 || header_->version != kVersion) {
+    error_ = path + ": not a UCP log segment";
+    close();
+    return false;
+  }
+
+  uint64_t index_bytes = (uint64_t)header_->index_count * sizeof(IndexEntry);
+  if (header_->index_offset != 0 && header_->index_offset + index_bytes <= size_) {
+    index_ = reinterpret_cast<const IndexEntry*>(base_ + header_->index_offset);
+    index_count_ = header_->index_count;
+    data_end_ = header_->index_offset;
+    record_count_ = header_->record_count;
+    return true;
+  }
+  return scan();
+}
+
+// Walk a segment that was never closed and index it in memory
+bool SegmentReader::scan() {
+  uint32_t every = header_->index_every ? header_->index_every : kDefaultIndexEvery;
+  uint64_t offset = begin();
+  record_count_ = 0;
+  while (offset + sizeof(RecordHeader) <= size_) {
+    const RecordHeader* rh = reinterpret_cast<const RecordHeader*>(base_ + offset);
+    size_t total = record_size(rh->len);
+    if (rh->timestamp_ns == 0 || offset + total > size_) break;  // Preallocated tail or torn write
+    if (record_count_ % every == 0) built_index_.push_back({rh->timestamp_ns, offset});
+    record_count_++;
+    offset += total;
+  }
+  data_end_ = offset;
+  index_ = built_index_.data();
+  index_count_ = built_index_.size();
+  return true;
+}
+
+uint64_t SegmentReader::seek(uint64_t timestamp_ns) const {
+  if (index_count_ == 0) return end();
+  // Last index entry at or before ts; records before it are all older
+  const IndexEntry* first = index_;
+  const IndexEntry* last = index_ + index_count_;
+  const IndexEntry* it = std::upper_bound(first, last, timestamp_ns,
+      [](uint64_t ts, const IndexEntry& e) { return ts < e.timestamp_ns; });
+  uint64_t offset = it == first ? first->offset : (it - 1)->offset;
+
+  Record r;
+  uint64_t cursor = offset;
+  while (next(&cursor, &r)) {
+    if (r.timestamp_ns >= timestamp_ns) return r.offset;
+  }
+  return end();
+}
+
+bool SegmentReader::next(uint64_t* offset, Record* record) const {
+  if (*offset + sizeof(RecordHeader) > data_end_) return false;
+  const RecordHeader* rh = reinterpret_cast<const RecordHeader*>(base_ + *offset);
+  size_t total = record_size(rh->len);
+  if (*offset + total > data_end_) return false;
+  record->timestamp_ns = rh->timestamp_ns;
+  record->direction = static_cast<Direction>(rh->direction);
+  record->frame = base_ + *offset + sizeof(RecordHeader);
+  record->len = rh->len;
+  record->offset = *offset;
+  *offset += total;
+  return true;
+}
+
+std::vector<std::string> list_segments(const std::string& dir) {
+  std::vector<std::string> names;
+  DIR* d = opendir(dir.c_str());
+  if (!d) return names;
+  while (struct dirent* e = readdir(d)) {
+    unsigned n;
+    char tail;
+    if (sscanf(e->d_name, "ucp-%u.lo%c", &n, &tail) == 2 && tail == 'g') names.push_back(e->d_name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());  // Zero-padded sequence numbers sort in order
+  for (std::string& n : names) n = dir + "/" + n;
+  return names;
+}
+
+// -----------------------------------------------------------------------------
+// LogReader
+// -----------------------------------------------------------------------------
+bool LogReader::open(const std::string& dir) {
+  paths_ = list_segments(dir);
+  if (paths_.empty()) {
+    error_ = dir + ": no log segments";
+    return false;
+  }
+  for (size_t i = 0; i < paths_.size(); i++) {
+    if (open_segment(i)) return true;
+  }
+  return false;
+}
+
+bool LogReader::open_segment(size_t i) {
+  current_ = i;
+  if (!reader_.open(paths_[i])) {
+    error_ = reader_.error();
+    offset_ = 0;
+    return false;
+  }
+  offset_ = reader_.begin();
+  return true;
+}
+
+void LogReader::seek(uint64_t timestamp_ns) {
+  for (size_t i = 0; i < paths_.size(); i++) {
+    if (!open_segment(i)) continue;
+    offset_ = reader_.seek(timestamp_ns);
+    if (offset_ < reader_.end()) return;
+  }
+}
+
+bool LogReader::next(Record* record) {
+  for (;;) {
+    if (offset_ != 0 && reader_.next(&offset_, record)) return true;
+    // Unreadable segments are skipped; the reason stays in error()
+    do {
+      if (current_ + 1 >= paths_.size()) return false;
+    } while (!open_segment(current_ + 1));
+  }
+}
+
+}  // namespace ucp_log
@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------------------
+// UCP traffic log: on-disk format and segment reader
+//
+// A log is a directory of segment files ucp-000001.log, ucp-000002.log, ...
+// Each segment is
+//
+//   SegmentHeader (64 bytes)
+//   records       RecordHeader + frame bytes, padded to 8 bytes
+//   index         IndexEntry[index_count], one per index_every records
+//
+// Timestamps are CLOCK_MONOTONIC nanoseconds, the clock the bridge and the
+// telemetry bus use. The header also stores the wall-clock time the segment
+// was opened, to line a log up with other evidence from the field.
+//
+// The index is written when a segment is closed. A segment left open by a
+// crash or power cut has index_offset == 0; the reader then scans it once and
+// builds the index in memory, stopping at the first incomplete record.
+// -----------------------------------------------------------------------------
+#ifndef UCP_LOG_HPP
+#define UCP_LOG_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace ucp_log {
+
+constexpr char kMagic[8] = {'U', 'C', 'P', 'L', 'O', 'G', '1', '\0'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kAlign = 8;
+
+enum Direction : uint8_t {
+  kFromRobot = 0,   // UART -> head (telemetry, acks)
+  kToRobot = 1,     // head -> UART (commands)
+};
+
+#pragma pack(push, 1)
+struct SegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t created_realtime_ns;   // CLOCK_REALTIME when the segment was opened
+  uint64_t first_timestamp_ns;    // 0 until the first record
+  uint64_t last_timestamp_ns;
+  uint64_t record_count;          // Filled in on close
+  uint64_t index_offset;          // 0 while the segment is open
+  uint32_t index_count;
+  uint32_t index_every;           // Records per index entry
+};
+
+struct RecordHeader {
+  uint64_t timestamp_ns;
+  uint16_t len;                   // Frame bytes that follow (sync + message + CRC)
+  uint8_t direction;              // Direction
+  uint8_t flags;                  // Reserved, 0
+};
+
+struct IndexEntry {
+  uint64_t timestamp_ns;          // Timestamp of the record at `offset`
+  uint64_t offset;                // File offset of a RecordHeader
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SegmentHeader) == 64, "segment header is 64 bytes");
+static_assert(sizeof(RecordHeader) == 12, "record header is 12 bytes");
+
+inline size_t record_size(size_t frame_len) {
+  return (sizeof(RecordHeader) + frame_len + kAlign - 1) & ~(kAlign - 1);
+}
+
+// One record, pointing into the mapped segment
+struct Record {
+  uint64_t timestamp_ns;
+  Direction direction;
+  const uint8_t* frame;
+  size_t len;
+  uint64_t offset;                // Of this record's header
+};
+
+// -----------------------------------------------------------------------------
+// SegmentReader: maps one segment read-only. Records are handed out as views
+// into the mapping; nothing is copied.
+// -----------------------------------------------------------------------------
+class SegmentReader {
+ public:
+  SegmentReader() = default;
+  ~SegmentReader();
+  SegmentReader(const SegmentReader&) = delete;
+  SegmentReader& operator=(const SegmentReader&) = delete;
+
+  // Returns false with the reason in error()
+  bool open(const std::string& path);
+  void close();
+
+  // Offset of the first record with timestamp >= ts (end() if none):
+  // binary search over the index, then at most index_every records scanned.
+  uint64_t seek(uint64_t timestamp_ns) const;
+
+  // Read the record at `offset` and advance `offset` past it. Returns false
+  // at the end of the data.
+  bool next(uint64_t* offset, Record* record) const;
+
+  uint64_t begin() const { return sizeof(SegmentHeader); }
+  uint64_t end() const { return data_end_; }
+  const SegmentHeader& header() const { return *header_; }
+  uint64_t record_count() const { return record_count_; }
+  bool was_closed() const { return header_->index_offset != 0; }
+  const std::string& error() const { return error_; }
+
+ private:
+  bool scan();
+
+  const uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+  const SegmentHeader* header_ = nullptr;
+  const IndexEntry* index_ = nullptr;
+  size_t index_count_ = 0;
+  std::vector<IndexEntry> built_index_;   // For segments without a footer
+  uint64_t data_end_ = 0;
+  uint64_t record_count_ = 0;
+  std::string error_;
+};
+
+// Segment files of a log directory in order
+std::vector<std::string> list_segments(const std::string& dir);
+
+// -----------------------------------------------------------------------------
+// LogReader: the records of a whole log directory in order, one segment
+// mapped at a time. A Record stays valid until next() moves to the next
+// segment.
+// -----------------------------------------------------------------------------
+class LogReader {
+ public:
+  // Returns false with the reason in error() if the directory has no
+  // readable segment
+  bool open(const std::string& dir);
+
+  // Position at the first record with timestamp >= ts. Segments that end
+  // before ts are skipped by their header (closed) or index (recovered).
+  void seek(uint64_t timestamp_ns);
+
+  bool next(Record* record);
+
+  // Back to the first record
+  void rewind() { seek(0); }
+
+  size_t segments() const { return paths_.size(); }
+  const std::string& error() const { return error_; }
+
+ private:
+  bool open_segment(size_t i);
+
+  std::vector<std::string> paths_;
+  size_t current_ = 0;
+  SegmentReader reader_;
+  uint64_t offset_ = 0;
+  std::string error_;
+};
+
+}  // namespace ucp_log
+
+#endif  // UCP_LOG_HPP
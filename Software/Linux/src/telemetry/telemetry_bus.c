@@ -0,0 +1,205 @@
+/*
+ * Telemetry bus, see telemetry_bus.h
+ *
+ * Memory ordering follows the usual seqlock recipe: the writer's lock
+ * increments are release stores around the data, and the reader re-reads
+ * the lock after an acquire fence. The payload copy itself is plain memcpy;
+ * a torn copy is always caught by the lock check and thrown away.
+ */
+#include "telemetry_bus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SLOT_MASK (TELEMETRY_BUS_SLOTS - 1)
+#define READ_RETRIES 64     // A slot is rewritten at most once per ~1000 frames; give up after this many torn copies
+
+_Static_assert((TELEMETRY_BUS_SLOTS & SLOT_MASK) == 0, "slot count must be a power of two");
+
+uint64_t telemetry_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+telemetry_bus_t *telemetry_bus_create(const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, sizeof(telemetry_bus_t)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(telemetry_bus_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    /*
+     * Start from an empty ring. A reader still mapped from an earlier run
+     * sees head go back to 0; its cursor then waits until the new stream
+     * catches up, which is acceptable for a restart.
+     */
+    telemetry_bus_t *bus = (telemetry_bus_t *)p;
+    __atomic_store_n(&bus->magic, 0, __ATOMIC_RELAXED);
+    memset(bus->slots, 0, sizeof(bus->slots));
+    bus->version = TELEMETRY_BUS_VERSION;
+    bus->slot_count = TELEMETRY_BUS_SLOTS;
+    bus->slot_size = sizeof(telemetry_slot_t);
+    __atomic_store_n(&bus->head, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&bus->magic, TELEMETRY_BUS_MAGIC, __ATOMIC_RELEASE);
+    return bus;
+}
+
+const telemetry_bus_t *telemetry_bus_open(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(telemetry_bus_t)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(telemetry_bus_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    const telemetry_bus_t *bus = (const telemetry_bus_t *)p;
+    if (__atomic_load_n(&bus->magic, __ATOMIC_ACQUIRE) != TELEMETRY_BUS_MAGIC ||
+        bus->version != TELEMETRY_BUS_VERSION || bus->slot_count != TELEMETRY_BUS_SLOTS ||
+        bus->slot_size != sizeof(telemetry_slot_t)) {
+        munmap(p, sizeof(telemetry_bus_t));
+        errno = EPROTO;
+        return NULL;
+    }
+    return bus;
+}
+
+void telemetry_bus_close(const telemetry_bus_t *bus)
+{
+    if (bus)
+        munmap((void *)bus, sizeof(telemetry_bus_t));
+}
+
+int telemetry_bus_unlink(const char *name)
+{
+    return shm_unlink(name);
+}
+
+void telemetry_bus_publish(telemetry_bus_t *bus, const void *msg, size_t len, uint64_t timestamp_ns)
+{
+    if (len > TELEMETRY_MSG_MAX)
+        len = TELEMETRY_MSG_MAX;
+
+    uint64_t seq = __atomic_load_n(&bus->head, __ATOMIC_RELAXED);
+    telemetry_slot_t *slot = &bus->slots[seq & SLOT_MASK];
+    uint32_t lock = __atomic_load_n(&slot->lock, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->seq = seq;
+    slot->timestamp_ns = timestamp_ns;
+    slot->len = (uint16_t)len;
+    slot->id = len >= 3 ? ((const uint8_t *)msg)[2] : 0;
+    memcpy(slot->msg, msg, len);
+    __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&bus->head, seq + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t telemetry_bus_head(const telemetry_bus_t *bus)
+{
+    return __atomic_load_n(&bus->head, __ATOMIC_ACQUIRE);
+}
+
+/* Copy one slot. Returns 0 with a consistent copy, -1 if the writer kept interfering. */
+static int copy_slot(const telemetry_slot_t *slot, telemetry_sample_t *out)
+{
+    for (int i = 0; i < READ_RETRIES; i++) {
+        uint32_t before = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        out->seq = slot->seq;
+        out->timestamp_ns = slot->timestamp_ns;
+        out->len = slot->len;
+        out->id = slot->id;
+        if (out->len > TELEMETRY_MSG_MAX)
+            continue;   // Torn length, the lock check below would reject it anyway
+        memcpy(out->msg, slot->msg, out->len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == before)
+            return 0;
+    }
+    return -1;
+}
+
+int telemetry_bus_read(const telemetry_bus_t *bus, uint64_t seq, telemetry_sample_t *out)
+{
+    if (seq >= telemetry_bus_head(bus))
+        return 1;
+    if (copy_slot(&bus->slots[seq & SLOT_MASK], out) < 0 || out->seq != seq)
+        return -1;  // Rewritten with a newer frame (or being rewritten right now)
+    return 0;
+}
+
+int telemetry_bus_latest(const telemetry_bus_t *bus, uint8_t id, telemetry_sample_t *out)
+{
+    uint64_t head = telemetry_bus_head(bus);
+    uint64_t oldest = head > TELEMETRY_BUS_SLOTS ? head - TELEMETRY_BUS_SLOTS : 0;
+    for (uint64_t seq = head; seq > oldest; seq--) {
+        int ret = telemetry_bus_read(bus, seq - 1, out);
+        if (ret < 0)
+            return -1;  // Lapped while scanning: everything older is gone too
+        if (out->id == id)
+            return 0;
+    }
+    return -1;
+}
+
+void telemetry_reader_init(telemetry_reader_t *reader, const telemetry_bus_t *bus, int from_start)
+{
+    uint64_t head = telemetry_bus_head(bus);
+    reader->bus = bus;
+    reader->lost = 0;
+    if (from_start)
+        reader->next = head > TELEMETRY_BUS_SLOTS ? head - TELEMETRY_BUS_SLOTS : 0;
+    else
+        reader->next = head;
+}
+
+int telemetry_reader_poll(telemetry_reader_t *reader, telemetry_sample_t *out)
+{
+    for (;;) {
+        int ret = telemetry_bus_read(reader->bus, reader->next, out);
+        if (ret == 0) {
+            reader->next++;
+            return 1;
+        }
+        if (ret > 0) {
+            /* Caught up, or the writer restarted with a shorter stream */
+            uint64_t head = telemetry_bus_head(reader->bus);
+            if (reader->next > head)
+                reader->next = head;
+            return 0;
+        }
+        /* Overwritten: skip to the oldest frame that should still be there */
+        uint64_t head = telemetry_bus_head(reader->bus);
+        uint64_t oldest = head > TELEMETRY_BUS_SLOTS ? head - TELEMETRY_BUS_SLOTS : 0;
+        if (oldest <= reader->next)
+            oldest = reader->next + 1;  // Slot is mid-rewrite; that frame is gone
+        reader->lost += oldest - reader->next;
+        reader->next = oldest;
+    }
+}
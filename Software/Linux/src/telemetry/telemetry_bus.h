@@ -0,0 +1,109 @@
+/*
+ * Telemetry bus: decoded UCP frames from the robot, shared with every local
+ * process through POSIX shared memory.
+ *
+ * One process (the bridge, which owns the UART) publishes; any number of
+ * processes map the bus read-only. The bus is a ring of fixed-size slots,
+ * each guarded by a sequence lock: the writer makes the slot's lock odd,
+ * fills the slot, then makes it even again. A reader copies the slot and
+ * keeps the copy only if the lock was even and unchanged around the copy.
+ * Readers never block the writer and need no syscalls per sample; a reader
+ * that falls a whole ring behind is told how many frames it missed.
+ *
+ * Usable from C (the camera process) and C++ (the bridge).
+ */
+#ifndef __TELEMETRY_BUS_H__
+#define __TELEMETRY_BUS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_BUS_NAME      "/ucp_telemetry"    // Default shm object (/dev/shm/ucp_telemetry)
+#define TELEMETRY_BUS_MAGIC     (0x55435042)        // "UCPB"
+#define TELEMETRY_BUS_VERSION   (1)
+#define TELEMETRY_BUS_SLOTS     (1024)              // Power of two; ~1 s of frames at full rate
+#define TELEMETRY_MSG_MAX       (256)               // Largest UCP message (hd.len) carried
+
+/* One published frame: the UCP message (ucp_hd_t + body, no sync or CRC) */
+typedef struct telemetry_sample {
+    uint64_t    seq;            // Position in the stream, 0 for the first frame ever published
+    uint64_t    timestamp_ns;   // CLOCK_MONOTONIC when the bridge decoded the frame
+    uint16_t    len;            // Message length (hd.len)
+    uint8_t     id;             // hd.id, for filtering without parsing
+    uint8_t     msg[TELEMETRY_MSG_MAX];
+} telemetry_sample_t;
+
+/* Shared memory layout. Lock and head are only touched with atomics. */
+typedef struct telemetry_slot {
+    uint32_t    lock;           // Sequence lock: odd while the writer is inside
+    uint16_t    len;
+    uint8_t     id;
+    uint8_t     reserved;
+    uint64_t    seq;
+    uint64_t    timestamp_ns;
+    uint8_t     msg[TELEMETRY_MSG_MAX];
+} __attribute__((aligned(64))) telemetry_slot_t;
+
+typedef struct telemetry_bus {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    slot_count;
+    uint32_t    slot_size;
+    uint64_t    head __attribute__((aligned(64)));  // Frames published so far
+    telemetry_slot_t slots[TELEMETRY_BUS_SLOTS];
+} telemetry_bus_t;
+
+/* Per-reader cursor for consuming every frame in order */
+typedef struct telemetry_reader {
+    const telemetry_bus_t *bus;
+    uint64_t    next;           // Next seq to read
+    uint64_t    lost;           // Frames overwritten before this reader got to them
+} telemetry_reader_t;
+
+/*
+ * Writer side. create() makes (or reuses) the shm object and maps it
+ * read-write; the caller is the only publisher. Returns NULL with errno set.
+ */
+telemetry_bus_t *telemetry_bus_create(const char *name);
+void telemetry_bus_publish(telemetry_bus_t *bus, const void *msg, size_t len, uint64_t timestamp_ns);
+
+/* Reader side: map an existing bus read-only. Returns NULL with errno set. */
+const telemetry_bus_t *telemetry_bus_open(const char *name);
+
+/* Unmap a bus from either side. unlink() removes the shm object itself. */
+void telemetry_bus_close(const telemetry_bus_t *bus);
+int telemetry_bus_unlink(const char *name);
+
+/* Number of frames published so far */
+uint64_t telemetry_bus_head(const telemetry_bus_t *bus);
+
+/*
+ * Copy frame `seq` out of the ring.
+ * Returns 0 on success, 1 if it hasn't been published yet, -1 if it has
+ * already been overwritten.
+ */
+int telemetry_bus_read(const telemetry_bus_t *bus, uint64_t seq, telemetry_sample_t *out);
+
+/* Newest frame with hd.id == id. Returns 0 on success, -1 if none is in the ring. */
+int telemetry_bus_latest(const telemetry_bus_t *bus, uint8_t id, telemetry_sample_t *out);
+
+/*
+ * In-order consumption. init() starts at the newest frame (from_start = 0) or
+ * the oldest one still in the ring. poll() returns 1 with the next frame,
+ * 0 when caught up. Overwritten frames are skipped and added to `lost`.
+ */
+void telemetry_reader_init(telemetry_reader_t *reader, const telemetry_bus_t *bus, int from_start);
+int telemetry_reader_poll(telemetry_reader_t *reader, telemetry_sample_t *out);
+
+/* CLOCK_MONOTONIC in nanoseconds, the clock the bus timestamps use */
+uint64_t telemetry_now_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_BUS_H__ */
@@ -0,0 +1,193 @@
+// -----------------------------------------------------------------------------
+// UART Control Protocol (UCP) frame codec for the Linux head
+//
+// Every UCP packet on the wire is
+//
+//   0xFD 0xFF | message (ucp_hd_t + body) | CRC16 (little endian)
+//
+// where hd.len is sizeof(message) and the CRC covers the sync bytes and the
+// message. The message layouts are the packed structs from ucp.h, shared with
+// the STM32 firmware, so this header never redeclares them. Frames are built
+// in caller-owned (usually stack) storage; nothing here touches the heap.
+// -----------------------------------------------------------------------------
+#ifndef UCP_CODEC_HPP
+#define UCP_CODEC_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp.h"
+#include "ucp_crc.h"
+
+namespace ucp {
+
+constexpr uint8_t kSync0 = 0xFD;          // First byte of every frame
+constexpr uint8_t kSync1 = 0xFF;          // Second byte of every frame
+constexpr size_t kSyncSize = 2;
+constexpr size_t kCrcSize = 2;
+constexpr size_t kFrameOverhead = kSyncSize + kCrcSize;
+
+// -----------------------------------------------------------------------------
+// Wire sizes. ucp.h is the contract with the firmware; if a struct there
+// changes size, every head-side user of it has to be revisited.
+// -----------------------------------------------------------------------------
+static_assert(sizeof(ucp_hd_t) == 4, "ucp_hd_t must be 4 bytes on the wire");
+static_assert(sizeof(ucp_alive_ping_t) == 4, "ucp_alive_ping_t wire size");
+static_assert(sizeof(ucp_alive_pong_t) == 5, "ucp_alive_pong_t wire size");
+static_assert(sizeof(ucp_ctl_cmd_t) == 20, "ucp_ctl_cmd_t wire size");
+static_assert(sizeof(ucp_imu_correct_t) == 5, "ucp_imu_correct_t wire size");
+static_assert(sizeof(ucp_imu_correct_ack_t) == 6, "ucp_imu_correct_ack_t wire size");
+static_assert(sizeof(ucp_rep_t) == 40, "ucp_rep_t wire size");
+static_assert(sizeof(ucp_mag_w_t) == 10, "ucp_mag_w_t wire size");
+static_assert(sizeof(ucp_mag_w_ack_t) == 5, "ucp_mag_w_ack_t wire size");
+static_assert(sizeof(ucp_imu_w_t) == 16, "ucp_imu_w_t wire size");
+static_assert(sizeof(ucp_imu_w_ack_t) == 5, "ucp_imu_w_ack_t wire size");
+static_assert(sizeof(ucp_imu_r_t) == 4, "ucp_imu_r_t wire size");
+static_assert(sizeof(ucp_imu_r_ack_t) == 23, "ucp_imu_r_ack_t wire size");
+static_assert(sizeof(ucp_ota_t) == 6, "ucp_ota_t wire size");
+static_assert(sizeof(ucp_ota_ack_t) == 5, "ucp_ota_ack_t wire size");
+static_assert(sizeof(ucp_time_sync_t) == 12, "ucp_time_sync_t wire size");
+static_assert(sizeof(ucp_time_sync_ack_t) == 28, "ucp_time_sync_ack_t wire size");
+static_assert(sizeof(ucp_rep_v2_t) == 50, "ucp_rep_v2_t wire size");
+static_assert(sizeof(ucp_baud_set_t) == 10, "ucp_baud_set_t wire size");
+static_assert(sizeof(ucp_baud_set_ack_t) == 9, "ucp_baud_set_ack_t wire size");
+static_assert(sizeof(ucp_subscribe_t) == 8, "ucp_subscribe_t wire size");
+static_assert(sizeof(ucp_subscribe_ack_t) == 9, "ucp_subscribe_ack_t wire size");
+static_assert(sizeof(ucp_telemetry_t) == 14, "ucp_telemetry_t wire size");
+static_assert(sizeof(ucp_tlm_wheels_t) == 8, "ucp_tlm_wheels_t wire size");
+static_assert(sizeof(ucp_tlm_imu_raw_t) == 18, "ucp_tlm_imu_raw_t wire size");
+static_assert(sizeof(ucp_tlm_attitude_t) == 2, "ucp_tlm_attitude_t wire size");
+static_assert(sizeof(ucp_tlm_power_t) == 8, "ucp_tlm_power_t wire size");
+static_assert(sizeof(ucp_tlm_tof_t) == 8, "ucp_tlm_tof_t wire size");
+static_assert(sizeof(ucp_imu_sample_t) == 12, "ucp_imu_sample_t wire size");
+static_assert(sizeof(ucp_imu_batch_t) == 18, "ucp_imu_batch_t wire size");
+static_assert(sizeof(ucp_rep_delta_t) == 6, "ucp_rep_delta_t wire size");
+static_assert(sizeof(ucp_rep_delta_ack_t) == 5, "ucp_rep_delta_ack_t wire size");
+static_assert(sizeof(ucp_hello_t) == 5, "ucp_hello_t wire size");
+static_assert(sizeof(ucp_hello_ack_t) == 54, "ucp_hello_ack_t wire size");
+
+// -----------------------------------------------------------------------------
+// Default message ID for each struct. Types that are used with more than one
+// ID (ucp_imu_correct_t for start/end) have no default and need the ID passed
+// explicitly.
+// -----------------------------------------------------------------------------
+template <typename T>
+struct MessageId;
+
+template <> struct MessageId<ucp_alive_ping_t> { static constexpr uint8_t value = UCP_KEEP_ALIVE; };
+template <> struct MessageId<ucp_alive_pong_t> { static constexpr uint8_t value = UCP_KEEP_ALIVE; };
+template <> struct MessageId<ucp_ctl_cmd_t>    { static constexpr uint8_t value = UCP_MOTOR_CTL; };
+template <> struct MessageId<ucp_rep_t>        { static constexpr uint8_t value = UCP_RPM_REPORT; };
+template <> struct MessageId<ucp_imu_w_t>      { static constexpr uint8_t value = UCP_IMU_WRITE; };
+template <> struct MessageId<ucp_imu_w_ack_t>  { static constexpr uint8_t value = UCP_IMU_WRITE; };
+template <> struct MessageId<ucp_mag_w_t>      { static constexpr uint8_t value = UCP_MAG_WRITE; };
+template <> struct MessageId<ucp_mag_w_ack_t>  { static constexpr uint8_t value = UCP_MAG_WRITE; };
+template <> struct MessageId<ucp_imu_r_t>      { static constexpr uint8_t value = UCP_IMUMAG_READ; };
+template <> struct MessageId<ucp_imu_r_ack_t>  { static constexpr uint8_t value = UCP_IMUMAG_READ; };
+template <> struct MessageId<ucp_ota_t>        { static constexpr uint8_t value = UCP_OTA; };
+template <> struct MessageId<ucp_ota_ack_t>    { static constexpr uint8_t value = UCP_OTA; };
+template <> struct MessageId<ucp_time_sync_t>  { static constexpr uint8_t value = UCP_TIME_SYNC; };
+template <> struct MessageId<ucp_time_sync_ack_t> { static constexpr uint8_t value = UCP_TIME_SYNC; };
+template <> struct MessageId<ucp_rep_v2_t>     { static constexpr uint8_t value = UCP_REPORT_V2; };
+template <> struct MessageId<ucp_baud_set_t>   { static constexpr uint8_t value = UCP_BAUD_SET; };
+template <> struct MessageId<ucp_baud_set_ack_t> { static constexpr uint8_t value = UCP_BAUD_SET; };
+template <> struct MessageId<ucp_subscribe_t>  { static constexpr uint8_t value = UCP_SUBSCRIBE; };
+template <> struct MessageId<ucp_subscribe_ack_t> { static constexpr uint8_t value = UCP_SUBSCRIBE; };
+template <> struct MessageId<ucp_rep_delta_ack_t> { static constexpr uint8_t value = UCP_REPORT_DELTA; };
+template <> struct MessageId<ucp_hello_t>      { static constexpr uint8_t value = UCP_HELLO; };
+template <> struct MessageId<ucp_hello_ack_t>  { static constexpr uint8_t value = UCP_HELLO; };
+
+// CRC16 used on every frame, shared with the firmware (see ucp_crc.h)
+inline uint16_t crc16(const uint8_t* msg, size_t len) { return ucp_crc16(msg, len); }
+
+// -----------------------------------------------------------------------------
+// Frame<T>: one complete wire frame carrying message type T. Declare it on the
+// stack, fill in `msg`, let an Encoder seal it and write data()/size().
+// -----------------------------------------------------------------------------
+#pragma pack(push, 1)
+template <typename T>
+struct Frame {
+  uint8_t sync[kSyncSize];
+  T msg;
+  uint8_t crc[kCrcSize];
+
+  static constexpr size_t size() { return sizeof(T) + kFrameOverhead; }
+  const uint8_t* data() const { return reinterpret_cast<const uint8_t*>(this); }
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Frame<ucp_ctl_cmd_t>) == 24, "motor command frame is 24 bytes");
+static_assert(sizeof(Frame<ucp_rep_t>) == 44, "report frame is 44 bytes");
+
+// Fill sync bytes and CRC of a frame whose header is already in place.
+// `frame` points at frame_len bytes: sync + message + CRC.
+inline void seal_raw(uint8_t* frame, size_t frame_len) {
+  frame[0] = kSync0;
+  frame[1] = kSync1;
+  uint16_t crc = crc16(frame, frame_len - kCrcSize);
+  frame[frame_len - 2] = crc & 0xff;
+  frame[frame_len - 1] = crc >> 8;
+}
+
+// -----------------------------------------------------------------------------
+// Encoder: stamps headers and CRCs. Owns the hd.index sequence so every frame
+// sent through one Encoder carries a distinct (wrapping) index.
+// -----------------------------------------------------------------------------
+class Encoder {
+ public:
+  // Seal a frame in place. msg fields other than the header are left as-is.
+  template <typename T>
+  void seal(Frame<T>& frame, uint8_t id = MessageId<T>::value) {
+    static_assert(sizeof(Frame<T>) == Frame<T>::size(), "Frame<T> must not be padded");
+    frame.msg.hd.len = sizeof(T);
+    frame.msg.hd.id = id;
+    frame.msg.hd.index = index_++;
+    seal_raw(reinterpret_cast<uint8_t*>(&frame), sizeof(Frame<T>));
+  }
+
+  // Encode a message into a caller buffer. Returns the frame length, or 0 if
+  // `cap` is too small. The caller's copy of msg is not modified.
+  template <typename T>
+  size_t encode(const T& msg, uint8_t* out, size_t cap, uint8_t id = MessageId<T>::value) {
+    const size_t len = Frame<T>::size();
+    if (cap < len) return 0;
+    memcpy(out + kSyncSize, &msg, sizeof(T));
+    ucp_hd_t hd;
+    hd.len = sizeof(T);
+    hd.id = id;
+    hd.index = index_++;
+    memcpy(out + kSyncSize, &hd, sizeof(hd));
+    seal_raw(out, len);
+    return len;
+  }
+
+  // Seal a frame of variable length built by hand: `frame` is frame_len
+  // bytes, the message body already in place behind the header
+  void seal_bytes(uint8_t* frame, size_t frame_len, uint8_t id) {
+    ucp_hd_t hd;
+    hd.len = (uint16_t)(frame_len - kFrameOverhead);
+    hd.id = id;
+    hd.index = index_++;
+    memcpy(frame + kSyncSize, &hd, sizeof(hd));
+    seal_raw(frame, frame_len);
+  }
+
+  uint8_t next_index() const { return index_; }
+
+ private:
+  uint8_t index_ = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Helpers for the messages the head sends most
+// -----------------------------------------------------------------------------
+inline void make_ctl_cmd(Frame<ucp_ctl_cmd_t>& frame, int16_t speed, int16_t angular) {
+  memset(&frame, 0, sizeof(frame));
+  frame.msg.speed = speed;
+  frame.msg.angular = angular;
+}
+
+}  // namespace ucp
+
+#endif  // UCP_CODEC_HPP
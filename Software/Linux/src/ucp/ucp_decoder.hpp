@@ -0,0 +1,262 @@
+// -----------------------------------------------------------------------------
+// Streaming UCP frame decoder
+//
+// Accepts the byte stream in chunks of any size (single bytes, split or merged
+// TCP segments, whole UART reads) and hands out each valid frame exactly once.
+// The decoder hunts for the 0xFD 0xFF preamble, checks hd.len and hd.id before
+// trusting the length, and verifies the CRC. After a bad header or CRC it
+// rescans from the byte after the rejected preamble, so a frame hiding behind
+// garbage is never lost.
+//
+// Frames that lie entirely inside the chunk being fed are handed out as views
+// into that chunk; only a frame split across chunks is copied, into a small
+// fixed buffer. No heap allocation.
+// -----------------------------------------------------------------------------
+#ifndef UCP_DECODER_HPP
+#define UCP_DECODER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp_codec.hpp"
+
+namespace ucp {
+
+constexpr size_t kHeaderBytes = kSyncSize + 3;      // Sync + hd.len + hd.id: enough to size a frame
+constexpr size_t kMaxMessageLen = 256;              // Largest hd.len accepted
+constexpr size_t kMaxFrameLen = kMaxMessageLen + kFrameOverhead;
+
+inline bool is_known_id(uint8_t id) { return id >= UCP_KEEP_ALIVE && id <= UCP_ID_LAST; }
+
+// -----------------------------------------------------------------------------
+// FrameView: a validated frame. Valid only inside the decoder callback.
+// -----------------------------------------------------------------------------
+struct FrameView {
+  const uint8_t* frame;   // Points at the 0xFD sync byte
+  size_t frame_len;       // Sync + message + CRC
+
+  const uint8_t* message() const { return frame + kSyncSize; }
+  uint16_t len() const { return message()[0] | (message()[1] << 8); }
+  uint8_t id() const { return message()[2]; }
+  uint8_t index() const { return message()[3]; }
+
+  // Typed access to the message. ucp.h structs are packed (alignment 1), so
+  // the view can point straight into the byte stream. Returns nullptr when
+  // the length does not match T, e.g. a request arriving where an ack is
+  // expected under the same ID.
+  template <typename T>
+  const T* as() const {
+    return len() == sizeof(T) ? reinterpret_cast<const T*>(message()) : nullptr;
+  }
+};
+
+struct DecoderStats {
+  uint64_t frames = 0;            // Valid frames delivered
+  uint64_t bytes = 0;             // Bytes fed in
+  uint64_t resyncs = 0;           // Times the decoder had to skip bytes to find a frame
+  uint64_t discarded = 0;         // Bytes skipped while resynchronizing
+  uint64_t crc_errors = 0;        // Well-formed headers whose CRC failed
+  uint64_t bad_headers = 0;       // Preambles followed by an impossible length or unknown id
+};
+
+class Decoder {
+ public:
+  // Decode a chunk. on_frame(const FrameView&) runs once per valid frame, in
+  // stream order. Returns the number of frames delivered from this chunk.
+  template <typename Fn>
+  size_t feed(const uint8_t* data, size_t n, Fn&& on_frame) {
+    size_t delivered = 0;
+    stats_.bytes += n;
+
+    // Finish a frame that started in an earlier chunk
+    while (have_ > 0 && n > 0) {
+      size_t want = pending_need();
+      if (want > have_) {
+        size_t take = want - have_ < n ? want - have_ : n;
+        memcpy(buf_ + have_, data, take);
+        have_ += take;
+        data += take;
+        n -= take;
+        if (have_ < want) break;
+      }
+      delivered += settle_pending(on_frame);
+    }
+    if (n == 0) return delivered;
+
+    // Everything else is scanned in place
+    const uint8_t* p = data;
+    const uint8_t* end = data + n;
+    while (p < end) {
+      const uint8_t* sync = find_sync(p, end);
+      if (sync != p) skipped(sync - p);
+      p = sync;
+      if (p == end) break;
+
+      size_t avail = end - p;
+      if (avail < kHeaderBytes) {
+        // Can't judge the header yet; keep the candidate for the next chunk
+        if (avail >= 2 && p[1] != kSync1) {
+          skipped(1);
+          p++;
+          continue;
+        }
+        stash(p, avail);
+        break;
+      }
+
+      size_t frame_len;
+      if (!check_header(p, &frame_len)) {
+        stats_.bad_headers++;
+        skipped(1);
+        p++;
+        continue;
+      }
+      if (avail < frame_len) {
+        stash(p, avail);
+        break;
+      }
+      if (!check_crc(p, frame_len)) {
+        stats_.crc_errors++;
+        skipped(1);
+        p++;
+        continue;
+      }
+      emit(p, frame_len, on_frame);
+      delivered++;
+      p += frame_len;
+    }
+    return delivered;
+  }
+
+  // Give up on a pending partial frame, e.g. after the line has been idle.
+  // A truncated header can claim more bytes than will ever arrive and hold
+  // back a complete frame queued behind it; flush rescans those bytes and
+  // delivers whatever complete frames they contain.
+  template <typename Fn>
+  size_t flush(Fn&& on_frame) {
+    size_t delivered = 0;
+    while (have_ > 0) {
+      drop_pending_byte();
+      delivered += settle_pending(on_frame);
+    }
+    return delivered;
+  }
+
+  const DecoderStats& stats() const { return stats_; }
+  size_t pending() const { return have_; }
+  void reset() {
+    have_ = 0;
+    in_resync_ = false;
+  }
+
+ private:
+  // Header check: preamble, a length that can hold ucp_hd_t and fits the
+  // buffer, and an ID the protocol defines.
+  static bool check_header(const uint8_t* p, size_t* frame_len) {
+    if (p[0] != kSync0 || p[1] != kSync1) return false;
+    size_t len = p[2] | (p[3] << 8);
+    if (len < sizeof(ucp_hd_t) || len > kMaxMessageLen) return false;
+    if (!is_known_id(p[4])) return false;
+    *frame_len = len + kFrameOverhead;
+    return true;
+  }
+
+  static bool check_crc(const uint8_t* p, size_t frame_len) {
+    uint16_t crc = crc16(p, frame_len - kCrcSize);
+    return p[frame_len - 2] == (crc & 0xff) && p[frame_len - 1] == (crc >> 8);
+  }
+
+  static const uint8_t* find_sync(const uint8_t* p, const uint8_t* end) {
+    const void* hit = memchr(p, kSync0, end - p);
+    return hit ? static_cast<const uint8_t*>(hit) : end;
+  }
+
+  // Bytes needed before the pending buffer can be judged
+  size_t pending_need() const {
+    if (have_ < kHeaderBytes) return kHeaderBytes;
+    size_t frame_len;
+    if (!check_header(buf_, &frame_len)) return have_;  // Settles immediately as bad
+    return frame_len;
+  }
+
+  // Called when buf_ holds a full header candidate. Emits or rejects the
+  // pending frame; on rejection the remaining buffered bytes are rescanned.
+  template <typename Fn>
+  size_t settle_pending(Fn& on_frame) {
+    size_t delivered = 0;
+    while (have_ >= kHeaderBytes) {
+      size_t frame_len;
+      if (!check_header(buf_, &frame_len)) {
+        stats_.bad_headers++;
+        drop_pending_byte();
+        continue;
+      }
+      if (have_ < frame_len) break;  // Still incomplete: wait for more input
+      if (!check_crc(buf_, frame_len)) {
+        stats_.crc_errors++;
+        drop_pending_byte();
+        continue;
+      }
+      emit(buf_, frame_len, on_frame);
+      delivered++;
+      // Anything after the frame in buf_ was copied from the same chunk and
+      // is rescanned here.
+      size_t rest = have_ - frame_len;
+      memmove(buf_, buf_ + frame_len, rest);
+      have_ = rest;
+      realign_pending();
+    }
+    return delivered;
+  }
+
+  // Reject the candidate at buf_[0] and slide to the next possible preamble
+  void drop_pending_byte() {
+    memmove(buf_, buf_ + 1, have_ - 1);
+    have_--;
+    skipped(1);
+    realign_pending();
+  }
+
+  void realign_pending() {
+    while (have_ > 0) {
+      size_t skip = find_sync(buf_, buf_ + have_) - buf_;
+      if (skip == 0) {
+        if (have_ < 2 || buf_[1] == kSync1) return;
+        skip = 1;
+      }
+      memmove(buf_, buf_ + skip, have_ - skip);
+      have_ -= skip;
+      skipped(skip);
+    }
+  }
+
+  void stash(const uint8_t* p, size_t n) {
+    memcpy(buf_, p, n);  // n < kMaxFrameLen: callers only stash one incomplete frame
+    have_ = n;
+  }
+
+  void skipped(size_t n) {
+    if (n == 0) return;
+    if (!in_resync_) stats_.resyncs++;
+    in_resync_ = true;
+    stats_.discarded += n;
+  }
+
+  template <typename Fn>
+  void emit(const uint8_t* p, size_t frame_len, Fn& on_frame) {
+    in_resync_ = false;
+    stats_.frames++;
+    FrameView view = {p, frame_len};
+    on_frame(view);
+  }
+
+  uint8_t buf_[kMaxFrameLen];
+  size_t have_ = 0;
+  bool in_resync_ = false;
+  DecoderStats stats_;
+};
+
+}  // namespace ucp
+
+#endif  // UCP_DECODER_HPP
@@ -0,0 +1,105 @@
+// -----------------------------------------------------------------------------
+// Capability discovery (UCP_HELLO) for the Linux head
+//
+// The head sends ucp_hello_t when it connects; firmware that knows UCP_HELLO
+// answers with ucp_hello_ack_t: protocol and report versions, the fastest
+// UART rate, the telemetry groups and subscription limits, buffer sizes and
+// a bitmap of the message IDs it handles. Firmware from before UCP_HELLO
+// skips the query and never answers, which is an answer too: such a board
+// has the 115200 UART and the UCP_RPM_REPORT it always had.
+//
+// parse_hello() unpacks an answer into Capabilities, encode_hello_ack()
+// builds one (for simulated firmware and tools). Later protocol versions
+// append fields, so an answer longer than this head knows is accepted.
+// -----------------------------------------------------------------------------
+#ifndef UCP_HELLO_HPP
+#define UCP_HELLO_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp_decoder.hpp"
+
+namespace ucp {
+
+constexpr uint32_t kLegacyBaud = 115200;
+
+// What a board supports
+struct Capabilities {
+  uint8_t proto_version = 0;       // 0: no answer to UCP_HELLO
+  uint8_t report_version = 0;
+  uint16_t app_version = 0;
+  uint32_t max_baud = kLegacyBaud;
+  uint8_t groups = 0;              // UCP_GRP_* bits UCP_SUBSCRIBE accepts
+  uint8_t sub_slots = 0;
+  uint16_t sub_tick_ms = 0;
+  uint8_t imu_batch_max = 0;
+  uint8_t rel_window = 0;
+  uint16_t rx_buffer = 0;
+  uint16_t max_frame = 0;
+  uint8_t rx_ids[UCP_HELLO_ID_BYTES] = {};
+
+  // The board answered UCP_HELLO
+  bool known() const { return proto_version != 0; }
+  // The board handles message `id` from the head
+  bool handles(uint8_t id) const { return (rx_ids[id / 8] >> (id % 8)) & 1; }
+  bool has_groups(uint8_t g) const { return (groups & g) == g; }
+
+  // The fastest rate both sides take, `head_max` being the head's
+  uint32_t best_baud(uint32_t head_max) const {
+    return max_baud < head_max ? max_baud : head_max;
+  }
+
+  // The cheapest way to get the full report: delta-coded, else sent as is
+  uint8_t report_group() const {
+    if (has_groups(UCP_GRP_REPORT_DELTA) && handles(UCP_REPORT_DELTA)) return UCP_GRP_REPORT_DELTA;
+    return UCP_GRP_REPORT;
+  }
+};
+
+// Unpack a UCP_HELLO answer. Returns false for any other frame, including
+// the head's own query.
+inline bool parse_hello(const FrameView& f, Capabilities* out) {
+  if (f.id() != UCP_HELLO || f.len() < sizeof(ucp_hello_ack_t)) return false;
+  ucp_hello_ack_t ack;
+  memcpy(&ack, f.message(), sizeof(ack));
+  if (ack.proto_version == 0) return false;
+  out->proto_version = ack.proto_version;
+  out->report_version = ack.report_version;
+  out->app_version = ack.app_version;
+  out->max_baud = ack.max_baud;
+  out->groups = ack.groups;
+  out->sub_slots = ack.sub_slots;
+  out->sub_tick_ms = ack.sub_tick_ms;
+  out->imu_batch_max = ack.imu_batch_max;
+  out->rel_window = ack.rel_window;
+  out->rx_buffer = ack.rx_buffer;
+  out->max_frame = ack.max_frame;
+  memcpy(out->rx_ids, ack.rx_ids, sizeof(out->rx_ids));
+  return true;
+}
+
+// Build the answer the firmware would send for `c`. Returns its length, or
+// 0 if `cap` is too small.
+inline size_t encode_hello_ack(Encoder& encoder, const Capabilities& c, uint8_t* out, size_t cap) {
+  ucp_hello_ack_t ack;
+  memset(&ack, 0, sizeof(ack));
+  ack.proto_version = c.proto_version;
+  ack.report_version = c.report_version;
+  ack.app_version = c.app_version;
+  ack.max_baud = c.max_baud;
+  ack.groups = c.groups;
+  ack.sub_slots = c.sub_slots;
+  ack.sub_tick_ms = c.sub_tick_ms;
+  ack.imu_batch_max = c.imu_batch_max;
+  ack.rel_window = c.rel_window;
+  ack.rx_buffer = c.rx_buffer;
+  ack.max_frame = c.max_frame;
+  memcpy(ack.rx_ids, c.rx_ids, sizeof(ack.rx_ids));
+  return encoder.encode(ack, out, cap);
+}
+
+}  // namespace ucp
+
+#endif  // UCP_HELLO_HPP
@@ -0,0 +1,85 @@
+// -----------------------------------------------------------------------------
+// Batched IMU samples (UCP_IMU_BATCH) for the Linux head
+//
+// The IMU thread samples every 10 ms; the report and UCP_TELEMETRY only carry
+// the latest sample when they are built. A subscription with
+// UCP_GRP_IMU_BATCH gets every sample instead, up to UCP_IMU_BATCH_MAX to a
+// frame: ucp_imu_batch_t, then `count` ucp_imu_sample_t, evenly spaced from
+// base_us. A frame of 16 samples is 214 bytes, against 36 a sample sent one
+// per UCP_TELEMETRY frame.
+//
+// parse_imu_batch() unpacks a frame into an ImuBatch, encode_imu_batch()
+// builds one (for simulated firmware and tools).
+// -----------------------------------------------------------------------------
+#ifndef UCP_IMU_BATCH_HPP
+#define UCP_IMU_BATCH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp_decoder.hpp"
+
+namespace ucp {
+
+// Whole frame on the wire for `count` samples
+constexpr size_t imu_batch_frame_size(size_t count) {
+  return sizeof(ucp_imu_batch_t) + count * sizeof(ucp_imu_sample_t) + kFrameOverhead;
+}
+
+constexpr size_t kMaxImuBatchFrame = imu_batch_frame_size(UCP_IMU_BATCH_MAX);
+
+// One UCP_IMU_BATCH frame unpacked
+struct ImuBatch {
+  uint8_t slot = 0;
+  uint8_t count = 0;
+  uint16_t dropped = 0;            // Samples lost on the MCU since the previous batch
+  uint16_t period_us = 0;
+  uint64_t base_us = 0;            // MCU time of samples[0]
+  ucp_imu_sample_t samples[UCP_IMU_BATCH_MAX];
+
+  // MCU time of samples[i]
+  uint64_t sample_us(size_t i) const { return base_us + (uint64_t)i * period_us; }
+};
+
+// Unpack a UCP_IMU_BATCH frame. Returns false for any other frame, or one
+// whose length doesn't match its count.
+inline bool parse_imu_batch(const FrameView& f, ImuBatch* out) {
+  if (f.id() != UCP_IMU_BATCH || f.len() < sizeof(ucp_imu_batch_t)) return false;
+  ucp_imu_batch_t head;
+  memcpy(&head, f.message(), sizeof(head));
+  if (head.count == 0 || head.count > UCP_IMU_BATCH_MAX ||
+      f.len() != sizeof(ucp_imu_batch_t) + head.count * sizeof(ucp_imu_sample_t)) {
+    return false;
+  }
+  out->slot = head.slot;
+  out->count = head.count;
+  out->dropped = head.dropped;
+  out->period_us = head.period_us;
+  out->base_us = head.base_us;
+  memcpy(out->samples, f.message() + sizeof(head), head.count * sizeof(ucp_imu_sample_t));
+  return true;
+}
+
+// Build the frame the firmware would send for `b`. Returns its length, or 0
+// if `cap` is too small or b.count is out of range.
+inline size_t encode_imu_batch(Encoder& encoder, const ImuBatch& b, uint8_t* out, size_t cap) {
+  if (b.count == 0 || b.count > UCP_IMU_BATCH_MAX) return 0;
+  size_t len = imu_batch_frame_size(b.count);
+  if (cap < len) return 0;
+  ucp_imu_batch_t head;
+  memset(&head, 0, sizeof(head));
+  head.slot = b.slot;
+  head.count = b.count;
+  head.dropped = b.dropped;
+  head.period_us = b.period_us;
+  head.base_us = b.base_us;
+  memcpy(out + kSyncSize, &head, sizeof(head));
+  memcpy(out + kSyncSize + sizeof(head), b.samples, b.count * sizeof(ucp_imu_sample_t));
+  encoder.seal_bytes(out, len, UCP_IMU_BATCH);
+  return len;
+}
+
+}  // namespace ucp
+
+#endif  // UCP_IMU_BATCH_HPP
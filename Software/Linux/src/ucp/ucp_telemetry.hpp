@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------------------
+// Compact telemetry (UCP_TELEMETRY) for the Linux head
+//
+// The firmware sends one UCP_TELEMETRY frame per due subscription. After the
+// fixed ucp_telemetry_t come the payloads of the groups in `groups`, lowest
+// bit first, so a frame is only as large as what was asked for:
+//
+//   wheels 8, imu raw 18, attitude 2, power 8, ToF 8 bytes
+//
+// against 40 for the full report. parse_telemetry() unpacks a frame into a
+// Telemetry, encode_telemetry() builds one (for simulated firmware and tools).
+// -----------------------------------------------------------------------------
+#ifndef UCP_TELEMETRY_HPP
+#define UCP_TELEMETRY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ucp_decoder.hpp"
+
+namespace ucp {
+
+// The groups a UCP_TELEMETRY frame can carry
+constexpr uint8_t kTelemetryGroups =
+    UCP_GRP_WHEELS | UCP_GRP_IMU_RAW | UCP_GRP_ATTITUDE | UCP_GRP_POWER | UCP_GRP_TOF;
+
+// Payload bytes behind ucp_telemetry_t for `groups`
+constexpr size_t telemetry_payload_size(uint8_t groups) {
+  return ((groups & UCP_GRP_WHEELS) ? sizeof(ucp_tlm_wheels_t) : 0) +
+         ((groups & UCP_GRP_IMU_RAW) ? sizeof(ucp_tlm_imu_raw_t) : 0) +
+         ((groups & UCP_GRP_ATTITUDE) ? sizeof(ucp_tlm_attitude_t) : 0) +
+         ((groups & UCP_GRP_POWER) ? sizeof(ucp_tlm_power_t) : 0) +
+         ((groups & UCP_GRP_TOF) ? sizeof(ucp_tlm_tof_t) : 0);
+}
+
+// Whole frame on the wire for `groups`
+constexpr size_t telemetry_frame_size(uint8_t groups) {
+  return sizeof(ucp_telemetry_t) + telemetry_payload_size(groups) + kFrameOverhead;
+}
+
+constexpr size_t kMaxTelemetryFrame = telemetry_frame_size(kTelemetryGroups);
+
+// One UCP_TELEMETRY frame unpacked; only the groups in `groups` are set
+struct Telemetry {
+  uint8_t slot = 0;
+  uint8_t groups = 0;
+  uint64_t sample_us = 0;          // MCU time (see ucp_telemetry_t)
+  ucp_tlm_wheels_t wheels;
+  ucp_tlm_imu_raw_t imu;
+  ucp_tlm_attitude_t attitude;
+  ucp_tlm_power_t power;
+  ucp_tlm_tof_t tof;
+
+  bool has(uint8_t group) const { return (groups & group) != 0; }
+};
+
+namespace detail {
+
+template <typename T>
+inline void take_group(const uint8_t*& p, uint8_t groups, uint8_t group, T* out) {
+  if (!(groups & group)) return;
+  memcpy(out, p, sizeof(T));
+  p += sizeof(T);
+}
+
+template <typename T>
+inline void put_group(uint8_t*& p, uint8_t groups, uint8_t group, const T& in) {
+  if (!(groups & group)) return;
+  memcpy(p, &in, sizeof(T));
+  p += sizeof(T);
+}
+
+}  // namespace detail
+
+// Unpack a UCP_TELEMETRY frame. Returns false for any other frame, or one
+// whose length doesn't match its groups.
+inline bool parse_telemetry(const FrameView& f, Telemetry* out) {
+  if (f.id() != UCP_TELEMETRY || f.len() < sizeof(ucp_telemetry_t)) return false;
+  ucp_telemetry_t head;
+  memcpy(&head, f.message(), sizeof(head));
+  if ((head.groups & ~kTelemetryGroups) ||
+      f.len() != sizeof(ucp_telemetry_t) + telemetry_payload_size(head.groups)) {
+    return false;
+  }
+  out->slot = head.slot;
+  out->groups = head.groups;
+  out->sample_us = head.sample_us;
+  const uint8_t* p = f.message() + sizeof(ucp_telemetry_t);
+  detail::take_group(p, head.groups, UCP_GRP_WHEELS, &out->wheels);
+  detail::take_group(p, head.groups, UCP_GRP_IMU_RAW, &out->imu);
+  detail::take_group(p, head.groups, UCP_GRP_ATTITUDE, &out->attitude);
+  detail::take_group(p, head.groups, UCP_GRP_POWER, &out->power);
+  detail::take_group(p, head.groups, UCP_GRP_TOF, &out->tof);
+  return true;
+}
+
+// Build the frame the firmware would send for `t`. Returns its length, or 0
+// if `cap` is too small or t.groups has bits no telemetry frame carries.
+inline size_t encode_telemetry(Encoder& encoder, const Telemetry& t, uint8_t* out, size_t cap) {
+  if (t.groups & ~kTelemetryGroups) return 0;
+  size_t len = telemetry_frame_size(t.groups);
+  if (cap < len) return 0;
+  ucp_telemetry_t head;
+  memset(&head, 0, sizeof(head));
+  head.slot = t.slot;
+  head.groups = t.groups;
+  head.sample_us = t.sample_us;
+  memcpy(out + kSyncSize, &head, sizeof(head));
+  uint8_t* p = out + kSyncSize + sizeof(head);
+  detail::put_group(p, t.groups, UCP_GRP_WHEELS, t.wheels);
+  detail::put_group(p, t.groups, UCP_GRP_IMU_RAW, t.imu);
+  detail::put_group(p, t.groups, UCP_GRP_ATTITUDE, t.attitude);
+  detail::put_group(p, t.groups, UCP_GRP_POWER, t.power);
+  detail::put_group(p, t.groups, UCP_GRP_TOF, t.tof);
+  encoder.seal_bytes(out, len, UCP_TELEMETRY);
+  return len;
+}
+
+}  // namespace ucp
+
+#endif  // UCP_TELEMETRY_HPP
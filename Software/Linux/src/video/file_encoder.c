@@ -0,0 +1,331 @@
+/*
+ * File encoder, see file_encoder.h
+ *
+ * Each channel is a single-producer single-consumer ring of ready times and
+ * an EFD_SEMAPHORE eventfd counting the packets in it: the encoder thread
+ * fills the slot, publishes the tail, then adds one to the eventfd; get()
+ * takes one from the eventfd, then reads the slot at the head. The eventfd
+ * thus stays readable exactly while packets wait.
+ */
+#include "file_encoder.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KEY_BYTES   (40000)     // Made-up keyframe, parameter sets included
+#define DELTA_BYTES (6000)
+
+typedef struct unit {
+    uint32_t    offset;
+    uint32_t    len;
+    uint8_t     keyframe;
+} unit_t;
+
+typedef struct slot {
+    uint64_t    ready_ns;
+    uint64_t    seq;            // Frame number, picks the unit
+} slot_t;
+
+typedef struct channel {
+    int         event_fd;
+    uint64_t    period_ns;
+    uint64_t    next_ns;        // Next packet finishes then
+    slot_t      slots[FILE_ENCODER_DEPTH];
+    uint32_t    head;           // Consumer
+    uint32_t    tail;           // Producer
+    uint64_t    produced;
+    uint64_t    overruns;
+} channel_t;
+
+struct file_encoder {
+    uint8_t     *data;
+    size_t      size;
+    unit_t      *units;
+    int         unit_count;
+    int         count;
+    channel_t   chn[STREAM_PUMP_MAX_CHANNELS];
+    pthread_t   thread;
+    int         running;
+    int         stop;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* H.265 NAL unit types that matter for splitting (ITU-T H.265 table 7-1) */
+static int nal_is_vcl(int type) { return type < 32; }
+static int nal_is_irap(int type) { return type >= 16 && type <= 21; }
+static int nal_starts_unit(int type)
+{
+    return (type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+}
+
+/* Split an Annex-B stream into access units. Returns the count, -1 on error. */
+static int split_units(const uint8_t *data, size_t size, unit_t **out)
+{
+    int cap = 64, count = 0;
+    unit_t *units = (unit_t *)malloc(cap * sizeof(unit_t));
+    if (!units)
+        return -1;
+    int have_vcl = 0;
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+            continue;
+        size_t start = (i > 0 && data[i - 1] == 0) ? i - 1 : i;
+        if (i + 5 >= size)
+            break;
+        int type = (data[i + 3] >> 1) & 0x3f;
+        int first_slice = nal_is_vcl(type) && (data[i + 5] & 0x80);
+        if (count == 0 || (have_vcl && (nal_starts_unit(type) || first_slice))) {
+            if (count == cap) {
+                cap *= 2;
+                unit_t *grown = (unit_t *)realloc(units, cap * sizeof(unit_t));
+                if (!grown) {
+                    free(units);
+                    return -1;
+                }
+                units = grown;
+            }
+            if (count > 0)
+                units[count - 1].len = (uint32_t)(start - units[count - 1].offset);
+            units[count].offset = (uint32_t)start;
+            units[count].keyframe = 0;
+            count++;
+            have_vcl = 0;
+        }
+        if (nal_is_vcl(type))
+            have_vcl = 1;
+        if (nal_is_irap(type))
+            units[count - 1].keyframe = 1;
+        i += 2;
+    }
+    if (count > 0)
+        units[count - 1].len = (uint32_t)(size - units[count - 1].offset);
+    *out = units;
+    return count;
+}
+
+/* Append one NAL unit of `type` and `len` bytes in all */
+static size_t put_nal(uint8_t *p, int type, size_t len, int first_slice)
+{
+    static const uint8_t start[4] = {0, 0, 0, 1};
+    memcpy(p, start, sizeof(start));
+    p[4] = (uint8_t)(type << 1);
+    p[5] = 1;   // nuh_temporal_id_plus1
+    for (size_t i = 6; i < len; i++)
+        p[i] = (uint8_t)((i * 31 + 7) | 1);  // Never two zero bytes, so no false start code
+    if (nal_is_vcl(type))
+        p[6] = first_slice ? 0x80 : 0x00;
+    return len;
+}
+
+/* A GOP of made-up access units */
+static uint8_t *make_stream(size_t *size)
+{
+    size_t cap = KEY_BYTES + (FILE_ENCODER_GOP - 1) * DELTA_BYTES;
+    uint8_t *data = (uint8_t *)malloc(cap);
+    if (!data)
+        return NULL;
+    size_t n = 0;
+    for (int f = 0; f < FILE_ENCODER_GOP; f++) {
+        if (f == 0) {
+            n += put_nal(data + n, 32, 30, 0);   // VPS
+            n += put_nal(data + n, 33, 60, 0);   // SPS
+            n += put_nal(data + n, 34, 20, 0);   // PPS
+            n += put_nal(data + n, 19, KEY_BYTES - 110, 1);  // IDR_W_RADL
+        } else {
+            n += put_nal(data + n, 1, DELTA_BYTES, 1);       // TRAIL_R
+        }
+    }
+    *size = n;
+    return data;
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *data = len > 0 ? (uint8_t *)malloc(len) : NULL;
+    if (!data || fread(data, 1, len, fp) != (size_t)len) {
+        fprintf(stderr, "%s: can't read\n", path);
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    *size = (size_t)len;
+    return data;
+}
+
+file_encoder_t *file_encoder_open(const char *path, int count, const unsigned *fps)
+{
+    if (count <= 0 || count > STREAM_PUMP_MAX_CHANNELS)
+        return NULL;
+    file_encoder_t *enc = (file_encoder_t *)calloc(1, sizeof(*enc));
+    if (!enc)
+        return NULL;
+    for (int i = 0; i < STREAM_PUMP_MAX_CHANNELS; i++)
+        enc->chn[i].event_fd = -1;
+    enc->count = count;
+    enc->data = path ? read_file(path, &enc->size) : make_stream(&enc->size);
+    if (!enc->data)
+        goto fail;
+    enc->unit_count = split_units(enc->data, enc->size, &enc->units);
+    if (enc->unit_count <= 0) {
+        fprintf(stderr, "%s: no H.265 access units\n", path ? path : "stream");
+        goto fail;
+    }
+    for (int i = 0; i < count; i++) {
+        channel_t *c = &enc->chn[i];
+        c->period_ns = 1000000000ull / (fps[i] ? fps[i] : 30);
+        c->event_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+        if (c->event_fd < 0) {
+            perror("eventfd");
+            goto fail;
+        }
+    }
+    return enc;
+
+fail:
+    file_encoder_close(enc);
+    return NULL;
+}
+
+void file_encoder_close(file_encoder_t *enc)
+{
+    if (!enc)
+        return;
+    file_encoder_stop(enc);
+    for (int i = 0; i < STREAM_PUMP_MAX_CHANNELS; i++) {
+        if (enc->chn[i].event_fd >= 0)
+            close(enc->chn[i].event_fd);
+    }
+    free(enc->units);
+    free(enc->data);
+    free(enc);
+}
+
+/* The "hardware": finish each channel's packets on its own clock */
+static void *encode(void *arg)
+{
+    file_encoder_t *enc = (file_encoder_t *)arg;
+    uint64_t start = now_ns();
+    for (int i = 0; i < enc->count; i++)
+        enc->chn[i].next_ns = start + enc->chn[i].period_ns;
+
+    while (!__atomic_load_n(&enc->stop, __ATOMIC_ACQUIRE)) {
+        uint64_t due = enc->chn[0].next_ns;
+        for (int i = 1; i < enc->count; i++) {
+            if (enc->chn[i].next_ns < due)
+                due = enc->chn[i].next_ns;
+        }
+        struct timespec ts = {(time_t)(due / 1000000000ull), (long)(due % 1000000000ull)};
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+            continue;
+
+        for (int i = 0; i < enc->count; i++) {
+            channel_t *c = &enc->chn[i];
+            if (c->next_ns > due)
+                continue;
+            slot_t slot = {c->next_ns, c->produced};
+            c->next_ns += c->period_ns;
+            c->produced++;
+            uint32_t head = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE);
+            if (c->tail - head >= FILE_ENCODER_DEPTH) {
+                c->overruns++;
+                continue;
+            }
+            c->slots[c->tail % FILE_ENCODER_DEPTH] = slot;
+            __atomic_store_n(&c->tail, c->tail + 1, __ATOMIC_RELEASE);
+            uint64_t one = 1;
+            ssize_t ret = write(c->event_fd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+    return NULL;
+}
+
+int file_encoder_start(file_encoder_t *enc)
+{
+    if (enc->running)
+        return 0;
+    enc->stop = 0;
+    if (pthread_create(&enc->thread, NULL, encode, enc) != 0)
+        return -1;
+    enc->running = 1;
+    return 0;
+}
+
+void file_encoder_stop(file_encoder_t *enc)
+{
+    if (!enc->running)
+        return;
+    __atomic_store_n(&enc->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(enc->thread, NULL);
+    enc->running = 0;
+}
+
+static int source_fd(void *ctx, int chn)
+{
+    file_encoder_t *enc = (file_encoder_t *)ctx;
+    return chn < enc->count ? enc->chn[chn].event_fd : -1;
+}
+
+static int source_get(void *ctx, int chn, stream_packet_t *pkt)
+{
+    file_encoder_t *enc = (file_encoder_t *)ctx;
+    channel_t *c = &enc->chn[chn];
+    uint64_t one;
+    if (read(c->event_fd, &one, sizeof(one)) != sizeof(one))
+        return -1;
+    uint32_t head = c->head;
+    const slot_t *slot = &c->slots[head % FILE_ENCODER_DEPTH];
+    const unit_t *u = &enc->units[slot->seq % enc->unit_count];
+    pkt->data = enc->data + u->offset;
+    pkt->len = u->len;
+    pkt->keyframe = u->keyframe;
+    pkt->ready_ns = slot->ready_ns;
+    pkt->pts = slot->ready_ns / 1000;
+    __atomic_store_n(&c->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void source_release(void *ctx, int chn, stream_packet_t *pkt)
+{
+    (void)ctx;
+    (void)chn;
+    (void)pkt;  // The file stays mapped until close
+}
+
+encoder_source_t file_encoder_source(file_encoder_t *enc)
+{
+    encoder_source_t source = {enc, source_fd, source_get, source_release};
+    return source;
+}
+
+int file_encoder_units(const file_encoder_t *enc)
+{
+    return enc->unit_count;
+}
+
+void file_encoder_get_stats(const file_encoder_t *enc, int chn, file_encoder_stats_t *out)
+{
+    out->produced = enc->chn[chn].produced;
+    out->overruns = enc->chn[chn].overruns;
+}
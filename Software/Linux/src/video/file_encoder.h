@@ -0,0 +1,56 @@
+/*
+ * File encoder: an encoder_source_t (stream_pump.h) that plays an H.265
+ * elementary stream from a file, for running the video path on a host.
+ *
+ * The file (Annex-B, as the encoder writes it) is split into access units
+ * once at open; without a file, packets of typical sizes with a keyframe
+ * every FILE_ENCODER_GOP frames are made up. A thread stands in for the
+ * encoder hardware: each channel finishes a packet every 1/fps seconds,
+ * stamped with that time, and its descriptor is readable while packets
+ * wait, as RK_MPI_VENC_GetFd()'s is. A channel holds at most
+ * FILE_ENCODER_DEPTH packets; further ones are dropped and counted, as the
+ * encoder's stream buffer would overflow.
+ */
+#ifndef __FILE_ENCODER_H__
+#define __FILE_ENCODER_H__
+
+#include <stdint.h>
+
+#include "stream_pump.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FILE_ENCODER_DEPTH  (8)     // Packets a channel holds before it drops
+#define FILE_ENCODER_GOP    (50)    // Keyframe interval of the made-up stream
+
+typedef struct file_encoder file_encoder_t;
+
+typedef struct file_encoder_stats {
+    uint64_t    produced;       // Packets the "hardware" finished
+    uint64_t    overruns;       // Dropped because the channel was full
+} file_encoder_stats_t;
+
+/* Play `path` (NULL: made-up packets) on `count` channels, channel i at
+ * fps[i] frames per second. Returns NULL on error. */
+file_encoder_t *file_encoder_open(const char *path, int count, const unsigned *fps);
+void file_encoder_close(file_encoder_t *enc);
+
+/* Start and stop the encoder thread. Packets are produced only in between. */
+int file_encoder_start(file_encoder_t *enc);
+void file_encoder_stop(file_encoder_t *enc);
+
+/* The source a stream pump reads the channels from */
+encoder_source_t file_encoder_source(file_encoder_t *enc);
+
+/* Access units found in the file */
+int file_encoder_units(const file_encoder_t *enc);
+
+void file_encoder_get_stats(const file_encoder_t *enc, int chn, file_encoder_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FILE_ENCODER_H__ */
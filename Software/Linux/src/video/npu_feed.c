@@ -0,0 +1,150 @@
+/*
+ * NPU feed, see npu_feed.h
+ *
+ * Free slots are bits of one word: the grabber claims the lowest set bit
+ * with a compare-and-swap, and both threads hand slots back by setting
+ * theirs. The mailbox is a slot index, -1 when empty; posting and taking
+ * each swap it in one exchange, so a frame is either taken or replaced,
+ * never both. An eventfd wakes the submitter when a frame is posted.
+ */
+#include "npu_feed.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+struct npu_feed {
+    npu_frame_t     slots[NPU_FEED_MAX_SLOTS];
+    int             count;
+    uint32_t        free_mask;      // Bit i set: slot i is free
+    int             mailbox;        // Posted slot, -1 when empty
+    int             event_fd;
+    int             stop;
+    npu_release_fn  release;
+    void            *user;
+    uint64_t        posted;
+    uint64_t        submitted;
+    uint64_t        dropped;
+    uint32_t        in_flight;
+};
+
+npu_feed_t *npu_feed_create(int slots, npu_release_fn release, void *user)
+{
+    if (slots <= 0 || slots > NPU_FEED_MAX_SLOTS)
+        return NULL;
+    npu_feed_t *feed = (npu_feed_t *)calloc(1, sizeof(*feed));
+    if (!feed)
+        return NULL;
+    feed->count = slots;
+    feed->free_mask = slots == 32 ? 0xffffffffu : (1u << slots) - 1;
+    feed->mailbox = -1;
+    feed->release = release;
+    feed->user = user;
+    feed->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (feed->event_fd < 0) {
+        perror("npu feed: eventfd");
+        free(feed);
+        return NULL;
+    }
+    return feed;
+}
+
+void npu_feed_destroy(npu_feed_t *feed)
+{
+    if (!feed)
+        return;
+    int left = __atomic_exchange_n(&feed->mailbox, -1, __ATOMIC_ACQ_REL);
+    if (left >= 0)
+        feed->release(feed->user, &feed->slots[left]);
+    close(feed->event_fd);
+    free(feed);
+}
+
+static void put_back(npu_feed_t *feed, int index)
+{
+    __atomic_fetch_or(&feed->free_mask, 1u << index, __ATOMIC_RELEASE);
+}
+
+static void count(uint64_t *counter)
+{
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+npu_frame_t *npu_feed_acquire(npu_feed_t *feed)
+{
+    uint32_t mask = __atomic_load_n(&feed->free_mask, __ATOMIC_ACQUIRE);
+    while (mask) {
+        uint32_t bit = mask & -mask;
+        if (__atomic_compare_exchange_n(&feed->free_mask, &mask, mask & ~bit, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE))
+            return &feed->slots[__builtin_ctz(bit)];
+    }
+    count(&feed->posted);
+    count(&feed->dropped);
+    return NULL;
+}
+
+void npu_feed_post(npu_feed_t *feed, npu_frame_t *frame)
+{
+    count(&feed->posted);
+    int old = __atomic_exchange_n(&feed->mailbox, npu_feed_index(feed, frame), __ATOMIC_ACQ_REL);
+    if (old >= 0) {
+        count(&feed->dropped);
+        feed->release(feed->user, &feed->slots[old]);
+        put_back(feed, old);
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(feed->event_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+npu_frame_t *npu_feed_take(npu_feed_t *feed, int timeout_ms)
+{
+    struct pollfd pfd = {feed->event_fd, POLLIN, 0};
+    for (;;) {
+        if (__atomic_load_n(&feed->stop, __ATOMIC_ACQUIRE))
+            return NULL;
+        int index = __atomic_exchange_n(&feed->mailbox, -1, __ATOMIC_ACQ_REL);
+        if (index >= 0) {
+            count(&feed->submitted);
+            __atomic_fetch_add(&feed->in_flight, 1, __ATOMIC_RELAXED);
+            return &feed->slots[index];
+        }
+        // The mailbox was emptied after the last wakeup: wait for the next
+        if (poll(&pfd, 1, timeout_ms) <= 0)
+            return NULL;
+        uint64_t n;
+        ssize_t ret = read(feed->event_fd, &n, sizeof(n));
+        (void)ret;
+    }
+}
+
+void npu_feed_done(npu_feed_t *feed, npu_frame_t *frame)
+{
+    feed->release(feed->user, frame);
+    __atomic_fetch_sub(&feed->in_flight, 1, __ATOMIC_RELAXED);
+    put_back(feed, npu_feed_index(feed, frame));
+}
+
+void npu_feed_stop(npu_feed_t *feed)
+{
+    __atomic_store_n(&feed->stop, 1, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    ssize_t ret = write(feed->event_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+int npu_feed_index(const npu_feed_t *feed, const npu_frame_t *frame)
+{
+    return (int)(frame - feed->slots);
+}
+
+void npu_feed_get_stats(const npu_feed_t *feed, npu_feed_stats_t *out)
+{
+    out->posted = __atomic_load_n(&feed->posted, __ATOMIC_RELAXED);
+    out->submitted = __atomic_load_n(&feed->submitted, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&feed->dropped, __ATOMIC_RELAXED);
+    out->in_flight = __atomic_load_n(&feed->in_flight, __ATOMIC_RELAXED);
+}
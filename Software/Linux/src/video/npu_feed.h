@@ -0,0 +1,81 @@
+/*
+ * NPU feed: hands camera frames from the thread that takes them off a VI
+ * channel to the thread that submits them to the NPU, newest frame first.
+ *
+ * The feed is a fixed pool of frame slots and a one-frame mailbox. The
+ * grabber takes a free slot, fills it and posts it; a posted frame replaces
+ * one the submitter hasn't taken yet, and the replaced frame is dropped
+ * (handed back to the release function) there and then. The grabber
+ * therefore never waits for the NPU and the VI channel never backs up,
+ * while the submitter always gets the newest frame once the NPU is free.
+ * The slot index lets the caller keep a preinitialised descriptor per slot
+ * (a RockIvaImage on the robot), so the path allocates nothing per frame.
+ *
+ * Slots move between the two threads with atomic operations only; one
+ * grabber and one submitter.
+ */
+#ifndef __NPU_FEED_H__
+#define __NPU_FEED_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NPU_FEED_SLOTS      (3)     // Filling or in the mailbox, in flight, spare
+#define NPU_FEED_MAX_SLOTS  (32)
+
+typedef struct npu_frame {
+    uint32_t    frame_id;
+    int32_t     fd;             // DMA buffer of the image
+    uint16_t    width;
+    uint16_t    height;
+    uint64_t    pts;
+    void        *source;        // The caller's handle for the frame, e.g. a VI frame
+} npu_frame_t;
+
+/* Gives a frame's buffer back to where it came from; called from the
+ * grabber for dropped frames, from the submitter for done ones */
+typedef void (*npu_release_fn)(void *user, npu_frame_t *frame);
+
+typedef struct npu_feed_stats {
+    uint64_t    posted;         // Frames the grabber offered
+    uint64_t    submitted;      // Frames the submitter took
+    uint64_t    dropped;        // Replaced in the mailbox, or no free slot
+    uint32_t    in_flight;      // Taken and not yet done
+} npu_feed_stats_t;
+
+typedef struct npu_feed npu_feed_t;
+
+/* A feed of `slots` slots (at most NPU_FEED_MAX_SLOTS). Returns NULL on error. */
+npu_feed_t *npu_feed_create(int slots, npu_release_fn release, void *user);
+/* Releases the frame still in the mailbox. Frames in flight must be done. */
+void npu_feed_destroy(npu_feed_t *feed);
+
+/* Grabber: a free slot to fill, or NULL if all are in use, in which case
+ * the frame counts as dropped and the caller releases it itself */
+npu_frame_t *npu_feed_acquire(npu_feed_t *feed);
+/* Grabber: offer a filled slot, dropping the frame it replaces */
+void npu_feed_post(npu_feed_t *feed, npu_frame_t *frame);
+
+/* Submitter: the newest posted frame, waiting up to timeout_ms (-1:
+ * forever). NULL on timeout or after npu_feed_stop(). */
+npu_frame_t *npu_feed_take(npu_feed_t *feed, int timeout_ms);
+/* Submitter: the NPU has what it needs from `frame`; release it */
+void npu_feed_done(npu_feed_t *feed, npu_frame_t *frame);
+
+/* Wake a waiting npu_feed_take() and have every later one return NULL */
+void npu_feed_stop(npu_feed_t *feed);
+
+/* Index of a slot, 0..slots-1 */
+int npu_feed_index(const npu_feed_t *feed, const npu_frame_t *frame);
+
+/* Counters; safe from any thread */
+void npu_feed_get_stats(const npu_feed_t *feed, npu_feed_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __NPU_FEED_H__ */
@@ -0,0 +1,191 @@
+/*
+ * Rate control, see rate_ctl.h
+ *
+ * The shared-link policy is additive-increase multiplicative-decrease on one
+ * budget for all streams. When the oldest packet of any stream has waited
+ * longer than target_ms, or packets were dropped, the link is taken to carry
+ * what was sent over the tick, and the budget falls to `backoff` percent of
+ * that, so the queues drain. When every queue is well under the target, the
+ * budget grows by `probe` percent a second to find spare capacity. Each
+ * stream gets its minimum, the watched one then up to its maximum, and the
+ * rest is shared in proportion to the others' ranges. A stream given less
+ * than half its maximum also drops frames in proportion, so each frame keeps
+ * enough bits to be worth watching.
+ */
+#include "rate_ctl.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct rate_ctl {
+    int             count;
+    rate_limits_t   limits[RATE_CTL_MAX_STREAMS];
+    rate_setting_t  current[RATE_CTL_MAX_STREAMS];
+    rate_sample_t   last[RATE_CTL_MAX_STREAMS];
+    uint64_t        last_ms;
+    int             started;
+    int             watched;
+    rate_policy_t   policy;
+};
+
+static uint32_t clamp(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+rate_ctl_t *rate_ctl_create(int count, const rate_limits_t *limits, const rate_setting_t *initial,
+                            const rate_policy_t *policy)
+{
+    if (count <= 0 || count > RATE_CTL_MAX_STREAMS)
+        return NULL;
+    rate_ctl_t *ctl = (rate_ctl_t *)calloc(1, sizeof(*ctl));
+    if (!ctl)
+        return NULL;
+    ctl->count = count;
+    ctl->watched = -1;
+    ctl->policy = *policy;
+    for (int i = 0; i < count; i++) {
+        ctl->limits[i] = limits[i];
+        ctl->current[i].kbps = clamp(initial[i].kbps, limits[i].min_kbps, limits[i].max_kbps);
+        ctl->current[i].fps = clamp(initial[i].fps, limits[i].min_fps, limits[i].max_fps);
+    }
+    return ctl;
+}
+
+void rate_ctl_destroy(rate_ctl_t *ctl)
+{
+    free(ctl);
+}
+
+void rate_ctl_watch(rate_ctl_t *ctl, int chn)
+{
+    ctl->watched = chn;
+}
+
+uint32_t rate_ctl_tick(rate_ctl_t *ctl, uint64_t now_ms, const rate_sample_t *samples)
+{
+    if (!ctl->started || now_ms <= ctl->last_ms) {
+        memcpy(ctl->last, samples, ctl->count * sizeof(rate_sample_t));
+        ctl->last_ms = now_ms;
+        ctl->started = 1;
+        return 0;
+    }
+    uint32_t interval_ms = (uint32_t)(now_ms - ctl->last_ms);
+
+    rate_input_t in[RATE_CTL_MAX_STREAMS];
+    rate_setting_t out[RATE_CTL_MAX_STREAMS];
+    for (int i = 0; i < ctl->count; i++) {
+        in[i].limits = ctl->limits[i];
+        in[i].current = ctl->current[i];
+        in[i].sent_kbps = (uint32_t)((samples[i].bytes_sent - ctl->last[i].bytes_sent) * 8 / interval_ms);
+        in[i].dropped = (uint32_t)(samples[i].dropped - ctl->last[i].dropped);
+        in[i].backlog = samples[i].backlog;
+        in[i].oldest_ms = samples[i].oldest_ms;
+        in[i].watched = i == ctl->watched;
+        out[i] = ctl->current[i];
+    }
+    memcpy(ctl->last, samples, ctl->count * sizeof(rate_sample_t));
+    ctl->last_ms = now_ms;
+
+    if (ctl->policy.decide)
+        ctl->policy.decide(ctl->policy.ctx, interval_ms, in, ctl->count, out);
+
+    uint32_t changed = 0;
+    for (int i = 0; i < ctl->count; i++) {
+        const rate_limits_t *l = &ctl->limits[i];
+        rate_setting_t *cur = &ctl->current[i];
+        uint32_t kbps = clamp(out[i].kbps, l->min_kbps, l->max_kbps);
+        uint32_t fps = clamp(out[i].fps, l->min_fps, l->max_fps);
+        uint32_t diff = kbps > cur->kbps ? kbps - cur->kbps : cur->kbps - kbps;
+        // Always reach the limits, however small the step
+        int edge = kbps != cur->kbps && (kbps == l->min_kbps || kbps == l->max_kbps);
+        if ((uint64_t)diff * 100 > (uint64_t)cur->kbps * RATE_CTL_DEADBAND || edge || fps != cur->fps) {
+            cur->kbps = kbps;
+            cur->fps = fps;
+            changed |= 1u << i;
+        }
+    }
+    return changed;
+}
+
+const rate_setting_t *rate_ctl_setting(const rate_ctl_t *ctl, int chn)
+{
+    return &ctl->current[chn];
+}
+
+void rate_link_policy_default(rate_link_policy_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    state->target_ms = 300;
+    state->backoff = 85;
+    state->probe = 20;
+}
+
+/* Full frame rate down to half the top bitrate, then fewer frames rather
+ * than starved ones */
+static uint32_t fps_for(const rate_limits_t *l, uint32_t kbps)
+{
+    uint64_t fps = (uint64_t)l->max_fps * kbps * 2 / (l->max_kbps ? l->max_kbps : 1);
+    return clamp((uint32_t)(fps < l->max_fps ? fps : l->max_fps), l->min_fps, l->max_fps);
+}
+
+static void link_decide(void *ctx, uint32_t interval_ms, const rate_input_t *in, int count,
+                        rate_setting_t *out)
+{
+    rate_link_policy_t *p = (rate_link_policy_t *)ctx;
+    uint64_t sent = 0, floor = 0, ceiling = 0, current = 0;
+    uint32_t worst_ms = 0, dropped = 0;
+    for (int i = 0; i < count; i++) {
+        sent += in[i].sent_kbps;
+        floor += in[i].limits.min_kbps;
+        ceiling += in[i].limits.max_kbps;
+        current += in[i].current.kbps;
+        dropped += in[i].dropped;
+        if (in[i].oldest_ms > worst_ms)
+            worst_ms = in[i].oldest_ms;
+    }
+
+    uint64_t budget = p->budget_kbps ? p->budget_kbps : current;
+    if (worst_ms > p->target_ms || dropped) {
+        uint64_t carried = sent * p->backoff / 100;
+        if (carried < budget)
+            budget = carried;
+        p->congested++;
+    } else if (worst_ms < p->target_ms / 2) {
+        uint64_t step = budget * p->probe * interval_ms / 100000;
+        budget += step > 50 ? step : 50;
+        p->congested = 0;
+    }
+    budget = budget < floor ? floor : budget > ceiling ? ceiling : budget;
+    p->budget_kbps = (uint32_t)budget;
+
+    uint64_t spare = budget - floor, others = 0;
+    for (int i = 0; i < count; i++) {
+        out[i].kbps = in[i].limits.min_kbps;
+        if (in[i].watched) {
+            uint64_t extra = in[i].limits.max_kbps - in[i].limits.min_kbps;
+            extra = extra < spare ? extra : spare;
+            out[i].kbps += (uint32_t)extra;
+            spare -= extra;
+        } else {
+            others += in[i].limits.max_kbps - in[i].limits.min_kbps;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (!in[i].watched && others)
+            out[i].kbps += (uint32_t)(spare * (in[i].limits.max_kbps - in[i].limits.min_kbps) / others);
+        out[i].fps = fps_for(&in[i].limits, out[i].kbps);
+    }
+}
+
+rate_policy_t rate_policy_shared_link(rate_link_policy_t *state)
+{
+    rate_policy_t policy = {"shared link", state, link_decide};
+    return policy;
+}
+
+rate_policy_t rate_policy_fixed(void)
+{
+    rate_policy_t policy = {"fixed", NULL, NULL};
+    return policy;
+}
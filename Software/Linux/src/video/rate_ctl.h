@@ -0,0 +1,108 @@
+/*
+ * Rate control: retunes each stream's encoder bitrate and frame rate from
+ * how its packets are getting out.
+ *
+ * Every tick the caller hands in each stream's sending counters (from
+ * rtsp_sender_get_stats() on the robot). The controller turns them into what
+ * the last tick looked like -- the rate actually sent, packets dropped, the
+ * bytes waiting and how long the oldest has waited -- and asks a policy for
+ * new settings. It clamps them to the stream's limits and reports the
+ * streams whose settings moved by more than RATE_CTL_DEADBAND, for the
+ * caller to push to the encoder; smaller moves are not worth reconfiguring
+ * it for.
+ *
+ * Policies are pluggable. rate_policy_shared_link() assumes the streams
+ * share one uplink, as they do over the cellular modem: it estimates what
+ * the link carries from the delay building up in the queues, and gives the
+ * stream being watched its full rate first. rate_policy_fixed() keeps the
+ * startup settings, as the demo did before.
+ *
+ * Not thread-safe: tick from one thread.
+ */
+#ifndef __RATE_CTL_H__
+#define __RATE_CTL_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RATE_CTL_MAX_STREAMS    (16)
+#define RATE_CTL_TICK_MS        (500)   // How often to tick
+#define RATE_CTL_DEADBAND       (5)     // Percent of bitrate not worth a change
+
+typedef struct rate_limits {
+    uint32_t    min_kbps;
+    uint32_t    max_kbps;
+    uint32_t    min_fps;
+    uint32_t    max_fps;
+} rate_limits_t;
+
+typedef struct rate_setting {
+    uint32_t    kbps;
+    uint32_t    fps;
+} rate_setting_t;
+
+/* One stream's sending counters at a tick */
+typedef struct rate_sample {
+    uint64_t    bytes_sent;     // Since start
+    uint64_t    dropped;        // Packets, since start
+    uint32_t    backlog;        // Bytes waiting now
+    uint32_t    oldest_ms;      // How long the oldest waiting packet has waited
+} rate_sample_t;
+
+/* What a policy sees of one stream */
+typedef struct rate_input {
+    rate_limits_t   limits;
+    rate_setting_t  current;
+    uint32_t        sent_kbps;  // Over the last tick
+    uint32_t        dropped;    // Packets dropped in the last tick
+    uint32_t        backlog;
+    uint32_t        oldest_ms;
+    int             watched;    // The operator is watching this stream
+} rate_input_t;
+
+typedef struct rate_policy {
+    const char  *name;
+    void        *ctx;
+    /* Choose the settings of all `count` streams; out[] holds the current ones */
+    void        (*decide)(void *ctx, uint32_t interval_ms, const rate_input_t *in, int count,
+                          rate_setting_t *out);
+} rate_policy_t;
+
+typedef struct rate_ctl rate_ctl_t;
+
+/* `count` streams starting at initial[i] within limits[i]. The policy is
+ * copied; its ctx must outlive the controller. Returns NULL on error. */
+rate_ctl_t *rate_ctl_create(int count, const rate_limits_t *limits, const rate_setting_t *initial,
+                            const rate_policy_t *policy);
+void rate_ctl_destroy(rate_ctl_t *ctl);
+
+/* The stream the operator is watching, -1 for none */
+void rate_ctl_watch(rate_ctl_t *ctl, int chn);
+
+/* Take the counters of every stream at `now_ms`. Returns a mask of the
+ * streams whose settings changed, bit i for stream i. */
+uint32_t rate_ctl_tick(rate_ctl_t *ctl, uint64_t now_ms, const rate_sample_t *samples);
+
+const rate_setting_t *rate_ctl_setting(const rate_ctl_t *ctl, int chn);
+
+/* Shared-link policy state; zero it, then fill in the config */
+typedef struct rate_link_policy {
+    uint32_t    target_ms;      // Queueing delay the link may build up
+    uint32_t    backoff;        // Percent of the sent rate to fall back to on congestion
+    uint32_t    probe;          // Percent to raise the estimate by per second when clear
+    uint32_t    budget_kbps;    // The link estimate, 0 until the first tick
+    uint32_t    congested;      // Ticks in a row the link was congested
+} rate_link_policy_t;
+
+void rate_link_policy_default(rate_link_policy_t *state);
+rate_policy_t rate_policy_shared_link(rate_link_policy_t *state);
+rate_policy_t rate_policy_fixed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RATE_CTL_H__ */
@@ -0,0 +1,224 @@
+/*
+ * ROI map, see roi_map.h
+ *
+ * A track's region is kept in detector coordinates, grown by the margin and
+ * possibly past the frame edge; only roi_target_update() clamps and snaps it
+ * to one encoder's pixels. A track's velocity is the average of the last
+ * two moves of its box centre.
+ */
+#include "roi_map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct track {
+    uint32_t    id;
+    int         used;
+    uint8_t     priority;
+    uint32_t    hits;
+    uint64_t    first_ms;
+    uint64_t    last_ms;
+    int32_t     cx;             // Centre of the last box
+    int32_t     cy;
+    int32_t     vx;             // 1/ROI_MAP_SCALE per second
+    int32_t     vy;
+    int32_t     left;           // Region, 1/ROI_MAP_SCALE
+    int32_t     top;
+    int32_t     right;
+    int32_t     bottom;
+} track_t;
+
+struct roi_map {
+    roi_map_config_t    cfg;
+    track_t             tracks[ROI_MAP_TRACKS];
+    uint64_t            detections;
+    uint64_t            started;
+    uint64_t            expired;
+};
+
+void roi_map_default_config(roi_map_config_t *cfg)
+{
+    cfg->hold_ms = 500;
+    cfg->confirm = 2;
+    cfg->min_score = 30;
+    cfg->margin = 1500;
+    cfg->shrink = 5000;
+    cfg->lead_ms = 400;
+}
+
+roi_map_t *roi_map_create(const roi_map_config_t *cfg)
+{
+    roi_map_t *map = (roi_map_t *)calloc(1, sizeof(*map));
+    if (!map)
+        return NULL;
+    map->cfg = *cfg;
+    if (map->cfg.confirm == 0)
+        map->cfg.confirm = 1;
+    return map;
+}
+
+void roi_map_destroy(roi_map_t *map)
+{
+    free(map);
+}
+
+static int64_t area(int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    return (int64_t)(right - left) * (bottom - top);
+}
+
+static void expire(roi_map_t *map, uint64_t now_ms)
+{
+    for (int i = 0; i < ROI_MAP_TRACKS; i++) {
+        track_t *t = &map->tracks[i];
+        if (t->used && now_ms - t->last_ms > map->cfg.hold_ms) {
+            t->used = 0;
+            map->expired++;
+        }
+    }
+}
+
+static track_t *find_track(roi_map_t *map, uint32_t id, uint64_t now_ms)
+{
+    for (int i = 0; i < ROI_MAP_TRACKS; i++) {
+        if (map->tracks[i].used && map->tracks[i].id == id)
+            return &map->tracks[i];
+    }
+    // A new object: take a free track, or the one not seen for longest
+    track_t *t = &map->tracks[0];
+    for (int i = 0; i < ROI_MAP_TRACKS && t->used; i++) {
+        track_t *c = &map->tracks[i];
+        if (!c->used || c->last_ms < t->last_ms)
+            t = c;
+    }
+    memset(t, 0, sizeof(*t));
+    t->used = 1;
+    t->id = id;
+    t->first_ms = now_ms;
+    map->started++;
+    return t;
+}
+
+void roi_map_update(roi_map_t *map, uint64_t now_ms, const roi_box_t *boxes, int count)
+{
+    const roi_map_config_t *cfg = &map->cfg;
+    for (int i = 0; i < count; i++) {
+        const roi_box_t *b = &boxes[i];
+        if (b->score < cfg->min_score || b->right <= b->left || b->bottom <= b->top)
+            continue;
+        map->detections++;
+        track_t *t = find_track(map, b->id, now_ms);
+        int32_t cx = (b->left + b->right) / 2, cy = (b->top + b->bottom) / 2;
+        if (t->hits > 0 && now_ms > t->last_ms) {
+            int64_t dt = (int64_t)(now_ms - t->last_ms);
+            t->vx = (int32_t)((t->vx + (int64_t)(cx - t->cx) * 1000 / dt) / 2);
+            t->vy = (int32_t)((t->vy + (int64_t)(cy - t->cy) * 1000 / dt) / 2);
+        }
+        t->cx = cx;
+        t->cy = cy;
+
+        int32_t dx = (int32_t)(b->right - b->left) * cfg->margin / ROI_MAP_SCALE;
+        int32_t dy = (int32_t)(b->bottom - b->top) * cfg->margin / ROI_MAP_SCALE;
+        int32_t ax = (int32_t)((int64_t)t->vx * cfg->lead_ms / 1000);
+        int32_t ay = (int32_t)((int64_t)t->vy * cfg->lead_ms / 1000);
+        int32_t left = b->left - dx + (ax < 0 ? ax : 0), top = b->top - dy + (ay < 0 ? ay : 0);
+        int32_t right = b->right + dx + (ax > 0 ? ax : 0), bottom = b->bottom + dy + (ay > 0 ? ay : 0);
+        int inside = b->left >= t->left && b->top >= t->top && b->right <= t->right &&
+                     b->bottom <= t->bottom;
+        int64_t needed = area(left, top, right, bottom);
+        int loose = area(t->left, t->top, t->right, t->bottom) >
+                    needed + needed * cfg->shrink / ROI_MAP_SCALE;
+        if (t->hits == 0 || !inside || loose) {
+            t->left = left;
+            t->top = top;
+            t->right = right;
+            t->bottom = bottom;
+        }
+        t->hits++;
+        t->last_ms = now_ms;
+        t->priority = b->priority;
+    }
+    expire(map, now_ms);
+}
+
+void roi_target_init(roi_target_t *target, uint32_t width, uint32_t height)
+{
+    memset(target, 0, sizeof(*target));
+    target->width = width;
+    target->height = height;
+}
+
+/* Higher priority first, then the track that has lasted longest */
+static int before(const track_t *a, const track_t *b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    if (a->first_ms != b->first_ms)
+        return a->first_ms < b->first_ms;
+    return a->id < b->id;
+}
+
+static int32_t snap(int32_t v, uint32_t size, int up)
+{
+    int64_t px = (int64_t)v * size;
+    px = up ? (px + ROI_MAP_SCALE - 1) / ROI_MAP_SCALE : px / ROI_MAP_SCALE;
+    if (px < 0)
+        px = 0;
+    px = up ? (px + ROI_MAP_ALIGN - 1) / ROI_MAP_ALIGN * ROI_MAP_ALIGN : px / ROI_MAP_ALIGN * ROI_MAP_ALIGN;
+    return px > size ? (int32_t)size : (int32_t)px;
+}
+
+uint32_t roi_target_update(roi_target_t *target, roi_map_t *map, uint64_t now_ms)
+{
+    expire(map, now_ms);
+
+    const track_t *order[ROI_MAP_TRACKS];
+    int n = 0;
+    for (int i = 0; i < ROI_MAP_TRACKS; i++) {
+        const track_t *t = &map->tracks[i];
+        if (!t->used || t->hits < map->cfg.confirm)
+            continue;
+        int j = n++;
+        for (; j > 0 && before(t, order[j - 1]); j--)
+            order[j] = order[j - 1];
+        order[j] = t;
+    }
+
+    roi_rect_t rects[ROI_MAP_REGIONS];
+    int count = 0;
+    for (int i = 0; i < n && count < ROI_MAP_REGIONS; i++) {
+        const track_t *t = order[i];
+        int32_t x0 = snap(t->left, target->width, 0), x1 = snap(t->right, target->width, 1);
+        int32_t y0 = snap(t->top, target->height, 0), y1 = snap(t->bottom, target->height, 1);
+        if (x1 <= x0 || y1 <= y0)
+            continue;
+        rects[count].x = x0;
+        rects[count].y = y0;
+        rects[count].width = (uint32_t)(x1 - x0);
+        rects[count].height = (uint32_t)(y1 - y0);
+        count++;
+    }
+
+    uint32_t changed = 0;
+    for (int i = 0; i < count || i < target->count; i++) {
+        if (i >= count || i >= target->count || memcmp(&rects[i], &target->rects[i], sizeof(roi_rect_t)) != 0) {
+            changed |= 1u << i;
+            target->updates++;
+        }
+    }
+    memcpy(target->rects, rects, count * sizeof(roi_rect_t));
+    target->count = count;
+    return changed;
+}
+
+void roi_map_get_stats(const roi_map_t *map, roi_map_stats_t *out)
+{
+    out->detections = map->detections;
+    out->tracks = map->started;
+    out->expired = map->expired;
+    out->active = 0;
+    for (int i = 0; i < ROI_MAP_TRACKS; i++) {
+        if (map->tracks[i].used && map->tracks[i].hits >= map->cfg.confirm)
+            out->active++;
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * ROI map: turns detections into the regions of interest an encoder codes
+ * at better quality than the rest of the frame.
+ *
+ * Detector boxes (in 1/ROI_MAP_SCALE of the frame, as RockIVA reports them)
+ * feed tracks keyed by the detector's object id. A track gets a region once
+ * it has been seen `confirm` times and keeps it for `hold_ms` after its last
+ * detection, so a missed frame or a one-off false positive does not switch
+ * regions on and off. The region is the box grown by `margin` on each side
+ * and stretched ahead of a moving object by where it will be `lead_ms` on,
+ * which covers the detector's latency and the next detection or two. It
+ * follows the object only when the object leaves it, or when it has become
+ * `shrink` larger than needed, so the encoder is not reconfigured for every
+ * pixel of jitter.
+ *
+ * An roi_target_t maps the regions onto one encoder's frame, snapped
+ * outward to ROI_MAP_ALIGN pixels, at most ROI_MAP_REGIONS of them with the
+ * highest priority first, and says which changed since the encoder last
+ * got them. Within a priority the longest-lived track comes first, so an
+ * object leaving renumbers only the regions after it.
+ *
+ * Not thread-safe: update and map from one thread.
+ */
+#ifndef __ROI_MAP_H__
+#define __ROI_MAP_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROI_MAP_SCALE       (10000) // Box coordinates are 1/ROI_MAP_SCALE of the frame
+#define ROI_MAP_REGIONS     (8)     // Regions an encoder takes (VENC_ROI_ATTR_S.u32Index)
+#define ROI_MAP_TRACKS      (32)
+#define ROI_MAP_ALIGN       (16)    // Region edges in pixels are multiples of this
+
+typedef struct roi_box {
+    uint32_t    id;             // The detector's object id, kept while it follows the object
+    int16_t     left;
+    int16_t     top;
+    int16_t     right;
+    int16_t     bottom;
+    uint8_t     priority;       // Higher first when there are more tracks than regions
+    uint8_t     score;          // 0..100
+} roi_box_t;
+
+typedef struct roi_map_config {
+    uint32_t    hold_ms;        // Keep a region this long after the last detection
+    uint8_t     confirm;        // Detections before a track gets a region
+    uint8_t     min_score;      // Ignore weaker detections
+    uint16_t    margin;         // Grow boxes on each side by this much of their size, 1/ROI_MAP_SCALE
+    uint16_t    shrink;         // Shrink a region once its area is this much too large, 1/ROI_MAP_SCALE
+    uint32_t    lead_ms;        // Stretch a moving object's region this far ahead
+} roi_map_config_t;
+
+/* A region in pixels */
+typedef struct roi_rect {
+    int32_t     x;
+    int32_t     y;
+    uint32_t    width;
+    uint32_t    height;
+} roi_rect_t;
+
+/* The regions one encoder has */
+typedef struct roi_target {
+    uint32_t    width;          // Encoder frame size
+    uint32_t    height;
+    int         count;
+    roi_rect_t  rects[ROI_MAP_REGIONS];
+    uint64_t    updates;        // Regions set or cleared
+} roi_target_t;
+
+typedef struct roi_map_stats {
+    uint64_t    detections;     // Boxes taken in
+    uint64_t    tracks;         // Tracks started
+    uint64_t    expired;        // Tracks dropped after hold_ms without a detection
+    int         active;         // Tracks with a region now
+} roi_map_stats_t;
+
+typedef struct roi_map roi_map_t;
+
+void roi_map_default_config(roi_map_config_t *cfg);
+
+roi_map_t *roi_map_create(const roi_map_config_t *cfg);
+void roi_map_destroy(roi_map_t *map);
+
+/* Take in one detector result: every box found in a frame at `now_ms` */
+void roi_map_update(roi_map_t *map, uint64_t now_ms, const roi_box_t *boxes, int count);
+
+/* Start a target for an encoder of width x height pixels, with no regions */
+void roi_target_init(roi_target_t *target, uint32_t width, uint32_t height);
+/* Recompute the target's regions at `now_ms`. Returns a mask of the ones
+ * that changed, bit i for rects[i]; a region past `count` was cleared. */
+uint32_t roi_target_update(roi_target_t *target, roi_map_t *map, uint64_t now_ms);
+
+void roi_map_get_stats(const roi_map_t *map, roi_map_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ROI_MAP_H__ */
@@ -0,0 +1,246 @@
+/*
+ * RTSP sender, see rtsp_sender.h
+ *
+ * Byte positions in a session's byte ring are cumulative counters; a
+ * packet that would wrap skips to the start of the ring instead, so every
+ * packet is contiguous for tx(). A descriptor records where its packet ends,
+ * and the network thread releases the bytes up to there once it is sent.
+ * The pushing thread publishes a descriptor with a release store of the
+ * tail; the network thread hands back bytes, then the descriptor, with
+ * release stores of byte_head and head.
+ */
+#include "rtsp_sender.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct slot {
+    uint64_t    end;            // Byte position just past the packet
+    uint32_t    len;
+    uint64_t    pts;
+    uint64_t    queued_ns;
+} slot_t;
+
+typedef struct session {
+    uint8_t     *bytes;
+    size_t      size;
+    slot_t      slots[RTSP_SENDER_SLOTS];
+    uint32_t    head;           // Network thread
+    uint32_t    tail;           // Pushing thread
+    uint64_t    byte_head;      // Network thread
+    uint64_t    byte_tail;      // Pushing thread
+    int         skipping;       // Pushing thread: dropping up to the next keyframe
+    uint64_t    queued;
+    uint64_t    dropped;
+    uint64_t    cuts;
+    uint32_t    max_depth;
+    uint64_t    sent;           // Network thread
+    uint64_t    bytes_sent;
+} session_t;
+
+struct rtsp_sender {
+    rtsp_sink_t         sink;
+    int                 count;
+    session_t           sessions[STREAM_PUMP_MAX_CHANNELS];
+    rtsp_keyframe_fn    on_cut;
+    void                *on_cut_user;
+    int                 wake_fd;
+    pthread_t           thread;
+    int                 running;
+    int                 stop;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+rtsp_sender_t *rtsp_sender_create(const rtsp_sink_t *sink, int count, const size_t *queue_bytes)
+{
+    if (count <= 0 || count > STREAM_PUMP_MAX_CHANNELS)
+        return NULL;
+    rtsp_sender_t *sender = (rtsp_sender_t *)calloc(1, sizeof(*sender));
+    if (!sender)
+        return NULL;
+    sender->sink = *sink;
+    sender->count = count;
+    sender->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sender->wake_fd < 0) {
+        perror("rtsp sender: eventfd");
+        rtsp_sender_destroy(sender);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        session_t *s = &sender->sessions[i];
+        s->size = queue_bytes[i];
+        s->bytes = (uint8_t *)malloc(s->size);
+        if (!s->bytes) {
+            rtsp_sender_destroy(sender);
+            return NULL;
+        }
+    }
+    return sender;
+}
+
+void rtsp_sender_destroy(rtsp_sender_t *sender)
+{
+    if (!sender)
+        return;
+    rtsp_sender_stop(sender);
+    for (int i = 0; i < sender->count; i++)
+        free(sender->sessions[i].bytes);
+    if (sender->wake_fd >= 0)
+        close(sender->wake_fd);
+    free(sender);
+}
+
+void rtsp_sender_on_cut(rtsp_sender_t *sender, rtsp_keyframe_fn fn, void *user)
+{
+    sender->on_cut = fn;
+    sender->on_cut_user = user;
+}
+
+static int cut(rtsp_sender_t *sender, session_t *s, int chn)
+{
+    __atomic_store_n(&s->dropped, s->dropped + 1, __ATOMIC_RELAXED);
+    if (s->skipping)
+        return -1;
+    s->skipping = 1;
+    __atomic_store_n(&s->cuts, s->cuts + 1, __ATOMIC_RELAXED);
+    if (sender->on_cut)
+        sender->on_cut(sender->on_cut_user, chn);
+    return -1;
+}
+
+int rtsp_sender_push(rtsp_sender_t *sender, int chn, const stream_packet_t *pkt)
+{
+    session_t *s = &sender->sessions[chn];
+    if (s->skipping) {
+        if (!pkt->keyframe)
+            return cut(sender, s, chn);
+        s->skipping = 0;
+    }
+
+    uint32_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    if (s->tail - head >= RTSP_SENDER_SLOTS)
+        return cut(sender, s, chn);
+    uint64_t byte_head = __atomic_load_n(&s->byte_head, __ATOMIC_ACQUIRE);
+    size_t pos = s->byte_tail % s->size;
+    uint64_t start = s->byte_tail + (pos + pkt->len > s->size ? s->size - pos : 0);
+    if (pkt->len > s->size || start + pkt->len - byte_head > s->size)
+        return cut(sender, s, chn);
+
+    memcpy(s->bytes + start % s->size, pkt->data, pkt->len);
+    slot_t *slot = &s->slots[s->tail % RTSP_SENDER_SLOTS];
+    slot->end = start + pkt->len;
+    slot->len = pkt->len;
+    slot->pts = pkt->pts;
+    slot->queued_ns = now_ns();
+    __atomic_store_n(&s->byte_tail, slot->end, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->tail, s->tail + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->queued, s->queued + 1, __ATOMIC_RELAXED);
+    uint32_t depth = s->tail - head;
+    if (depth > s->max_depth)
+        __atomic_store_n(&s->max_depth, depth, __ATOMIC_RELAXED);
+
+    uint64_t one = 1;
+    ssize_t ret = write(sender->wake_fd, &one, sizeof(one));
+    (void)ret;
+    return 0;
+}
+
+/* Send the oldest packet of `s`, if any and the sink can take it. Returns 1
+ * if one went. */
+static int send_one(rtsp_sender_t *sender, session_t *s, int chn)
+{
+    uint32_t tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+    if (s->head == tail)
+        return 0;
+    const slot_t *slot = &s->slots[s->head % RTSP_SENDER_SLOTS];
+    if (sender->sink.ready && !sender->sink.ready(sender->sink.ctx, chn, (int)slot->len))
+        return 0;
+    sender->sink.tx(sender->sink.ctx, chn, s->bytes + (slot->end - slot->len) % s->size, (int)slot->len, slot->pts);
+    __atomic_store_n(&s->byte_head, slot->end, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->head, s->head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->sent, s->sent + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->bytes_sent, s->bytes_sent + slot->len, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static void *network(void *arg)
+{
+    rtsp_sender_t *sender = (rtsp_sender_t *)arg;
+    struct pollfd pfd = {sender->wake_fd, POLLIN, 0};
+    while (!__atomic_load_n(&sender->stop, __ATOMIC_ACQUIRE)) {
+        if (poll(&pfd, 1, RTSP_SENDER_EVENT_MS) > 0) {
+            uint64_t count;
+            ssize_t ret = read(sender->wake_fd, &count, sizeof(count));
+            (void)ret;
+        }
+        // One packet per session per round, until no session sends
+        for (;;) {
+            int sent = 0;
+            for (int chn = 0; chn < sender->count; chn++)
+                sent += send_one(sender, &sender->sessions[chn], chn);
+            sender->sink.do_event(sender->sink.ctx);
+            if (!sent || __atomic_load_n(&sender->stop, __ATOMIC_ACQUIRE))
+                break;
+        }
+    }
+    return NULL;
+}
+
+int rtsp_sender_start(rtsp_sender_t *sender)
+{
+    if (sender->running)
+        return 0;
+    sender->stop = 0;
+    if (pthread_create(&sender->thread, NULL, network, sender) != 0)
+        return -1;
+    sender->running = 1;
+    return 0;
+}
+
+void rtsp_sender_stop(rtsp_sender_t *sender)
+{
+    if (!sender->running)
+        return;
+    __atomic_store_n(&sender->stop, 1, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    ssize_t ret = write(sender->wake_fd, &one, sizeof(one));
+    (void)ret;
+    pthread_join(sender->thread, NULL);
+    sender->running = 0;
+}
+
+void rtsp_sender_get_stats(const rtsp_sender_t *sender, int chn, rtsp_session_stats_t *out)
+{
+    const session_t *s = &sender->sessions[chn];
+    uint32_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+    out->queued = __atomic_load_n(&s->queued, __ATOMIC_RELAXED);
+    out->sent = __atomic_load_n(&s->sent, __ATOMIC_RELAXED);
+    out->bytes_sent = __atomic_load_n(&s->bytes_sent, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&s->dropped, __ATOMIC_RELAXED);
+    out->cuts = __atomic_load_n(&s->cuts, __ATOMIC_RELAXED);
+    out->depth = tail - head;
+    out->max_depth = __atomic_load_n(&s->max_depth, __ATOMIC_RELAXED);
+    out->backlog = (uint32_t)(__atomic_load_n(&s->byte_tail, __ATOMIC_RELAXED) -
+                              __atomic_load_n(&s->byte_head, __ATOMIC_RELAXED));
+    out->oldest_ms = 0;
+    if (tail != head) {
+        // The slot may be sent and reused meanwhile; an estimate is enough
+        uint64_t queued = __atomic_load_n(&s->slots[head % RTSP_SENDER_SLOTS].queued_ns, __ATOMIC_RELAXED);
+        uint64_t now = now_ns();
+        out->oldest_ms = now > queued ? (uint32_t)((now - queued) / 1000000) : 0;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * RTSP sender: per-session packet queues between the stream pump and the
+ * RTSP server, drained by one network thread that owns the server.
+ *
+ * The pump thread pushes each encoded packet into its session's queue and
+ * goes on; it never waits for a client. The network thread takes one
+ * packet from every session in turn, hands it to the sink (rtsp_tx_video()
+ * on the robot), and lets the server handle its own events between rounds
+ * and at least every RTSP_SENDER_EVENT_MS. A client that can't keep up thus
+ * holds back its own session's queue, not the encoder. If the sink can tell
+ * when a session would block (ready()), the network thread passes over that
+ * session until it can take its next packet, so the other sessions go on
+ * too; a sink without ready() that blocks in tx() still holds them all.
+ *
+ * Each queue is single-producer single-consumer and lock-free: a ring of
+ * packet descriptors over a byte ring the packets are copied into, both
+ * sized at create, so pushing allocates nothing. When a packet doesn't fit,
+ * the queue drops it and every following packet up to the next keyframe,
+ * so the client sees a clean cut rather than frames that reference a lost
+ * one, and asks the encoder for that keyframe right away.
+ */
+#ifndef __RTSP_SENDER_H__
+#define __RTSP_SENDER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream_pump.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTSP_SENDER_SLOTS       (64)    // Packets a session queue holds
+#define RTSP_SENDER_EVENT_MS    (10)    // Longest wait between server events
+
+/* Where packets go: the RTSP server, or a stand-in */
+typedef struct rtsp_sink {
+    void        *ctx;
+    /* Send one packet of session `chn` */
+    int         (*tx)(void *ctx, int chn, const uint8_t *data, int len, uint64_t pts);
+    /* Optional: whether tx() of `len` bytes would go without blocking */
+    int         (*ready)(void *ctx, int chn, int len);
+    /* Serve connections and requests; called from the network thread only */
+    int         (*do_event)(void *ctx);
+} rtsp_sink_t;
+
+/* Called from the pushing thread when session `chn` starts dropping */
+typedef void (*rtsp_keyframe_fn)(void *user, int chn);
+
+typedef struct rtsp_session_stats {
+    uint64_t    queued;         // Packets accepted
+    uint64_t    sent;
+    uint64_t    bytes_sent;
+    uint64_t    dropped;        // Packets dropped while waiting for a keyframe
+    uint64_t    cuts;           // Times the session started dropping
+    uint32_t    depth;          // Packets waiting now
+    uint32_t    max_depth;
+    uint32_t    backlog;        // Bytes waiting now
+    uint32_t    oldest_ms;      // How long the oldest waiting packet has waited
+} rtsp_session_stats_t;
+
+typedef struct rtsp_sender rtsp_sender_t;
+
+/* Sessions 0..count-1, session i copying packets into queue_bytes[i]
+ * bytes. Returns NULL on error. */
+rtsp_sender_t *rtsp_sender_create(const rtsp_sink_t *sink, int count, const size_t *queue_bytes);
+void rtsp_sender_destroy(rtsp_sender_t *sender);
+
+/* Ask `fn` for a keyframe whenever a session starts dropping */
+void rtsp_sender_on_cut(rtsp_sender_t *sender, rtsp_keyframe_fn fn, void *user);
+
+/* Start and stop the network thread. Stopping sends nothing more; packets
+ * still queued are discarded. */
+int rtsp_sender_start(rtsp_sender_t *sender);
+void rtsp_sender_stop(rtsp_sender_t *sender);
+
+/* Queue a packet for session `chn`, copying it. One pushing thread only.
+ * Returns 0, or -1 if it was dropped. */
+int rtsp_sender_push(rtsp_sender_t *sender, int chn, const stream_packet_t *pkt);
+
+/* Counters of session `chn`; safe from any thread */
+void rtsp_sender_get_stats(const rtsp_sender_t *sender, int chn, rtsp_session_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RTSP_SENDER_H__ */
@@ -0,0 +1,133 @@
+/*
+ * Stream pump, see stream_pump.h
+ *
+ * The epoll user data of a channel's descriptor is the channel number; the
+ * stop eventfd is registered as STREAM_PUMP_MAX_CHANNELS, which no channel
+ * can have.
+ */
+#include "stream_pump.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define STOP_TAG    STREAM_PUMP_MAX_CHANNELS
+
+struct stream_pump {
+    encoder_source_t    source;
+    int                 count;
+    stream_sink_t       sink;
+    void                *user;
+    int                 epoll_fd;
+    int                 stop_fd;
+    stream_pump_stats_t stats;
+};
+
+static int watch(int epoll_fd, int fd, uint32_t tag)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+stream_pump_t *stream_pump_create(const encoder_source_t *source, int count, stream_sink_t sink, void *user)
+{
+    if (count <= 0 || count > STREAM_PUMP_MAX_CHANNELS)
+        return NULL;
+    stream_pump_t *pump = (stream_pump_t *)calloc(1, sizeof(*pump));
+    if (!pump)
+        return NULL;
+    pump->source = *source;
+    pump->count = count;
+    pump->sink = sink;
+    pump->user = user;
+    pump->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    pump->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pump->epoll_fd < 0 || pump->stop_fd < 0 || watch(pump->epoll_fd, pump->stop_fd, STOP_TAG) < 0) {
+        perror("stream pump");
+        stream_pump_destroy(pump);
+        return NULL;
+    }
+    for (int chn = 0; chn < count; chn++) {
+        int fd = source->fd(source->ctx, chn);
+        if (fd < 0 || watch(pump->epoll_fd, fd, chn) < 0) {
+            fprintf(stderr, "stream pump: no descriptor for channel %d\n", chn);
+            stream_pump_destroy(pump);
+            return NULL;
+        }
+    }
+    return pump;
+}
+
+void stream_pump_destroy(stream_pump_t *pump)
+{
+    if (!pump)
+        return;
+    if (pump->epoll_fd >= 0)
+        close(pump->epoll_fd);
+    if (pump->stop_fd >= 0)
+        close(pump->stop_fd);
+    free(pump);
+}
+
+/* Hand up to STREAM_PUMP_BURST packets of `chn` to the sink */
+static void drain(stream_pump_t *pump, int chn)
+{
+    stream_packet_t pkt;
+    int n;
+    for (n = 0; n < STREAM_PUMP_BURST; n++) {
+        memset(&pkt, 0, sizeof(pkt));
+        if (pump->source.get(pump->source.ctx, chn, &pkt) < 0)
+            break;
+        pump->sink(pump->user, chn, &pkt);
+        pump->source.release(pump->source.ctx, chn, &pkt);
+        pump->stats.packets++;
+        pump->stats.bytes += pkt.len;
+        pump->stats.channel_packets[chn]++;
+    }
+    if (n == 0)
+        pump->stats.spurious++;
+}
+
+int stream_pump_run(stream_pump_t *pump)
+{
+    struct epoll_event events[STREAM_PUMP_MAX_CHANNELS + 1];
+    for (;;) {
+        int n = epoll_wait(pump->epoll_fd, events, STREAM_PUMP_MAX_CHANNELS + 1, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("stream pump: epoll_wait");
+            return -1;
+        }
+        pump->stats.wakeups++;
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == STOP_TAG) {
+                uint64_t count;
+                ssize_t ret = read(pump->stop_fd, &count, sizeof(count));
+                (void)ret;
+                return 0;
+            }
+            drain(pump, (int)tag);
+        }
+    }
+}
+
+void stream_pump_stop(stream_pump_t *pump)
+{
+    uint64_t one = 1;
+    ssize_t ret = write(pump->stop_fd, &one, sizeof(one));
+    (void)ret;
+}
+
+void stream_pump_get_stats(const stream_pump_t *pump, stream_pump_stats_t *out)
+{
+    *out = pump->stats;
+}
@@ -0,0 +1,80 @@
+/*
+ * Stream pump: one thread that takes encoded packets from every encoder
+ * channel as they finish and hands them to a sink.
+ *
+ * The encoder is reached through encoder_source_t: a pollable descriptor
+ * per channel (RK_MPI_VENC_GetFd() on the robot), readable while the channel
+ * holds a packet, and non-blocking get/release calls. The pump waits on all
+ * descriptors with one epoll set, so it sleeps until a packet is ready and
+ * wakes once per batch of ready channels, instead of a thread per channel
+ * polling every millisecond. A channel that is ready gives at most
+ * STREAM_PUMP_BURST packets per wakeup, so a busy main stream can't hold
+ * back the sub streams; epoll is level-triggered and brings it back.
+ *
+ * The sink runs on the pump thread and must return quickly; the packet is
+ * released as soon as it returns. file_encoder.h is a source backed by a
+ * file, for running the pump on a host without the encoder.
+ */
+#ifndef __STREAM_PUMP_H__
+#define __STREAM_PUMP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_PUMP_MAX_CHANNELS    (16)
+#define STREAM_PUMP_BURST           (4)     // Packets per channel per wakeup
+
+/* One encoded packet, valid until the source releases it */
+typedef struct stream_packet {
+    const uint8_t   *data;
+    uint32_t    len;
+    uint64_t    pts;            // Encoder timestamp, microseconds
+    uint8_t     keyframe;       // Starts a GOP: the decoder can join here
+    uint64_t    ready_ns;       // CLOCK_MONOTONIC when the packet was ready, 0 if the source can't tell
+} stream_packet_t;
+
+/* An encoder with channels 0..count-1 */
+typedef struct encoder_source {
+    void        *ctx;
+    /* Descriptor that is readable while `chn` holds a packet, -1 on error */
+    int         (*fd)(void *ctx, int chn);
+    /* Take the next packet of `chn` without blocking: 0, or -1 if none */
+    int         (*get)(void *ctx, int chn, stream_packet_t *pkt);
+    /* Give back the packet get() returned */
+    void        (*release)(void *ctx, int chn, stream_packet_t *pkt);
+} encoder_source_t;
+
+typedef void (*stream_sink_t)(void *user, int chn, const stream_packet_t *pkt);
+
+typedef struct stream_pump_stats {
+    uint64_t    wakeups;        // Returns from epoll_wait with a channel ready
+    uint64_t    packets;
+    uint64_t    bytes;
+    uint64_t    spurious;       // A channel was ready but had no packet
+    uint64_t    channel_packets[STREAM_PUMP_MAX_CHANNELS];
+} stream_pump_stats_t;
+
+typedef struct stream_pump stream_pump_t;
+
+/* A pump over channels 0..count-1 of `source`. Returns NULL on error. */
+stream_pump_t *stream_pump_create(const encoder_source_t *source, int count, stream_sink_t sink, void *user);
+void stream_pump_destroy(stream_pump_t *pump);
+
+/* Pump until stream_pump_stop(). Returns 0, or -1 if waiting failed. */
+int stream_pump_run(stream_pump_t *pump);
+
+/* Make stream_pump_run() return; safe from any thread and signal handlers */
+void stream_pump_stop(stream_pump_t *pump);
+
+/* Counters so far; exact once stream_pump_run() has returned */
+void stream_pump_get_stats(const stream_pump_t *pump, stream_pump_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STREAM_PUMP_H__ */
@@ -17,6 +17,7 @@
  #include "QMC5883P.h"     // Magnetometer driver (QMC5883P variant)
  #include "ellipsoidfit.h" // Ellipsoid fitting algorithm (for magnetometer calibration)
  #include "imu.h"          // IMU data structures and calibration state definitions
+ #include "ucp_time.h"     // Sample timestamps for UCP_REPORT_V2
  
  // ==========================================================================
  // Local Buffers and Globals
@@ -42,6 +43,10 @@
  // Shared IMU data structure
  IMU_data IMU_updata;               // IMU output data container
  thread_imu_data_t thread_imu_data; // Global IMU data accessible across threads
+
+ // Every sample, oldest overwritten first (protected by imu_data_mutex)
+ static imu_ring_sample_t imu_ring[IMU_RING_SIZE];
+ static uint32_t imu_ring_seq = 0;  // Samples written since boot
  
  // ==========================================================================
  // Filtering and Sensor Fusion
@@ -385,6 +390,34 @@ float adjust_angle_minus_90(float angle)
 CalibrationState_t mag_calib_state = CALIB_IDLE;  // Current state of magnetometer calibration
 CalibrationState_t imu_calib_state = CALIB_IDLE;  // Current state of IMU calibration
 
+// ==========================================================================
+// Sample Ring
+// ==========================================================================
+
+uint32_t imu_ring_head(void)
+{
+    return imu_ring_seq;  // A single word, written only by the IMU thread
+}
+
+int imu_ring_read(uint32_t *seq, imu_ring_sample_t *out, int max)
+{
+    int n = 0;
+
+    if (imu_data_mutex == RT_NULL)
+        return 0;
+
+    rt_mutex_take(imu_data_mutex, RT_WAITING_FOREVER);
+    if (imu_ring_seq - *seq > IMU_RING_SIZE)
+        *seq = imu_ring_seq - IMU_RING_SIZE;  // The reader fell behind
+    while (n < max && *seq + n != imu_ring_seq)
+    {
+        out[n] = imu_ring[(*seq + n) & (IMU_RING_SIZE - 1)];
+        n++;
+    }
+    rt_mutex_release(imu_data_mutex);
+    return n;
+}
+
 
 /**
  * @brief IMU thread entry function
@@ -489,6 +522,7 @@ void imu_thread_entry(void *parameter)
             rt_sem_take(imu_sem, RT_WAITING_FOREVER);
 
             /** Acquire raw sensor data **/
+            uint64_t sample_us = ucp_time_us();
             mpu_dmp_get_data(IMU_updata.imu_data, IMU_updata.imu_data + 1, IMU_updata.imu_data + 2, quaternion);
             MPU6050_acc_read(&acc[0], &acc[1], &acc[2]);
             MPU6050_gyro_read(&gyro[0], &gyro[1], &gyro[2]);
@@ -564,6 +598,18 @@ void imu_thread_entry(void *parameter)
             thread_imu_data.mag_data.mag_x = (int32_t)mag_calibrated[0];
             thread_imu_data.mag_data.mag_y = (int32_t)mag_calibrated[1];
             thread_imu_data.mag_data.mag_z = (int32_t)mag_calibrated[2];
+            thread_imu_data.sample_us = sample_us;
+
+            // Keep every sample for UCP_IMU_BATCH; the report only sees the latest
+            imu_ring_sample_t *ring = &imu_ring[imu_ring_seq & (IMU_RING_SIZE - 1)];
+            ring->acc[0] = thread_imu_data.acc_data.acc_x;
+            ring->acc[1] = thread_imu_data.acc_data.acc_y;
+            ring->acc[2] = thread_imu_data.acc_data.acc_z;
+            ring->gyro[0] = thread_imu_data.gyro_data.gyro_x;
+            ring->gyro[1] = thread_imu_data.gyro_data.gyro_y;
+            ring->gyro[2] = thread_imu_data.gyro_data.gyro_z;
+            ring->sample_us = sample_us;
+            imu_ring_seq++;
 
             /** Heading calculation (sensor fusion) **/
             IMUupdate(
@@ -137,10 +137,29 @@
      mag_calib_data_t  mag_calib_data;   // Magnetometer calibration data
  
      int16_t           heading;          // Computed heading (yaw/compass direction)
+     uint64_t          sample_us;        // ucp_time_us() when the sensors were read
  } thread_imu_data_t;
  
  // Shared IMU data instance (protected by imu_data_mutex)
  extern thread_imu_data_t thread_imu_data;
+
+ // --------------------------------------------------------------------------
+ // Sample Ring (every sample, for UCP_IMU_BATCH)
+ // --------------------------------------------------------------------------
+ #define IMU_RING_SIZE 64   // Power of two; 640 ms of samples at 100 Hz
+
+ typedef struct {
+     int16_t  acc[3];       // Accelerometer, calibrated as in thread_imu_data
+     int16_t  gyro[3];      // Gyroscope, calibrated as in thread_imu_data
+     uint64_t sample_us;    // ucp_time_us() when the sensors were read
+ } imu_ring_sample_t;
+
+ // Sequence number of the next sample to be written
+ uint32_t imu_ring_head(void);
+ // Copy up to `max` samples, oldest first, starting at sequence number *seq.
+ // Samples already overwritten are skipped by moving *seq to the oldest one
+ // still held. Returns the number copied; *seq is not advanced past them.
+ int imu_ring_read(uint32_t *seq, imu_ring_sample_t *out, int max);
  
  #endif /* APPLICATIONS_IMU_H_ */
  
\ No newline at end of file
@@ -61,6 +61,7 @@ typedef struct robot_state_t
 			uint32_t rs485_crcerr_num;  //RS485丢包次数 = Number of RS485 packet loss (CRC errors)
 			uint8_t lamp;
 			uint8_t tof;
+			uint16_t tof_mm[4];  // Latest VL53L0X ranges, 0 when there is no reading
 			int16_t speed;
 			int16_t steer;
 			uint8_t key;
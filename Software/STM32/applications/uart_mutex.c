@@ -14,19 +14,26 @@
 #include <rtdbg.h>
 #include "state.h"
 #include "ucp.h"
+#include "ucp_crc.h"
 #include "imu.h"
+#include "ucp_time.h"
+#include "ucp_delta.h"
+#include "ucp_reliable.h"
 
 #define DATA_SIZE 20
 #define RS485_UART_NAME "uart3"
 
-#define DATA_SEND_INTERVAL 20        // Timed send interval in milliseconds
+#define DATA_SEND_INTERVAL 20        // Period of the default report subscription in milliseconds
+#define UART_BAUD_DEFAULT BAUD_RATE_115200  // Boot rate, and the fallback after a failed switch
+#define UART_BAUD_MAX BAUD_RATE_2000000     // Fastest rate uart_baud_supported() accepts
+#define UART_FRAME_MAX 64                   // Longest frame from the head the parser takes, sync to CRC
 
 // UART_EVENT commands
 #define EVENT_DATA_READY 0x01        // Event flag 1, data is ready to send
 #define EVENT_DATA_GET   0x02        // Event flag 2, indicates a request to retrieve data
 #define EVENT_IMU_SET    0x04        // Event flag 3, triggers IMU configuration
 #define EVENT_MAG_SET    0x08        // Event flag 4, triggers magnetometer configuration
-#define EVENT_TIMER_START 0x10       // Event flag 5, starts a timer
+#define EVENT_TIMER_START 0x10       // Event flag 5, retransmit due requests and rearm ucp_timer
 #define EVENT_IMU_SET_DONE 0x20      // IMU configuration completed
 #define EVENT_MAG_SET_DONE 0x40      // Magnetometer configuration completed
 #define EVENT_DATA_GET_DONE 0x80     // Data retrieval completed
@@ -34,6 +41,10 @@
 static rt_event_t uart_event;       // Event flag to notify the timed send thread
 static rt_mutex_t uart_mutex;       // Mutex to protect serial device access
 
+static uint32_t uart_baud = UART_BAUD_DEFAULT;  // Current UART rate
+static rt_tick_t uart_fallback_ticks = 0;       // Silence before returning to the default rate, 0 at it
+static rt_tick_t uart_last_frame = 0;           // Tick of the last valid frame from the head
+
 extern void update_driver();
 static struct rt_semaphore rx_sem;
 static rt_device_t serial;
@@ -52,20 +63,52 @@ struct rx_msg
 
 typedef struct uart_message
 {
-    u_int8_t get_data_flag;  // Indicates a request to retrieve data
-    u_int8_t imu_set_flag;   // Indicates a request to configure IMU
-    u_int8_t mag_set_flag;   // Indicates a request to configure magnetometer
+    u_int8_t report_v2;      // Head speaks UCP_TIME_SYNC: report with UCP_REPORT_V2
 } uart_flag;
 
 static uart_flag ucp_flag;
 
-rt_timer_t ucp_timer;  // ACK timeout timer
+// hd.index of the frame from the head being handled. Every answer carries
+// it back as its own hd.index, so the head can route the answer to the
+// client that asked.
+static uint8_t uart_rx_index = 0;
+
+// Telemetry subscriptions (UCP_SUBSCRIBE), run by the send thread on every
+// UCP_SUB_TICK_MS tick. Written by the receive thread under rt_enter_critical().
+typedef struct ucp_sub
+{
+    uint8_t groups;          // UCP_GRP_* bits, 0 = slot unused
+    uint16_t period_ticks;   // Send period in scheduler ticks
+    uint16_t countdown;      // Ticks until the next packet
+} ucp_sub_t;
+
+static ucp_sub_t ucp_subs[UCP_SUB_SLOTS];
+static uint8_t ucp_subs_default = 1;  // Only the boot-time report subscription is active
+
+// Per slot, the next IMU ring sample to send with UCP_GRP_IMU_BATCH. Owned by
+// the send thread; valid while the slot keeps UCP_GRP_IMU_BATCH.
+static uint32_t ucp_imu_seq[UCP_SUB_SLOTS];
+static uint8_t ucp_imu_live[UCP_SUB_SLOTS];
+
+// Report delta coder for UCP_GRP_REPORT_DELTA: the send thread codes reports,
+// the receive thread applies the head's keyframe acknowledgments, both
+// under rt_enter_critical()
+static ucp_delta_enc_t ucp_delta;
+
+// Calibration requests to the head (UCP_IMU_WRITE, UCP_MAG_WRITE,
+// UCP_IMUMAG_READ) in flight until answered: the send thread sends and
+// retransmits them, the receive thread retires them, both under
+// rt_enter_critical()
+static ucp_rel_tx_t ucp_rel;
+
+rt_timer_t ucp_timer;  // Retransmission timer of ucp_rel
 rt_timer_t ucp_data;   // Data reporting timer
 
 void uart_data_updata_init(void);
 void uart_timout_init(void);
 
-// Timer callback executed every 20ms, sets event flag to trigger data send
+// Timer callback executed every UCP_SUB_TICK_MS, sets event flag to run the
+// telemetry subscriptions
 void uart_data_send_timeout(void *parameter)
 {
     if (uart_event != RT_NULL)
@@ -78,103 +121,14 @@ void uart_data_send_timeout(void *parameter)
 // Initialize and start the periodic data reporting timer
 void uart_send_timout_init(void)
 {
-    ucp_data = rt_timer_create("ucp_data", uart_data_send_timeout, RT_NULL, DATA_SEND_INTERVAL, RT_TIMER_FLAG_PERIODIC);
+    ucp_data = rt_timer_create("ucp_data", uart_data_send_timeout, RT_NULL,
+                               rt_tick_from_millisecond(UCP_SUB_TICK_MS), RT_TIMER_FLAG_PERIODIC);
     if (ucp_data != RT_NULL)
     {
         rt_timer_start(ucp_data);  // Start the timer
     }
 }
 
-// CRC lookup tables (high and low bytes) used for data integrity
-static uint8_t crc_hi_table[] = { 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 ,
-
-    0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 ,
-
-    0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 ,
-
-    0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 ,
-
-    0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 ,
-
-    0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 ,
-
-    0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 ,
-
-    0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 ,
-
-    0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 ,
-
-    0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 ,
-
-    0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 ,
-
-    0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 ,
-
-    0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 ,
-
-    0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 ,
-
-    0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 ,
-
-    0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 ,
-
-    0xC0 , 0x80 , 0x41 , 0x00 , 0xC1 , 0x81 , 0x40 , 0x01 , 0xC0 , 0x80 , 0x41 , 0x01 , 0xC0 , 0x80 , 0x41 ,
-
-    0x00 , 0xC1 , 0x81 , 0x40 };
-
-
-static uint8_t crc_lo_table[] ={ 0x00 , 0xC0 , 0xC1 , 0x01 , 0xC3 , 0x03 , 0x02 , 0xC2 , 0xC6 , 0x06 , 0x07 , 0xC7 ,
-
-    0x05 , 0xC5 , 0xC4 , 0x04 , 0xCC , 0x0C , 0x0D , 0xCD , 0x0F , 0xCF , 0xCE , 0x0E , 0x0A , 0xCA , 0xCB ,
-
-    0x0B , 0xC9 , 0x09 , 0x08 , 0xC8 , 0xD8 , 0x18 , 0x19 , 0xD9 , 0x1B , 0xDB , 0xDA , 0x1A , 0x1E , 0xDE ,
-
-    0xDF , 0x1F , 0xDD , 0x1D , 0x1C , 0xDC , 0x14 , 0xD4 , 0xD5 , 0x15 , 0xD7 , 0x17 , 0x16 , 0xD6 , 0xD2 ,
-
-    0x12 , 0x13 , 0xD3 , 0x11 , 0xD1 , 0xD0 , 0x10 , 0xF0 , 0x30 , 0x31 , 0xF1 , 0x33 , 0xF3 , 0xF2 , 0x32 ,
-
-    0x36 , 0xF6 , 0xF7 , 0x37 , 0xF5 , 0x35 , 0x34 , 0xF4 , 0x3C , 0xFC , 0xFD , 0x3D , 0xFF , 0x3F , 0x3E ,
-
-    0xFE , 0xFA , 0x3A , 0x3B , 0xFB , 0x39 , 0xF9 , 0xF8 , 0x38 , 0x28 , 0xE8 , 0xE9 , 0x29 , 0xEB , 0x2B ,
-
-    0x2A , 0xEA , 0xEE , 0x2E , 0x2F , 0xEF , 0x2D , 0xED , 0xEC , 0x2C , 0xE4 , 0x24 , 0x25 , 0xE5 , 0x27 ,
-
-    0xE7 , 0xE6 , 0x26 , 0x22 , 0xE2 , 0xE3 , 0x23 , 0xE1 , 0x21 , 0x20 , 0xE0 , 0xA0 , 0x60 , 0x61 , 0xA1 ,
-
-    0x63 , 0xA3 , 0xA2 , 0x62 , 0x66 , 0xA6 , 0xA7 , 0x67 , 0xA5 , 0x65 , 0x64 , 0xA4 , 0x6C , 0xAC , 0xAD ,
-
-    0x6D , 0xAF , 0x6F , 0x6E , 0xAE , 0xAA , 0x6A , 0x6B , 0xAB , 0x69 , 0xA9 , 0xA8 , 0x68 , 0x78 , 0xB8 ,
-
-    0xB9 , 0x79 , 0xBB , 0x7B , 0x7A , 0xBA , 0xBE , 0x7E , 0x7F , 0xBF , 0x7D , 0xBD , 0xBC , 0x7C , 0xB4 ,
-
-    0x74 , 0x75 , 0xB5 , 0x77 , 0xB7 , 0xB6 , 0x76 , 0x72 , 0xB2 , 0xB3 , 0x73 , 0xB1 , 0x71 , 0x70 , 0xB0 ,
-
-    0x50 , 0x90 , 0x91 , 0x51 , 0x93 , 0x53 , 0x52 , 0x92 , 0x96 , 0x56 , 0x57 , 0x97 , 0x55 , 0x95 , 0x94 ,
-
-    0x54 , 0x9C , 0x5C , 0x5D , 0x9D , 0x5F , 0x9F , 0x9E , 0x5E , 0x5A , 0x9A , 0x9B , 0x5B , 0x99 , 0x59 ,
-
-    0x58 , 0x98 , 0x88 , 0x48 , 0x49 , 0x89 , 0x4B , 0x8B , 0x8A , 0x4A , 0x4E , 0x8E , 0x8F , 0x4F , 0x8D ,
-
-    0x4D , 0x4C , 0x8C , 0x44 , 0x84 , 0x85 , 0x45 , 0x87 , 0x47 , 0x46 , 0x86 , 0x82 , 0x42 , 0x43 , 0x83 ,
-
-    0x41 , 0x81 , 0x80 , 0x40 };
-
-// Calculate CRC16 for a data buffer
-static uint16_t crc16(char* msg, size_t len)
-{
-    uint8_t crc_hi = 0xFF;  
-    uint8_t crc_lo = 0xFF;  
-    uint8_t index;
-
-    while (len--)
-    {
-        index = crc_lo ^ *msg++;
-        crc_lo = crc_hi ^ crc_hi_table[index];
-        crc_hi = crc_lo_table[index];
-    }
-    return (crc_hi << 8 | crc_lo);
-}
-
 // UART input callback, triggers when data is received
 static rt_err_t uart_input(rt_device_t dev, rt_size_t size)
 {
@@ -201,8 +155,87 @@ void uart_send_data(const uint8_t *data, uint16_t len)
     rt_mutex_release(uart_mutex);  // Release mutex
 }
 
-// Compose and send information packet (Packet ID: 0x05)
-static void uart_report_state(void)
+// Resend a composed 0x05 report as a versioned report (Packet ID: 0x0C)
+// carrying the MCU time of the IMU sample
+static void uart_report_state_v2(const uint8_t *v1, uint64_t sample_us)
+{
+    ucp_hd_t hd;
+    hd.len = sizeof(ucp_rep_v2_t);
+    hd.id = UCP_REPORT_V2;
+    uint16_t crc = 0;
+    uint8_t data[sizeof(ucp_rep_v2_t) + 4] = {0};
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = hd.len & 0xff;
+    data[3] = hd.len >> 8;
+    data[4] = hd.id;
+    data[5] = v1[5];                 // Same index sequence as the 0x05 report
+    data[6] = UCP_REPORT_VERSION;
+    data[7] = 0;
+    for (int i = 0; i < 8; i++)
+        data[8 + i] = (uint8_t)(sample_us >> (8 * i));
+    rt_memcpy(data + 16, v1 + 6, 36); // voltage .. version, same layout as 0x05
+
+    crc = ucp_crc16(data, sizeof(data) - 2);
+    data[sizeof(data) - 2] = crc & 0xff;
+    data[sizeof(data) - 1] = crc >> 8;
+
+    uart_send_data(data, sizeof(data));
+}
+
+// Apply a UART rate; the other settings stay as uart_int_sample() set them
+static void uart_apply_baud(uint32_t baud)
+{
+    struct serial_configure config = RT_SERIAL_CONFIG_DEFAULT;
+    config.baud_rate = baud;
+    config.data_bits = DATA_BITS_8;
+    config.stop_bits = STOP_BITS_1;
+    config.bufsz = 2048;
+    config.parity = PARITY_NONE;
+    rt_device_control(serial, RT_DEVICE_CTRL_CONFIG, &config);
+    uart_baud = baud;
+}
+
+// Rates UCP_BAUD_SET may ask for
+static int uart_baud_supported(uint32_t baud)
+{
+    switch (baud)
+    {
+        case BAUD_RATE_115200:
+        case BAUD_RATE_230400:
+        case BAUD_RATE_460800:
+        case BAUD_RATE_921600:
+        case BAUD_RATE_2000000:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// A CRC-valid frame arrived from the head
+static void uart_link_alive(void)
+{
+    uart_last_frame = rt_tick_get();
+}
+
+// Back to the default rate when the head hasn't been heard at the
+// negotiated one for fallback_ms: the switch failed or the head restarted
+static void uart_check_fallback(void)
+{
+    if (uart_fallback_ticks == 0 || rt_tick_get() - uart_last_frame < uart_fallback_ticks)
+        return;
+
+    rt_mutex_take(uart_mutex, RT_WAITING_FOREVER);
+    uart_apply_baud(UART_BAUD_DEFAULT);
+    rt_mutex_release(uart_mutex);
+    uart_fallback_ticks = 0;
+    LOG_W("No valid frame at the negotiated rate, back to %d", UART_BAUD_DEFAULT);
+}
+
+// Compose the information packet (Packet ID: 0x05) into data[44], returning
+// the time of its IMU sample
+static uint64_t uart_build_report(uint8_t *data)
 {
     uint16_t version = APP_VERSION;
     ucp_hd_t hd;
@@ -210,7 +243,9 @@ static void uart_report_state(void)
     hd.id = 0x05;
     static uint8_t index = 0;
     uint16_t crc = 0;
-    uint8_t data[44] = {0};
+    uint64_t sample_us = 0;
+
+    rt_memset(data, 0, 44);
 
     data[0] = 0xfd;
     data[1] = 0xff;
@@ -266,6 +301,7 @@ static void uart_report_state(void)
     data[33] = thread_imu_data.mag_data.mag_z >> 8;
     data[34] = thread_imu_data.heading & 0xff;
     data[35] = thread_imu_data.heading >> 8;
+    sample_us = thread_imu_data.sample_us;
 
     // Release imu_data mutex
     if (imu_data_mutex != RT_NULL)
@@ -273,21 +309,351 @@ static void uart_report_state(void)
 
     data[40] = version & 0xff;
     data[41] = version >> 8;
-    crc = crc16(data, 42);
+    crc = ucp_crc16(data, 42);
     data[42] = crc & 0xff;
     data[43] = crc >> 8;
+    return sample_us;
+}
+
+// Send the information packet, as UCP_REPORT_V2 once the head syncs clocks
+static void uart_report_state(void)
+{
+    uint8_t data[44];
+    uint64_t sample_us = uart_build_report(data);
 
+    if (ucp_flag.report_v2)
+    {
+        uart_report_state_v2(data, sample_us);
+        return;
+    }
     uart_send_data(data, sizeof(data));  // Send the state packet over UART
 }
 
+// Send the information packet delta-coded against the last keyframe the head
+// acknowledged (Packet ID: 0x11)
+static void uart_report_delta(void)
+{
+    uint8_t rep[44];
+    uint8_t data[sizeof(ucp_hd_t) + UCP_DELTA_MSG_MAX + 4];
+    ucp_delta_report_t r;
+    static uint8_t index = 0;
+    uint16_t len, crc;
+
+    rt_memset(&r, 0, sizeof(r));
+    r.sample_us = uart_build_report(rep);
+    rt_memcpy((uint8_t *)&r.rep + sizeof(ucp_hd_t), rep + 6, UCP_DELTA_REP_BYTES);
+
+    rt_enter_critical();
+    len = sizeof(ucp_hd_t) + ucp_delta_encode(&ucp_delta, &r, data + 6);
+    rt_exit_critical();
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = len & 0xff;
+    data[3] = len >> 8;
+    data[4] = UCP_REPORT_DELTA;
+    data[5] = index++;
+    crc = ucp_crc16(data, len + 2);
+    data[len + 2] = crc & 0xff;
+    data[len + 3] = crc >> 8;
+
+    uart_send_data(data, len + 4);
+}
+
+// Append a little-endian 16-bit value to a packet, returning the next offset
+static uint16_t put_u16(uint8_t *data, uint16_t p, uint16_t value)
+{
+    data[p] = value & 0xff;
+    data[p + 1] = value >> 8;
+    return p + 2;
+}
+
+// Compose and send compact telemetry with only `groups` (Packet ID: 0x0F)
+static void uart_send_telemetry(uint8_t slot, uint8_t groups)
+{
+    uint8_t data[sizeof(ucp_telemetry_t) + sizeof(ucp_tlm_wheels_t) + sizeof(ucp_tlm_imu_raw_t) +
+                 sizeof(ucp_tlm_attitude_t) + sizeof(ucp_tlm_power_t) + sizeof(ucp_tlm_tof_t) + 4];
+    static uint8_t index = 0;
+    uint16_t p = sizeof(ucp_telemetry_t) + 2;  // Payloads follow the fixed part
+    int16_t rpm[4] = {0};
+    uint16_t tof_mm[4] = {0};
+    uint16_t battery = 0;
+    float voltage = 0, current = 0, power = 0;
+    int16_t imu[9] = {0};  // acc, gyro, mag
+    int16_t heading = 0;
+    uint64_t sample_us;
+    uint16_t crc;
+    int i;
+
+    // Snapshot under each mutex, then serialize without holding either
+    if (groups & (UCP_GRP_WHEELS | UCP_GRP_POWER | UCP_GRP_TOF))
+    {
+        if (state_data_mutex != RT_NULL)
+            rt_mutex_take(state_data_mutex, RT_WAITING_FOREVER);
+        for (i = 0; i < 4; i++)
+        {
+            rpm[i] = robot_state.rpm[i];
+            tof_mm[i] = robot_state.tof_mm[i];
+        }
+        battery = robot_state.battery;
+        voltage = robot_state.voltage;
+        current = robot_state.current;
+        power = robot_state.power;
+        if (state_data_mutex != RT_NULL)
+            rt_mutex_release(state_data_mutex);
+    }
+
+    if (groups & (UCP_GRP_IMU_RAW | UCP_GRP_ATTITUDE))
+    {
+        if (imu_data_mutex != RT_NULL)
+            rt_mutex_take(imu_data_mutex, RT_WAITING_FOREVER);
+        imu[0] = thread_imu_data.acc_data.acc_x;
+        imu[1] = thread_imu_data.acc_data.acc_y;
+        imu[2] = thread_imu_data.acc_data.acc_z;
+        imu[3] = thread_imu_data.gyro_data.gyro_x;
+        imu[4] = thread_imu_data.gyro_data.gyro_y;
+        imu[5] = thread_imu_data.gyro_data.gyro_z;
+        imu[6] = thread_imu_data.mag_data.mag_x;
+        imu[7] = thread_imu_data.mag_data.mag_y;
+        imu[8] = thread_imu_data.mag_data.mag_z;
+        heading = thread_imu_data.heading;
+        sample_us = thread_imu_data.sample_us;
+        if (imu_data_mutex != RT_NULL)
+            rt_mutex_release(imu_data_mutex);
+    }
+    else
+    {
+        sample_us = ucp_time_us();
+    }
+
+    // Payloads in group bit order
+    if (groups & UCP_GRP_WHEELS)
+    {
+        for (i = 0; i < 4; i++)
+            p = put_u16(data, p, rpm[i]);
+    }
+    if (groups & UCP_GRP_IMU_RAW)
+    {
+        for (i = 0; i < 9; i++)
+            p = put_u16(data, p, imu[i]);
+    }
+    if (groups & UCP_GRP_ATTITUDE)
+        p = put_u16(data, p, heading);
+    if (groups & UCP_GRP_POWER)
+    {
+        p = put_u16(data, p, battery);
+        p = put_u16(data, p, (uint16_t)(voltage * 100));
+        p = put_u16(data, p, (uint16_t)(int16_t)(current * 100));
+        p = put_u16(data, p, (uint16_t)(power * 10));
+    }
+    if (groups & UCP_GRP_TOF)
+    {
+        for (i = 0; i < 4; i++)
+            p = put_u16(data, p, tof_mm[i]);
+    }
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = (p - 2) & 0xff;  // hd.len: everything but sync and CRC
+    data[3] = (p - 2) >> 8;
+    data[4] = UCP_TELEMETRY;
+    data[5] = index++;
+    data[6] = slot;
+    data[7] = groups;
+    for (i = 0; i < 8; i++)
+        data[8 + i] = (sample_us >> (8 * i)) & 0xff;
+
+    crc = ucp_crc16(data, p);
+    data[p] = crc & 0xff;
+    data[p + 1] = crc >> 8;
+
+    uart_send_data(data, p + 2);
+}
+
+// Length of the evenly spaced run at the front of `s`: a sample further
+// than half a period off the nominal spacing ends it
+static int imu_batch_run(const imu_ring_sample_t *s, int n)
+{
+    int k;
+    uint64_t gap;
+
+    for (k = 1; k < n; k++)
+    {
+        gap = s[k].sample_us - s[k - 1].sample_us;
+        if (gap < UCP_IMU_PERIOD_US / 2 || gap > UCP_IMU_PERIOD_US * 3 / 2)
+            break;
+    }
+    return k;
+}
+
+// Send the IMU samples taken since the last batch of `slot` (Packet ID: 0x10),
+// as many batches as it takes, each of evenly spaced samples
+static void uart_send_imu_batch(uint8_t slot)
+{
+    uint8_t data[sizeof(ucp_imu_batch_t) + UCP_IMU_BATCH_MAX * sizeof(ucp_imu_sample_t) + 4];
+    imu_ring_sample_t s[UCP_IMU_BATCH_MAX];
+    static uint8_t index = 0;
+    uint32_t from, dropped = 0;
+    uint16_t period_us, p, crc;
+    int n, k, i, j;
+
+    if (!ucp_imu_live[slot])
+    {
+        // Newly subscribed: start with the next sample
+        ucp_imu_seq[slot] = imu_ring_head();
+        ucp_imu_live[slot] = 1;
+        return;
+    }
+
+    for (;;)
+    {
+        from = ucp_imu_seq[slot];
+        n = imu_ring_read(&ucp_imu_seq[slot], s, UCP_IMU_BATCH_MAX);
+        dropped += ucp_imu_seq[slot] - from;
+        if (n == 0)
+            return;
+
+        k = imu_batch_run(s, n);
+        period_us = k > 1 ? (uint16_t)((s[k - 1].sample_us - s[0].sample_us) / (k - 1)) : UCP_IMU_PERIOD_US;
+        ucp_imu_seq[slot] += k;
+
+        p = sizeof(ucp_imu_batch_t) + 2;
+        for (i = 0; i < k; i++)
+        {
+            for (j = 0; j < 3; j++)
+                p = put_u16(data, p, s[i].acc[j]);
+            for (j = 0; j < 3; j++)
+                p = put_u16(data, p, s[i].gyro[j]);
+        }
+
+        data[0] = 0xfd;
+        data[1] = 0xff;
+        data[2] = (p - 2) & 0xff;  // hd.len: everything but sync and CRC
+        data[3] = (p - 2) >> 8;
+        data[4] = UCP_IMU_BATCH;
+        data[5] = index++;
+        data[6] = slot;
+        data[7] = k;
+        put_u16(data, 8, dropped > 0xffff ? 0xffff : dropped);
+        put_u16(data, 10, period_us);
+        for (i = 0; i < 8; i++)
+            data[12 + i] = (s[0].sample_us >> (8 * i)) & 0xff;
+
+        crc = ucp_crc16(data, p);
+        data[p] = crc & 0xff;
+        data[p + 1] = crc >> 8;
+        uart_send_data(data, p + 2);
+
+        dropped = 0;
+        if (k == n && n < UCP_IMU_BATCH_MAX)
+            return;  // Caught up
+    }
+}
+
+// Back to what the MCU sent before subscriptions: the full report every 20 ms
+static void uart_subs_reset(void)
+{
+    rt_enter_critical();
+    rt_memset(ucp_subs, 0, sizeof(ucp_subs));
+    ucp_subs[0].groups = UCP_GRP_REPORT;
+    ucp_subs[0].period_ticks = DATA_SEND_INTERVAL / UCP_SUB_TICK_MS;
+    ucp_subs[0].countdown = 1;
+    ucp_subs_default = 1;
+    rt_exit_critical();
+}
+
+// One scheduler tick: send every subscription that is due. Packets are
+// built outside the critical section; a subscription changed meanwhile
+// takes effect on the next tick.
+static void uart_telemetry_tick(void)
+{
+    uint8_t due[UCP_SUB_SLOTS];
+    int i;
+
+    rt_enter_critical();
+    for (i = 0; i < UCP_SUB_SLOTS; i++)
+    {
+        due[i] = 0;
+        if (!(ucp_subs[i].groups & UCP_GRP_IMU_BATCH))
+            ucp_imu_live[i] = 0;
+        if (ucp_subs[i].groups == 0 || --ucp_subs[i].countdown > 0)
+            continue;
+        ucp_subs[i].countdown = ucp_subs[i].period_ticks;
+        due[i] = ucp_subs[i].groups;
+    }
+    rt_exit_critical();
+
+    for (i = 0; i < UCP_SUB_SLOTS; i++)
+    {
+        if (due[i] & UCP_GRP_REPORT)
+            uart_report_state();
+        if (due[i] & UCP_GRP_REPORT_DELTA)
+            uart_report_delta();
+        if (due[i] & UCP_GRP_IMU_BATCH)
+            uart_send_imu_batch(i);
+        if (due[i] & ~(UCP_GRP_REPORT | UCP_GRP_REPORT_DELTA | UCP_GRP_IMU_BATCH))
+            uart_send_telemetry(i, due[i] & ~(UCP_GRP_REPORT | UCP_GRP_REPORT_DELTA | UCP_GRP_IMU_BATCH));
+    }
+}
+
+static uint32_t uart_rel_now_ms(void)
+{
+    return (uint32_t)(ucp_time_us() / 1000);
+}
+
+// Send a request through ucp_rel, which stamps its index and CRC and keeps
+// it for retransmission until the head answers
+static void uart_rel_send(uint8_t *data, uint16_t len)
+{
+    int ret;
+
+    rt_enter_critical();
+    ret = ucp_rel_send(&ucp_rel, data, len, uart_rel_now_ms());
+    rt_exit_critical();
+    if (ret == 0)
+        uart_send_data(data, len);
+    else
+        LOG_W("Request 0x%02x not sent: %d requests in flight", data[4], UCP_REL_WINDOW);
+}
+
+// Retransmit the requests whose timeout passed, then rearm ucp_timer for the
+// next one. Send thread, on EVENT_TIMER_START.
+static void uart_rel_poll(void)
+{
+    uint8_t frame[UCP_REL_FRAME_MAX];
+    size_t len;
+    int32_t next_ms;
+
+    do
+    {
+        rt_enter_critical();
+        len = ucp_rel_due(&ucp_rel, uart_rel_now_ms(), frame);
+        rt_exit_critical();
+        if (len)
+            uart_send_data(frame, len);
+    } while (len);
+
+    rt_enter_critical();
+    next_ms = ucp_rel_next_ms(&ucp_rel, uart_rel_now_ms());
+    rt_exit_critical();
+    if (next_ms < 0)
+    {
+        rt_timer_stop(ucp_timer);
+        return;
+    }
+    rt_tick_t ticks = rt_tick_from_millisecond(next_ms > 0 ? next_ms : 1);
+    rt_timer_stop(ucp_timer);
+    rt_timer_control(ucp_timer, RT_TIMER_CTRL_SET_TIME, &ticks);
+    rt_timer_start(ucp_timer);
+}
+
 // Write gyroscope calibration parameters (Packet ID: 0x06)
 static void IMU_PERS_SET(void)
 {
     ucp_hd_t hd;
     hd.len = 0x10;    // Packet length
     hd.id = 0x06;     // Packet ID for gyroscope calibration write
-    hd.index = 0x00;  // Packet index
-    uint16_t crc = 0;
+    hd.index = 0x00;  // Stamped by ucp_rel_send()
     uint8_t data[20] = {0};
 
     // Set packet header
@@ -314,12 +680,11 @@ static void IMU_PERS_SET(void)
     data[16] = thread_imu_data.gyro_calib_data.bias_z & 0xff;
     data[17] = thread_imu_data.gyro_calib_data.bias_z >> 8;
 
-    crc = crc16(data, 18); // Compute CRC16 over packet data
-    data[18] = crc & 0xff;
-    data[19] = crc >> 8;
-
-    // Send calibration data over UART
-    uart_send_data(data, sizeof(data));
+    // Newer values replace any still unanswered
+    rt_enter_critical();
+    ucp_rel_cancel(&ucp_rel, UCP_IMU_WRITE);
+    rt_exit_critical();
+    uart_rel_send(data, sizeof(data));
 
     // Log calibration values for accelerometer and gyroscope
     LOG_W("Gyroscope calibration report ->>> acc: %d,%d,%d",
@@ -339,7 +704,6 @@ static void MAG_PERS_SET(void)
     hd.len = 0x0A;   // Packet length
     hd.id = 0x07;    // Packet ID for magnetometer calibration write
     hd.index = 0x00;
-    uint16_t crc = 0;
     uint8_t data[14] = {0};
 
     // Set packet header
@@ -358,12 +722,10 @@ static void MAG_PERS_SET(void)
     data[10] = thread_imu_data.mag_calib_data.offset_z & 0xff;
     data[11] = thread_imu_data.mag_calib_data.offset_z >> 8;
 
-    crc = crc16(data, 12); // Compute CRC16
-    data[12] = crc & 0xff;
-    data[13] = crc >> 8;
-
-    // Send magnetometer calibration data over UART
-    uart_send_data(data, sizeof(data));
+    rt_enter_critical();
+    ucp_rel_cancel(&ucp_rel, UCP_MAG_WRITE);
+    rt_exit_critical();
+    uart_rel_send(data, sizeof(data));
 
     LOG_W("Magnetometer calibration report ->>> mag: %d,%d,%d",
           thread_imu_data.mag_calib_data.offset_x,
@@ -378,7 +740,6 @@ static void IMU_PERS_GET(void)
     hd.len = 0x04;   // Packet length
     hd.id = 0x08;    // Packet ID for calibration data request
     hd.index = 0x00;
-    uint16_t crc = 0;
     uint8_t data[8] = {0};
 
     // Set packet header
@@ -389,12 +750,8 @@ static void IMU_PERS_GET(void)
     data[4] = hd.id;
     data[5] = hd.index;
 
-    crc = crc16(data, 6); // Compute CRC16
-    data[6] = crc & 0xff;
-    data[7] = crc >> 8;
-
     // Send calibration request over UART
-    uart_send_data(data, sizeof(data));
+    uart_rel_send(data, sizeof(data));
 }
 
 // Respond with system status (Packet ID: 0x01)
@@ -403,7 +760,7 @@ static void Keep_alive_ACK(uint8_t err)
     ucp_hd_t hd;
     hd.len = 0x05;
     hd.id = 0x01;
-    hd.index = 0x00;
+    hd.index = uart_rx_index;
     uint16_t crc = 0;
     uint8_t data[9] = {0};
 
@@ -416,7 +773,7 @@ static void Keep_alive_ACK(uint8_t err)
     data[5] = hd.index;
     data[6] = err;
 
-    crc = crc16(data, 7); // Compute CRC16
+    crc = ucp_crc16(data, 7); // Compute CRC16
     data[7] = crc & 0xff;
     data[8] = crc >> 8;
 
@@ -430,7 +787,7 @@ static void IMU_Correct_Start_ACK(uint8_t type, uint8_t err)
     ucp_hd_t hd;
     hd.len = 0x06;
     hd.id = 0x03;
-    hd.index = 0x00;
+    hd.index = uart_rx_index;
     uint16_t crc = 0;
     uint8_t data[10] = {0};
 
@@ -443,7 +800,7 @@ static void IMU_Correct_Start_ACK(uint8_t type, uint8_t err)
     data[6] = type;
     data[7] = err;
 
-    crc = crc16(data, 8); // Compute CRC16
+    crc = ucp_crc16(data, 8); // Compute CRC16
     data[8] = crc & 0xff;
     data[9] = crc >> 8;
 
@@ -456,7 +813,7 @@ static void IMU_Correct_End_ACK(uint8_t type, uint8_t err)
     ucp_hd_t hd;
     hd.len = 0x06;
     hd.id = 0x04;
-    hd.index = 0x00;
+    hd.index = uart_rx_index;
     uint16_t crc = 0;
     uint8_t data[10] = {0};
 
@@ -469,7 +826,7 @@ static void IMU_Correct_End_ACK(uint8_t type, uint8_t err)
     data[6] = type;
     data[7] = err;
 
-    crc = crc16(data, 8); // Compute CRC16
+    crc = ucp_crc16(data, 8); // Compute CRC16
     data[8] = crc & 0xff;
     data[9] = crc >> 8;
 
@@ -482,7 +839,7 @@ static void OTA_Start_ACK(uint8_t err)
     ucp_hd_t hd;
     hd.len = 0x05;
     hd.id = 0x09;
-    hd.index = 0x00;
+    hd.index = uart_rx_index;
     uint16_t crc = 0;
     uint8_t data[10] = {0};
 
@@ -494,13 +851,144 @@ static void OTA_Start_ACK(uint8_t err)
     data[5] = hd.index;
     data[6] = err;
 
-    crc = crc16(data, 7); // Compute CRC16
+    crc = ucp_crc16(data, 7); // Compute CRC16
     data[7] = crc & 0xff;
     data[8] = crc >> 8;
 
     uart_send_data(data, sizeof(data)); // Send OTA status
 }
 
+// Respond to a subscription (Packet ID: 0x0E)
+static void Subscribe_ACK(uint8_t slot, uint8_t groups, uint16_t period_ms, uint8_t err)
+{
+    ucp_hd_t hd;
+    hd.len = sizeof(ucp_subscribe_ack_t);
+    hd.id = UCP_SUBSCRIBE;
+    hd.index = uart_rx_index;
+    uint16_t crc = 0;
+    uint8_t data[sizeof(ucp_subscribe_ack_t) + 4] = {0};
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = hd.len & 0xff;
+    data[3] = hd.len >> 8;
+    data[4] = hd.id;
+    data[5] = hd.index;
+    data[6] = slot;
+    data[7] = groups;
+    data[8] = period_ms & 0xff;
+    data[9] = period_ms >> 8;
+    data[10] = err;
+
+    crc = ucp_crc16(data, 11); // Compute CRC16
+    data[11] = crc & 0xff;
+    data[12] = crc >> 8;
+
+    uart_send_data(data, sizeof(data));
+}
+
+// Apply a UCP_SUBSCRIBE and answer it
+static void uart_subscribe(uint8_t slot, uint8_t groups, uint16_t period_ms)
+{
+    uint16_t ticks = (period_ms + UCP_SUB_TICK_MS - 1) / UCP_SUB_TICK_MS;
+
+    if (slot >= UCP_SUB_SLOTS || (groups & ~UCP_GRP_ALL) || (groups && ticks == 0))
+    {
+        Subscribe_ACK(slot, groups, period_ms, UCP_ERR_UNKNOWN);
+        LOG_W("Bad subscription: slot %d groups 0x%02x every %d ms", slot, groups, period_ms);
+        return;
+    }
+
+    rt_enter_critical();
+    if ((groups & UCP_GRP_REPORT_DELTA) && !(ucp_subs[slot].groups & UCP_GRP_REPORT_DELTA))
+        ucp_delta_enc_init(&ucp_delta, UCP_DELTA_KEY_INTERVAL);  // Keyframes until the head acknowledges one
+    ucp_subs[slot].groups = groups;
+    ucp_subs[slot].period_ticks = ticks;
+    ucp_subs[slot].countdown = 1;  // First packet on the next tick
+    ucp_subs_default = 0;
+    rt_exit_critical();
+
+    Subscribe_ACK(slot, groups, groups ? ticks * UCP_SUB_TICK_MS : 0, UCP_ERR_OK);
+    LOG_I("Subscription %d: groups 0x%02x every %d ms", slot, groups, ticks * UCP_SUB_TICK_MS);
+}
+
+// Restore the default subscription once the head has been silent for
+// UCP_SUB_IDLE_MS: whoever talks to the MCU next may expect the old report
+static void uart_check_subs_idle(void)
+{
+    if (ucp_subs_default || rt_tick_get() - uart_last_frame < rt_tick_from_millisecond(UCP_SUB_IDLE_MS))
+        return;
+
+    uart_subs_reset();
+    LOG_W("Head silent, telemetry subscriptions reset");
+}
+
+// Respond to a UART rate change (Packet ID: 0x0D)
+static void Baud_Set_ACK(uint32_t baud, uint8_t err)
+{
+    ucp_hd_t hd;
+    hd.len = sizeof(ucp_baud_set_ack_t);
+    hd.id = UCP_BAUD_SET;
+    hd.index = uart_rx_index;
+    uint16_t crc = 0;
+    uint8_t data[sizeof(ucp_baud_set_ack_t) + 4] = {0};
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = hd.len & 0xff;
+    data[3] = hd.len >> 8;
+    data[4] = hd.id;
+    data[5] = hd.index;
+    data[6] = baud & 0xff;
+    data[7] = (baud >> 8) & 0xff;
+    data[8] = (baud >> 16) & 0xff;
+    data[9] = baud >> 24;
+    data[10] = err;
+
+    crc = ucp_crc16(data, 11); // Compute CRC16
+    data[11] = crc & 0xff;
+    data[12] = crc >> 8;
+
+    uart_send_data(data, sizeof(data)); // Send the answer at the current rate
+}
+
+// Respond to a clock sync request (Packet ID: 0x0B). t3 is taken once the
+// UART is ours, right before the first byte goes out, so a report being
+// sent meanwhile doesn't skew it.
+static void Time_Sync_ACK(const uint8_t *t1, uint64_t t2_us)
+{
+    ucp_hd_t hd;
+    hd.len = sizeof(ucp_time_sync_ack_t);
+    hd.id = UCP_TIME_SYNC;
+    hd.index = uart_rx_index;
+    uint16_t crc = 0;
+    uint8_t data[sizeof(ucp_time_sync_ack_t) + 4] = {0};
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = hd.len & 0xff;
+    data[3] = hd.len >> 8;
+    data[4] = hd.id;
+    data[5] = hd.index;
+    rt_memcpy(data + 6, t1, 8);       // Echo the head's t1
+    for (int i = 0; i < 8; i++)
+        data[14 + i] = (uint8_t)(t2_us >> (8 * i));
+
+    rt_mutex_take(uart_mutex, RT_WAITING_FOREVER);
+    rt_device_t uart_dev = rt_device_find(RS485_UART_NAME);
+    if (uart_dev != RT_NULL)
+    {
+        uint64_t t3_us = ucp_time_us();
+        for (int i = 0; i < 8; i++)
+            data[22 + i] = (uint8_t)(t3_us >> (8 * i));
+        crc = ucp_crc16(data, sizeof(data) - 2);
+        data[sizeof(data) - 2] = crc & 0xff;
+        data[sizeof(data) - 1] = crc >> 8;
+        rt_device_write(uart_dev, 0, data, sizeof(data));
+    }
+    rt_mutex_release(uart_mutex);
+}
+
 // UART command handling thread
 void uart_send_thread_entry(void *parameter)
 {
@@ -514,6 +1002,7 @@ void uart_send_thread_entry(void *parameter)
         return;
     }
 
+    uart_subs_reset();       // The report every 20 ms until the head subscribes
     uart_send_timout_init(); // Initialize periodic send timer
 
     while (1)
@@ -543,50 +1032,298 @@ void uart_send_thread_entry(void *parameter)
                       RT_WAITING_FOREVER, &received_flags);
 
         if (received_flags & EVENT_DATA_READY)
-            uart_report_state(); // Upload current system state
+            uart_telemetry_tick(); // Upload what the subscriptions ask for
 
         if (received_flags & EVENT_DATA_GET)
         {
-            ucp_flag.get_data_flag = 1;
             IMU_PERS_GET(); // Request IMU calibration data
             LOG_I("Data retrieval triggered after cooldown.");
         }
 
         if (received_flags & EVENT_IMU_SET)
         {
-            ucp_flag.imu_set_flag = 1;
             IMU_PERS_SET(); // Write gyroscope calibration data
             LOG_I("Gyroscope calibration data written.");
         }
 
         if (received_flags & EVENT_MAG_SET)
         {
-            ucp_flag.mag_set_flag = 1;
             MAG_PERS_SET(); // Write magnetometer calibration data
             LOG_I("Magnetometer calibration data written.");
         }
 
         if (received_flags & EVENT_IMU_SET_DONE)
         {
-            ucp_flag.imu_set_flag = 0;
             LOG_I("Gyroscope calibration write completed.");
         }
 
         if (received_flags & EVENT_MAG_SET_DONE)
         {
-            ucp_flag.mag_set_flag = 0;
             LOG_I("Magnetometer calibration write completed.");
         }
 
         if (received_flags & EVENT_DATA_GET_DONE)
         {
-            ucp_flag.get_data_flag = 0;
             LOG_I("Initial data retrieval completed.");
         }
 
         if (received_flags & EVENT_TIMER_START)
-            rt_timer_start(ucp_timer); // Start ACK timeout timer
+            uart_rel_poll(); // Retransmit what is due, rearm the timer
+    }
+}
+
+static int uart_ota = 0;             // OTA update flag, set by a newer version in a motor command
+static uint8_t uart_calib_mode = 0;  // IMU calibration mode (1: magnetometer, 2: accelerometer+gyro)
+
+// Handlers for the frames the head sends. `frame` is the whole frame, sync
+// to CRC, already CRC checked; rx_us is when its last byte was read.
+typedef void (*uart_handle_fn)(const uint8_t *frame, uint64_t rx_us);
+// Answer to a frame that failed its CRC, for the messages that have one
+typedef void (*uart_refuse_fn)(void);
+
+typedef struct uart_handler
+{
+    const char *name;        // For the log
+    uint16_t len;            // hd.len the message must have, 0 = not checked
+    uart_handle_fn handle;
+    uart_refuse_fn refuse;
+} uart_handler_t;
+
+static void uart_on_keep_alive(const uint8_t *frame, uint64_t rx_us)
+{
+    // Respond with system status ACK
+    uart_link_alive();
+    Keep_alive_ACK(RT_EOK);
+    LOG_I("Keep-alive received!");
+}
+
+static void uart_refuse_keep_alive(void)
+{
+    Keep_alive_ACK(RT_ERROR);
+}
+
+static void uart_on_motor(const uint8_t *frame, uint64_t rx_us)
+{
+    // Update motor control values
+    uart_link_alive();
+    robot_state.speed = (frame[7] << 8) + frame[6];
+    robot_state.steer = (frame[9] << 8) + frame[8];
+    robot_state.lamp = (frame[11] << 8) + frame[10];
+    int16_t ota_version = (frame[15] << 8) + frame[14]; // OTA firmware version received from head
+    if(ota_version > APP_VERSION)
+    {
+        LOG_D("New firmware version detected");
+        uart_ota = 1;
     }
+    LOG_I("Motor control packet processed");
+}
+
+static void uart_on_calib_start(const uint8_t *frame, uint64_t rx_us)
+{
+    uart_calib_mode = frame[6];
+    if(uart_calib_mode == 1 && imu_event != RT_NULL)
+        rt_event_send(imu_event, IMU_MAG_EVENT_START | IMU_CALIB_LED_START);
+    else if(uart_calib_mode == 2 && imu_event != RT_NULL)
+        rt_event_send(imu_event, IMU_ACC_GYRO_EVENT_START | IMU_CALIB_LED_START);
+
+    IMU_Correct_Start_ACK(uart_calib_mode, 0);
+    LOG_I("0x03 IMU calibration start ACK sent");
+}
+
+static void uart_refuse_calib_start(void)
+{
+    IMU_Correct_Start_ACK(uart_calib_mode, 1);
+}
+
+static void uart_on_calib_end(const uint8_t *frame, uint64_t rx_us)
+{
+    IMU_Correct_End_ACK(uart_calib_mode, 0);
+    uart_calib_mode = frame[6];
+    if(uart_calib_mode == 1 && imu_event != RT_NULL)
+        rt_event_send(imu_event, IMU_MAG_EVENT_STOP);
+    else if(uart_calib_mode == 2 && imu_event != RT_NULL)
+        rt_event_send(imu_event, IMU_ACC_GYRO_EVENT_STOP);
+
+    LOG_I("0x04 IMU calibration end ACK sent");
+}
+
+static void uart_refuse_calib_end(void)
+{
+    IMU_Correct_End_ACK(uart_calib_mode, 1);
+}
+
+// Head stored the gyroscope or magnetometer calibration
+static void uart_on_calib_written(const uint8_t *frame, uint64_t rx_us)
+{
+    uint8_t id = frame[4];
+
+    uart_link_alive();
+    if(frame[6] != UCP_ERR_OK)
+    {
+        LOG_W("Calibration write 0x%02x refused: %d", id, frame[6]);
+        return;
+    }
+    rt_enter_critical();
+    int answered = ucp_rel_ack(&ucp_rel, id, frame[5], uart_rel_now_ms());
+    rt_exit_critical();
+    if(answered && uart_event != RT_NULL)
+        rt_event_send(uart_event, id == UCP_IMU_WRITE ? EVENT_IMU_SET_DONE : EVENT_MAG_SET_DONE);
+}
+
+// Calibration the head stored
+static void uart_on_calib_read(const uint8_t *frame, uint64_t rx_us)
+{
+    uart_link_alive();
+    rt_enter_critical();
+    int answered = ucp_rel_ack(&ucp_rel, frame[4], frame[5], uart_rel_now_ms());
+    rt_exit_critical();
+    // A retransmission's second answer is not applied again
+    if(answered && frame[6] == UCP_ERR_OK)
+    {
+        rt_mutex_take(imu_data_mutex, RT_WAITING_FOREVER);
+        thread_imu_data.acc_calib_data.bias_x  = (int16_t)(frame[7]  | frame[8]  << 8);
+        thread_imu_data.acc_calib_data.bias_y  = (int16_t)(frame[9]  | frame[10] << 8);
+        thread_imu_data.acc_calib_data.bias_z  = (int16_t)(frame[11] | frame[12] << 8);
+        thread_imu_data.gyro_calib_data.bias_x = (int16_t)(frame[13] | frame[14] << 8);
+        thread_imu_data.gyro_calib_data.bias_y = (int16_t)(frame[15] | frame[16] << 8);
+        thread_imu_data.gyro_calib_data.bias_z = (int16_t)(frame[17] | frame[18] << 8);
+        thread_imu_data.mag_calib_data.offset_x = (int16_t)(frame[19] | frame[20] << 8);
+        thread_imu_data.mag_calib_data.offset_y = (int16_t)(frame[21] | frame[22] << 8);
+        thread_imu_data.mag_calib_data.offset_z = (int16_t)(frame[23] | frame[24] << 8);
+        rt_mutex_release(imu_data_mutex);
+        if(uart_event != RT_NULL)
+            rt_event_send(uart_event, EVENT_DATA_GET_DONE);
+    }
+    else if(answered)
+        LOG_W("Head has no calibration: %d", frame[6]);
+}
+
+// Clock sync ping (about 1 s)
+static void uart_on_time_sync(const uint8_t *frame, uint64_t rx_us)
+{
+    uart_link_alive();
+    Time_Sync_ACK(frame + 6, rx_us);
+    ucp_flag.report_v2 = 1;
+}
+
+// UART rate change
+static void uart_on_baud_set(const uint8_t *frame, uint64_t rx_us)
+{
+    uint32_t baud = frame[6] | (frame[7] << 8) | (frame[8] << 16) | ((uint32_t)frame[9] << 24);
+    uint16_t fallback_ms = frame[10] | (frame[11] << 8);
+
+    uart_link_alive();
+    if(uart_baud_supported(baud) && fallback_ms > 0)
+    {
+        // Hold the UART from the answer until the switch (RT-Thread mutexes
+        // nest, so Baud_Set_ACK takes it again): a report or retransmission
+        // sent in between would reach a head already at the new rate, or
+        // leave half at each rate. TX is polled, so the answer is in the
+        // UART when the write returns; wait out its frame time at the old
+        // rate, rounded up, before switching.
+        rt_mutex_take(uart_mutex, RT_WAITING_FOREVER);
+        Baud_Set_ACK(baud, UCP_ERR_OK);
+        rt_thread_mdelay((sizeof(ucp_baud_set_ack_t) + 4) * 10 * 1000 / uart_baud + 1);
+        uart_apply_baud(baud);
+        rt_mutex_release(uart_mutex);
+        uart_fallback_ticks = baud == UART_BAUD_DEFAULT ? 0 : rt_tick_from_millisecond(fallback_ms);
+        LOG_I("UART switched to %d", baud);
+    }
+    else
+    {
+        Baud_Set_ACK(baud, UCP_ERR_UNKNOWN);
+        LOG_W("UART rate %d not supported", baud);
+    }
+}
+
+// Telemetry subscription
+static void uart_on_subscribe(const uint8_t *frame, uint64_t rx_us)
+{
+    uart_link_alive();
+    uart_subscribe(frame[6], frame[7], frame[8] | (frame[9] << 8));
+}
+
+// Keyframe acknowledgment
+static void uart_on_delta_ack(const uint8_t *frame, uint64_t rx_us)
+{
+    uart_link_alive();
+    rt_enter_critical();
+    ucp_delta_enc_ack(&ucp_delta, frame[6]);
+    rt_exit_critical();
+}
+
+static void uart_on_hello(const uint8_t *frame, uint64_t rx_us);
+
+// What the MCU does with each message ID from the head. A new message needs
+// its row here and nothing else: the parser, the skipping of unknown IDs
+// and the ID list in UCP_HELLO all come from this table. OTA (0x09) and the
+// device state (0x0A) are not handled yet and are skipped.
+static const uart_handler_t uart_handlers[UCP_ID_LAST + 1] =
+{
+    [UCP_KEEP_ALIVE]            = { "Keep-alive", 0, uart_on_keep_alive, uart_refuse_keep_alive },
+    [UCP_MOTOR_CTL]             = { "Motor control", 0, uart_on_motor, RT_NULL },
+    [UCP_IMU_CORRECTION_START]  = { "0x03 IMU calibration start", 0, uart_on_calib_start, uart_refuse_calib_start },
+    [UCP_IMU_CORRECTION_END]    = { "0x04 IMU calibration end", 0, uart_on_calib_end, uart_refuse_calib_end },
+    [UCP_IMU_WRITE]             = { "Calibration write ack", sizeof(ucp_imu_w_ack_t), uart_on_calib_written, RT_NULL },
+    [UCP_MAG_WRITE]             = { "Calibration write ack", sizeof(ucp_mag_w_ack_t), uart_on_calib_written, RT_NULL },
+    [UCP_IMUMAG_READ]           = { "Calibration read", sizeof(ucp_imu_r_ack_t), uart_on_calib_read, RT_NULL },
+    [UCP_TIME_SYNC]             = { "Time sync", sizeof(ucp_time_sync_t), uart_on_time_sync, RT_NULL },
+    [UCP_BAUD_SET]              = { "Baud set", sizeof(ucp_baud_set_t), uart_on_baud_set, RT_NULL },
+    [UCP_SUBSCRIBE]             = { "Subscribe", sizeof(ucp_subscribe_t), uart_on_subscribe, RT_NULL },
+    [UCP_REPORT_DELTA]          = { "Delta ack", sizeof(ucp_rep_delta_ack_t), uart_on_delta_ack, RT_NULL },
+    [UCP_HELLO]                 = { "Hello", sizeof(ucp_hello_t), uart_on_hello, RT_NULL },
+};
+
+#define UART_HANDLERS (sizeof(uart_handlers) / sizeof(uart_handlers[0]))
+
+// Answer a capability query (Packet ID: 0x12)
+static void Hello_ACK(void)
+{
+    ucp_hd_t hd;
+    hd.len = sizeof(ucp_hello_ack_t);
+    hd.id = UCP_HELLO;
+    hd.index = uart_rx_index;
+    uint16_t crc = 0;
+    uint8_t data[sizeof(ucp_hello_ack_t) + 4] = {0};
+    uint16_t p = 6;
+
+    data[0] = 0xfd;
+    data[1] = 0xff;
+    data[2] = hd.len & 0xff;
+    data[3] = hd.len >> 8;
+    data[4] = hd.id;
+    data[5] = hd.index;
+    data[p++] = UCP_PROTO_VERSION;
+    data[p++] = UCP_REPORT_VERSION;
+    p = put_u16(data, p, APP_VERSION);
+    p = put_u16(data, p, UART_BAUD_MAX & 0xffff);
+    p = put_u16(data, p, UART_BAUD_MAX >> 16);
+    data[p++] = UCP_GRP_ALL;
+    data[p++] = UCP_SUB_SLOTS;
+    p = put_u16(data, p, UCP_SUB_TICK_MS);
+    data[p++] = UCP_IMU_BATCH_MAX;
+    data[p++] = UCP_REL_WINDOW;
+    p = put_u16(data, p, RING_BUFFER_LEN);
+    p = put_u16(data, p, UART_FRAME_MAX);
+    for (uint16_t id = 0; id < UART_HANDLERS; id++)
+    {
+        if (uart_handlers[id].handle != RT_NULL)
+            data[p + id / 8] |= 1 << (id % 8);
+    }
+
+    crc = ucp_crc16(data, sizeof(data) - 2); // Compute CRC16
+    data[sizeof(data) - 2] = crc & 0xff;
+    data[sizeof(data) - 1] = crc >> 8;
+
+    uart_send_data(data, sizeof(data));
+}
+
+// Capability query
+static void uart_on_hello(const uint8_t *frame, uint64_t rx_us)
+{
+    uart_link_alive();
+    Hello_ACK();
+    LOG_I("Hello from head, protocol %d", frame[6]);
 }
 
 // UART command handling thread
@@ -594,17 +1331,14 @@ void uart_send_thread_entry(void *parameter)
 void uart_thread_entry(void *parameter)
 {
     uint16_t crc;                    // CRC16 checksum variable
-    int16_t ota_version = 0;         // OTA firmware version received from head
-    int ota = 0;                      // OTA update flag
     rt_err_t ret;                     // RT-Thread return code
     char rx_buffer[2] = {0};          // Temporary buffer for reading one byte at a time
     rt_uint32_t rx_length;            // Length of data read
-    uint8_t ring_buffer[64] = {0};    // Temporary buffer to store packet data
+    uint8_t ring_buffer[UART_FRAME_MAX] = {0}; // Temporary buffer to store packet data
     rt_int32_t ring_length = 0;       // Length of valid data in ring buffer
     uint8_t handle_id = 0;            // Current packet ID being processed
-    int8_t handle_len = 0;            // Length of the current packet
+    int handle_len = 0;               // Length of the current packet
     uint8_t ring_buffer_p = 0;        // Pointer/index in ring_buffer
-    uint8_t calib_mode = 0;           // IMU calibration mode (1: magnetometer, 2: accelerometer+gyro)
     uint8_t led_status = 0;           // LED status from head
     int8_t readlen = 0;               // Counter for bytes read in a loop
     int get_init = 0;                 // Flag to indicate first-time data request after boot
@@ -614,6 +1348,8 @@ void uart_thread_entry(void *parameter)
 
     while (1)
     {
+        uart_check_fallback();
+
         // First-time boot: request initial data from head
         if(!get_init)
         {
@@ -625,7 +1361,7 @@ void uart_thread_entry(void *parameter)
         }
 
         // OTA update handling
-        if (ota)
+        if (uart_ota)
         {
             rt_timer_stop(ucp_data);  // Stop periodic data timer
             rt_timer_stop(ucp_timer); // Stop ACK timer
@@ -644,7 +1380,7 @@ void uart_thread_entry(void *parameter)
             rt_device_open(serial, RT_DEVICE_OFLAG_RDWR | RT_DEVICE_FLAG_INT_RX);
             rt_device_set_rx_indicate(serial, uart_input);
             rt_timer_start(ucp_data);  // Restart data timer
-            ota = 0;
+            uart_ota = 0;
         }
 
         readlen = 0;
@@ -664,6 +1400,8 @@ void uart_thread_entry(void *parameter)
                     robot_state.speed = 0;
                     robot_state.steer = 0;
                     LOG_I("Communication timeout, stop driving!");
+                    uart_check_fallback();
+                    uart_check_subs_idle();
                 }
             }
             rx_buffer[1] = '\0';
@@ -694,16 +1432,26 @@ void uart_thread_entry(void *parameter)
                             rt_ringbuffer_get(rb, ring_buffer + ring_buffer_p, 3);
                             ring_buffer_p += 3;
                             ring_length -= 3;
-                            if(ring_buffer[4] >= 0x01 && ring_buffer[4] <= 0x0A)
+                            handle_len = (ring_buffer[3] << 8) + ring_buffer[2];
+                            // Check the length now: a frame that can't fit would be waited for forever
+                            if(ring_buffer[4] >= 0x01 && ring_buffer[4] < UART_HANDLERS &&
+                               handle_len >= (int)sizeof(ucp_hd_t) && handle_len + 4 <= UART_FRAME_MAX &&
+                               (uart_handlers[ring_buffer[4]].len == 0 ||
+                                handle_len == uart_handlers[ring_buffer[4]].len))
                             {
                                 // Valid packet header
-                                handle_len = (ring_buffer[3] << 8) + ring_buffer[2];
                                 handle_id = ring_buffer[4];
                                 ring_length -= (i + 1);
                                 break;
                             }
                             else
-                                ring_buffer_p = 0; // Invalid ID, reset pointer
+                            {
+                                if(ring_buffer[4] >= 0x01 && ring_buffer[4] < UART_HANDLERS &&
+                                   uart_handlers[ring_buffer[4]].handle != RT_NULL)
+                                    LOG_W("%s: unexpected length %d", uart_handlers[ring_buffer[4]].name, handle_len);
+                                handle_len = 0;
+                                ring_buffer_p = 0; // Invalid ID or length, reset pointer and resync
+                            }
                         }
                         else
                             ring_buffer_p = 0; // Invalid second header byte
@@ -720,134 +1468,38 @@ void uart_thread_entry(void *parameter)
                 }
             }
 
-            // Process packet based on handle_id
-            switch(handle_id)
+            // Process the packet once all of it is in the ring buffer
+            if(handle_id != 0 && ring_length >= (handle_len - 1))
             {
-                case 0: break;
-
-                case 0x01: // Keep-alive packet (200ms)
-                {
-                    if(ring_length >= (handle_len - 1))
-                    {
-                        rt_ringbuffer_get(rb, ring_buffer + ring_buffer_p, handle_len - 1);
-                        ring_length -= (handle_len - 1);
-                        // Verify CRC
-                        crc = crc16(ring_buffer, handle_len + 2);
-                        if((crc & 0xff) == ring_buffer[handle_len + 2] &&
-                           (crc >> 8) == ring_buffer[handle_len + 3])
-                        {
-                            // Respond with system status ACK
-                            Keep_alive_ACK(RT_EOK);
-                            LOG_I("Keep-alive received!");
-                        }
-                        else
-                        {
-                            Keep_alive_ACK(RT_ERROR);
-                            LOG_E("Keep-alive error!");
-                        }
-                        handle_id = 0;
-                        handle_len = 0;
-                        ring_buffer_p = 0;
-                    }
-                } break;
-
-                case 0x02: // Motor control packet (100ms)
-                {
-                    if(ring_length >= (handle_len - 1))
-                    {
-                        rt_ringbuffer_get(rb, ring_buffer + ring_buffer_p, handle_len - 1);
-                        ring_length -= (handle_len - 1);
-                        crc = crc16(ring_buffer, handle_len + 2);
-                        if((crc & 0xff) == ring_buffer[handle_len + 2] &&
-                           (crc >> 8) == ring_buffer[handle_len + 3])
-                        {
-                            // Update motor control values
-                            robot_state.speed = (ring_buffer[7] << 8) + ring_buffer[6];
-                            robot_state.steer = (ring_buffer[9] << 8) + ring_buffer[8];
-                            robot_state.lamp = (ring_buffer[11] << 8) + ring_buffer[10];
-                            ota_version = (ring_buffer[15] << 8) + ring_buffer[14];
-                            if(ota_version > APP_VERSION)
-                            {
-                                LOG_D("New firmware version detected");
-                                ota = 1;
-                            }
-                            LOG_I("Motor control packet processed");
-                        }
-                        else LOG_E("Motor control CRC error");
-
-                        handle_id = 0;
-                        handle_len = 0;
-                        ring_buffer_p = 0;
-                    }
-                } break;
-
-                case 0x03: // IMU calibration start
+                const uart_handler_t *h = &uart_handlers[handle_id];
+                if(h->handle == RT_NULL)
                 {
-                    if(ring_length >= (handle_len - 1))
-                    {
-                        rt_ringbuffer_get(rb, ring_buffer + ring_buffer_p, handle_len - 1);
-                        ring_length -= (handle_len - 1);
-                        crc = crc16(ring_buffer, handle_len + 2);
-                        if((crc & 0xff) == ring_buffer[handle_len + 2] &&
-                           (crc >> 8) == ring_buffer[handle_len + 3])
-                        {
-                            calib_mode = ring_buffer[6];
-                            if(calib_mode == 1 && imu_event != RT_NULL)
-                                rt_event_send(imu_event, IMU_MAG_EVENT_START | IMU_CALIB_LED_START);
-                            else if(calib_mode == 2 && imu_event != RT_NULL)
-                                rt_event_send(imu_event, IMU_ACC_GYRO_EVENT_START | IMU_CALIB_LED_START);
-
-                            IMU_Correct_Start_ACK(calib_mode, 0);
-                            LOG_I("0x03 IMU calibration start ACK sent");
-                        }
-                        else
-                        {
-                            IMU_Correct_Start_ACK(calib_mode, 1);
-                            LOG_E("0x03 IMU calibration start CRC error");
-                        }
-
-                        handle_id = 0;
-                        handle_len = 0;
-                        ring_buffer_p = 0;
-                    }
-                } break;
-
-                case 0x04: // IMU calibration end
+                    // Not a frame the MCU handles: skip it so parsing goes on
+                    for(int left = handle_len - 1; left > 0; left -= 32)
+                        rt_ringbuffer_get(rb, ring_buffer + 6, left > 32 ? 32 : left);
+                }
+                else
                 {
-                    if(ring_length >= (handle_len - 1))
+                    rt_ringbuffer_get(rb, ring_buffer + ring_buffer_p, handle_len - 1);
+                    uint64_t rx_us = ucp_time_us();
+                    // Verify CRC
+                    crc = ucp_crc16(ring_buffer, handle_len + 2);
+                    uart_rx_index = ring_buffer[5];
+                    if((crc & 0xff) == ring_buffer[handle_len + 2] &&
+                       (crc >> 8) == ring_buffer[handle_len + 3])
+                        h->handle(ring_buffer, rx_us);
+                    else
                     {
-                        rt_ringbuffer_get(rb, ring_buffer + ring_buffer_p, handle_len - 1);
-                        ring_length -= (handle_len - 1);
-                        crc = crc16(ring_buffer, handle_len + 2);
-                        if((crc & 0xff) == ring_buffer[handle_len + 2] &&
-                           (crc >> 8) == ring_buffer[handle_len + 3])
-                        {
-                            IMU_Correct_End_ACK(calib_mode, 0);
-                            calib_mode = ring_buffer[6];
-                            if(calib_mode == 1 && imu_event != RT_NULL)
-                                rt_event_send(imu_event, IMU_MAG_EVENT_STOP);
-                            else if(calib_mode == 2 && imu_event != RT_NULL)
-                                rt_event_send(imu_event, IMU_ACC_GYRO_EVENT_STOP);
-
-                            LOG_I("0x04 IMU calibration end ACK sent");
-                        }
-                        else
-                        {
-                            IMU_Correct_End_ACK(calib_mode, 1);
-                            LOG_E("0x04 IMU calibration end CRC error");
-                        }
-
-                        handle_id = 0;
-                        handle_len = 0;
-                        ring_buffer_p = 0;
+                        if(h->refuse != RT_NULL)
+                            h->refuse();
+                        LOG_E("%s CRC error", h->name);
                     }
-                } break;
-
-                // Cases 0x05 to 0x0A handle IMU/magnetometer ACKs, initial data, OTA, and LED status similarly
-                // Each packet is read, CRC validated, processed, and ACK/events triggered as needed
-                // For brevity, they follow the same pattern as above
-
-            } // end switch
+                }
+                ring_length -= (handle_len - 1);
+                handle_id = 0;
+                handle_len = 0;
+                ring_buffer_p = 0;
+            }
         } // end while ring_length check
     } // end main while(1)
 
@@ -868,7 +1520,7 @@ int uart_int_sample(void)
     }
 
     /* Step 2: Modify UART configuration parameters */
-    config.baud_rate = BAUD_RATE_115200; // Set baud rate to 115200
+    config.baud_rate = UART_BAUD_DEFAULT; // Set baud rate to 115200
     config.data_bits = DATA_BITS_8;      // 8 data bits
     config.stop_bits = STOP_BITS_1;      // 1 stop bit
     config.bufsz = 2048;                 // Set buffer size to 2048 bytes
@@ -905,31 +1557,22 @@ int uart_int_sample(void)
     return ret; // Return success
 }
 
-// UART periodic timer callback
-// This is called when ucp_timer times out. It triggers re-sending events if ACKs are not received
+// UART retransmission timer callback
+// This is called when ucp_timer times out: the send thread retransmits the
+// requests still unanswered and rearms the timer for the next
 static void uart_timer_timeout(void *parameter)
 {
-    if(ucp_flag.get_data_flag == 1)
-    {
-        if (uart_event != RT_NULL)
-            rt_event_send(uart_event, EVENT_DATA_GET | EVENT_TIMER_START); // Re-send data request
-    }
-    if(ucp_flag.imu_set_flag == 1)
-    {
-        if (uart_event != RT_NULL)
-            rt_event_send(uart_event, EVENT_IMU_SET | EVENT_TIMER_START); // Re-send IMU set request
-    }
-    if(ucp_flag.mag_set_flag == 1)
-    {
-        if (uart_event != RT_NULL)
-            rt_event_send(uart_event, EVENT_MAG_SET | EVENT_TIMER_START); // Re-send magnetometer set request
-    }
+    if (uart_event != RT_NULL)
+        rt_event_send(uart_event, EVENT_TIMER_START);
 }
 
-// Initialize UART ACK timeout timer
+// Initialize the request window and its retransmission timer
 void uart_timout_init(void)
 {
-    // Create a one-shot timer named "ucp_timer" with 1000ms timeout
-    // On timeout, uart_timer_timeout() is called
-    ucp_timer = rt_timer_create("ucp_timer", uart_timer_timeout, RT_NULL, 1000, RT_TIMER_FLAG_ONE_SHOT);
+    // Start the indexes where the clock's low bits happen to be, so the
+    // first request after a reset is unlikely to repeat the last one's
+    ucp_rel_tx_init(&ucp_rel, (uint8_t)ucp_time_us());
+    // One-shot; uart_rel_poll() sets each timeout from the request window
+    ucp_timer = rt_timer_create("ucp_timer", uart_timer_timeout, RT_NULL,
+                                rt_tick_from_millisecond(UCP_REL_RTO_INIT_MS), RT_TIMER_FLAG_ONE_SHOT);
 }
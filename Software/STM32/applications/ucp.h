@@ -25,6 +25,40 @@
 #define UCP_IMUMAG_READ             (0X8)   // Read IMU and magnetometer calibration values
 #define UCP_OTA                     (0X9)   // Over-the-Air update request
 #define UCP_STATE                   (0XA)   // Device state report
+#define UCP_TIME_SYNC               (0XB)   // Clock sync ping (head) / pong (MCU)
+#define UCP_REPORT_V2               (0XC)   // Versioned report with the sample timestamp
+#define UCP_BAUD_SET                (0XD)   // UART rate change proposal (head) / answer (MCU)
+#define UCP_SUBSCRIBE               (0XE)   // Telemetry subscription (head) / answer (MCU)
+#define UCP_TELEMETRY               (0XF)   // Compact telemetry for one subscription
+#define UCP_IMU_BATCH               (0X10)  // Consecutive raw IMU samples for one subscription
+#define UCP_REPORT_DELTA            (0X11)  // Delta-coded report (MCU) / keyframe acknowledgment (head)
+#define UCP_HELLO                   (0X12)  // Capability query (head) / capabilities (MCU)
+#define UCP_ID_LAST                 UCP_HELLO           // Highest ID defined above
+
+#define UCP_PROTO_VERSION           (1)     // proto_version of ucp_hello_t / ucp_hello_ack_t
+#define UCP_HELLO_ID_BYTES          (32)    // ucp_hello_ack_t.rx_ids: one bit for each of the 256 IDs
+
+#define UCP_REPORT_VERSION          (2)     // rep_version of ucp_rep_v2_t
+
+/* Telemetry field groups, in the order their payloads follow ucp_telemetry_t */
+#define UCP_GRP_WHEELS              (1 << 0)    // ucp_tlm_wheels_t
+#define UCP_GRP_IMU_RAW             (1 << 1)    // ucp_tlm_imu_raw_t
+#define UCP_GRP_ATTITUDE            (1 << 2)    // ucp_tlm_attitude_t
+#define UCP_GRP_POWER               (1 << 3)    // ucp_tlm_power_t
+#define UCP_GRP_TOF                 (1 << 4)    // ucp_tlm_tof_t
+#define UCP_GRP_IMU_BATCH           (1 << 5)    // Every IMU sample since the last period, as UCP_IMU_BATCH
+#define UCP_GRP_REPORT_DELTA        (1 << 6)    // The full report delta-coded, as UCP_REPORT_DELTA
+#define UCP_GRP_REPORT              (1 << 7)    // The full UCP_RPM_REPORT / UCP_REPORT_V2, sent as is
+#define UCP_GRP_ALL                 (0x7F | UCP_GRP_REPORT)
+
+#define UCP_SUB_SLOTS               (8)     // Subscriptions the MCU keeps
+#define UCP_SUB_TICK_MS             (5)     // Scheduler tick; periods are rounded up to it
+#define UCP_SUB_IDLE_MS             (10000) // Head silence after which the default subscription returns
+
+#define UCP_IMU_PERIOD_US           (10000) // IMU sampling period (hwtimer)
+#define UCP_IMU_BATCH_MAX           (16)    // Samples in one UCP_IMU_BATCH at most
+
+#define UCP_DELTA_F_KEY             (1 << 0)    // ucp_rep_delta_t.flags: a keyframe
 
 #pragma pack(push, 1)  // 1-byte alignment for all structures (no padding)
 
@@ -54,7 +88,7 @@ typedef enum ucp_imu_correction_type {
 typedef struct ucp_hd {
     uint16_t    len;    // Length of the message body (not including header)
     uint8_t     id;     // Message ID (one of the UCP_* defines)
-    uint8_t     index;  // Sequence index (helps with tracking/retransmission)
+    uint8_t     index;  // Sequence index; an answer carries its request's
 } ucp_hd_t __attribute__((packed));
 
 /* Keep-alive ping message (empty body) */
@@ -108,6 +142,168 @@ typedef struct ucp_rep { // report
     uint16_t    version;        // Firmware/protocol version
 } ucp_rep_t __attribute__((packed));
 
+/* Clock sync request: the head's send time, echoed back untouched */
+typedef struct ucp_time_sync {
+    ucp_hd_t    hd;
+    uint64_t    t1_ns;          // Head CLOCK_MONOTONIC when the request was sent
+} ucp_time_sync_t __attribute__((packed));
+
+/* Clock sync reply. The MCU times are microseconds since boot (ucp_time.h).
+ * The first reply also switches the periodic report to UCP_REPORT_V2. */
+typedef struct ucp_time_sync_ack {
+    ucp_hd_t    hd;
+    uint64_t    t1_ns;          // Echo of the request
+    uint64_t    t2_us;          // MCU time the request was received
+    uint64_t    t3_us;          // MCU time the reply was sent
+} ucp_time_sync_ack_t __attribute__((packed));
+
+/* Versioned report: ucp_rep_t's fields plus the time of the sensor sample */
+typedef struct ucp_rep_v2 {
+    ucp_hd_t    hd;
+    uint8_t     rep_version;    // UCP_REPORT_VERSION
+    uint8_t     reserve0;       // Reserved
+    uint64_t    sample_us;      // MCU time the IMU sample was read
+    uint16_t    voltage;        // Battery/system voltage
+    int16_t     rpm[4];         // Motor RPM for 4 wheels
+    int16_t     acc[3];         // Accelerometer (x,y,z)
+    int16_t     gyros[3];       // Gyroscope (x,y,z)
+    int16_t     mag[3];         // Magnetometer (x,y,z)
+    int16_t     heading;        // Heading angle (from IMU/mag)
+    uint8_t     stop_switch;    // Emergency stop switch status
+    uint8_t     error_code;     // Error code for system state
+    uint16_t    reserve;        // Reserved
+    uint16_t    version;        // Firmware/protocol version
+} ucp_rep_v2_t __attribute__((packed));
+
+/* UART rate change. The MCU answers at the current rate and then switches;
+ * the head switches when the answer arrives and confirms with a keep-alive.
+ * Either side returns to 115200 after fallback_ms without a valid frame
+ * from the other. */
+typedef struct ucp_baud_set {
+    ucp_hd_t    hd;
+    uint32_t    baud;           // Proposed rate
+    uint16_t    fallback_ms;    // Silence after which both sides return to 115200
+} ucp_baud_set_t __attribute__((packed));
+
+/* UART rate change answer */
+typedef struct ucp_baud_set_ack {
+    ucp_hd_t    hd;
+    uint32_t    baud;           // Rate the MCU switches to after this answer
+    uint8_t     err;            // UCP_ERR_OK, UCP_ERR_UNKNOWN for an unsupported rate
+} ucp_baud_set_ack_t __attribute__((packed));
+
+/* Telemetry subscription. Slot `slot` sends `groups` every period_ms;
+ * groups = 0 ends it. Slot 0 starts out as UCP_GRP_REPORT every 20 ms, the
+ * report the MCU always sent, and returns to that after UCP_SUB_IDLE_MS
+ * without a valid frame from the head. */
+typedef struct ucp_subscribe {
+    ucp_hd_t    hd;
+    uint8_t     slot;           // 0 .. UCP_SUB_SLOTS - 1
+    uint8_t     groups;         // UCP_GRP_* bits
+    uint16_t    period_ms;      // At least UCP_SUB_TICK_MS
+} ucp_subscribe_t __attribute__((packed));
+
+/* Subscription answer */
+typedef struct ucp_subscribe_ack {
+    ucp_hd_t    hd;
+    uint8_t     slot;
+    uint8_t     groups;         // As now in effect
+    uint16_t    period_ms;      // Rounded up to the scheduler tick
+    uint8_t     err;            // UCP_ERR_OK, UCP_ERR_UNKNOWN for a bad slot, group or period
+} ucp_subscribe_ack_t __attribute__((packed));
+
+/* Compact telemetry. The payload of each group in `groups` follows, lowest
+ * bit first, so hd.len = sizeof(ucp_telemetry_t) + the groups' sizes. */
+typedef struct ucp_telemetry {
+    ucp_hd_t    hd;
+    uint8_t     slot;           // Subscription that produced it
+    uint8_t     groups;         // UCP_GRP_* bits present, never UCP_GRP_REPORT
+    uint64_t    sample_us;      // MCU time of the IMU sample, or when built for non-IMU groups
+} ucp_telemetry_t __attribute__((packed));
+
+typedef struct ucp_tlm_wheels {
+    int16_t     rpm[4];         // Motor RPM for 4 wheels
+} ucp_tlm_wheels_t __attribute__((packed));
+
+typedef struct ucp_tlm_imu_raw {
+    int16_t     acc[3];         // Accelerometer (x,y,z)
+    int16_t     gyros[3];       // Gyroscope (x,y,z)
+    int16_t     mag[3];         // Magnetometer (x,y,z)
+} ucp_tlm_imu_raw_t __attribute__((packed));
+
+typedef struct ucp_tlm_attitude {
+    int16_t     heading;        // Heading angle (from IMU/mag)
+} ucp_tlm_attitude_t __attribute__((packed));
+
+typedef struct ucp_tlm_power {
+    uint16_t    battery;        // Battery level
+    uint16_t    voltage_cv;     // Voltage, 0.01 V
+    int16_t     current_ca;     // Current, 0.01 A
+    uint16_t    power_dw;       // Power, 0.1 W
+} ucp_tlm_power_t __attribute__((packed));
+
+typedef struct ucp_tlm_tof {
+    uint16_t    range_mm[4];    // Time-of-flight ranges, 0 when there is no reading
+} ucp_tlm_tof_t __attribute__((packed));
+
+/* One raw IMU sample, calibration offsets applied as in the report */
+typedef struct ucp_imu_sample {
+    int16_t     acc[3];         // Accelerometer (x,y,z)
+    int16_t     gyros[3];       // Gyroscope (x,y,z)
+} ucp_imu_sample_t __attribute__((packed));
+
+/* Consecutive IMU samples, sent for a subscription with UCP_GRP_IMU_BATCH.
+ * `count` ucp_imu_sample_t follow, oldest first; sample i was taken at
+ * base_us + i * period_us. A gap in sampling starts a new batch, so the
+ * samples of one batch are always evenly spaced. */
+typedef struct ucp_imu_batch {
+    ucp_hd_t    hd;
+    uint8_t     slot;           // Subscription that produced it
+    uint8_t     count;          // 1 .. UCP_IMU_BATCH_MAX
+    uint16_t    dropped;        // Samples overwritten before they could be sent, since the last batch
+    uint16_t    period_us;      // Spacing of the samples
+    uint64_t    base_us;        // MCU time of the first sample
+} ucp_imu_batch_t __attribute__((packed));
+
+/* Delta-coded report, sent for a subscription with UCP_GRP_REPORT_DELTA.
+ * A keyframe or the fields changed since one follow (see ucp_delta.h). */
+typedef struct ucp_rep_delta {
+    ucp_hd_t    hd;
+    uint8_t     key_seq;        // Keyframe this frame is, or is relative to
+    uint8_t     flags;          // UCP_DELTA_F_KEY for a keyframe
+} ucp_rep_delta_t __attribute__((packed));
+
+/* Keyframe acknowledgment from the head: later deltas may refer to it */
+typedef struct ucp_rep_delta_ack {
+    ucp_hd_t    hd;
+    uint8_t     key_seq;
+} ucp_rep_delta_ack_t __attribute__((packed));
+
+/* Capability query, sent by the head when it connects. Firmware from
+ * before UCP_HELLO skips it without an answer. */
+typedef struct ucp_hello {
+    ucp_hd_t    hd;
+    uint8_t     proto_version;  // UCP_PROTO_VERSION of the head
+} ucp_hello_t __attribute__((packed));
+
+/* Capabilities of the MCU. Fields may be appended in later protocol
+ * versions; the head reads the ones its own version knows. */
+typedef struct ucp_hello_ack {
+    ucp_hd_t    hd;
+    uint8_t     proto_version;  // UCP_PROTO_VERSION of the firmware
+    uint8_t     report_version; // UCP_REPORT_VERSION, 0 for UCP_RPM_REPORT only
+    uint16_t    app_version;    // APP_VERSION, as in the report's `version`
+    uint32_t    max_baud;       // Fastest rate UCP_BAUD_SET accepts
+    uint8_t     groups;         // UCP_GRP_* bits UCP_SUBSCRIBE accepts
+    uint8_t     sub_slots;      // UCP_SUB_SLOTS
+    uint16_t    sub_tick_ms;    // UCP_SUB_TICK_MS
+    uint8_t     imu_batch_max;  // UCP_IMU_BATCH_MAX
+    uint8_t     rel_window;     // Requests the MCU keeps in flight (UCP_REL_WINDOW)
+    uint16_t    rx_buffer;      // Bytes the MCU buffers from the head
+    uint16_t    max_frame;      // Longest frame the MCU parses, sync to CRC
+    uint8_t     rx_ids[UCP_HELLO_ID_BYTES];     // Bit (id % 8) of byte id / 8: the MCU handles message `id`
+} ucp_hello_ack_t __attribute__((packed));
+
 /* Magnetometer write request */
 typedef struct ucp_mag_w {
     ucp_hd_t    hd;
@@ -0,0 +1,50 @@
+/*
+ * UCP CRC16 (Modbus: reflected polynomial 0xA001, init 0xFFFF, no final xor)
+ *
+ * Single implementation shared by the STM32 firmware and the Linux head.
+ * The firmware (Cortex-M) builds only the compact byte-at-a-time path with
+ * the original 2 x 256 byte tables. Other targets also get slicing-by-8 and,
+ * where the CPU has a 64-bit carry-less multiply (x86 PCLMULQDQ, AArch64
+ * PMULL), a folding kernel for large buffers. All paths return exactly the
+ * same value as the legacy crc16() they replace.
+ */
+#ifndef __UCP_CRC_H__
+#define __UCP_CRC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UCP_CRC_INIT    (0xFFFF)    // Initial CRC register value
+
+/* Select the compact path on microcontrollers unless told otherwise */
+#ifndef UCP_CRC_COMPACT
+#if defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define UCP_CRC_COMPACT 1
+#else
+#define UCP_CRC_COMPACT 0
+#endif
+#endif
+
+/* CRC16 of a whole buffer, same result as the legacy crc16(msg, len) */
+uint16_t ucp_crc16(const void *data, size_t len);
+
+/* Continue a CRC over more data; start with UCP_CRC_INIT */
+uint16_t ucp_crc16_update(uint16_t crc, const void *data, size_t len);
+
+/* Individual kernels, exposed for verification and benchmarking */
+uint16_t ucp_crc16_bytewise(uint16_t crc, const void *data, size_t len);
+#if !UCP_CRC_COMPACT
+uint16_t ucp_crc16_slice8(uint16_t crc, const void *data, size_t len);
+uint16_t ucp_crc16_clmul(uint16_t crc, const void *data, size_t len);  // Falls back to slice8 without CPU support
+int ucp_crc16_has_clmul(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UCP_CRC_H__ */
@@ -0,0 +1,266 @@
+/*
+ * UCP report delta coding, see ucp_delta.h
+ *
+ * Fields are 8 or 16 bits wide and their deltas are taken modulo 2^16, so
+ * signed and unsigned fields code alike and a wrap costs nothing extra.
+ * Mask bits follow how often a field moves: the IMU fields that change on
+ * every report and the heading come first, so a report from a robot at
+ * rest needs a two-byte mask.
+ */
+#include <string.h>
+
+#include "ucp_delta.h"
+
+/* Where each coded field lives in ucp_rep_t, in mask bit order from bit 1 */
+typedef struct ucp_delta_field {
+    uint8_t offset;
+    uint8_t size;
+} ucp_delta_field_t;
+
+#define REP_FIELD(member, i) { (uint8_t)(offsetof(ucp_rep_t, member) + (i) * sizeof(int16_t)), 2 }
+
+static const ucp_delta_field_t delta_fields[] = {
+    REP_FIELD(acc, 0), REP_FIELD(acc, 1), REP_FIELD(acc, 2),
+    REP_FIELD(gyros, 0), REP_FIELD(gyros, 1), REP_FIELD(gyros, 2),
+    REP_FIELD(heading, 0),
+    REP_FIELD(mag, 0), REP_FIELD(mag, 1), REP_FIELD(mag, 2),
+    REP_FIELD(rpm, 0), REP_FIELD(rpm, 1), REP_FIELD(rpm, 2), REP_FIELD(rpm, 3),
+    REP_FIELD(voltage, 0),
+    { (uint8_t)offsetof(ucp_rep_t, stop_switch), 1 },
+    { (uint8_t)offsetof(ucp_rep_t, error_code), 1 },
+    REP_FIELD(reserve, 0),
+    REP_FIELD(version, 0),
+};
+
+#define DELTA_FIELDS    (sizeof(delta_fields) / sizeof(delta_fields[0]))
+
+static uint16_t field_get(const ucp_rep_t *rep, const ucp_delta_field_t *f)
+{
+    const uint8_t *p = (const uint8_t *)rep + f->offset;
+    return f->size == 1 ? p[0] : (uint16_t)(p[0] | p[1] << 8);
+}
+
+static void field_set(ucp_rep_t *rep, const ucp_delta_field_t *f, uint16_t v)
+{
+    uint8_t *p = (uint8_t *)rep + f->offset;
+    p[0] = v & 0xff;
+    if (f->size == 2)
+        p[1] = v >> 8;
+}
+
+static size_t put_varint(uint8_t *out, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+/* Returns the bytes read, 0 if the varint runs past `len` or 64 bits */
+static size_t get_varint(const uint8_t *in, size_t len, uint64_t *v)
+{
+    size_t n = 0;
+    unsigned shift = 0;
+    *v = 0;
+    while (n < len && shift < 64)
+    {
+        uint8_t b = in[n++];
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return n;
+        shift += 7;
+    }
+    return 0;
+}
+
+static uint64_t zigzag64(int64_t d) { return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63); }
+static int64_t unzigzag64(uint64_t z) { return (int64_t)(z >> 1) ^ -(int64_t)(z & 1); }
+static uint16_t zigzag16(int16_t d) { return (uint16_t)(((uint16_t)d << 1) ^ (uint16_t)(d >> 15)); }
+static int16_t unzigzag16(uint16_t z) { return (int16_t)((z >> 1) ^ (uint16_t)-(int16_t)(z & 1)); }
+
+static void put_u64(uint8_t *out, uint64_t v)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+        out[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const uint8_t *in)
+{
+    uint64_t v = 0;
+    int i;
+    for (i = 0; i < 8; i++)
+        v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+void ucp_delta_enc_init(ucp_delta_enc_t *enc, uint16_t key_interval)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->key_interval = key_interval ? key_interval : 1;
+}
+
+static size_t encode_key(ucp_delta_enc_t *enc, const ucp_delta_report_t *r, uint8_t *out)
+{
+    enc->key_seq++;
+    enc->keys[enc->key_seq % UCP_DELTA_KEYS] = *r;
+    if (enc->keys_held < UCP_DELTA_KEYS)
+        enc->keys_held++;
+    enc->since_key = 0;
+    out[0] = enc->key_seq;
+    out[1] = UCP_DELTA_F_KEY;
+    put_u64(out + 2, r->sample_us);
+    memcpy(out + 10, (const uint8_t *)&r->rep + sizeof(ucp_hd_t), UCP_DELTA_REP_BYTES);
+    return UCP_DELTA_KEY_BYTES;
+}
+
+/* Values first, behind room for the longest mask, then the mask in front */
+static size_t encode_delta(const ucp_delta_enc_t *enc, const ucp_delta_report_t *r, uint8_t *out)
+{
+    uint8_t values[UCP_DELTA_MSG_MAX];
+    uint8_t mask_bytes[4];
+    uint32_t mask = 0;
+    size_t n = 0, m;
+    unsigned i;
+
+    if (r->sample_us != enc->ref.sample_us)
+    {
+        mask |= 1;
+        n += put_varint(values + n, zigzag64((int64_t)(r->sample_us - enc->ref.sample_us)));
+    }
+    for (i = 0; i < DELTA_FIELDS; i++)
+    {
+        uint16_t d = field_get(&r->rep, &delta_fields[i]) - field_get(&enc->ref.rep, &delta_fields[i]);
+        if (delta_fields[i].size == 1)
+            d = (uint16_t)(int16_t)(int8_t)d;
+        if (d == 0)
+            continue;
+        mask |= 1u << (i + 1);
+        n += put_varint(values + n, zigzag16((int16_t)d));
+    }
+
+    m = put_varint(mask_bytes, mask);
+    out[0] = enc->ref_seq;
+    out[1] = 0;
+    memcpy(out + 2, mask_bytes, m);
+    memcpy(out + 2 + m, values, n);
+    return 2 + m + n;
+}
+
+size_t ucp_delta_encode(ucp_delta_enc_t *enc, const ucp_delta_report_t *r, uint8_t *out)
+{
+    size_t n;
+
+    if (enc->ref_valid && enc->since_key < enc->key_interval)
+    {
+        n = encode_delta(enc, r, out);
+        if (n < UCP_DELTA_KEY_BYTES)
+        {
+            enc->since_key++;
+            return n;
+        }
+    }
+    return encode_key(enc, r, out);
+}
+
+void ucp_delta_enc_ack(ucp_delta_enc_t *enc, uint8_t key_seq)
+{
+    // Only keyframes still held, and never back to an older one than the ref
+    if ((uint8_t)(enc->key_seq - key_seq) >= enc->keys_held)
+        return;
+    if (enc->ref_valid && (uint8_t)(key_seq - enc->ref_seq - 1) >= 0x80)
+        return;
+    enc->ref = enc->keys[key_seq % UCP_DELTA_KEYS];
+    enc->ref_seq = key_seq;
+    enc->ref_valid = 1;
+}
+
+void ucp_delta_dec_init(ucp_delta_dec_t *dec)
+{
+    memset(dec, 0, sizeof(*dec));
+}
+
+static int find_key(const ucp_delta_dec_t *dec, uint8_t seq)
+{
+    int i;
+    for (i = 0; i < UCP_DELTA_KEYS; i++)
+    {
+        if ((dec->valid & (1 << i)) && dec->seqs[i] == seq)
+            return i;
+    }
+    return -1;
+}
+
+static int decode_key(ucp_delta_dec_t *dec, const uint8_t *body, size_t len, ucp_delta_report_t *out)
+{
+    int slot;
+
+    if (len != UCP_DELTA_KEY_BYTES)
+        return UCP_DELTA_MALFORMED;
+    memset(out, 0, sizeof(*out));
+    out->sample_us = get_u64(body + 2);
+    memcpy((uint8_t *)&out->rep + sizeof(ucp_hd_t), body + 10, UCP_DELTA_REP_BYTES);
+
+    // A keyframe seen before replaces itself; otherwise the next slot,
+    // stepping over the one deltas refer to
+    slot = find_key(dec, body[0]);
+    if (slot < 0)
+    {
+        slot = dec->next;
+        if (slot == dec->in_use && (dec->valid & (1 << slot)))
+            slot = (slot + 1) % UCP_DELTA_KEYS;
+        dec->next = (slot + 1) % UCP_DELTA_KEYS;
+    }
+    dec->keys[slot] = *out;
+    dec->seqs[slot] = body[0];
+    dec->valid |= 1 << slot;
+    return UCP_DELTA_KEYFRAME;
+}
+
+int ucp_delta_decode(ucp_delta_dec_t *dec, const uint8_t *body, size_t len, ucp_delta_report_t *out)
+{
+    uint64_t mask, z;
+    size_t p, n;
+    unsigned i;
+    int slot;
+
+    if (len < 2 || len > UCP_DELTA_MSG_MAX)
+        return UCP_DELTA_MALFORMED;
+    if (body[1] & UCP_DELTA_F_KEY)
+        return decode_key(dec, body, len, out);
+
+    slot = find_key(dec, body[0]);
+    if (slot < 0)
+        return UCP_DELTA_NO_KEY;
+    dec->in_use = slot;
+
+    p = 2;
+    n = get_varint(body + p, len - p, &mask);
+    if (n == 0 || (mask >> (DELTA_FIELDS + 1)))
+        return UCP_DELTA_MALFORMED;
+    p += n;
+
+    *out = dec->keys[slot];
+    if (mask & 1)
+    {
+        if ((n = get_varint(body + p, len - p, &z)) == 0)
+            return UCP_DELTA_MALFORMED;
+        out->sample_us += (uint64_t)unzigzag64(z);
+        p += n;
+    }
+    for (i = 0; i < DELTA_FIELDS; i++)
+    {
+        if (!(mask & (1ull << (i + 1))))
+            continue;
+        if ((n = get_varint(body + p, len - p, &z)) == 0 || z > 0xffff)
+            return UCP_DELTA_MALFORMED;
+        field_set(&out->rep, &delta_fields[i],
+                  field_get(&out->rep, &delta_fields[i]) + (uint16_t)unzigzag16((uint16_t)z));
+        p += n;
+    }
+    return p == len ? UCP_DELTA_DECODED : UCP_DELTA_MALFORMED;
+}
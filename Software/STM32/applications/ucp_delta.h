@@ -0,0 +1,91 @@
+/*
+ * UCP report delta coding (UCP_REPORT_DELTA)
+ *
+ * Single implementation shared by the STM32 firmware and the Linux head.
+ * Most report fields barely move between 20 ms reports, so instead of the
+ * full report the MCU sends a keyframe now and then and, in between, only
+ * the fields that differ from the last keyframe the head acknowledged, as
+ * zig-zag varints. Deltas are taken against that keyframe rather than the
+ * previous report, so a lost frame costs nothing but itself.
+ *
+ * Message body after ucp_rep_delta_t:
+ *   keyframe : sample_us (8 bytes LE), then ucp_rep_t without its header
+ *   delta    : varint field mask, then a zig-zag varint per set bit, in bit
+ *              order; bit 0 is sample_us, the others UCP_DELTA_FIELDS
+ *
+ * The encoder sends keyframes until the head acknowledges one, then every
+ * key_interval reports and whenever a delta would not be smaller. Both sides
+ * keep the last UCP_DELTA_KEYS keyframes, so an acknowledgment may lag that
+ * many keyframes; the decoder never drops the one deltas currently refer to.
+ */
+#ifndef __UCP_DELTA_H__
+#define __UCP_DELTA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ucp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UCP_DELTA_KEY_INTERVAL  (50)    // Reports between keyframes: 1 s at 20 ms
+#define UCP_DELTA_KEYS          (4)     // Keyframes the decoder keeps
+#define UCP_DELTA_REP_BYTES     (sizeof(ucp_rep_t) - sizeof(ucp_hd_t))
+#define UCP_DELTA_KEY_BYTES     (sizeof(ucp_rep_delta_t) - sizeof(ucp_hd_t) + 8 + UCP_DELTA_REP_BYTES)
+#define UCP_DELTA_MSG_MAX       (72)    // Body after ucp_hd_t, at most (the longest delta)
+
+/* A report as coded: ucp_rep_t (header ignored) and its sample time */
+typedef struct ucp_delta_report {
+    ucp_rep_t   rep;
+    uint64_t    sample_us;
+} ucp_delta_report_t;
+
+typedef struct ucp_delta_enc {
+    ucp_delta_report_t  ref;        // Last keyframe the head acknowledged
+    ucp_delta_report_t  keys[UCP_DELTA_KEYS];   // Last keyframes sent, by key_seq % UCP_DELTA_KEYS
+    uint8_t             ref_valid;
+    uint8_t             ref_seq;
+    uint8_t             key_seq;    // Of the last keyframe sent
+    uint8_t             keys_held;  // Entries of keys[] filled
+    uint16_t            since_key;  // Reports since the last keyframe
+    uint16_t            key_interval;
+} ucp_delta_enc_t;
+
+typedef struct ucp_delta_dec {
+    ucp_delta_report_t  keys[UCP_DELTA_KEYS];
+    uint8_t             seqs[UCP_DELTA_KEYS];
+    uint8_t             valid;      // Bit per slot of keys[]
+    uint8_t             in_use;     // Slot the newest delta referred to
+    uint8_t             next;       // Slot the next keyframe goes to, unless in use
+} ucp_delta_dec_t;
+
+/* Results of ucp_delta_decode() */
+#define UCP_DELTA_DECODED       (0)     // A delta, rebuilt
+#define UCP_DELTA_KEYFRAME      (1)     // A keyframe; acknowledge its key_seq
+#define UCP_DELTA_MALFORMED     (-1)
+#define UCP_DELTA_NO_KEY        (-2)    // Refers to a keyframe the decoder doesn't have
+
+/* Start over: the next report goes out as a keyframe */
+void ucp_delta_enc_init(ucp_delta_enc_t *enc, uint16_t key_interval);
+
+/* Code `r` into `out` (UCP_DELTA_MSG_MAX bytes): the message body after
+ * ucp_hd_t, starting with ucp_rep_delta_t's fields. Returns its length. */
+size_t ucp_delta_encode(ucp_delta_enc_t *enc, const ucp_delta_report_t *r, uint8_t *out);
+
+/* The head acknowledged keyframe `key_seq`; deltas now refer to it */
+void ucp_delta_enc_ack(ucp_delta_enc_t *enc, uint8_t key_seq);
+
+void ucp_delta_dec_init(ucp_delta_dec_t *dec);
+
+/* Rebuild the report in a message body (after ucp_hd_t) of `len` bytes.
+ * Returns UCP_DELTA_DECODED or UCP_DELTA_KEYFRAME with *out set, or a
+ * negative UCP_DELTA_* error. */
+int ucp_delta_decode(ucp_delta_dec_t *dec, const uint8_t *body, size_t len, ucp_delta_report_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UCP_DELTA_H__ */
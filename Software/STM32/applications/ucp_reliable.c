@@ -0,0 +1,217 @@
+/*
+ * UCP reliable requests, see ucp_reliable.h
+ *
+ * The round trip estimate is kept scaled (SRTT x 8, RTTVAR x 4) as in BSD
+ * TCP, so the 1/8 and 1/4 gains stay exact in integers even for the few
+ * milliseconds a UART exchange takes.
+ */
+#include <string.h>
+
+#include "ucp_crc.h"
+#include "ucp_reliable.h"
+
+/* Frame offsets: 2 sync bytes, then ucp_hd_t {len, id, index} */
+#define FRAME_ID        (4)
+#define FRAME_INDEX     (5)
+#define FRAME_MIN       (8)     // Sync, header and CRC
+
+static int due_by(uint32_t due_ms, uint32_t now_ms)
+{
+    return (int32_t)(due_ms - now_ms) <= 0;
+}
+
+static uint16_t frame_crc(const uint8_t *frame, size_t len)
+{
+    return (uint16_t)(frame[len - 2] | frame[len - 1] << 8);
+}
+
+void ucp_rel_tx_init(ucp_rel_tx_t *tx, uint8_t first_index)
+{
+    memset(tx, 0, sizeof(*tx));
+    tx->rto_ms = UCP_REL_RTO_INIT_MS;
+    tx->next_index = first_index;
+}
+
+int ucp_rel_send(ucp_rel_tx_t *tx, uint8_t *frame, size_t len, uint32_t now_ms)
+{
+    uint16_t crc;
+    int i;
+
+    if (len < FRAME_MIN || len > UCP_REL_FRAME_MAX)
+        return -1;
+    for (i = 0; i < UCP_REL_WINDOW; i++)
+    {
+        if (tx->slots[i].len == 0)
+            break;
+    }
+    if (i == UCP_REL_WINDOW)
+        return -1;
+
+    frame[FRAME_INDEX] = tx->next_index++;
+    crc = ucp_crc16(frame, len - 2);
+    frame[len - 2] = crc & 0xff;
+    frame[len - 1] = crc >> 8;
+
+    memcpy(tx->slots[i].frame, frame, len);
+    tx->slots[i].len = (uint8_t)len;
+    tx->slots[i].tries = 1;
+    tx->slots[i].sent_ms = now_ms;
+    tx->slots[i].due_ms = now_ms + tx->rto_ms;
+    return 0;
+}
+
+/* RFC 6298 section 2, from a request that was sent once */
+static void rtt_sample(ucp_rel_tx_t *tx, uint32_t rtt_ms)
+{
+    uint32_t rto;
+
+    if (!tx->have_rtt)
+    {
+        tx->srtt_ms8 = rtt_ms << 3;
+        tx->rttvar_ms4 = rtt_ms << 1;
+        tx->have_rtt = 1;
+    }
+    else
+    {
+        int32_t delta = (int32_t)rtt_ms - (int32_t)(tx->srtt_ms8 >> 3);
+        tx->srtt_ms8 += delta;
+        if (delta < 0)
+            delta = -delta;
+        tx->rttvar_ms4 += delta - (tx->rttvar_ms4 >> 2);
+    }
+    rto = (tx->srtt_ms8 >> 3) + (tx->rttvar_ms4 > 1 ? tx->rttvar_ms4 : 1);
+    if (rto < UCP_REL_RTO_MIN_MS)
+        rto = UCP_REL_RTO_MIN_MS;
+    if (rto > UCP_REL_RTO_MAX_MS)
+        rto = UCP_REL_RTO_MAX_MS;
+    tx->rto_ms = rto;
+}
+
+int ucp_rel_ack(ucp_rel_tx_t *tx, uint8_t id, uint8_t index, uint32_t now_ms)
+{
+    int i;
+
+    for (i = 0; i < UCP_REL_WINDOW; i++)
+    {
+        ucp_rel_request_t *r = &tx->slots[i];
+        if (r->len == 0 || r->frame[FRAME_ID] != id || r->frame[FRAME_INDEX] != index)
+            continue;
+        // Karn: after a retransmission the answer may be to either copy
+        if (r->tries == 1)
+            rtt_sample(tx, now_ms - r->sent_ms);
+        r->len = 0;
+        return 1;
+    }
+    return 0;
+}
+
+size_t ucp_rel_due(ucp_rel_tx_t *tx, uint32_t now_ms, uint8_t *out)
+{
+    int i;
+
+    for (i = 0; i < UCP_REL_WINDOW; i++)
+    {
+        ucp_rel_request_t *r = &tx->slots[i];
+        uint32_t backoff;
+        if (r->len == 0 || !due_by(r->due_ms, now_ms))
+            continue;
+        // Double the timeout on every retransmission, up to the cap
+        backoff = tx->rto_ms << (r->tries < 8 ? r->tries : 8);
+        if (backoff > UCP_REL_RTO_MAX_MS)
+            backoff = UCP_REL_RTO_MAX_MS;
+        if (r->tries < 0xff)
+            r->tries++;
+        r->due_ms = now_ms + backoff;
+        memcpy(out, r->frame, r->len);
+        return r->len;
+    }
+    return 0;
+}
+
+int32_t ucp_rel_next_ms(const ucp_rel_tx_t *tx, uint32_t now_ms)
+{
+    int32_t next = -1;
+    int i;
+
+    for (i = 0; i < UCP_REL_WINDOW; i++)
+    {
+        int32_t left;
+        if (tx->slots[i].len == 0)
+            continue;
+        left = (int32_t)(tx->slots[i].due_ms - now_ms);
+        if (left < 0)
+            left = 0;
+        if (next < 0 || left < next)
+            next = left;
+    }
+    return next;
+}
+
+void ucp_rel_cancel(ucp_rel_tx_t *tx, uint8_t id)
+{
+    int i;
+
+    for (i = 0; i < UCP_REL_WINDOW; i++)
+    {
+        if (tx->slots[i].len && tx->slots[i].frame[FRAME_ID] == id)
+            tx->slots[i].len = 0;
+    }
+}
+
+int ucp_rel_pending(const ucp_rel_tx_t *tx, uint8_t id)
+{
+    int i, n = 0;
+
+    for (i = 0; i < UCP_REL_WINDOW; i++)
+    {
+        if (tx->slots[i].len && tx->slots[i].frame[FRAME_ID] == id)
+            n++;
+    }
+    return n;
+}
+
+void ucp_rel_rx_init(ucp_rel_rx_t *rx)
+{
+    memset(rx, 0, sizeof(*rx));
+}
+
+const uint8_t *ucp_rel_rx_seen(ucp_rel_rx_t *rx, const uint8_t *request, size_t request_len, size_t *len,
+                               uint32_t now_ms)
+{
+    uint16_t crc;
+    int i;
+
+    if (request_len < FRAME_MIN)
+        return NULL;
+    crc = frame_crc(request, request_len);
+    for (i = 0; i < UCP_REL_ANSWERS; i++)
+    {
+        ucp_rel_answer_t *a = &rx->answers[i];
+        if (a->len && due_by(a->seen_ms + UCP_REL_ANSWER_TTL_MS, now_ms))
+            a->len = 0;
+        if (a->len && a->id == request[FRAME_ID] && a->index == request[FRAME_INDEX] && a->request_crc == crc)
+        {
+            a->seen_ms = now_ms;
+            *len = a->len;
+            return a->frame;
+        }
+    }
+    return NULL;
+}
+
+void ucp_rel_rx_answered(ucp_rel_rx_t *rx, const uint8_t *request, size_t request_len,
+                         const uint8_t *answer, size_t len, uint32_t now_ms)
+{
+    ucp_rel_answer_t *a;
+
+    if (request_len < FRAME_MIN || len > UCP_REL_FRAME_MAX)
+        return;
+    a = &rx->answers[rx->next];
+    rx->next = (rx->next + 1) % UCP_REL_ANSWERS;
+    a->id = request[FRAME_ID];
+    a->index = request[FRAME_INDEX];
+    a->request_crc = frame_crc(request, request_len);
+    a->seen_ms = now_ms;
+    a->len = (uint8_t)len;
+    memcpy(a->frame, answer, len);
+}
@@ -0,0 +1,117 @@
+/*
+ * UCP reliable requests: retransmission on the sender, duplicate
+ * suppression on the receiver
+ *
+ * Single implementation shared by the STM32 firmware and the Linux head.
+ * A request and its answer share the message ID and hd.index, so the index
+ * names the exchange. The sender keeps up to UCP_REL_WINDOW requests in
+ * flight, each retransmitted unchanged (same index, same bytes) until an
+ * answer with its index arrives. The timeout adapts to the measured round
+ * trip as in TCP (RFC 6298): SRTT and RTTVAR from answers to requests sent
+ * once, RTO = SRTT + 4 * RTTVAR, doubled on every retransmission of a
+ * request, within UCP_REL_RTO_MIN_MS..UCP_REL_RTO_MAX_MS.
+ *
+ * The receiver remembers its last UCP_REL_ANSWERS answers, keyed by the
+ * request's ID, index and CRC. A retransmitted request gets the remembered
+ * answer again without being applied twice. Retransmissions come at least
+ * every UCP_REL_RTO_MAX_MS, so an answer not asked for again within
+ * UCP_REL_ANSWER_TTL_MS, ten of them lost in a row, is forgotten: a
+ * restarted sender, whose indexes start over, is not answered from before
+ * its restart.
+ *
+ * No locking inside: callers on several threads serialize the calls.
+ */
+#ifndef __UCP_RELIABLE_H__
+#define __UCP_RELIABLE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UCP_REL_WINDOW          (4)     // Requests in flight at once
+#define UCP_REL_FRAME_MAX       (32)    // Longest request or answer frame, sync to CRC
+#define UCP_REL_ANSWERS         (8)     // Answers the receiver remembers
+#define UCP_REL_RTO_INIT_MS     (250)   // Before the first round trip is measured
+#define UCP_REL_RTO_MIN_MS      (20)
+#define UCP_REL_RTO_MAX_MS      (1000)  // Also the cap of the backed-off timeout
+#define UCP_REL_ANSWER_TTL_MS   (10 * UCP_REL_RTO_MAX_MS)
+
+typedef struct ucp_rel_request {
+    uint8_t     frame[UCP_REL_FRAME_MAX];
+    uint8_t     len;            // 0 = slot free
+    uint8_t     tries;          // Transmissions so far
+    uint32_t    sent_ms;        // Of the first transmission
+    uint32_t    due_ms;         // Of the next retransmission
+} ucp_rel_request_t;
+
+typedef struct ucp_rel_tx {
+    ucp_rel_request_t   slots[UCP_REL_WINDOW];
+    uint32_t            srtt_ms8;   // Smoothed round trip, in 1/8 ms
+    uint32_t            rttvar_ms4; // Its mean deviation, in 1/4 ms
+    uint32_t            rto_ms;     // Timeout of a first transmission
+    uint8_t             have_rtt;
+    uint8_t             next_index;
+} ucp_rel_tx_t;
+
+typedef struct ucp_rel_answer {
+    uint8_t     id;
+    uint8_t     index;
+    uint16_t    request_crc;
+    uint32_t    seen_ms;        // The request last arrived
+    uint8_t     len;            // 0 = slot free
+    uint8_t     frame[UCP_REL_FRAME_MAX];
+} ucp_rel_answer_t;
+
+typedef struct ucp_rel_rx {
+    ucp_rel_answer_t    answers[UCP_REL_ANSWERS];
+    uint8_t             next;   // Slot the next answer replaces
+} ucp_rel_rx_t;
+
+/* Sender. Times are in ms from any free-running clock; they may wrap. */
+void ucp_rel_tx_init(ucp_rel_tx_t *tx, uint8_t first_index);
+
+/* Send a request: `frame` is `len` bytes, sync to CRC, with hd.len, hd.id
+ * and the body in place. Stamps hd.index and the CRC into `frame`, which
+ * the caller then writes. Returns 0, or -1 (nothing stamped) if the window
+ * is full or the frame longer than UCP_REL_FRAME_MAX. */
+int ucp_rel_send(ucp_rel_tx_t *tx, uint8_t *frame, size_t len, uint32_t now_ms);
+
+/* An answer to message `id` with `index` arrived. Returns 1 and retires the
+ * request it answers, 0 if none is in flight (a late duplicate). */
+int ucp_rel_ack(ucp_rel_tx_t *tx, uint8_t id, uint8_t index, uint32_t now_ms);
+
+/* Copy the next request due for retransmission at now_ms into `out`
+ * (UCP_REL_FRAME_MAX bytes) and restart its timer. Returns its length, 0
+ * when none is due. */
+size_t ucp_rel_due(ucp_rel_tx_t *tx, uint32_t now_ms, uint8_t *out);
+
+/* Milliseconds until the next retransmission is due, -1 with nothing in flight */
+int32_t ucp_rel_next_ms(const ucp_rel_tx_t *tx, uint32_t now_ms);
+
+/* Drop the requests in flight for message `id`, e.g. superseded by a newer one */
+void ucp_rel_cancel(ucp_rel_tx_t *tx, uint8_t id);
+
+/* Requests in flight for message `id` */
+int ucp_rel_pending(const ucp_rel_tx_t *tx, uint8_t id);
+
+/* Receiver */
+void ucp_rel_rx_init(ucp_rel_rx_t *rx);
+
+/* A request frame (sync to CRC) arrived. Returns the answer frame sent to it
+ * before, with *len set, if this is a retransmission; NULL if it is new. */
+const uint8_t *ucp_rel_rx_seen(ucp_rel_rx_t *rx, const uint8_t *request, size_t request_len, size_t *len,
+                               uint32_t now_ms);
+
+/* Remember `answer` (a whole frame, at most UCP_REL_FRAME_MAX bytes) as the
+ * one sent to `request` */
+void ucp_rel_rx_answered(ucp_rel_rx_t *rx, const uint8_t *request, size_t request_len,
+                         const uint8_t *answer, size_t len, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UCP_RELIABLE_H__ */
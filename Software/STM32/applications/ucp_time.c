@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2006-2021, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2025-01-20     yuxing       the first version
+ */
+#include <rtthread.h>
+#include <rthw.h>
+#include <drv_common.h>
+#include "ucp_time.h"
+
+#define US_PER_TICK (1000000UL / RT_TICK_PER_SECOND)
+
+static rt_tick_t last_tick;      // Tick seen by the previous call
+static uint32_t tick_epoch;      // Number of times the 32-bit tick has wrapped
+
+uint64_t ucp_time_us(void)
+{
+    rt_base_t level = rt_hw_interrupt_disable();
+
+    rt_tick_t tick = rt_tick_get();
+    uint32_t load = SysTick->LOAD + 1;
+    uint32_t val = SysTick->VAL;
+
+    // SysTick reloaded after we masked interrupts: its tick has not been
+    // counted yet, so count it here and re-read the counter
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+    {
+        tick++;
+        val = SysTick->VAL;
+    }
+
+    if (tick < last_tick)
+        tick_epoch++;
+    last_tick = tick;
+
+    rt_hw_interrupt_enable(level);
+
+    uint64_t ticks = ((uint64_t)tick_epoch << 32) | tick;
+    // SysTick counts down from LOAD to 0 within each tick
+    return ticks * US_PER_TICK + (uint64_t)(load - 1 - val) * US_PER_TICK / load;
+}
@@ -0,0 +1,18 @@
+/*
+ * UCP time base: microseconds since boot on the MCU
+ *
+ * Timestamps carried by UCP_TIME_SYNC and UCP_REPORT_V2. Built from the
+ * RT-Thread tick and the SysTick down-counter inside the current tick, so
+ * the resolution is one SysTick clock rather than one tick, and extended to
+ * 64 bits so it never wraps. The head maps these values into its own
+ * CLOCK_MONOTONIC with the offset/drift it estimates from the sync exchange.
+ */
+#ifndef __UCP_TIME_H__
+#define __UCP_TIME_H__
+
+#include <stdint.h>
+
+/* Current MCU time in microseconds. Callable from threads and ISRs. */
+uint64_t ucp_time_us(void);
+
+#endif /*__UCP_TIME_H__*/
@@ -15,6 +15,8 @@
  #define DBG_LVL DBG_LOG
  #include <rtdbg.h>
  #include "board.h"
+ #include "main.h"
+ #include "state.h"
  #include "sensor.h"
  #include "vl53l0x_platform.h"
  #include "vl53l0x_api.h"
@@ -232,20 +234,33 @@
      }
  }
  
- /* Sensor thread that continuously polls TOF sensors and logs their readings */
+ /* Sensor thread that continuously polls TOF sensors, logs their readings
+  * and keeps the latest in robot_state.tof_mm for the ToF telemetry group */
  void sensor_thread_entry(void *parameter)
  {
      vl53l0x_init_all();
  
      while (1)
      {
+         uint16_t range_mm[4] = {0};
          for (int i = 0; i < 4; i++)
          {
              if (robot_tofs[i].enabled)
              {
-                 LOG_D("TOF[%d]: %d", i, vl53l0x_get_value(&robot_tofs[i].vl53l0x_dev));
+                 int range = vl53l0x_get_value(&robot_tofs[i].vl53l0x_dev);
+                 LOG_D("TOF[%d]: %d", i, range);
+                 if (range > 0)
+                     range_mm[i] = (uint16_t)range;
              }
          }
+
+         if (state_data_mutex != RT_NULL)
+             rt_mutex_take(state_data_mutex, RT_WAITING_FOREVER);
+         for (int i = 0; i < 4; i++)
+             robot_state.tof_mm[i] = range_mm[i];
+         if (state_data_mutex != RT_NULL)
+             rt_mutex_release(state_data_mutex);
+
          rt_thread_mdelay(1000); // Delay 1s between readings
      }
  }